@@ -134,6 +134,10 @@ inline uint qHash(const DocumentParseTarget& target)
 struct DocumentParsePlan
 {
     QSet<DocumentParseTarget> targets;
+    /// Position of the document in the queue, among documents of the same priority
+    quint64 sequence = 0;
+    /// Time when the document was queued, see BackgroundParserPrivate::m_clock
+    qint64 queuedAt = 0;
 
     ParseJob::SequentialProcessingFlags sequentialProcessingFlags() const
     {
@@ -180,8 +184,24 @@ struct DocumentParsePlan
     }
 };
 
+/**
+ * Orders the queued documents by priority, and in order of arrival within the same priority,
+ * so that documents of one priority can not starve each other.
+ */
+struct DocumentQueueKey
+{
+    int priority;
+    quint64 sequence;
+
+    bool operator<(const DocumentQueueKey& rhs) const
+    {
+        return priority < rhs.priority || (priority == rhs.priority && sequence < rhs.sequence);
+    }
+};
+
 Q_DECLARE_TYPEINFO(DocumentParseTarget, Q_MOVABLE_TYPE);
 Q_DECLARE_TYPEINFO(DocumentParsePlan, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(DocumentQueueKey, Q_PRIMITIVE_TYPE);
 
 class KDevelop::BackgroundParserPrivate
 {
@@ -195,6 +215,7 @@ public:
         m_progressTimer.setSingleShot(true);
         m_progressTimer.setInterval(500);
         m_totalTimer.invalidate();
+        m_clock.start();
 
         ThreadWeaver::setDebugLevel(true, 1);
 
@@ -214,6 +235,33 @@ public:
 
     // Non-mutex guarded functions, only call with m_mutex acquired.
 
+    static BackgroundParser::Queue queueForPriority(int priority)
+    {
+        return priority <= BackgroundParser::NormalPriority ? BackgroundParser::ForegroundQueue
+                                                            : BackgroundParser::BackgroundQueue;
+    }
+
+    /// Adds the plan of @p url to the queue, call again whenever its priority changed after unqueue()
+    void enqueue(const IndexedString& url, const DocumentParsePlan& plan)
+    {
+        m_queue.insert({plan.priority(), plan.sequence}, url);
+    }
+
+    /// Removes the plan of @p url from the queue, call this before changing the priority of the plan
+    void unqueue(const DocumentParsePlan& plan)
+    {
+        m_queue.remove({plan.priority(), plan.sequence});
+    }
+
+    /// Inserts a new plan for @p url, it is queued behind all documents of the same priority
+    DocumentParsePlan& insertPlan(const IndexedString& url)
+    {
+        DocumentParsePlan& plan = m_documents[url];
+        plan.sequence = m_nextSequence++;
+        plan.queuedAt = m_clock.elapsed();
+        return plan;
+    }
+
     int currentBestRunningPriority() const
     {
         int bestRunningPriority = BackgroundParser::WorstPriority;
@@ -233,10 +281,8 @@ public:
         // That way, parse job priorities can be used for dependency handling.
         const int bestRunningPriority = currentBestRunningPriority();
 
-        for (auto it1 = m_documentsForPriority.begin();
-             it1 != m_documentsForPriority.end(); ++it1 )
-        {
-            const auto priority = it1.key();
+        for (auto it = m_queue.constBegin(); it != m_queue.constEnd(); ++it) {
+            const auto priority = it.key().priority;
             if(priority > m_neededPriority)
                 break; //The priority is not good enough to be processed right now
 
@@ -244,29 +290,116 @@ public:
                 break; //The additional parsing thread is reserved for higher priority parsing
             }
 
-            for (const auto& url : it1.value()) {
-                // When a document is scheduled for parsing while it is being parsed, it will be parsed
-                // again once the job finished, but not now.
-                if (m_parseJobs.contains(url)) {
-                    continue;
-                }
-
-                Q_ASSERT(m_documents.contains(url));
-                const auto& parsePlan = m_documents[url];
-                // If the current job requires sequential processing, but not all jobs with a better priority have been
-                // completed yet, it will not be created now.
-                if (    parsePlan.sequentialProcessingFlags() & ParseJob::RequiresSequentialProcessing
-                     && parsePlan.priority() > bestRunningPriority )
-                {
-                    continue;
-                }
+            const auto& url = it.value();
+            // When a document is scheduled for parsing while it is being parsed, it will be parsed
+            // again once the job finished, but not now.
+            if (m_parseJobs.contains(url)) {
+                continue;
+            }
 
-                return url;
+            Q_ASSERT(m_documents.contains(url));
+            const auto& parsePlan = m_documents[url];
+            // If the current job requires sequential processing, but not all jobs with a better priority have been
+            // completed yet, it will not be created now.
+            if (    parsePlan.sequentialProcessingFlags() & ParseJob::RequiresSequentialProcessing
+                 && priority > bestRunningPriority )
+            {
+                continue;
             }
+
+            return url;
         }
         return {};
     }
 
+    /**
+     * When all threads are busy and a foreground document is waiting, aborts the most recently
+     * started background job and queues its document again, so that the foreground document
+     * does not have to wait for a long-running project parse job.
+     */
+    void preemptForForeground()
+    {
+        int foregroundWaiting = 0;
+        for (auto it = m_queue.constBegin(); it != m_queue.constEnd(); ++it) {
+            if (it.key().priority > BackgroundParser::NormalPriority || it.key().priority > m_neededPriority) {
+                break;
+            }
+            if (!m_parseJobs.contains(it.value())) {
+                ++foregroundWaiting;
+            }
+        }
+
+        // threads that are about to be freed by earlier preemptions
+        int pendingPreemptions = 0;
+        auto victim = m_runningPlans.end();
+        for (auto it = m_runningPlans.begin(); it != m_runningPlans.end(); ++it) {
+            if (it->preempted) {
+                ++pendingPreemptions;
+                continue;
+            }
+            if (queueForPriority(it->plan.priority()) != BackgroundParser::BackgroundQueue) {
+                continue;
+            }
+            if (victim == m_runningPlans.end() || it->startedAt > victim->startedAt) {
+                victim = it;
+            }
+        }
+        if (foregroundWaiting <= pendingPreemptions || victim == m_runningPlans.end()) {
+            return;
+        }
+
+        const IndexedString url = victim.key();
+        const RunningParseJob& running = *victim;
+        victim->preempted = true;
+
+        auto* parseJob = dynamic_cast<ParseJob*>(m_parseJobs.value(url)->job());
+        Q_ASSERT(parseJob);
+        qCDebug(LANGUAGE) << "preempting parse job" << url << "in favor of a foreground document";
+        // the requesters get notified by the job that parses the document again, not by the aborted one
+        parseJob->setNotifyWhenReady({});
+        parseJob->requestAbort();
+        ++m_statistics[BackgroundParser::BackgroundQueue].preemptedJobs;
+
+        auto it = m_documents.find(url);
+        if (it == m_documents.end()) {
+            // keep the original position in the queue
+            m_documents.insert(url, running.plan);
+            enqueue(url, running.plan);
+            ++m_maxParseJobs;
+        } else {
+            unqueue(*it);
+            it->targets.unite(running.plan.targets);
+            it->sequence = qMin(it->sequence, running.plan.sequence);
+            it->queuedAt = qMin(it->queuedAt, running.plan.queuedAt);
+            enqueue(url, *it);
+        }
+    }
+
+    /**
+     * A preempted job that did not yield to the abort request still parsed the document. When its result
+     * is up to date and sufficient for the plan the document was queued again with, that plan is dropped
+     * and its requesters are notified by the finished job instead.
+     */
+    void finishPreemptedJob(ParseJob* parseJob)
+    {
+        const IndexedString url = parseJob->document();
+        auto it = m_documents.find(url);
+        if (it == m_documents.end() || parseJob->isPreempted() || !parseJob->success()) {
+            return;
+        }
+        const TopDUContext::Features features = it->features();
+        if ((parseJob->minimumFeatures() & features) != features
+            || parseJob->contents().modification != ModificationRevision::revisionForFile(url)) {
+            return;
+        }
+
+        qCDebug(LANGUAGE) << "preempted parse job for" << url << "completed, not parsing it again";
+        parseJob->setNotifyWhenReady(it->notifyWhenReady());
+        unqueue(*it);
+        m_documents.erase(it);
+        --m_maxParseJobs;
+    }
+
     /**
      * Create a single delayed parse job
      *
@@ -282,6 +415,7 @@ public:
         if (m_parseJobs.count() >= m_threads+1
             || (m_parseJobs.count() >= m_threads && !separateThreadForHighPriority))
         {
+            preemptForForeground();
             return;
         }
 
@@ -312,11 +446,10 @@ public:
             // iterator might get invalid during the time we didn't have the lock
             // search again
             const auto parsePlanIt = m_documents.find(url);
+            DocumentParsePlan runningPlan = parsePlan;
             if (parsePlanIt != m_documents.end()) {
-                // Remove all mentions of this document.
-                for (const auto& target : qAsConst(parsePlanIt->targets)) {
-                    m_documentsForPriority[target.priority].remove(url);
-                }
+                runningPlan = *parsePlanIt;
+                unqueue(*parsePlanIt);
                 m_documents.erase(parsePlanIt);
             } else {
                 qCWarning(LANGUAGE) << "Document got removed during parse job creation:" << url;
@@ -326,7 +459,15 @@ public:
                 if(m_parseJobs.count() == m_threads+1 && !specialParseJob)
                     specialParseJob = decorator; //This parse-job is allocated into the reserved thread
 
+                const qint64 now = m_clock.elapsed();
+                auto& statistics = m_statistics[queueForPriority(runningPlan.priority())];
+                const qint64 wait = now - runningPlan.queuedAt;
+                ++statistics.startedJobs;
+                statistics.totalWaitMs += wait;
+                statistics.maxWaitMs = qMax(statistics.maxWaitMs, wait);
+
                 m_parseJobs.insert(url, decorator);
+                m_runningPlans.insert(url, {runningPlan, now, false});
                 m_weaver.enqueue(ThreadWeaver::JobPointer(decorator));
             } else {
                 --m_maxParseJobs;
@@ -338,11 +479,7 @@ public:
                 QMetaObject::invokeMethod(m_parser, "parseDocuments", Qt::QueuedConnection);
             } else {
                 // make sure we cleaned up properly
-                // TODO: also empty m_documentsForPriority when m_documents is empty? or do we want to keep capacity?
-                Q_ASSERT(std::none_of(m_documentsForPriority.constBegin(), m_documentsForPriority.constEnd(),
-                                        [] (const QSet<IndexedString>& docs) {
-                                        return !docs.isEmpty();
-                                        }));
+                Q_ASSERT(m_queue.isEmpty());
             }
         }
 
@@ -487,10 +624,23 @@ config.readEntry(entry, oldConfig.readEntry(entry, default))
 
     // A list of documents that are planned to be parsed, and their priority
     QHash<IndexedString, DocumentParsePlan > m_documents;
-    // The documents ordered by priority
-    QMap<int, QSet<IndexedString> > m_documentsForPriority;
+    // The documents ordered by priority, and by arrival within the same priority
+    QMap<DocumentQueueKey, IndexedString> m_queue;
+    quint64 m_nextSequence = 0;
     // Currently running parse jobs
     QHash<IndexedString, ThreadWeaver::QObjectDecorator*> m_parseJobs;
+    struct RunningParseJob
+    {
+        DocumentParsePlan plan;
+        qint64 startedAt;
+        // the job was aborted in favor of a foreground document, and its document queued again
+        bool preempted;
+    };
+    // The plans of the running parse jobs, to queue them again when they are preempted
+    QHash<IndexedString, RunningParseJob> m_runningPlans;
+    // Monotonic clock for the queue statistics
+    QElapsedTimer m_clock;
+    BackgroundParser::QueueStatistics m_statistics[2];
     // The url for each managed document. Those may temporarily differ from the real url.
     QHash<KTextEditor::Document*, IndexedString> m_managedTextDocumentUrls;
     // Projects currently in progress of loading
@@ -576,7 +726,7 @@ void BackgroundParser::revertAllRequests(QObject* notifyWhenReady)
     QMutexLocker lock(&d->m_mutex);
     for (auto it = d->m_documents.begin(); it != d->m_documents.end(); ) {
 
-        d->m_documentsForPriority[it.value().priority()].remove(it.key());
+        d->unqueue(it.value());
 
         foreach ( const DocumentParseTarget& target, (*it).targets ) {
             if ( notifyWhenReady && target.notifyWhenReady.data() == notifyWhenReady ) {
@@ -591,7 +741,7 @@ void BackgroundParser::revertAllRequests(QObject* notifyWhenReady)
             continue;
         }
 
-        d->m_documentsForPriority[it.value().priority()].insert(it.key());
+        d->enqueue(it.key(), it.value());
         ++it;
     }
 }
@@ -614,13 +764,14 @@ void BackgroundParser::addDocument(const IndexedString& url, TopDUContext::Featu
         if (it != d->m_documents.end()) {
             //Update the stored plan
 
-            d->m_documentsForPriority[it.value().priority()].remove(url);
+            d->unqueue(it.value());
             it.value().targets << target;
-            d->m_documentsForPriority[it.value().priority()].insert(url);
+            d->enqueue(url, it.value());
         }else{
 //             qCDebug(LANGUAGE) << "BackgroundParser::addDocument: queuing" << cleanedUrl;
-            d->m_documents[url].targets << target;
-            d->m_documentsForPriority[d->m_documents[url].priority()].insert(url);
+            auto& plan = d->insertPlan(url);
+            plan.targets << target;
+            d->enqueue(url, plan);
             ++d->m_maxParseJobs; //So the progress-bar waits for this document
         }
 
@@ -639,7 +790,7 @@ void BackgroundParser::removeDocument(const IndexedString& url, QObject* notifyW
 
     if(d->m_documents.contains(url)) {
 
-        d->m_documentsForPriority[d->m_documents[url].priority()].remove(url);
+        d->unqueue(d->m_documents[url]);
 
         foreach(const DocumentParseTarget& target, d->m_documents[url].targets) {
             if(target.notifyWhenReady.data() == notifyWhenReady) {
@@ -652,7 +803,7 @@ void BackgroundParser::removeDocument(const IndexedString& url, QObject* notifyW
             --d->m_maxParseJobs;
         }else{
             //Insert with an eventually different priority
-            d->m_documentsForPriority[d->m_documents[url].priority()].insert(url);
+            d->enqueue(url, d->m_documents[url]);
         }
     }
 }
@@ -674,12 +825,19 @@ void BackgroundParser::parseComplete(const ThreadWeaver::JobPointer& job)
     Q_ASSERT(decorator);
     ParseJob* parseJob = dynamic_cast<ParseJob*>(decorator->job());
     Q_ASSERT(parseJob);
+
     emit parseJobFinished(parseJob);
 
     {
         QMutexLocker lock(&d->m_mutex);
 
+        const auto runningPlan = d->m_runningPlans.constFind(parseJob->document());
+        if (runningPlan != d->m_runningPlans.constEnd() && runningPlan->preempted) {
+            d->finishPreemptedJob(parseJob);
+        }
+
         d->m_parseJobs.remove(parseJob->document());
+        d->m_runningPlans.remove(parseJob->document());
 
         d->m_jobProgress.remove(parseJob);
 
@@ -727,6 +885,26 @@ bool BackgroundParser::isIdle() const
     return d->m_documents.isEmpty() && d->m_weaver.isIdle();
 }
 
+BackgroundParser::QueueStatistics BackgroundParser::queueStatistics(Queue queue) const
+{
+    QMutexLocker lock(&d->m_mutex);
+    QueueStatistics ret = d->m_statistics[queue];
+    ret.queuedDocuments = 0;
+    for (auto it = d->m_queue.constBegin(); it != d->m_queue.constEnd(); ++it) {
+        if (BackgroundParserPrivate::queueForPriority(it.key().priority) == queue) {
+            ++ret.queuedDocuments;
+        }
+    }
+    return ret;
+}
+
+void BackgroundParser::resetQueueStatistics()
+{
+    QMutexLocker lock(&d->m_mutex);
+    d->m_statistics[ForegroundQueue] = {};
+    d->m_statistics[BackgroundQueue] = {};
+}
+
 void BackgroundParser::setNeededPriority(int priority)
 {
     QMutexLocker lock(&d->m_mutex);
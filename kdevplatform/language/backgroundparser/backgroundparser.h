@@ -72,6 +72,30 @@ public:
         WorstPriority = 100000  ///Worst possible job-priority.
     };
 
+    /**
+     * The queues for which statistics are kept, depending on the priority of a document.
+     */
+    enum Queue {
+        ForegroundQueue = 0, ///< Documents with NormalPriority or better, e.g. opened or edited by the user
+        BackgroundQueue = 1  ///< Documents with a worse priority, e.g. from parsing a whole project
+    };
+
+    /**
+     * Latency counters of a queue. Times are given in milliseconds.
+     */
+    struct QueueStatistics
+    {
+        /// Documents currently waiting in the queue
+        int queuedDocuments = 0;
+        /// Parse jobs created for documents from the queue
+        quint64 startedJobs = 0;
+        /// Running parse jobs that were aborted, and their document queued again, in favor of foreground documents
+        quint64 preemptedJobs = 0;
+        /// Time between queuing a document and creating its parse job
+        qint64 totalWaitMs = 0;
+        qint64 maxWaitMs = 0;
+    };
+
     /**
      * Queries the background parser as to whether there is currently
      * a parse job for @p document, and if so, returns it.
@@ -112,6 +136,16 @@ public:
 
     bool waitForIdle() const;
 
+    /**
+     * Returns a snapshot of the latency counters of @p queue.
+     */
+    QueueStatistics queueStatistics(Queue queue) const;
+
+    /**
+     * Resets the latency counters of all queues to zero.
+     */
+    void resetQueueStatistics();
+
 Q_SIGNALS:
     /**
      * Emitted whenever a document parse-job has finished.
@@ -22,6 +22,7 @@
 
 #include "parsejob.h"
 
+#include <QElapsedTimer>
 #include <QFile>
 #include <QMutex>
 #include <QMutexLocker>
@@ -69,8 +70,10 @@ public:
         , abortRequested( 0 )
         , hasReadContents( false )
         , aborted( false )
+        , preempted( false )
         , features( TopDUContext::VisibleDeclarationsAndContexts )
         , parsePriority( 0 )
+        , parseTime( -1 )
         , sequentialProcessingFlags( ParseJob::IgnoresSequentialProcessing )
     {
     }
@@ -90,6 +93,7 @@ public:
 
     bool hasReadContents : 1;
     bool aborted : 1;
+    bool preempted : 1;
     TopDUContext::Features features;
     QVector<QPointer<QObject>> notify;
     QPointer<DocumentChangeTracker> tracker;
@@ -97,6 +101,8 @@ public:
     RevisionReference previousRevision;
 
     int parsePriority;
+    QElapsedTimer parseTimer;
+    qint64 parseTime;
     ParseJob::SequentialProcessingFlags sequentialProcessingFlags;
 };
 
@@ -131,6 +137,23 @@ int ParseJob::parsePriority() const
     return d->parsePriority;
 }
 
+qint64 ParseJob::parseTime() const
+{
+    return d->parseTime;
+}
+
+void ParseJob::defaultBegin(const ThreadWeaver::JobPointer& job, ThreadWeaver::Thread* thread)
+{
+    d->parseTimer.start();
+    ThreadWeaver::Sequence::defaultBegin(job, thread);
+}
+
+void ParseJob::defaultEnd(const ThreadWeaver::JobPointer& job, ThreadWeaver::Thread* thread)
+{
+    ThreadWeaver::Sequence::defaultEnd(job, thread);
+    d->parseTime = d->parseTimer.elapsed();
+}
+
 bool ParseJob::requiresSequentialProcessing() const
 {
     return d->sequentialProcessingFlags & RequiresSequentialProcessing;
@@ -210,6 +233,16 @@ void ParseJob::abortJob()
     setStatus(Status_Aborted);
 }
 
+void ParseJob::setPreempted()
+{
+    d->preempted = true;
+}
+
+bool ParseJob::isPreempted() const
+{
+    return d->preempted;
+}
+
 void ParseJob::setNotifyWhenReady(const QVector<QPointer<QObject>>& notify)
 {
     d->notify = notify;
@@ -89,6 +89,11 @@ public:
     ///not the QThread one (which is always zero).
     int parsePriority() const;
 
+    ///Wall-clock time in milliseconds from starting to run on a parser thread until it finished,
+    ///the time spent waiting in the queue is not included.
+    ///Only valid once BackgroundParser::parseJobFinished() was emitted for it, -1 before.
+    qint64 parseTime() const;
+
     /**
      * _No_ mutexes/locks are allowed to be locked when this is called (except for optionally the foreground lock)
      *
@@ -149,6 +154,13 @@ public:
     bool abortRequested() const;
     /// Sets success to false, causing failed() to be emitted
     void abortJob();
+    /**
+     * Marks the job as having returned early on an abort request, without a complete result.
+     * A preempted document is only parsed again when its job did yield.
+     */
+    void setPreempted();
+    /// Determine if the job returned early on an abort request
+    bool isPreempted() const;
 
     /// Overridden to convey whether the job succeeded or not.
     bool success() const override;
@@ -229,6 +241,9 @@ protected:
      */
     bool hasTracker() const;
 
+    void defaultBegin(const ThreadWeaver::JobPointer& job, ThreadWeaver::Thread* thread) override;
+    void defaultEnd(const ThreadWeaver::JobPointer& job, ThreadWeaver::Thread* thread) override;
+
 private:
     const QScopedPointer<class ParseJobPrivate> d;
 };
@@ -79,7 +79,10 @@ void JobPlan::parseJobCreated(ParseJob* job)
     Q_ASSERT(testJob);
 
     qDebug() << "assigning propierties for created job" << testJob->document().toUrl();
-    testJob->duration_ms = jobForUrl(testJob->document()).m_duration;
+    const JobPrototype prototype = jobForUrl(testJob->document());
+    testJob->duration_ms = prototype.m_duration;
+    testJob->blocker = prototype.m_blocker;
+    testJob->ignores_abort = prototype.m_ignoresAbort;
 
     m_createdJobs.append(testJob->document());
 }
@@ -265,6 +268,106 @@ void TestBackgroundparser::testParseOrdering_noSequentialProcessing()
     QVERIFY(m_jobPlan.runJobs(1000));
 }
 
+void TestBackgroundparser::testParseOrdering_fifo()
+{
+    m_jobPlan.clear();
+    // documents of the same priority are parsed in the order they were queued
+    for ( int i = 0; i < 20; i++ ) {
+        m_jobPlan.addJob(JobPrototype(QUrl::fromLocalFile("/test_fifo__" + QString::number(i) + ".txt"),
+                                      BackgroundParser::InitialParsePriority, ParseJob::IgnoresSequentialProcessing));
+    }
+    QVERIFY(m_jobPlan.runJobs(1000));
+
+    for ( int i = 0; i < m_jobPlan.m_createdJobs.size(); i++ ) {
+        QCOMPARE(m_jobPlan.m_createdJobs.at(i), m_jobPlan.m_jobs.at(i).m_url);
+    }
+}
+
+namespace {
+/**
+ * Occupies every parse thread, including the one reserved for foreground jobs, with jobs
+ * that run until @p blocker is released, and then queues the foreground document @p foreground.
+ */
+bool occupyThreadsAndQueueForeground(JobPlan* plan, QSemaphore* blocker, bool ignoresAbort,
+                                     const QString& prefix, JobPrototype* foreground)
+{
+    auto parser = ICore::self()->languageController()->backgroundParser();
+
+    auto addAndWaitForCreation = [&](JobPrototype job) {
+        job.m_blocker = blocker;
+        job.m_ignoresAbort = ignoresAbort;
+        plan->addJob(job);
+        parser->addDocument(job.m_url, TopDUContext::Empty, job.m_priority, plan, job.m_flags);
+        parser->parseDocuments();
+
+        // blocked jobs never finish on their own, so the timeout is only a safety net
+        QElapsedTimer t;
+        t.start();
+        while ( !t.hasExpired(10000) && !plan->m_createdJobs.contains(job.m_url) ) {
+            QTest::qWait(10);
+        }
+        return plan->m_createdJobs.contains(job.m_url);
+    };
+
+    for ( int i = 0; i < parser->threadCount(); i++ ) {
+        QVERIFY_RETURN(addAndWaitForCreation(JobPrototype(QUrl::fromLocalFile("/" + prefix + "_bg__" + QString::number(i) + ".txt"),
+                                                          BackgroundParser::InitialParsePriority, ParseJob::IgnoresSequentialProcessing)), false);
+    }
+    QVERIFY_RETURN(addAndWaitForCreation(JobPrototype(QUrl::fromLocalFile("/" + prefix + "_fg1.txt"),
+                                                      BackgroundParser::NormalPriority, ParseJob::IgnoresSequentialProcessing)), false);
+
+    *foreground = JobPrototype(QUrl::fromLocalFile("/" + prefix + "_fg2.txt"),
+                               BackgroundParser::NormalPriority, ParseJob::IgnoresSequentialProcessing);
+    plan->addJob(*foreground);
+    parser->addDocument(foreground->m_url, TopDUContext::Empty, foreground->m_priority, plan, foreground->m_flags);
+    parser->parseDocuments();
+    return true;
+}
+}
+
+void TestBackgroundparser::testPreemptForForeground()
+{
+    m_jobPlan.clear();
+    auto parser = ICore::self()->languageController()->backgroundParser();
+    parser->resetQueueStatistics();
+
+    QSemaphore blocker;
+    JobPrototype foreground;
+    QVERIFY(occupyThreadsAndQueueForeground(&m_jobPlan, &blocker, false, QStringLiteral("test_preempt"), &foreground));
+
+    // an edit in the foreground must not wait for the project jobs, which only finish once unblocked
+    QTRY_VERIFY_WITH_TIMEOUT(m_jobPlan.m_finishedJobs.contains(foreground.m_url), 10000);
+    QCOMPARE(parser->queueStatistics(BackgroundParser::BackgroundQueue).preemptedJobs, quint64(1));
+    QCOMPARE(m_jobPlan.numFinishedJobs(), 1);
+
+    // the preempted document is parsed again, and every requester is notified exactly once
+    blocker.release(m_jobPlan.numJobs());
+    QTRY_COMPARE_WITH_TIMEOUT(m_jobPlan.numFinishedJobs(), m_jobPlan.numJobs(), 10000);
+    QCOMPARE(m_jobPlan.m_createdJobs.size(), m_jobPlan.numJobs() + 1);
+
+    const auto foregroundStatistics = parser->queueStatistics(BackgroundParser::ForegroundQueue);
+    QCOMPARE(foregroundStatistics.startedJobs, quint64(2));
+    QCOMPARE(foregroundStatistics.queuedDocuments, 0);
+}
+
+void TestBackgroundparser::testPreemptIgnoringAbort()
+{
+    m_jobPlan.clear();
+    auto parser = ICore::self()->languageController()->backgroundParser();
+    parser->resetQueueStatistics();
+
+    QSemaphore blocker;
+    JobPrototype foreground;
+    QVERIFY(occupyThreadsAndQueueForeground(&m_jobPlan, &blocker, true, QStringLiteral("test_preempt_ignored"), &foreground));
+    QTRY_COMPARE_WITH_TIMEOUT(parser->queueStatistics(BackgroundParser::BackgroundQueue).preemptedJobs, quint64(1), 10000);
+
+    // the preempted job runs to completion, its document is unchanged and must not be parsed again
+    blocker.release(m_jobPlan.numJobs());
+    QTRY_COMPARE_WITH_TIMEOUT(m_jobPlan.numFinishedJobs(), m_jobPlan.numJobs(), 10000);
+    QCOMPARE(m_jobPlan.m_createdJobs.size(), m_jobPlan.numJobs());
+    QCOMPARE(parser->queuedCount(), 0);
+}
+
 void TestBackgroundparser::testParseOrdering_lockup()
 {
     m_jobPlan.clear();
@@ -32,6 +32,8 @@
 
 #include "testlanguagesupport.h"
 
+class QSemaphore;
+
 class JobPrototype
 {
 public:
@@ -53,6 +55,10 @@ public:
     int m_priority;
     int m_duration;
     ParseJob::SequentialProcessingFlags m_flags;
+    /// If set, the job runs until it can acquire this semaphore
+    QSemaphore* m_blocker = nullptr;
+    /// Whether the job keeps running when it is asked to abort
+    bool m_ignoresAbort = false;
 };
 
 Q_DECLARE_TYPEINFO(JobPrototype, Q_MOVABLE_TYPE);
@@ -106,6 +112,9 @@ private Q_SLOTS:
     void testParseOrdering_lockup();
     void testParseOrdering_foregroundThread();
     void testParseOrdering_noSequentialProcessing();
+    void testParseOrdering_fifo();
+    void testPreemptForForeground();
+    void testPreemptIgnoringAbort();
 
     void testNoDeadlockInJobCreation();
     void testSuspendResume();
@@ -21,6 +21,8 @@
 
 #include "testparsejob.h"
 
+#include <QElapsedTimer>
+#include <QSemaphore>
 #include <QTest>
 
 TestParseJob::TestParseJob(const IndexedString& url, ILanguageSupport* languageSupport)
@@ -35,9 +37,26 @@ void TestParseJob::run(ThreadWeaver::JobPointer, ThreadWeaver::Thread*)
     if (run_callback) {
         run_callback(document());
     }
+    if (blocker) {
+        while (!blocker->tryAcquire(1, 10)) {
+            if (abortRequested() && !ignores_abort) {
+                setPreempted();
+                abortJob();
+                return;
+            }
+        }
+    }
     if (duration_ms) {
         qDebug() << "waiting" << duration_ms << "ms";
-        QTest::qWait(duration_ms);
+        QElapsedTimer timer;
+        timer.start();
+        while (!timer.hasExpired(duration_ms) && !abortRequested()) {
+            QTest::qWait(qMin<qint64>(10, duration_ms - timer.elapsed()));
+        }
+        if (abortRequested()) {
+            setPreempted();
+            abortJob();
+        }
     }
 }
 
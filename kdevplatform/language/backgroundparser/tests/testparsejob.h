@@ -26,6 +26,8 @@
 
 #include <functional>
 
+class QSemaphore;
+
 using namespace KDevelop;
 
 class TestParseJob : public KDevelop::ParseJob
@@ -38,6 +40,8 @@ public:
     DataAccessRepository* dataAccessInformation() override;
 
     int duration_ms;
+    QSemaphore* blocker = nullptr;
+    bool ignores_abort = false;
     std::function<void(const IndexedString&)> run_callback;
 };
 
@@ -55,8 +55,9 @@ ParsingUrls& parsingUrls()
 
 }
 
-UrlParseLock::UrlParseLock(const IndexedString& url)
+UrlParseLock::UrlParseLock(const IndexedString& url, LockMode mode)
     : m_url(url)
+    , m_locked(true)
 {
   QMutexLocker lock(&parsingUrlsMutex);
 
@@ -74,10 +75,27 @@ UrlParseLock::UrlParseLock(const IndexedString& url)
   auto& mutex = perUrlData->mutex;
   lock.unlock();
 
-  mutex.lock();
+  if (mode == Blocking) {
+    mutex.lock();
+  } else if (!mutex.tryLock()) {
+    m_locked = false;
+    release(false);
+  }
 }
 
 UrlParseLock::~UrlParseLock()
+{
+  if (m_locked) {
+    release(true);
+  }
+}
+
+bool UrlParseLock::isLocked() const
+{
+  return m_locked;
+}
+
+void UrlParseLock::release(bool unlock)
 {
   QMutexLocker lock(&parsingUrlsMutex);
 
@@ -88,7 +106,9 @@ UrlParseLock::~UrlParseLock()
   auto& perUrlData = it.value();
 
   // unlock the per-url mutex
-  perUrlData->mutex.unlock();
+  if (unlock) {
+    perUrlData->mutex.unlock();
+  }
 
   // decrement the refcount
   --perUrlData->ref;
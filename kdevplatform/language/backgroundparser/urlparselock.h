@@ -39,11 +39,27 @@ namespace KDevelop
 class KDEVPLATFORMLANGUAGE_EXPORT UrlParseLock
 {
 public:
-  explicit UrlParseLock(const IndexedString& url);
+  enum LockMode {
+    /// wait until no-one else holds the lock of the url
+    Blocking,
+    /// only lock the url if that is possible right away, see isLocked()
+    NonBlocking
+  };
+
+  explicit UrlParseLock(const IndexedString& url, LockMode mode = Blocking);
   ~UrlParseLock();
 
+  /// @return whether the url was locked, which is always the case for a blocking lock
+  bool isLocked() const;
+
 private:
+  /// drops the reference to the per-url data, @p unlock whether its mutex has to be unlocked
+  void release(bool unlock);
+
+  Q_DISABLE_COPY(UrlParseLock)
+
   IndexedString m_url;
+  bool m_locked;
 };
 
 }
@@ -26,6 +26,12 @@
 #include <serialization/referencecounting.h>
 #include <util/embeddedfreetree.h>
 
+#include <QSet>
+
+#include <qtcompat_p.h>
+
+#include <algorithm>
+
 #define ifDebug(x)
 
 namespace KDevelop {
@@ -68,6 +74,29 @@ class CodeModelItemHandler {
     }
 };
 
+namespace {
+
+///The kinds counted by CodeModel::itemCount(). They exclude each other, the other kinds are only added to them.
+const CodeModelItem::Kind countedKinds[] = {CodeModelItem::Function, CodeModelItem::Variable, CodeModelItem::Class, CodeModelItem::Namespace};
+const int countedKindCount = sizeof(countedKinds) / sizeof(countedKinds[0]);
+
+///Adds @p difference to the counts in @p counts of the kinds an item with @p id and @p kind has
+void countItem(uint* counts, const IndexedQualifiedIdentifier& id, uint kind, int difference)
+{
+  if(kind & CodeModelItem::ForwardDeclaration)
+    return;
+  //Unnamed items, like anonymous structs, are not counted
+  const QualifiedIdentifier identifier = id.identifier();
+  if(identifier.isEmpty() || identifier.at(0).identifier().isEmpty())
+    return;
+  for(int a = 0; a < countedKindCount; ++a) {
+    if(kind & countedKinds[a])
+      counts[a] += difference;
+  }
+}
+
+}
+
 DEFINE_LIST_MEMBER_HASH(CodeModelRepositoryItem, items, CodeModelItem)
 
 class CodeModelRepositoryItem {
@@ -76,6 +105,7 @@ class CodeModelRepositoryItem {
     initializeAppendedLists();
   }
   CodeModelRepositoryItem(const CodeModelRepositoryItem& rhs, bool dynamic = true) : file(rhs.file), centralFreeItem(rhs.centralFreeItem) {
+    std::copy(rhs.kindCounts, rhs.kindCounts + countedKindCount, kindCounts);
     initializeAppendedLists(dynamic);
     copyListsFrom(rhs);
   }
@@ -100,6 +130,8 @@ class CodeModelRepositoryItem {
 
   IndexedString file;
   int centralFreeItem = -1;
+  //For each of countedKinds, how many named items that are no forward-declarations have it
+  uint kindCounts[countedKindCount] = {};
 
   START_APPENDED_LISTS(CodeModelRepositoryItem);
   APPENDED_LIST_FIRST(CodeModelRepositoryItem, CodeModelItem, items);
@@ -148,13 +180,442 @@ class CodeModelRequestItem {
 };
 
 
+namespace {
+
+///The search index is made of names, stored in trees of name references under the following keys:
+///the prefixes of up to three characters of each name and of its camel-humps, and each trigram of the name.
+enum NameKeyType : quint64 {
+  NamePrefix = 1,
+  HumpPrefix = 2,
+  NameTrigram = 3
+};
+
+quint64 nameKey(NameKeyType type, const QChar* chars, int count)
+{
+  quint64 key = quint64(type) << 48;
+  for(int a = 0; a < count; ++a)
+    key |= quint64(chars[a].unicode()) << (16 * (2 - a));
+  return key;
+}
+
+///How many items the names under @p key are spread over, by the index of the names. The short keys are shared
+///by a large part of all names, so storing each in one item would rewrite a huge item whenever a name is added.
+uint shardsOfKey(quint64 key)
+{
+  if(key & 0xFFFF)
+    return 16; //Three characters, like all trigrams
+  if(key & 0xFFFFFFFF)
+    return 64; //Two characters
+  return 256;
+}
+
+///The key of the item holding the names of @p shard under @p key
+quint64 shardedKey(quint64 key, uint shard)
+{
+  return key | quint64(shard) << 52;
+}
+
+///The lower-cased first letters of the words within @p name, like "qsl" for "QStringList" or "mv" for "m_value"
+QString camelHumps(const QString& name)
+{
+  QString humps;
+  for(int a = 0; a < name.size(); ++a) {
+    const QChar c = name[a];
+    if(!c.isLetterOrNumber())
+      continue;
+    const QChar previous = a ? name[a-1] : QChar();
+    if(!previous.isLetterOrNumber() || (c.isUpper() && !previous.isUpper()) || (c.isDigit() && !previous.isDigit()))
+      humps += c.toLower();
+  }
+  return humps;
+}
+
+QVector<quint64> nameKeys(const QString& name)
+{
+  const QString lowerName = name.toLower();
+  const QString humps = camelHumps(name);
+
+  QVector<quint64> keys;
+  for(int size = 1; size <= qMin(lowerName.size(), 3); ++size)
+    keys << nameKey(NamePrefix, lowerName.constData(), size);
+  for(int size = 1; size <= qMin(humps.size(), 3); ++size)
+    keys << nameKey(HumpPrefix, humps.constData(), size);
+  for(int a = 0; a + 3 <= lowerName.size(); ++a)
+    keys << nameKey(NameTrigram, lowerName.constData() + a, 3);
+
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+IndexedString nameOf(const IndexedQualifiedIdentifier& id)
+{
+  const QualifiedIdentifier identifier = id.identifier();
+  return identifier.isEmpty() ? IndexedString() : identifier.last().identifier();
+}
+
+}
+
+///An item with the name of a CodeModelNameItem
+struct CodeModelNameEntry
+{
+  IndexedQualifiedIdentifier id;
+  IndexedString file;
+  uint kind = 0;
+  //Only used by free items
+  int leftChild = -1;
+  int rightChild = -1;
+
+  bool isFree() const {
+    return !id.isValid();
+  }
+  bool operator<(const CodeModelNameEntry& rhs) const {
+    return id.index() < rhs.id.index() || (id.index() == rhs.id.index() && file.index() < rhs.file.index());
+  }
+};
+
+///A name registered under the key of a CodeModelNameKeyItem
+struct CodeModelNameReference
+{
+  IndexedString name;
+  //Only used by free items
+  int leftChild = -1;
+  int rightChild = -1;
+
+  bool isFree() const {
+    return name.isEmpty();
+  }
+  bool operator<(const CodeModelNameReference& rhs) const {
+    return name.index() < rhs.name.index();
+  }
+};
+
+template<class Entry>
+class CodeModelNameEntryHandler {
+    public:
+    static int leftChild(const Entry& m_data) {
+        return m_data.leftChild;
+    }
+    static void setLeftChild(Entry& m_data, int child) {
+        m_data.leftChild = child;
+    }
+    static int rightChild(const Entry& m_data) {
+        return m_data.rightChild;
+    }
+    static void setRightChild(Entry& m_data, int child) {
+        m_data.rightChild = child;
+    }
+    static void copyTo(const Entry& m_data, Entry& data) {
+      data = m_data;
+    }
+    static void createFreeItem(Entry& data) {
+        data = Entry();
+    }
+    static bool isFree(const Entry& m_data) {
+        return m_data.isFree();
+    }
+    static const Entry& data(const Entry& m_data) {
+      return m_data;
+    }
+    static bool equals(const Entry& m_data, const Entry& rhs) {
+      return !(m_data < rhs) && !(rhs < m_data);
+    }
+};
+
+DEFINE_LIST_MEMBER_HASH(CodeModelNameItem, entries, CodeModelNameEntry)
+
+///Maps a name to all items having it
+class CodeModelNameItem {
+  public:
+  typedef CodeModelNameEntry Entry;
+
+  CodeModelNameItem() {
+    initializeAppendedLists();
+  }
+  CodeModelNameItem(const CodeModelNameItem& rhs, bool dynamic = true) : name(rhs.name), centralFreeItem(rhs.centralFreeItem) {
+    initializeAppendedLists(dynamic);
+    copyListsFrom(rhs);
+  }
+
+  ~CodeModelNameItem() {
+    freeAppendedLists();
+  }
+
+  unsigned int hash() const {
+    return name.index();
+  }
+
+  uint itemSize() const {
+    return dynamicSize();
+  }
+
+  uint classSize() const {
+    return sizeof(CodeModelNameItem);
+  }
+
+  bool equalKey(const CodeModelNameItem& rhs) const {
+    return name == rhs.name;
+  }
+
+  IndexedString name;
+  int centralFreeItem = -1;
+
+  START_APPENDED_LISTS(CodeModelNameItem);
+  APPENDED_LIST_FIRST(CodeModelNameItem, CodeModelNameEntry, entries);
+  END_APPENDED_LISTS(CodeModelNameItem, entries);
+};
+
+DEFINE_LIST_MEMBER_HASH(CodeModelNameKeyItem, entries, CodeModelNameReference)
+
+///Maps a key of the search index to the names having it
+class CodeModelNameKeyItem {
+  public:
+  typedef CodeModelNameReference Entry;
+
+  CodeModelNameKeyItem() {
+    initializeAppendedLists();
+  }
+  CodeModelNameKeyItem(const CodeModelNameKeyItem& rhs, bool dynamic = true) : key(rhs.key), centralFreeItem(rhs.centralFreeItem) {
+    initializeAppendedLists(dynamic);
+    copyListsFrom(rhs);
+  }
+
+  ~CodeModelNameKeyItem() {
+    freeAppendedLists();
+  }
+
+  unsigned int hash() const {
+    return static_cast<uint>(key ^ (key >> 32)) * 31 + static_cast<uint>(key >> 48);
+  }
+
+  uint itemSize() const {
+    return dynamicSize();
+  }
+
+  uint classSize() const {
+    return sizeof(CodeModelNameKeyItem);
+  }
+
+  bool equalKey(const CodeModelNameKeyItem& rhs) const {
+    return key == rhs.key;
+  }
+
+  quint64 key = 0;
+  int centralFreeItem = -1;
+
+  START_APPENDED_LISTS(CodeModelNameKeyItem);
+  APPENDED_LIST_FIRST(CodeModelNameKeyItem, CodeModelNameReference, entries);
+  END_APPENDED_LISTS(CodeModelNameKeyItem, entries);
+};
+
+template<class Item>
+class CodeModelNameRequestItem {
+  public:
+
+  CodeModelNameRequestItem(const Item& item) : m_item(item) {
+  }
+  enum {
+    AverageSize = 40 //This should be the approximate average size of an Item
+  };
+
+  unsigned int hash() const {
+    return m_item.hash();
+  }
+
+  uint itemSize() const {
+      return m_item.itemSize();
+  }
+
+  void createItem(Item* item) const {
+    new (item) Item(m_item, false);
+  }
+
+  static void destroy(Item* item, KDevelop::AbstractItemRepository&) {
+    item->~Item();
+  }
+
+  static bool persistent(const Item* item) {
+    Q_UNUSED(item);
+    return true;
+  }
+
+  bool equals(const Item* item) const {
+    return m_item.equalKey(*item);
+  }
+
+  const Item& m_item;
+};
+
 class CodeModelPrivate {
 public:
 
-  CodeModelPrivate() : m_repository(QStringLiteral("Code Model")) {
+  CodeModelPrivate()
+    : m_repository(QStringLiteral("Code Model"))
+    , m_names(QStringLiteral("Code Model Names"))
+    , m_nameKeys(QStringLiteral("Code Model Name Keys"))
+  {
+  }
+
+  template<class Item>
+  using Repository = ItemRepository<Item, CodeModelNameRequestItem<Item>>;
+
+  ///Adds @p entry to the tree of the item with the key of @p item, or updates it if it is there already.
+  ///@returns Whether the item was created.
+  template<class Item>
+  static bool insertEntry(Repository<Item>& repository, Item& item, const typename Item::Entry& entry)
+  {
+    typedef CodeModelNameEntryHandler<typename Item::Entry> Handler;
+
+    QMutexLocker lock(repository.mutex());
+    uint index = repository.findIndex(item);
+    if(index) {
+      DynamicItem<Item, true> editableItem = repository.dynamicItemFromIndex(index);
+      auto entries = const_cast<typename Item::Entry*>(editableItem->entries());
+
+      EmbeddedTreeAlgorithms<typename Item::Entry, Handler> alg(entries, editableItem->entriesSize(), editableItem->centralFreeItem);
+      int listIndex = alg.indexOf(entry);
+      if(listIndex != -1) {
+        entries[listIndex] = entry;
+        return false;
+      }
+
+      EmbeddedTreeAddItem<typename Item::Entry, Handler> add(entries, editableItem->entriesSize(), editableItem->centralFreeItem, entry);
+      if(add.newItemCount() == editableItem->entriesSize())
+        return false; //The entry fits into the existing list
+
+      //The data needs to be transferred into a bigger list
+      item.entriesList().resize(add.newItemCount());
+      add.transferData(item.entriesList().data(), item.entriesList().size(), &item.centralFreeItem);
+      repository.deleteItem(index);
+      repository.index(CodeModelNameRequestItem<Item>(item));
+      return false;
+    }
+
+    item.entriesList().append(entry);
+    repository.index(CodeModelNameRequestItem<Item>(item));
+    return true;
+  }
+
+  ///Removes @p entry from the tree of the item with the key of @p item.
+  ///@returns Whether the item was deleted, because it became empty.
+  template<class Item>
+  static bool removeEntry(Repository<Item>& repository, Item& item, const typename Item::Entry& entry)
+  {
+    typedef CodeModelNameEntryHandler<typename Item::Entry> Handler;
+
+    QMutexLocker lock(repository.mutex());
+    uint index = repository.findIndex(item);
+    if(!index)
+      return false;
+
+    DynamicItem<Item, true> oldItem = repository.dynamicItemFromIndex(index);
+    auto entries = const_cast<typename Item::Entry*>(oldItem->entries());
+
+    EmbeddedTreeAlgorithms<typename Item::Entry, Handler> alg(entries, oldItem->entriesSize(), oldItem->centralFreeItem);
+    if(alg.indexOf(entry) == -1)
+      return false;
+
+    EmbeddedTreeRemoveItem<typename Item::Entry, Handler> remove(entries, oldItem->entriesSize(), oldItem->centralFreeItem, entry);
+    uint newItemCount = remove.newItemCount();
+    if(newItemCount == oldItem->entriesSize())
+      return false;
+
+    if(newItemCount == 0) {
+      repository.deleteItem(index);
+      return true;
+    }
+
+    item.entriesList().resize(newItemCount);
+    remove.transferData(item.entriesList().data(), item.entriesSize(), &item.centralFreeItem);
+    repository.deleteItem(index);
+    repository.index(CodeModelNameRequestItem<Item>(item));
+    return false;
+  }
+
+  ///Copies the used entries of the item with the key of @p item
+  template<class Item>
+  static QVector<typename Item::Entry> entries(Repository<Item>& repository, const Item& item)
+  {
+    QVector<typename Item::Entry> ret;
+    QMutexLocker lock(repository.mutex());
+    if(uint index = repository.findIndex(item)) {
+      const Item* repositoryItem = repository.itemFromIndex(index);
+      ret.reserve(repositoryItem->entriesSize());
+      FOREACH_FUNCTION(const typename Item::Entry& entry, repositoryItem->entries) {
+        if(!entry.isFree())
+          ret << entry;
+      }
+    }
+    return ret;
+  }
+
+  ///Adds the item to the search index, or updates its kind
+  void addName(const IndexedString& file, const IndexedQualifiedIdentifier& id, uint kind)
+  {
+    CodeModelNameItem item;
+    item.name = nameOf(id);
+    if(item.name.isEmpty())
+      return;
+
+    CodeModelNameEntry entry;
+    entry.id = id;
+    entry.file = file;
+    entry.kind = kind;
+    if(!insertEntry(m_names, item, entry))
+      return;
+
+    //A new name, register it under all its keys
+    CodeModelNameReference reference;
+    reference.name = item.name;
+    const QVector<quint64> keys = nameKeys(item.name.str());
+    for(quint64 key : keys) {
+      CodeModelNameKeyItem keyItem;
+      keyItem.key = shardedKey(key, item.name.index() % shardsOfKey(key));
+      insertEntry(m_nameKeys, keyItem, reference);
+    }
+  }
+
+  void removeName(const IndexedString& file, const IndexedQualifiedIdentifier& id)
+  {
+    CodeModelNameItem item;
+    item.name = nameOf(id);
+    if(item.name.isEmpty())
+      return;
+
+    CodeModelNameEntry entry;
+    entry.id = id;
+    entry.file = file;
+    if(!removeEntry(m_names, item, entry))
+      return;
+
+    //No item has the name anymore
+    CodeModelNameReference reference;
+    reference.name = item.name;
+    const QVector<quint64> keys = nameKeys(item.name.str());
+    for(quint64 key : keys) {
+      CodeModelNameKeyItem keyItem;
+      keyItem.key = shardedKey(key, item.name.index() % shardsOfKey(key));
+      removeEntry(m_nameKeys, keyItem, reference);
+    }
   }
+
+  QVector<CodeModelNameReference> namesForKey(quint64 key)
+  {
+    QVector<CodeModelNameReference> ret;
+    const uint shards = shardsOfKey(key);
+    for(uint shard = 0; shard < shards; ++shard) {
+      CodeModelNameKeyItem keyItem;
+      keyItem.key = shardedKey(key, shard);
+      ret += entries(m_nameKeys, keyItem);
+    }
+    return ret;
+  }
+
   //Maps declaration-ids to items
   ItemRepository<CodeModelRepositoryItem, CodeModelRequestItem> m_repository;
+  //The search index, see CodeModel::search
+  Repository<CodeModelNameItem> m_names;
+  Repository<CodeModelNameKeyItem> m_nameKeys;
 };
 
 CodeModel::CodeModel() : d(new CodeModelPrivate())
@@ -194,15 +655,24 @@ void CodeModel::addItem(const IndexedString& file, const IndexedQualifiedIdentif
     if(listIndex != -1) {
       //Only update the reference-count
         ++items[listIndex].referenceCount;
-        items[listIndex].kind = kind;
+        if(items[listIndex].kind != kind) {
+          countItem(editableItem->kindCounts, id, items[listIndex].kind, -1);
+          countItem(editableItem->kindCounts, id, kind, 1);
+          items[listIndex].kind = kind;
+          d->addName(file, id, kind);
+        }
         return;
     }else{
       //Add the item to the list
       EmbeddedTreeAddItem<CodeModelItem, CodeModelItemHandler> add(items, editableItem->itemsSize(), editableItem->centralFreeItem, newItem);
 
+      d->addName(file, id, kind);
+      countItem(editableItem->kindCounts, id, kind, 1);
+
       if(add.newItemCount() != editableItem->itemsSize()) {
         //The data needs to be transferred into a bigger list. That list is within "item".
 
+        std::copy(editableItem->kindCounts, editableItem->kindCounts + countedKindCount, item.kindCounts);
         item.itemsList().resize(add.newItemCount());
         add.transferData(item.itemsList().data(), item.itemsList().size(), &item.centralFreeItem);
 
@@ -215,6 +685,8 @@ void CodeModel::addItem(const IndexedString& file, const IndexedQualifiedIdentif
   }else{
     //We're creating a new index
     item.itemsList().append(newItem);
+    d->addName(file, id, kind);
+    countItem(item.kindCounts, id, kind, 1);
   }
 
   Q_ASSERT(!d->m_repository.findIndex(request));
@@ -257,7 +729,10 @@ void CodeModel::updateItem(const IndexedString& file, const IndexedQualifiedIden
     CodeModelItem* items = const_cast<CodeModelItem*>(oldItem->items());
 
     Q_ASSERT(items[listIndex].id == id);
+    countItem(oldItem->kindCounts, id, items[listIndex].kind, -1);
+    countItem(oldItem->kindCounts, id, kind, 1);
     items[listIndex].kind = kind;
+    d->addName(file, id, kind);
 
     return;
   }
@@ -300,6 +775,8 @@ void CodeModel::removeItem(const IndexedString& file, const IndexedQualifiedIden
       return; //Nothing to remove, there's still a reference-count left
 
     //We have reduced the reference-count to zero, so remove the item from the list
+    d->removeName(file, id);
+    countItem(oldItem->kindCounts, id, items[listIndex].kind, -1);
 
     EmbeddedTreeRemoveItem<CodeModelItem, CodeModelItemHandler> remove(items, oldItem->itemsSize(), oldItem->centralFreeItem, searchItem);
 
@@ -312,6 +789,7 @@ void CodeModel::removeItem(const IndexedString& file, const IndexedQualifiedIden
         return;
       }else{
         //Make smaller
+        std::copy(oldItem->kindCounts, oldItem->kindCounts + countedKindCount, item.kindCounts);
         item.itemsList().resize(newItemCount);
         remove.transferData(item.itemsList().data(), item.itemsSize(), &item.centralFreeItem);
 
@@ -347,6 +825,99 @@ void CodeModel::items(const IndexedString& file, uint& count, const CodeModelIte
   }
 }
 
+uint CodeModel::itemCount(const IndexedString& file, uint kinds) const
+{
+  CodeModelRepositoryItem item;
+  item.file = file;
+
+  QMutexLocker lock(d->m_repository.mutex());
+  uint index = d->m_repository.findIndex(item);
+  if(!index)
+    return 0;
+
+  const CodeModelRepositoryItem* repositoryItem = d->m_repository.itemFromIndex(index);
+  uint count = 0;
+  for(int a = 0; a < countedKindCount; ++a) {
+    if(kinds & countedKinds[a])
+      count += repositoryItem->kindCounts[a];
+  }
+  return count;
+}
+
+QVector<CodeModelMatch> CodeModel::search(const QString& text, uint kinds) const
+{
+  QVector<CodeModelMatch> ret;
+  const QString query = text.toLower();
+  if(query.isEmpty())
+    return ret;
+
+  //Collect the candidate names: those starting with the text or having it as camel-humps prefix,
+  //and for longer text those containing its rarest trigram
+  QVector<CodeModelNameReference> candidates;
+  const int prefixSize = qMin(query.size(), 3);
+  candidates += d->namesForKey(nameKey(NamePrefix, query.constData(), prefixSize));
+  candidates += d->namesForKey(nameKey(HumpPrefix, query.constData(), prefixSize));
+  if(query.size() >= 3) {
+    QVector<CodeModelNameReference> rarest;
+    for(int a = 0; a + 3 <= query.size(); ++a) {
+      const QVector<CodeModelNameReference> names = d->namesForKey(nameKey(NameTrigram, query.constData() + a, 3));
+      if(a == 0 || names.size() < rarest.size())
+        rarest = names;
+      if(rarest.isEmpty())
+        break; //No name can contain the text
+    }
+    candidates += rarest;
+  }
+
+  struct Candidate {
+    IndexedString name;
+    int size;
+    CodeModelMatch::Quality quality;
+  };
+  QVector<Candidate> matches;
+  QSet<uint> seen;
+  for(const CodeModelNameReference& candidate : qAsConst(candidates)) {
+    if(seen.contains(candidate.name.index()))
+      continue;
+    seen.insert(candidate.name.index());
+
+    const QString name = candidate.name.str();
+    const QString lowerName = name.toLower();
+    CodeModelMatch::Quality quality;
+    if(lowerName == query)
+      quality = CodeModelMatch::Exact;
+    else if(lowerName.startsWith(query))
+      quality = CodeModelMatch::Prefix;
+    else if(camelHumps(name).startsWith(query))
+      quality = CodeModelMatch::CamelHumps;
+    else if(query.size() >= 3 && lowerName.contains(query))
+      quality = CodeModelMatch::Substring;
+    else
+      continue;
+    matches.append({candidate.name, name.size(), quality});
+  }
+
+  std::sort(matches.begin(), matches.end(), [](const Candidate& lhs, const Candidate& rhs) {
+    if(lhs.quality != rhs.quality)
+      return lhs.quality < rhs.quality;
+    if(lhs.size != rhs.size)
+      return lhs.size < rhs.size;
+    return lhs.name.index() < rhs.name.index();
+  });
+
+  for(const Candidate& match : qAsConst(matches)) {
+    CodeModelNameItem item;
+    item.name = match.name;
+    const QVector<CodeModelNameEntry> entries = CodeModelPrivate::entries(d->m_names, item);
+    for(const CodeModelNameEntry& entry : entries) {
+      if(entry.kind & kinds)
+        ret.append({entry.file, entry.id, static_cast<CodeModelItem::Kind>(entry.kind), match.quality});
+    }
+  }
+
+  return ret;
+}
+
 CodeModel& CodeModel::self() {
   static CodeModel ret;
   return ret;
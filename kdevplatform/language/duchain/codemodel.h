@@ -21,7 +21,10 @@
 
 #include "identifier.h"
 
+#include <serialization/indexedstring.h>
+
 #include <QScopedPointer>
+#include <QVector>
 
 namespace KDevelop {
 
@@ -30,7 +33,6 @@ namespace KDevelop {
   class DeclarationId;
   class TopDUContext;
   class QualifiedIdentifier;
-  class IndexedString;
 
   struct CodeModelItem
   {
@@ -58,6 +60,24 @@ namespace KDevelop {
     }
   };
 
+  /**
+   * An item found by CodeModel::search()
+   */
+  struct CodeModelMatch
+  {
+    /// How the name of the item matches the searched text, better matches first
+    enum Quality {
+      Exact,
+      Prefix,
+      CamelHumps,
+      Substring
+    };
+    IndexedString file;
+    IndexedQualifiedIdentifier id;
+    CodeModelItem::Kind kind;
+    Quality quality;
+  };
+
   /**
    * Persistent store that efficiently holds a list of identifiers
    * and their kind for each declaration-string.
@@ -91,6 +111,29 @@ namespace KDevelop {
      */
     void items(const IndexedString& file, uint& count, const CodeModelItem*& items) const;
 
+    /**
+     * Returns how many items of @p file have any of @p kinds, without forward-declarations and unnamed items.
+     *
+     * The counts are kept up to date together with the items, so this does not walk them.
+     *
+     * @param kinds Any of Function, Variable, Class and Namespace. Items having several of those are counted once for each.
+     */
+    uint itemCount(const IndexedString& file, uint kinds) const;
+
+    /**
+     * Searches the items of all files by their name, the last component of their identifier, ignoring case.
+     *
+     * Names equal to @p text come first, then names starting with it, names whose camel-humps start with it
+     * (like "qsl" for "QStringList"), and names containing it. Shorter names come first within each of those.
+     * Text shorter than three characters only matches at the start of names or of their camel-humps.
+     *
+     * The names are kept in a persistent index that is updated together with the items, so this neither
+     * walks the items nor needs the DUChain lock.
+     *
+     * @param kinds Only items having any of these kinds are returned.
+     */
+    QVector<CodeModelMatch> search(const QString& text, uint kinds) const;
+
     static CodeModel& self();
 
     private:
@@ -99,5 +142,6 @@ namespace KDevelop {
 }
 
 Q_DECLARE_TYPEINFO(KDevelop::CodeModelItem, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(KDevelop::CodeModelMatch, Q_MOVABLE_TYPE);
 
 #endif
@@ -21,15 +21,24 @@
 #include "duchainlock.h"
 
 #include <QApplication>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFuture>
 #include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMultiMap>
 #include <QProcessEnvironment>
 #include <QReadWriteLock>
+#include <QSharedPointer>
 #include <QAtomicInt>
 #include <QThread>
 #include <QStandardPaths>
 #include <QMutex>
 #include <QTimer>
+#include <QtConcurrentRun>
 
 #include <qtcompat_p.h>
 #include <interfaces/idocumentcontroller.h>
@@ -40,6 +49,7 @@
 #include "../interfaces/ilanguagesupport.h"
 #include "../interfaces/icodehighlighting.h"
 #include "../backgroundparser/backgroundparser.h"
+#include "../backgroundparser/urlparselock.h"
 #include <debug.h>
 
 #include "language-features.h"
@@ -74,6 +84,42 @@ const int SOFT_CLEANUP_STEPS = 1;
 // seconds to wait before trying to cleanup the DUChain
 const uint cleanupEverySeconds = 200;
 
+// seconds between checkpoints, which store the changed top-contexts in between the cleanups
+const uint checkpointEverySeconds = 30;
+
+// maximum time in milliseconds for which a checkpoint keeps the DUChain write-locked at once
+const qint64 checkpointSliceMilliseconds = 5;
+
+// maximum count of documents a checkpoint locks for one slice
+const int checkpointSliceDocuments = 64;
+
+///Whether a parse-job is running for @p url. Not every top-context has an url the background parser accepts.
+bool isBeingParsed(KDevelop::BackgroundParser* parser, const KDevelop::IndexedString& url)
+{
+  const QUrl original = url.toUrl();
+  if (!original.isValid() || original.isRelative() || (original.fileName().isEmpty() && original.isLocalFile())
+      || original != original.adjusted(QUrl::NormalizePathSegments)) {
+    return false;
+  }
+  return parser->parseJobForDocument(url);
+}
+
+///File of an exported duchain cache that records the content of the files it was built from, see DUChain::exportCache()
+QString cacheManifestFileName()
+{
+  return QStringLiteral("cache_manifest.json");
+}
+
+QByteArray contentHash(const QString& fileName)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    return QByteArray();
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(&file);
+  return hash.result().toHex();
+}
+
 ///Approximate maximum count of top-contexts that are checked during final cleanup
 const uint maxFinalCleanupCheckContexts = 2000;
 const uint minimumFinalCleanupCheckContextsPercentage = 10; //Check at least n% of all top-contexts during cleanup
@@ -284,6 +330,12 @@ class DUChainPrivate
           m_data->doMoreCleanup(SOFT_CLEANUP_STEPS, TryLock);
         });
         timer.start(cleanupEverySeconds * 1000);
+
+        QTimer checkpointTimer;
+        connect(&checkpointTimer, &QTimer::timeout, &checkpointTimer, [this]() {
+          m_data->checkpoint();
+        });
+        checkpointTimer.start(checkpointEverySeconds * 1000);
         exec();
       }
       DUChainPrivate* m_data;
@@ -305,6 +357,9 @@ public:
     qRegisterMetaType<KDevelop::IndexedTopDUContext>("KDevelop::IndexedTopDUContext");
     qRegisterMetaType<KDevelop::ReferencedTopDUContext>("KDevelop::ReferencedTopDUContext");
 
+    //Roll back the top-contexts stored after the last complete store of the repositories
+    TopDUContextDynamicData::restoreCheckpoint();
+
     instance = new DUChain();
     m_cleanup = new CleanupThread(this);
     m_cleanup->start();
@@ -428,6 +483,13 @@ public:
 
   CleanupThread* m_cleanup;
 
+  mutable QMutex m_checkpointStatisticsMutex;
+  DUChain::CheckpointStatistics m_checkpointStatistics;
+
+  //Adopts an imported cache in the background, see adoptImportedCache()
+  QFuture<void> m_adoption;
+  QAtomicInt m_adoptionCancelled;
+
   DUChain* instance;
   DUChainLock lock;
   QMultiMap<IndexedString, TopDUContext*> m_chainsByUrl;
@@ -696,6 +758,138 @@ public:
     /// only try to lock and abort on failure, good for the intermittent cleanups
     TryLock = 2,
   };
+  ///Write-locks the parse locks of all loaded languages, which waits for the running parse-jobs to stop their processing.
+  ///The duchain must not be locked by the calling thread.
+  ///@param locked receives the locks, the caller has to unlock them
+  ///@returns false if @p lockFlag is TryLock and a language is still parsing, nothing is locked then
+  bool lockParsing(LockFlag lockFlag, QList<QReadWriteLock*>* locked) {
+    QList<ILanguageSupport*> languages;
+    if (ICore* core = ICore::self())
+      if (ILanguageController* lc = core->languageController())
+        languages = lc->loadedLanguages();
+
+    foreach(const auto language, languages) {
+      if (lockFlag == TryLock) {
+        if (!language->parseLock() || !language->parseLock()->tryLockForWrite()) {
+          qCDebug(LANGUAGE) << "Aborting cleanup because language plugin is still parsing:" << language->name();
+          // some language is still parsing, don't interfere with the cleanup
+          foreach(auto* lock, *locked) {
+            lock->unlock();
+          }
+          locked->clear();
+          return false;
+        }
+      } else {
+        language->parseLock()->lockForWrite();
+      }
+      *locked << language->parseLock();
+    }
+    return true;
+  }
+
+  ///Stores the changed top-contexts in between the cleanups without stopping the parsing. Unlike doMoreCleanup,
+  ///it holds the duchain write-lock only for slices of checkpointSliceMilliseconds, and the stored data is written
+  ///to disk after the last slice, without holding the duchain lock.
+  ///After a crash before the next cleanup, the top-contexts stored here are rolled back to the state of the
+  ///last stored repositories, see TopDUContextDynamicData::restoreCheckpoint().
+  void checkpoint() {
+
+    if(m_cleanupDisabled)
+      return;
+
+    QMutexLocker lockCleanupMutex(&cleanupMutex());
+
+    if(m_destroyed || m_cleanupDisabled)
+      return;
+
+    Q_ASSERT(!instance->lock()->currentThreadHasReadLock() && !instance->lock()->currentThreadHasWriteLock());
+
+    QVector<QPair<uint, IndexedString>> changed;
+    {
+      DUChainReadLocker readLock(instance->lock());
+      QMutexLocker l(&m_chainsMutex);
+      foreach(TopDUContext* top, m_chainsByUrl)
+        if(top->m_dynamicData->hasChanged())
+          changed << qMakePair(top->ownIndex(), top->url());
+    }
+
+    BackgroundParser* parser = nullptr;
+    if (ICore* core = ICore::self())
+      if (ILanguageController* lc = core->languageController())
+        parser = lc->backgroundParser();
+
+    {
+      QMutexLocker lock(&m_checkpointStatisticsMutex);
+      ++m_checkpointStatistics.checkpoints;
+      m_checkpointStatistics.checkedContexts = 0;
+      m_checkpointStatistics.totalContexts = changed.size();
+    }
+
+    TopDUContextDynamicData::beginStoreBatch();
+
+    int next = 0;
+    while(next < changed.size()) {
+      //A top-context must not be stored while a parse-job builds it, so lock the documents of the slice. The locks
+      //are only tried, as the parse-jobs lock their documents in their own order. Documents being parsed are skipped,
+      //their contexts are stored with the next checkpoint.
+      const int sliceEnd = qMin(next + checkpointSliceDocuments, changed.size());
+      QVector<QSharedPointer<UrlParseLock>> urlLocks;
+      urlLocks.reserve(sliceEnd - next);
+      for(int a = next; a < sliceEnd; ++a)
+        urlLocks << QSharedPointer<UrlParseLock>(new UrlParseLock(changed[a].second, UrlParseLock::NonBlocking));
+
+      DUChainWriteLocker writeLock(instance->lock());
+      QElapsedTimer slice;
+      slice.start();
+
+      quint64 stored = 0;
+      quint64 skipped = 0;
+      const int sliceStart = next;
+      for(; next < sliceEnd && slice.elapsed() < checkpointSliceMilliseconds; ++next) {
+        //The context may have been unloaded in the meantime
+        TopDUContext* context = readChainForIndex(changed[next].first);
+        if(!context || !context->m_dynamicData->hasChanged())
+          continue;
+
+        if(!urlLocks[next - sliceStart]->isLocked() || (parser && isBeingParsed(parser, context->url()))) {
+          ++skipped;
+          continue;
+        }
+
+        context->m_dynamicData->store();
+        ++stored;
+      }
+
+      const quint64 pauseUs = slice.nsecsElapsed() / 1000;
+      writeLock.unlock();
+      urlLocks.clear();
+
+      {
+        QMutexLocker lock(&m_checkpointStatisticsMutex);
+        ++m_checkpointStatistics.slices;
+        m_checkpointStatistics.storedContexts += stored;
+        m_checkpointStatistics.skippedContexts += skipped;
+        m_checkpointStatistics.totalPauseUs += pauseUs;
+        m_checkpointStatistics.maxPauseUs = qMax(m_checkpointStatistics.maxPauseUs, pauseUs);
+        m_checkpointStatistics.checkedContexts = next;
+      }
+
+      if(next < changed.size()) {
+        //Give the other threads a realistic chance to get the lock in between
+        QThread::usleep(500);
+      }
+    }
+
+    QElapsedTimer write;
+    write.start();
+    TopDUContextDynamicData::endStoreBatch();
+
+    QMutexLocker lock(&m_checkpointStatisticsMutex);
+    m_checkpointStatistics.totalWriteUs += write.nsecsElapsed() / 1000;
+    m_checkpointStatistics.checkedContexts = 0;
+    m_checkpointStatistics.totalContexts = 0;
+  }
+
   ///@param retries When this is nonzero, then doMoreCleanup will do the specified amount of cycles
   ///doing the cleanup without permanently locking the du-chain. During these steps the consistency
   ///of the disk-storage is not guaranteed, but only few changes will be done during these steps,
@@ -719,29 +913,10 @@ public:
     QList<QReadWriteLock*> locked;
 
     if (lockFlag != NoLock) {
-      QList<ILanguageSupport*> languages;
-      if (ICore* core = ICore::self())
-        if (ILanguageController* lc = core->languageController())
-          languages = lc->loadedLanguages();
-
       writeLock.unlock();
 
-      //Here we wait for all parsing-threads to stop their processing
-      foreach(const auto language, languages) {
-        if (lockFlag == TryLock) {
-          if (!language->parseLock() || !language->parseLock()->tryLockForWrite()) {
-            qCDebug(LANGUAGE) << "Aborting cleanup because language plugin is still parsing:" << language->name();
-            // some language is still parsing, don't interfere with the cleanup
-            foreach(auto* lock, locked) {
-              lock->unlock();
-            }
-            return;
-          }
-        } else {
-          language->parseLock()->lockForWrite();
-        }
-        locked << language->parseLock();
-      }
+      if (!lockParsing(lockFlag, &locked))
+        return;
 
       writeLock.lock();
 
@@ -767,6 +942,9 @@ public:
       }
     }
 
+    //The contexts stored until the end of the batch are written to disk together
+    TopDUContextDynamicData::beginStoreBatch();
+
     foreach(TopDUContext* context, workOnContexts) {
 
       context->m_dynamicData->store();
@@ -873,32 +1051,31 @@ public:
       if(retries)
         writeLock.unlock();
 
-      //This must be the last step, due to the on-disk reference counting
-      globalItemRepositoryRegistry().store(); //Stores all repositories
+      TopDUContextDynamicData::endStoreBatch();
 
+      //The static data is written together with the repositories, so it is consistent with them after a crash
       {
         //Store the static parsing-environment file data
         ///@todo Solve this more elegantly, using a general mechanism to store static duchain-like data
         Q_ASSERT(ParsingEnvironmentFile::m_staticData);
-        QFile f(globalItemRepositoryRegistry().path() + QLatin1String("/parsing_environment_data"));
-        bool opened = f.open(QIODevice::WriteOnly);
-        Q_ASSERT(opened);
-        Q_UNUSED(opened);
-        f.write((char*)ParsingEnvironmentFile::m_staticData, sizeof(StaticParsingEnvironmentData));
+        globalItemRepositoryRegistry().storeFile(QStringLiteral("parsing_environment_data"),
+                                                 QByteArray((const char*)ParsingEnvironmentFile::m_staticData, sizeof(StaticParsingEnvironmentData)));
       }
 
       ///Write out the list of available top-context indices
       {
         QMutexLocker lock(&m_chainsMutex);
 
-        QFile f(globalItemRepositoryRegistry().path() + QLatin1String("/available_top_context_indices"));
-        bool opened = f.open(QIODevice::WriteOnly);
-        Q_ASSERT(opened);
-        Q_UNUSED(opened);
-
-        f.write((char*)m_availableTopContextIndices.data(), m_availableTopContextIndices.size() * sizeof(uint));
+        globalItemRepositoryRegistry().storeFile(QStringLiteral("available_top_context_indices"),
+                                                 QByteArray((const char*)m_availableTopContextIndices.data(), m_availableTopContextIndices.size() * sizeof(uint)));
       }
 
+      //This must be the last step, due to the on-disk reference counting
+      globalItemRepositoryRegistry().store(); //Stores all repositories
+
+      //The top-contexts stored so far belong to the stored repositories now
+      TopDUContextDynamicData::discardUndo();
+
 
       if(retries) {
         doMoreCleanup(retries-1, NoLock);
@@ -1017,8 +1194,87 @@ public:
     qCDebug(LANGUAGE) << "check ready";
   }
 
+  ///The urls of all files there are top-contexts for
+  QSet<IndexedString> storedUrls() {
+    ENSURE_CHAIN_READ_LOCKED;
+    CleanupListVisitor visitor;
+    m_environmentInfo.visitAllItems(visitor);
+
+    QSet<IndexedString> urls;
+    for (uint topContext : qAsConst(visitor.checkContexts)) {
+      if (ParsingEnvironmentFile* file = loadInformation(topContext))
+        urls.insert(file->url());
+    }
+    return urls;
+  }
+
+  ///The imported cache was checked against the modification times of the files on the machine that built it.
+  ///Every top-context whose file and recursive imports still have the content recorded in the manifest of
+  ///@p importPath is checked against the local modification times instead, the others are parsed again.
+  ///Runs in the background after DUChain::initialize(), until then the imported top-contexts just look outdated.
+  void adoptImportedCache(const QString& importPath) {
+    QFile manifestFile(QDir(importPath).filePath(cacheManifestFileName()));
+    if (!manifestFile.open(QIODevice::ReadOnly)) {
+      qCWarning(LANGUAGE) << "the imported duchain cache has no manifest, its files will be parsed again";
+      return;
+    }
+    const QJsonObject manifest = QJsonDocument::fromJson(manifestFile.readAll()).object();
+    //The root is recorded relative to the cache, KDEV_DUCHAIN_IMPORT_ROOT overrides it when the cache was moved away from the sources
+    QString rootPath = QProcessEnvironment::systemEnvironment().value(QStringLiteral("KDEV_DUCHAIN_IMPORT_ROOT"));
+    if (rootPath.isEmpty())
+      rootPath = QDir(importPath).absoluteFilePath(manifest.value(QStringLiteral("root")).toString());
+    const QDir root(rootPath);
+
+    QSet<IndexedString> unchanged;
+    foreach (const auto& value, manifest.value(QStringLiteral("files")).toArray()) {
+      if (m_adoptionCancelled.load())
+        return;
+      const QJsonObject entry = value.toObject();
+      const QString fileName = QDir::cleanPath(root.absoluteFilePath(entry.value(QStringLiteral("path")).toString()));
+      if (contentHash(fileName) == entry.value(QStringLiteral("hash")).toString().toLatin1())
+        unchanged.insert(IndexedString(fileName));
+    }
+
+    DUChainWriteLocker writeLock(DUChain::lock());
+    CleanupListVisitor visitor;
+    m_environmentInfo.visitAllItems(visitor);
+
+    int adopted = 0;
+    for (uint topContext : qAsConst(visitor.checkContexts)) {
+      ParsingEnvironmentFilePointer file(loadInformation(topContext));
+      QSet<IndexedString> dependencies;
+      if (!file || !collectUnchangedDependencies(file, unchanged, &dependencies))
+        continue;
+
+      file->setModificationRevision(ModificationRevision::revisionForFile(file->url()));
+      file->clearModificationRevisions();
+      for (const IndexedString& url : qAsConst(dependencies))
+        file->addModificationRevision(url, ModificationRevision::revisionForFile(url));
+      ++adopted;
+    }
+    qCDebug(LANGUAGE) << "adopted" << adopted << "of" << visitor.checkContexts.size() << "imported top-contexts," << unchanged.size() << "files are unchanged";
+    if (!adopted && !unchanged.isEmpty())
+      qCWarning(LANGUAGE) << "none of the imported top-contexts is for the files under" << root.absolutePath() << "- the top-contexts refer to the paths the cache was built at";
+  }
+
 private:
 
+  ///Collects the urls of @p file and its recursive imports into @p dependencies
+  ///@returns false if any of them is not in @p unchanged
+  static bool collectUnchangedDependencies(const ParsingEnvironmentFilePointer& file, const QSet<IndexedString>& unchanged, QSet<IndexedString>* dependencies) {
+    if (!unchanged.contains(file->url()))
+      return false;
+    if (dependencies->contains(file->url()))
+      return true;
+    dependencies->insert(file->url());
+
+    foreach (const ParsingEnvironmentFilePointer& import, file->imports()) {
+      if (!collectUnchangedDependencies(import, unchanged, dependencies))
+        return false;
+    }
+    return true;
+  }
+
   void addContextsForRemoval(QSet<uint>& topContexts, IndexedTopDUContext top) {
     if(topContexts.contains(top.index()))
       return;
@@ -1165,7 +1421,22 @@ void DUChain::initialize()
   Q_ASSERT(ICore::self());
   Q_ASSERT(ICore::self()->activeSession());
 
-  ItemRepositoryRegistry::initialize(repositoryPathForSession(ICore::self()->activeSessionLock()));
+  const QString repositoryPath = repositoryPathForSession(ICore::self()->activeSessionLock());
+
+  // Seed a session that has no cache yet from a pre-built one, see "duchainify --export-cache"
+  const QString importPath = QProcessEnvironment::systemEnvironment().value(QStringLiteral("KDEV_DUCHAIN_IMPORT_DIR"));
+  bool imported = false;
+  if (!importPath.isEmpty() && QDir(repositoryPath).entryList(QDir::AllEntries | QDir::NoDotAndDotDot).isEmpty()) {
+    if (ItemRepositoryRegistry::copyRepository(importPath, repositoryPath)) {
+      qCDebug(LANGUAGE) << "imported the duchain cache from" << importPath;
+      imported = true;
+    } else {
+      qCWarning(LANGUAGE) << "failed importing the duchain cache from" << importPath;
+      QDir(repositoryPath).removeRecursively();
+    }
+  }
+
+  ItemRepositoryRegistry::initialize(repositoryPath);
 
   initReferenceCounting();
 
@@ -1190,6 +1461,10 @@ void DUChain::initialize()
   globalIndexedImportIdentifier();
   globalAliasIdentifier();
   globalIndexedAliasIdentifier();
+
+  //Hashing all files of the imported cache takes a while, so don't block the startup with it
+  if (imported)
+    sdDUChainPrivate->m_adoption = QtConcurrent::run([importPath]() { sdDUChainPrivate->adoptImportedCache(importPath); });
 }
 
 DUChainLock* DUChain::lock()
@@ -1621,6 +1896,9 @@ void DUChain::shutdown()
 
   qCDebug(LANGUAGE) << "Cleaning up and shutting down DUChain";
 
+  sdDUChainPrivate->m_adoptionCancelled.store(1);
+  sdDUChainPrivate->m_adoption.waitForFinished();
+
   QMutexLocker lock(&sdDUChainPrivate->cleanupMutex());
 
   {
@@ -1772,6 +2050,54 @@ void DUChain::storeToDisk() {
   sdDUChainPrivate->m_cleanupDisabled = wasDisabled;
 }
 
+bool DUChain::exportCache(const QString& path, const QString& root) {
+  storeToDisk();
+  if (!ItemRepositoryRegistry::copyRepository(globalItemRepositoryRegistry().path(), path))
+    return false;
+
+  QSet<IndexedString> urls;
+  {
+    DUChainReadLocker lock;
+    urls = sdDUChainPrivate->storedUrls();
+  }
+
+  const QDir rootDir(root);
+  QJsonArray files;
+  for (const IndexedString& url : qAsConst(urls)) {
+    const QString fileName = url.str();
+    const QByteArray hash = contentHash(fileName);
+    if (hash.isEmpty())
+      continue;
+    files.append(QJsonObject{{QStringLiteral("path"), rootDir.relativeFilePath(fileName)},
+                             {QStringLiteral("hash"), QString::fromLatin1(hash)}});
+  }
+
+  QFile manifest(QDir(path).filePath(cacheManifestFileName()));
+  if (!manifest.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qCWarning(LANGUAGE) << "cannot write" << manifest.fileName() << manifest.errorString();
+    return false;
+  }
+  //No absolute path is recorded, the importing session resolves the root against where it imports the cache from
+  const QJsonObject contents{{QStringLiteral("root"), QDir(path).relativeFilePath(rootDir.absolutePath())}, {QStringLiteral("files"), files}};
+  return manifest.write(QJsonDocument(contents).toJson(QJsonDocument::Compact)) != -1;
+}
+
+void DUChain::checkpoint() {
+  sdDUChainPrivate->checkpoint();
+}
+
+DUChain::CheckpointStatistics DUChain::checkpointStatistics() const
+{
+  QMutexLocker lock(&sdDUChainPrivate->m_checkpointStatisticsMutex);
+  return sdDUChainPrivate->m_checkpointStatistics;
+}
+
+void DUChain::resetCheckpointStatistics()
+{
+  QMutexLocker lock(&sdDUChainPrivate->m_checkpointStatisticsMutex);
+  sdDUChainPrivate->m_checkpointStatistics = {};
+}
+
 bool DUChain::compareToDisk() {
 
   DUChainWriteLocker writeLock(DUChain::lock());
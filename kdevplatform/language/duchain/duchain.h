@@ -247,6 +247,40 @@ public:
   ///Stores the whole duchain and all its repositories in the current state to disk
   ///The duchain must not be locked in any way
   void storeToDisk();
+
+  ///Stores the duchain and copies it to @p path, so a new session imports it when KDEV_DUCHAIN_IMPORT_DIR points there.
+  ///The content of every file the duchain was built from is recorded by its path relative to @p root, so the
+  ///imported top-contexts are valid for the files that did not change, whatever their modification time is.
+  ///@p root itself is recorded relative to @p path, KDEV_DUCHAIN_IMPORT_ROOT overrides it in the importing session.
+  ///The duchain must not be locked in any way
+  ///@returns false if storing the copy failed
+  bool exportCache(const QString& path, const QString& root);
+
+  struct CheckpointStatistics
+  {
+    quint64 checkpoints = 0;
+    /// Time slices during which the duchain was write-locked
+    quint64 slices = 0;
+    quint64 storedContexts = 0;
+    /// Contexts skipped because they were being parsed
+    quint64 skippedContexts = 0;
+    quint64 totalPauseUs = 0;
+    quint64 maxPauseUs = 0;
+    /// Time spent writing the stored contexts, without holding the duchain lock
+    quint64 totalWriteUs = 0;
+    /// Progress of the running checkpoint; both are zero when none is running
+    int checkedContexts = 0;
+    int totalContexts = 0;
+  };
+
+  ///Writes the changed loaded top-contexts to disk without stopping the parsing. The duchain is only
+  ///write-locked for short time-slices, so the periodic cleanup has little left to store.
+  ///The duchain must not be locked in any way
+  void checkpoint();
+
+  CheckpointStatistics checkpointStatistics() const;
+
+  void resetCheckpointStatistics();
   
   ///Compares the whole duchain and all its repositories in the current state to disk
   ///When the comparison fails, debug-output will show why
@@ -22,16 +22,13 @@
 #include "duchainlock.h"
 #include "duchain.h"
 
+#include <QCoreApplication>
+#include <QMutex>
 #include <QThread>
 #include <QThreadStorage>
 #include <QElapsedTimer>
-
-
-///@todo Always prefer exactly that lock that is requested by the thread that has the foreground mutex,
-///           to reduce the amount of UI blocking.
-
-//Microseconds to sleep when waiting for a lock
-const uint uSleepTime = 500;
+#include <QVector>
+#include <QWaitCondition>
 
 namespace KDevelop
 {
@@ -42,30 +39,116 @@ public:
   DUChainLockPrivate()
     : m_writer(nullptr)
     , m_writerRecursion(0)
-    , m_totalReaderRecursion(0)
+    , m_readers(0)
+    , m_waitingReaders(0)
+    , m_waitingForegroundReaders(0)
+    , m_waitingForegroundWriters(0)
+    , m_writePhase(0)
+    , m_pendingReaderHandoff(0)
   { }
 
-  int ownReaderRecursion() const
+  static bool isForeground(QThread* thread)
   {
-    return m_readerRecursion.localData();
+    const QCoreApplication* app = QCoreApplication::instance();
+    return app && app->thread() == thread;
   }
 
-  void changeOwnReaderRecursion(int difference)
+  /**
+   * Whether @p self may enter as a reader right now. Must be called with m_mutex held.
+   *
+   * Background readers queue up behind waiting writers, unless they already waited
+   * through a complete write phase. The foreground thread only waits for an active writer.
+   */
+  bool canRead(QThread* self, bool foreground, uint startPhase) const
   {
-    m_readerRecursion.localData() += difference;
-    Q_ASSERT(m_readerRecursion.localData() >= 0);
-    m_totalReaderRecursion.fetchAndAddOrdered(difference);
+    QThread* writer = m_writer.load();
+    if (writer == self) {
+      return true;
+    }
+    if (writer) {
+      return false;
+    }
+    if (foreground) {
+      return true;
+    }
+    if (m_waitingForegroundWriters) {
+      return false;
+    }
+    return m_writerQueue.isEmpty() || m_writePhase != startPhase;
   }
 
-  ///Holds the writer that currently has the write-lock, or zero. Is protected by m_writerRecursion.
-  QAtomicPointer<QThread> m_writer;
+  /**
+   * Whether @p self may take the write lock right now. Must be called with m_mutex held.
+   *
+   * Background writers are served in FIFO order, after the foreground thread and after
+   * the readers that were waiting when the last writer released the lock.
+   */
+  bool canWrite(QThread* self, bool foreground) const
+  {
+    if (m_writer.load() || m_readers) {
+      return false;
+    }
+    if (foreground) {
+      return true;
+    }
+    return !m_waitingForegroundReaders && !m_waitingForegroundWriters && !m_pendingReaderHandoff
+        && m_writerQueue.first() == self;
+  }
+
+  bool waitForCondition(const QElapsedTimer& timer, unsigned int timeout)
+  {
+    if (!timeout) {
+      return m_wait.wait(&m_mutex);
+    }
+    const qint64 remaining = timeout - timer.elapsed();
+    if (remaining <= 0) {
+      return false;
+    }
+    m_wait.wait(&m_mutex, remaining);
+    return true;
+  }
+
+  void wakeWaiters()
+  {
+    if (m_waitingReaders || m_waitingForegroundWriters || !m_writerQueue.isEmpty()) {
+      m_wait.wakeAll();
+    }
+  }
+
+  static void recordWait(quint64* total, quint64* max, qint64 waitedNs)
+  {
+    const quint64 waitedUs = waitedNs / 1000;
+    *total += waitedUs;
+    *max = qMax(*max, waitedUs);
+  }
 
-  ///How often is the chain write-locked by the writer? This value protects m_writer,
-  ///m_writer may only be changed by the thread that successfully increases this value from 0 to 1
-  QAtomicInt m_writerRecursion;
-  ///How often is the chain read-locked recursively by all readers? Should be sum of all m_readerRecursion values
-  QAtomicInt m_totalReaderRecursion;
+  ///Protects all members below, except for m_writer, m_writerRecursion and m_readerRecursion
+  QMutex m_mutex;
+  QWaitCondition m_wait;
 
+  ///Holds the writer that currently has the write-lock, or zero. Only changed with m_mutex held.
+  QAtomicPointer<QThread> m_writer;
+  ///How often is the chain write-locked by the writer? Only touched by the writer itself.
+  int m_writerRecursion;
+  ///How many threads currently hold at least one read-lock
+  int m_readers;
+
+  int m_waitingReaders;
+  int m_waitingForegroundReaders;
+  int m_waitingForegroundWriters;
+  ///Waiting background writers, in arrival order
+  QVector<QThread*> m_writerQueue;
+
+  ///Incremented whenever a writer releases the lock
+  uint m_writePhase;
+  ///Readers that were waiting when the last writer released the lock, and that are let in before the next background writer
+  int m_pendingReaderHandoff;
+  ///Incremented with m_mutex held whenever the last reader or the writer releases the lock, read without it
+  QAtomicInt m_quiescentGeneration;
+
+  DUChainLock::Statistics m_statistics;
+
+  ///Recursion depth of the read-lock held by the current thread
   QThreadStorage<int> m_readerRecursion;
 };
 
@@ -78,104 +161,168 @@ DUChainLock::~DUChainLock() = default;
 
 bool DUChainLock::lockForRead(unsigned int timeout)
 {
-  ///Step 1: Increase the own reader-recursion. This will make sure no further write-locks will succeed
-  d->changeOwnReaderRecursion(1);
+  int& ownRecursion = d->m_readerRecursion.localData();
+  if (ownRecursion) {
+    //Recursive read-locks never block, else a waiting writer could dead-lock us
+    ++ownRecursion;
+    return true;
+  }
 
-  QThread* w = d->m_writer.loadAcquire();
-  if (w == nullptr || w == QThread::currentThread()) {
-    //Successful lock: Either there is no writer, or we hold the write-lock by ourselves
-  } else {
-    ///Step 2: Start spinning until there is no writer any more
+  QThread* const self = QThread::currentThread();
+  const bool foreground = DUChainLockPrivate::isForeground(self);
+
+  QMutexLocker lock(&d->m_mutex);
+  ++d->m_statistics.readLocks;
+
+  const uint startPhase = d->m_writePhase;
+  if (!d->canRead(self, foreground, startPhase)) {
+    ++d->m_statistics.contendedReadLocks;
 
     QElapsedTimer t;
-    if (timeout) {
-      t.start();
+    t.start();
+
+    ++d->m_waitingReaders;
+    if (foreground) {
+      ++d->m_waitingForegroundReaders;
     }
 
-    while (d->m_writer.loadAcquire()) {
-      if (!timeout || t.elapsed() < timeout) {
-        QThread::usleep(uSleepTime);
-      } else {
-        //Fail!
-        d->changeOwnReaderRecursion(-1);
-        qWarning() << Q_FUNC_INFO << "timed out after" << t.elapsed()/1000.0 << "seconds";
-        return false;
+    bool success = true;
+    while (!d->canRead(self, foreground, startPhase)) {
+      if (!d->waitForCondition(t, timeout)) {
+        success = false;
+        break;
       }
     }
+
+    --d->m_waitingReaders;
+    if (foreground) {
+      --d->m_waitingForegroundReaders;
+    }
+    if (d->m_pendingReaderHandoff && d->m_writePhase != startPhase) {
+      --d->m_pendingReaderHandoff;
+    }
+    DUChainLockPrivate::recordWait(&d->m_statistics.totalReadWaitUs, &d->m_statistics.maxReadWaitUs, t.nsecsElapsed());
+
+    if (!success) {
+      ++d->m_statistics.timeouts;
+      //We may have been holding back writers
+      d->wakeWaiters();
+      qWarning() << Q_FUNC_INFO << "timed out after" << t.elapsed()/1000.0 << "seconds";
+      return false;
+    }
   }
 
+  ++d->m_readers;
+  ownRecursion = 1;
   return true;
 }
 
 void DUChainLock::releaseReadLock()
 {
-  d->changeOwnReaderRecursion(-1);
+  int& ownRecursion = d->m_readerRecursion.localData();
+  Q_ASSERT(ownRecursion > 0);
+  if (--ownRecursion) {
+    return;
+  }
+
+  QMutexLocker lock(&d->m_mutex);
+  --d->m_readers;
+  Q_ASSERT(d->m_readers >= 0);
+  if (!d->m_readers) {
+    if (!d->m_writer.load()) {
+      d->m_quiescentGeneration.fetchAndAddOrdered(1);
+    }
+    d->wakeWaiters();
+  }
 }
 
 bool DUChainLock::currentThreadHasReadLock()
 {
-  return (bool)d->ownReaderRecursion();
+  return (bool)d->m_readerRecursion.localData();
 }
 
 bool DUChainLock::lockForWrite(uint timeout)
 {
   //It is not allowed to acquire a write-lock while holding read-lock
 
-  Q_ASSERT(d->ownReaderRecursion() == 0);
-  if (d->ownReaderRecursion() != 0) {
+  Q_ASSERT(d->m_readerRecursion.localData() == 0);
+  if (d->m_readerRecursion.localData() != 0) {
     return false;
   }
-  if (d->m_writer.load() == QThread::currentThread()) {
+
+  QThread* const self = QThread::currentThread();
+  if (d->m_writer.load() == self) {
     //We already hold the write lock, just increase the recursion count and return
-    d->m_writerRecursion.fetchAndAddRelaxed(1);
+    ++d->m_writerRecursion;
     return true;
   }
 
-  QElapsedTimer t;
-  if (timeout) {
-    t.start();
+  const bool foreground = DUChainLockPrivate::isForeground(self);
+
+  QMutexLocker lock(&d->m_mutex);
+  ++d->m_statistics.writeLocks;
+
+  if (foreground) {
+    ++d->m_waitingForegroundWriters;
+  } else {
+    d->m_writerQueue.append(self);
   }
 
-  while (1) {
-    //Try acquiring the write-lcok
-    if (d->m_totalReaderRecursion.load() == 0 && d->m_writerRecursion.testAndSetOrdered(0, 1)) {
-      //Now we can be sure that there is no other writer, as we have increased m_writerRecursion from 0 to 1
-      d->m_writer = QThread::currentThread();
-      if (d->m_totalReaderRecursion.load() == 0) {
-        //There is still no readers, we have successfully acquired a write-lock
-        return true;
-      } else {
-        //There may be readers.. we have to continue spinning
-        d->m_writer = nullptr;
-        d->m_writerRecursion = 0;
+  bool success = true;
+  if (!d->canWrite(self, foreground)) {
+    ++d->m_statistics.contendedWriteLocks;
+
+    QElapsedTimer t;
+    t.start();
+
+    while (!d->canWrite(self, foreground)) {
+      if (!d->waitForCondition(t, timeout)) {
+        success = false;
+        break;
       }
     }
 
-    if (!timeout || t.elapsed() < timeout) {
-      QThread::usleep(uSleepTime);
-    } else {
-      //Fail!
+    DUChainLockPrivate::recordWait(&d->m_statistics.totalWriteWaitUs, &d->m_statistics.maxWriteWaitUs, t.nsecsElapsed());
+    if (!success) {
+      ++d->m_statistics.timeouts;
       qWarning() << Q_FUNC_INFO << "timed out after" << t.elapsed()/1000.0 << "seconds";
-      return false;
     }
   }
 
-  return false;
+  if (foreground) {
+    --d->m_waitingForegroundWriters;
+  } else {
+    d->m_writerQueue.removeOne(self);
+  }
+
+  if (!success) {
+    //The queue has changed, or we were holding back others as foreground thread
+    d->wakeWaiters();
+    return false;
+  }
+
+  d->m_writerRecursion = 1;
+  d->m_writer.storeRelease(self);
+  return true;
 }
 
 void DUChainLock::releaseWriteLock()
 {
   Q_ASSERT(currentThreadHasWriteLock());
 
-  //The order is important here, m_writerRecursion protects m_writer
+  if (--d->m_writerRecursion) {
+    return;
+  }
 
-  //TODO: could testAndSet here
-  if (d->m_writerRecursion.load() == 1) {
-    d->m_writer = nullptr;
-    d->m_writerRecursion = 0;
-  } else {
-    d->m_writerRecursion.fetchAndAddOrdered(-1);
+  QMutexLocker lock(&d->m_mutex);
+  d->m_writer.storeRelease(nullptr);
+  if (!d->m_readers) {
+    d->m_quiescentGeneration.fetchAndAddOrdered(1);
   }
+  //Hand the lock over to the readers that queued up during this write phase before letting in the next writer
+  ++d->m_writePhase;
+  d->m_pendingReaderHandoff = d->m_waitingReaders;
+  d->wakeWaiters();
 }
 
 bool DUChainLock::currentThreadHasWriteLock()
@@ -183,6 +330,23 @@ bool DUChainLock::currentThreadHasWriteLock()
   return d->m_writer.load() == QThread::currentThread();
 }
 
+uint DUChainLock::quiescentGeneration() const
+{
+  return d->m_quiescentGeneration.loadAcquire();
+}
+
+DUChainLock::Statistics DUChainLock::statistics() const
+{
+  QMutexLocker lock(&d->m_mutex);
+  return d->m_statistics;
+}
+
+void DUChainLock::resetStatistics()
+{
+  QMutexLocker lock(&d->m_mutex);
+  d->m_statistics = {};
+}
+
 DUChainReadLocker::DUChainReadLocker(DUChainLock* duChainLock, uint timeout)
   : m_lock(duChainLock ? duChainLock : DUChain::lock())
   , m_locked(false)
@@ -21,6 +21,7 @@
 
 #include <language/languageexport.h>
 #include <QScopedPointer>
+#include <QtGlobal>
 
 namespace KDevelop
 {
@@ -46,10 +47,33 @@ namespace KDevelop
 
 /**
  * Customized read/write locker for the definition-use chain.
+ *
+ * Waiting threads block instead of spinning. Background writers are served in
+ * arrival order, and readers that queued up while a writer held the lock are let in
+ * before the next writer, so neither side can starve the other.
+ * The thread that owns the QCoreApplication instance gets priority: while it waits,
+ * no background writer may take the lock.
  */
 class KDEVPLATFORMLANGUAGE_EXPORT DUChainLock
 {
 public:
+  /**
+   * Contention counters, only counting non-recursive lock requests.
+   * Wait times are given in microseconds.
+   */
+  struct Statistics
+  {
+    quint64 readLocks = 0;
+    quint64 writeLocks = 0;
+    quint64 contendedReadLocks = 0;
+    quint64 contendedWriteLocks = 0;
+    quint64 timeouts = 0;
+    quint64 totalReadWaitUs = 0;
+    quint64 totalWriteWaitUs = 0;
+    quint64 maxReadWaitUs = 0;
+    quint64 maxWriteWaitUs = 0;
+  };
+
   /// Constructor.
   DUChainLock();
   /// Destructor.
@@ -100,6 +124,24 @@ public:
    */
   bool currentThreadHasWriteLock();
 
+  /**
+   * Incremented whenever no thread holds the lock anymore, neither for reading nor for writing.
+   *
+   * Data that readers may still reference after it was unlinked while holding a read lock
+   * can be freed once this changed, as all those readers have released the lock since then.
+   */
+  uint quiescentGeneration() const;
+
+  /**
+   * Returns a snapshot of the contention counters.
+   */
+  Statistics statistics() const;
+
+  /**
+   * Resets all contention counters to zero.
+   */
+  void resetStatistics();
+
 private:
   const QScopedPointer<class DUChainLockPrivate> d;
 };
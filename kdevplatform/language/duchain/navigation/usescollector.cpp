@@ -22,6 +22,7 @@
 #include <language/duchain/parsingenvironment.h>
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/duchain.h>
+#include <language/duchain/uses.h>
 #include <interfaces/iprojectcontroller.h>
 #include <interfaces/idocumentcontroller.h>
 #include <language/duchain/duchainutils.h>
@@ -243,9 +244,28 @@ void UsesCollector::startCollecting() {
         {
           QSet<ParsingEnvironmentFile*> filteredCollected;
           QMap<IndexedString, bool> grepCache;
+          uint indexedFiles = 0;
           // Filter the collected files by performing a grep
           foreach(ParsingEnvironmentFile* file, collected)
           {
+            // Up to date files that were parsed with uses are looked up in the uses index instead,
+            // without loading their top-context or reading the file
+            const IndexedTopDUContext top = file->indexedTopContext();
+            if((file->features() & TopDUContext::AllDeclarationsContextsAndUses) == TopDUContext::AllDeclarationsContextsAndUses
+                && !m_declarationTopContexts.contains(top) && !file->needsUpdate())
+            {
+              ++indexedFiles;
+              foreach(const IndexedDeclaration& indexed, m_declarations) {
+                Declaration* declaration = indexed.data();
+                if(declaration && (!DUChain::uses()->useRanges(declaration->id(), top).isEmpty()
+                                   || !DUChain::uses()->useRanges(declaration->id(true), top).isEmpty())) {
+                  filteredCollected << file;
+                  break;
+                }
+              }
+              continue;
+            }
+
             IndexedString url = file->url();
             QMap< IndexedString, bool >::iterator grepCacheIt = grepCache.find(url);
             if(grepCacheIt == grepCache.end())
@@ -260,7 +280,8 @@ void UsesCollector::startCollecting() {
             if(grepCacheIt.value())
               filteredCollected << file;
           }
-          qCDebug(LANGUAGE) << "Collected contexts for full re-parse, before filtering: " << collected.size() << " after filtering: " << filteredCollected.size();
+          qCDebug(LANGUAGE) << "Collected contexts for full re-parse, before filtering: " << collected.size() << " after filtering: " << filteredCollected.size()
+                            << " filtered through the uses index: " << indexedFiles;
           collected = filteredCollected;
         }
 
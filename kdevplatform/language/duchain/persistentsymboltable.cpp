@@ -19,6 +19,11 @@
 #include "persistentsymboltable.h"
 
 #include <QHash>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+
+#include <algorithm>
+#include <atomic>
 
 #include "declaration.h"
 #include "declarationid.h"
@@ -34,6 +39,11 @@
 //For now, just _always_ use the cache
 const uint MinimumCountForCache = 1;
 
+//Upper bound for the count of declarations held by the filtered-declarations cache, about 16MB
+const uint MaximumCachedDeclarations = 2 * 1024 * 1024;
+//Upper bound for the count of cached import sets
+const uint MaximumCachedImports = 4096;
+
 namespace {
 QDebug fromTextStream(const QTextStream& out) { if (out.device()) return {out.device()}; return {out.string()}; }
 }
@@ -119,29 +129,145 @@ class PersistentSymbolTableRequestItem {
   const PersistentSymbolTableItem& m_item;
 };
 
-template<class ValueType>
-struct CacheEntry {
-  
-  typedef KDevVarLengthArray<ValueType> Data;
-  typedef QHash<TopDUContext::IndexedRecursiveImports, Data > DataHash;
-  
-  DataHash m_hash;
+///The declarations of one identifier filtered by one visibility set
+struct CachedDeclarations {
+  KDevVarLengthArray<IndexedDeclaration> data;
+  ///Value of PersistentSymbolTablePrivate::m_useTick when this entry was last used
+  std::atomic<uint> lastUse{0};
+};
+
+struct CachedImports {
+  explicit CachedImports(const PersistentSymbolTable::CachedIndexedRecursiveImports& _imports) : imports(_imports) {
+  }
+  PersistentSymbolTable::CachedIndexedRecursiveImports imports;
+  std::atomic<uint> lastUse{0};
 };
 
+typedef QSharedPointer<CachedDeclarations> CachedDeclarationsPtr;
+typedef QSharedPointer<CachedImports> CachedImportsPtr;
+
 class PersistentSymbolTablePrivate
 {
 public:
 
   PersistentSymbolTablePrivate() : m_declarations(QStringLiteral("Persistent Declaration Table")) {
   }
+
+  ///Returns the declarations stored for @p id, the repository mutex must be locked
+  PersistentSymbolTable::Declarations declarations(const IndexedQualifiedIdentifier& id) {
+    PersistentSymbolTableItem item;
+    item.id = id;
+
+    uint index = m_declarations.findIndex(item);
+
+    if(index) {
+      const PersistentSymbolTableItem* repositoryItem = m_declarations.itemFromIndex(index);
+      return PersistentSymbolTable::Declarations(repositoryItem->declarations(), repositoryItem->declarationsSize(), repositoryItem->centralFreeItem);
+    }else{
+      return PersistentSymbolTable::Declarations();
+    }
+  }
+
+  uint nextUse() {
+    return m_useTick.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  ///Removes all cached entries for @p id. m_cacheLock must be write-locked, and the duchain write-locked
+  void removeCachedDeclarations(const IndexedQualifiedIdentifier& id) {
+    auto it = m_declarationsCache.find(id);
+    if(it == m_declarationsCache.end())
+      return;
+    for(const auto& entry : *it)
+      evict(entry);
+    m_declarationsCache.erase(it);
+  }
+
+  ///Unlinks @p entry from the cache accounting and keeps it alive until freeEvicted() may delete it.
+  ///Iterators handed out by filteredDeclarations() may still point into the entry, also on the thread
+  ///that holds the duchain write lock. m_cacheLock must be write-locked.
+  void evict(const CachedDeclarationsPtr& entry) {
+    m_cachedDeclarationCount -= entry->data.size();
+    m_evicted.append(qMakePair(DUChain::lock()->quiescentGeneration(), entry));
+  }
+
+  ///Deletes the evicted entries that no iterator can point into anymore. m_cacheLock must be write-locked.
+  void freeEvicted() {
+    if(m_evicted.isEmpty())
+      return;
+    const uint generation = DUChain::lock()->quiescentGeneration();
+    m_evicted.erase(std::remove_if(m_evicted.begin(), m_evicted.end(), [generation](const QPair<uint, CachedDeclarationsPtr>& evicted) {
+      return evicted.first != generation;
+    }), m_evicted.end());
+  }
+
+  ///Evicts the least recently used entries until the caches are at 3/4 of their maximum size.
+  ///m_cacheLock must be write-locked.
+  void evictLeastRecentlyUsed() {
+    const uint now = m_useTick.load(std::memory_order_relaxed);
+
+    if(m_cachedDeclarationCount > MaximumCachedDeclarations) {
+      struct Candidate {
+        uint age;
+        IndexedQualifiedIdentifier id;
+        TopDUContext::IndexedRecursiveImports visibility;
+      };
+      QVector<Candidate> candidates;
+      for(auto it = m_declarationsCache.constBegin(); it != m_declarationsCache.constEnd(); ++it)
+        for(auto entryIt = it->constBegin(); entryIt != it->constEnd(); ++entryIt)
+          candidates.append(Candidate{now - (*entryIt)->lastUse.load(std::memory_order_relaxed), it.key(), entryIt.key()});
+      std::sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.age > rhs.age;
+      });
+
+      for(const Candidate& candidate : candidates) {
+        if(m_cachedDeclarationCount <= MaximumCachedDeclarations / 4 * 3)
+          break;
+        auto it = m_declarationsCache.find(candidate.id);
+        CachedDeclarationsPtr entry = it->take(candidate.visibility);
+        if(it->isEmpty())
+          m_declarationsCache.erase(it);
+        evict(entry);
+        ++m_evictions;
+      }
+    }
+
+    if(uint(m_importsCache.size()) > MaximumCachedImports) {
+      QVector<QPair<uint, TopDUContext::IndexedRecursiveImports>> candidates;
+      candidates.reserve(m_importsCache.size());
+      for(auto it = m_importsCache.constBegin(); it != m_importsCache.constEnd(); ++it)
+        candidates.append(qMakePair(now - (*it)->lastUse.load(std::memory_order_relaxed), it.key()));
+      std::sort(candidates.begin(), candidates.end(), [](const QPair<uint, TopDUContext::IndexedRecursiveImports>& lhs,
+                                                         const QPair<uint, TopDUContext::IndexedRecursiveImports>& rhs) {
+        return lhs.first > rhs.first;
+      });
+      //The iterators hold their own reference to the imports, so these can be removed right away
+      for(int a = 0, count = m_importsCache.size() - MaximumCachedImports / 4 * 3; a < count; ++a) {
+        m_importsCache.remove(candidates.at(a).second);
+        ++m_evictions;
+      }
+    }
+  }
+
   //Maps declaration-ids to declarations
   ItemRepository<PersistentSymbolTableItem, PersistentSymbolTableRequestItem, true, false> m_declarations;
-  
-  
-  QHash<IndexedQualifiedIdentifier, CacheEntry<IndexedDeclaration> > m_declarationsCache;
-  
+
+  //Protects the caches below. Lookups that hit the cache only take it for reading, so they do not serialize
+  //on the repository mutex. When both are needed, the repository mutex has to be locked first.
+  mutable QReadWriteLock m_cacheLock;
+
+  QHash<IndexedQualifiedIdentifier, QHash<TopDUContext::IndexedRecursiveImports, CachedDeclarationsPtr> > m_declarationsCache;
+  uint m_cachedDeclarationCount = 0;
+  //Evicted entries with the quiescent generation of the duchain lock at their eviction. They are deleted
+  //once the generation changed, as no iterators into them can be alive then
+  QVector<QPair<uint, CachedDeclarationsPtr>> m_evicted;
+
   //We cache the imports so the currently used nodes are very close in memory, which leads to much better CPU cache utilization
-  QHash<TopDUContext::IndexedRecursiveImports, PersistentSymbolTable::CachedIndexedRecursiveImports> m_importsCache;
+  QHash<TopDUContext::IndexedRecursiveImports, CachedImportsPtr> m_importsCache;
+
+  std::atomic<uint> m_useTick{0};
+  std::atomic<quint64> m_hits{0};
+  std::atomic<quint64> m_misses{0};
+  quint64 m_evictions = 0;
 };
 
 void PersistentSymbolTable::clearCache()
@@ -149,11 +275,36 @@ void PersistentSymbolTable::clearCache()
   ENSURE_CHAIN_WRITE_LOCKED
   {
     QMutexLocker lock(d->m_declarations.mutex());
+    QWriteLocker cacheLock(&d->m_cacheLock);
     d->m_importsCache.clear();
+    for(auto it = d->m_declarationsCache.constBegin(); it != d->m_declarationsCache.constEnd(); ++it)
+      for(const auto& entry : *it)
+        d->evict(entry);
     d->m_declarationsCache.clear();
+    d->freeEvicted();
   }
 }
 
+PersistentSymbolTable::CacheStatistics PersistentSymbolTable::cacheStatistics() const
+{
+  QReadLocker lock(&d->m_cacheLock);
+  CacheStatistics ret;
+  ret.hits = d->m_hits.load();
+  ret.misses = d->m_misses.load();
+  ret.evictions = d->m_evictions;
+  ret.cachedDeclarations = d->m_cachedDeclarationCount;
+  ret.cachedImports = d->m_importsCache.size();
+  return ret;
+}
+
+void PersistentSymbolTable::resetCacheStatistics()
+{
+  QWriteLocker lock(&d->m_cacheLock);
+  d->m_hits = 0;
+  d->m_misses = 0;
+  d->m_evictions = 0;
+}
+
 PersistentSymbolTable::PersistentSymbolTable() : d(new PersistentSymbolTablePrivate())
 {
 }
@@ -171,7 +322,11 @@ void PersistentSymbolTable::addDeclaration(const IndexedQualifiedIdentifier& id,
   QMutexLocker lock(d->m_declarations.mutex());
   ENSURE_CHAIN_WRITE_LOCKED
   
-  d->m_declarationsCache.remove(id);
+  {
+    QWriteLocker cacheLock(&d->m_cacheLock);
+    d->removeCachedDeclarations(id);
+    d->freeEvicted();
+  }
   
   PersistentSymbolTableItem item;
   item.id = id;
@@ -217,8 +372,12 @@ void PersistentSymbolTable::removeDeclaration(const IndexedQualifiedIdentifier&
   QMutexLocker lock(d->m_declarations.mutex());
   ENSURE_CHAIN_WRITE_LOCKED
   
-  d->m_declarationsCache.remove(id);
-  Q_ASSERT(!d->m_declarationsCache.contains(id));
+  {
+    QWriteLocker cacheLock(&d->m_cacheLock);
+    d->removeCachedDeclarations(id);
+    Q_ASSERT(!d->m_declarationsCache.contains(id));
+    d->freeEvicted();
+  }
   
   PersistentSymbolTableItem item;
   item.id = id;
@@ -272,41 +431,80 @@ struct DeclarationCacheVisitor {
 
 PersistentSymbolTable::FilteredDeclarationIterator PersistentSymbolTable::filteredDeclarations(const IndexedQualifiedIdentifier& id, const TopDUContext::IndexedRecursiveImports& visibility) const {
   
-  QMutexLocker lock(d->m_declarations.mutex());
   ENSURE_CHAIN_READ_LOCKED
   
-  Declarations decls = declarations(id).iterator();
+  //Fast path: everything is cached, the repository is not needed at all
+  {
+    QReadLocker cacheLock(&d->m_cacheLock);
+    auto importsIt = d->m_importsCache.constFind(visibility);
+    auto declarationsIt = d->m_declarationsCache.constFind(id);
+    if(importsIt != d->m_importsCache.constEnd() && declarationsIt != d->m_declarationsCache.constEnd()) {
+      auto cacheIt = declarationsIt->constFind(visibility);
+      if(cacheIt != declarationsIt->constEnd()) {
+        const uint use = d->nextUse();
+        (*importsIt)->lastUse.store(use, std::memory_order_relaxed);
+        (*cacheIt)->lastUse.store(use, std::memory_order_relaxed);
+        ++d->m_hits;
+        const KDevVarLengthArray<IndexedDeclaration>& cache((*cacheIt)->data);
+        return FilteredDeclarationIterator(Declarations::Iterator(cache.constData(), cache.size(), -1), (*importsIt)->imports);
+      }
+    }
+  }
+  
+  ++d->m_misses;
+  
+  QMutexLocker lock(d->m_declarations.mutex());
+  
+  Declarations decls = d->declarations(id).iterator();
   
   CachedIndexedRecursiveImports cachedImports;
+  bool haveImports = false;
   
-  QHash<TopDUContext::IndexedRecursiveImports, CachedIndexedRecursiveImports>::const_iterator it = d->m_importsCache.constFind(visibility);
-  if(it != d->m_importsCache.constEnd()) {
-    cachedImports = *it;
-  }else{
-    cachedImports = CachedIndexedRecursiveImports(visibility.set().stdSet());
-    d->m_importsCache.insert(visibility, cachedImports);
+  {
+    QReadLocker cacheLock(&d->m_cacheLock);
+    auto it = d->m_importsCache.constFind(visibility);
+    if(it != d->m_importsCache.constEnd()) {
+      cachedImports = (*it)->imports;
+      (*it)->lastUse.store(d->nextUse(), std::memory_order_relaxed);
+      haveImports = true;
+    }
+  }
+  
+  if(!haveImports) {
+    //Computed without the cache lock, another thread may have inserted the same set meanwhile
+    CachedIndexedRecursiveImports imports(visibility.set().stdSet());
+    QWriteLocker cacheLock(&d->m_cacheLock);
+    CachedImportsPtr& entry(d->m_importsCache[visibility]);
+    if(!entry)
+      entry = CachedImportsPtr(new CachedImports(imports));
+    cachedImports = entry->imports;
+    entry->lastUse.store(d->nextUse(), std::memory_order_relaxed);
+    d->freeEvicted();
   }
   
   if(decls.dataSize() > MinimumCountForCache)
   {
     //Do visibility caching
-    CacheEntry<IndexedDeclaration>& cached(d->m_declarationsCache[id]);
-    CacheEntry<IndexedDeclaration>::DataHash::const_iterator cacheIt = cached.m_hash.constFind(visibility);
-    if(cacheIt != cached.m_hash.constEnd())
-      return FilteredDeclarationIterator(Declarations::Iterator(cacheIt->constData(), cacheIt->size(), -1), cachedImports);
-
-    CacheEntry<IndexedDeclaration>::DataHash::iterator insertIt = cached.m_hash.insert(visibility, KDevVarLengthArray<IndexedDeclaration>());
-    
-    KDevVarLengthArray<IndexedDeclaration>& cache(*insertIt);
-    
-    {
+    QWriteLocker cacheLock(&d->m_cacheLock);
+    CachedDeclarationsPtr& cached(d->m_declarationsCache[id][visibility]);
+    if(!cached) {
+      cached = CachedDeclarationsPtr(new CachedDeclarations);
+      
       typedef ConvenientEmbeddedSetTreeFilterVisitor<IndexedDeclaration, IndexedDeclarationHandler, IndexedTopDUContext, CachedIndexedRecursiveImports, DeclarationTopContextExtractor, DeclarationCacheVisitor> FilteredDeclarationCacheVisitor;
     
       //The visitor visits all the declarations from within its constructor
-      DeclarationCacheVisitor v(cache);
+      DeclarationCacheVisitor v(cached->data);
       FilteredDeclarationCacheVisitor visitor(v, decls.iterator(), cachedImports);
+      d->m_cachedDeclarationCount += cached->data.size();
     }
+    cached->lastUse.store(d->nextUse(), std::memory_order_relaxed);
+    
+    //Keep the entry alive across the eviction, evicted entries are deleted later on
+    const CachedDeclarationsPtr entry = cached;
+    d->freeEvicted();
+    d->evictLeastRecentlyUsed();
     
+    const KDevVarLengthArray<IndexedDeclaration>& cache(entry->data);
     return FilteredDeclarationIterator(Declarations::Iterator(cache.constData(), cache.size(), -1), cachedImports, true);
   }else{
     return FilteredDeclarationIterator(decls.iterator(), cachedImports);
@@ -317,17 +515,7 @@ PersistentSymbolTable::Declarations PersistentSymbolTable::declarations(const In
   QMutexLocker lock(d->m_declarations.mutex());
   ENSURE_CHAIN_READ_LOCKED
   
-  PersistentSymbolTableItem item;
-  item.id = id;
-  
-  uint index = d->m_declarations.findIndex(item);
-  
-  if(index) {
-    const PersistentSymbolTableItem* repositoryItem = d->m_declarations.itemFromIndex(index);
-    return PersistentSymbolTable::Declarations(repositoryItem->declarations(), repositoryItem->declarationsSize(), repositoryItem->centralFreeItem);
-  }else{
-    return PersistentSymbolTable::Declarations();
-  }
+  return d->declarations(id);
 }
 
 void PersistentSymbolTable::declarations(const IndexedQualifiedIdentifier& id, uint& countTarget, const IndexedDeclaration*& declarationsTarget) const
@@ -91,6 +91,20 @@ struct KDEVPLATFORMLANGUAGE_EXPORT RecursiveImportCacheRepository {
  * */
   class KDEVPLATFORMLANGUAGE_EXPORT PersistentSymbolTable {
     public:
+    /**
+     * Counters of the cache used by filteredDeclarations().
+     */
+    struct CacheStatistics
+    {
+      quint64 hits = 0;
+      quint64 misses = 0;
+      quint64 evictions = 0;
+      /// Count of declarations currently held by the cache
+      uint cachedDeclarations = 0;
+      /// Count of import sets currently held by the cache
+      uint cachedImports = 0;
+    };
+
     /// Constructor.
     PersistentSymbolTable();
     /// Destructor.
@@ -123,7 +137,8 @@ struct KDEVPLATFORMLANGUAGE_EXPORT RecursiveImportCacheRepository {
     
     typedef ConvenientEmbeddedSetTreeFilterIterator<IndexedDeclaration, IndexedDeclarationHandler, IndexedTopDUContext, CachedIndexedRecursiveImports, DeclarationTopContextExtractor> FilteredDeclarationIterator;
     ///Retrieves an iterator to all declarations of the given id, filtered by the visilibity given through @a visibility
-    ///This is very efficient since it uses a cache
+    ///This is very efficient since it uses a cache. Cache hits do not lock the repository, so lookups from
+    ///multiple threads run concurrently. The cache is bounded in size, least recently used entries are evicted.
     ///The returned iterator is valid as long as the duchain read lock is held
     FilteredDeclarationIterator filteredDeclarations(const IndexedQualifiedIdentifier& id, const TopDUContext::IndexedRecursiveImports& visibility) const;
 
@@ -135,6 +150,12 @@ struct KDEVPLATFORMLANGUAGE_EXPORT RecursiveImportCacheRepository {
     //Clears the internal cache. Should be called regularly to save memory
     //The duchain must be read-locked
     void clearCache();
+
+    ///Returns a snapshot of the cache counters
+    CacheStatistics cacheStatistics() const;
+
+    ///Resets the hit, miss and eviction counters to zero
+    void resetCacheStatistics();
     
     private:
       // cannot use QScopedPointer yet, see comment in ~PersistentSymbolTable()
@@ -40,6 +40,8 @@
 #include <language/duchain/duchainregister.h>
 #include <language/duchain/problem.h>
 #include <language/duchain/parsingenvironment.h>
+#include <language/duchain/uses.h>
+#include <language/backgroundparser/urlparselock.h>
 
 #include <language/codegen/coderepresentation.h>
 
@@ -51,6 +53,7 @@
 #include <algorithm>
 #include <iterator> // needed for std::insert_iterator on windows
 #include <QThread>
+#include <thread>
 
 //Extremely slow
 // #define TEST_NORMAL_IMPORTS
@@ -369,6 +372,69 @@ void TestDUChain::testSymbolTableValid() {
   PersistentSymbolTable::self().dump(QTextStream(stdout));
 }
 
+void TestDUChain::testSymbolTableCache() {
+  DUChainWriteLocker lock;
+  auto top = new TopDUContext(IndexedString(QStringLiteral("/test/symboltablecache")), {0, 0, INT_MAX, INT_MAX});
+  DUChain::self()->addDocumentChain(top);
+  top->updateImportsCache();
+
+  const IndexedQualifiedIdentifier id(QualifiedIdentifier(QStringLiteral("symbolTableCacheTest")));
+  const IndexedDeclaration first(top->ownIndex(), 1);
+  const IndexedDeclaration second(top->ownIndex(), 2);
+  // not visible from top
+  const IndexedDeclaration hidden(top->ownIndex() + 1000, 1);
+
+  PersistentSymbolTable& table = PersistentSymbolTable::self();
+  table.addDeclaration(id, first);
+  table.addDeclaration(id, second);
+  table.addDeclaration(id, hidden);
+  table.resetCacheStatistics();
+
+  auto visibleCount = [&]() {
+    uint count = 0;
+    for (auto it = table.filteredDeclarations(id, top->recursiveImportIndices()); it; ++it) {
+      ++count;
+    }
+    return count;
+  };
+
+  QCOMPARE(visibleCount(), 2u);
+  QCOMPARE(table.cacheStatistics().misses, quint64(1));
+  QCOMPARE(table.cacheStatistics().hits, quint64(0));
+  QCOMPARE(table.cacheStatistics().cachedDeclarations, 2u);
+
+  QCOMPARE(visibleCount(), 2u);
+  QCOMPARE(table.cacheStatistics().misses, quint64(1));
+  QCOMPARE(table.cacheStatistics().hits, quint64(1));
+
+  // modifying the table must invalidate the cached entries of the identifier
+  table.addDeclaration(id, IndexedDeclaration(top->ownIndex(), 3));
+  QCOMPARE(table.cacheStatistics().cachedDeclarations, 0u);
+  QCOMPARE(visibleCount(), 3u);
+  QCOMPARE(table.cacheStatistics().misses, quint64(2));
+
+  // the writer may still iterate an entry it invalidated itself
+  auto it = table.filteredDeclarations(id, top->recursiveImportIndices());
+  table.addDeclaration(id, IndexedDeclaration(top->ownIndex(), 4));
+  uint count = 0;
+  for (; it; ++it) {
+    QCOMPARE((*it).topContextIndex(), top->ownIndex());
+    ++count;
+  }
+  QCOMPARE(count, 3u);
+  table.removeDeclaration(id, IndexedDeclaration(top->ownIndex(), 4));
+
+  table.removeDeclaration(id, IndexedDeclaration(top->ownIndex(), 3));
+  table.removeDeclaration(id, hidden);
+  table.removeDeclaration(id, second);
+  table.removeDeclaration(id, first);
+  table.clearCache();
+  QCOMPARE(table.cacheStatistics().cachedDeclarations, 0u);
+  QCOMPARE(table.cacheStatistics().cachedImports, 0u);
+
+  DUChain::self()->removeDocumentChain(top);
+}
+
 void TestDUChain::testIndexedStrings() {
 
   int testCount  = 600000;
@@ -710,6 +776,73 @@ void TestDUChain::testLockForReadWrite()
   QVERIFY(threads.join(1000));
 }
 
+void TestDUChain::testLockStatistics()
+{
+  DUChainLock lock;
+  QVERIFY(lock.lockForWrite());
+  // recursive locking keeps working while holding the write lock
+  QVERIFY(lock.lockForWrite());
+  QVERIFY(lock.lockForRead());
+  QVERIFY(lock.currentThreadHasReadLock());
+  lock.releaseReadLock();
+  lock.releaseWriteLock();
+  QVERIFY(lock.currentThreadHasWriteLock());
+
+  class ReaderThread : public QThread
+  {
+  public:
+    explicit ReaderThread(DUChainLock* lock) : m_lock(lock) {}
+    void run() override
+    {
+      locked = m_lock->lockForRead(50);
+      if (locked) {
+        m_lock->releaseReadLock();
+      }
+    }
+    DUChainLock* m_lock;
+    bool locked = true;
+  };
+
+  ReaderThread reader(&lock);
+  reader.start();
+  QVERIFY(reader.wait(5000));
+  QVERIFY(!reader.locked);
+
+  lock.releaseWriteLock();
+  QVERIFY(!lock.currentThreadHasWriteLock());
+
+  const auto stats = lock.statistics();
+  QCOMPARE(stats.writeLocks, quint64(1));
+  QCOMPARE(stats.readLocks, quint64(2));
+  QCOMPARE(stats.contendedReadLocks, quint64(1));
+  QCOMPARE(stats.timeouts, quint64(1));
+  QVERIFY(stats.maxReadWaitUs >= 40000);
+
+  lock.resetStatistics();
+  QCOMPARE(lock.statistics().readLocks, quint64(0));
+}
+
+void TestDUChain::testLockQuiescentGeneration()
+{
+  DUChainLock lock;
+  const uint start = lock.quiescentGeneration();
+
+  QVERIFY(lock.lockForRead());
+  QVERIFY(lock.lockForRead());
+  lock.releaseReadLock();
+  QCOMPARE(lock.quiescentGeneration(), start);
+  lock.releaseReadLock();
+  QCOMPARE(lock.quiescentGeneration(), start + 1);
+
+  // a read lock taken by the writer does not make the lock quiescent
+  QVERIFY(lock.lockForWrite());
+  QVERIFY(lock.lockForRead());
+  lock.releaseReadLock();
+  QCOMPARE(lock.quiescentGeneration(), start + 1);
+  lock.releaseWriteLock();
+  QCOMPARE(lock.quiescentGeneration(), start + 2);
+}
+
 void TestDUChain::testProblemSerialization()
 {
   DUChain::self()->disablePersistentStorage(false);
@@ -787,6 +920,259 @@ void TestDUChain::testProblemSerialization()
   QVERIFY(parent->diagnostics().isEmpty());
 }
 
+void TestDUChain::testImportsSerialization()
+{
+  DUChain::self()->disablePersistentStorage(false);
+
+  const IndexedString importedUrl("/my/test/imported");
+  const IndexedString importerUrl("/my/test/importer");
+
+  uint importedIndex = 0;
+  uint importerIndex = 0;
+  {
+    DUChainWriteLocker lock;
+    auto imported = new TopDUContext(importedUrl, {}, new ParsingEnvironmentFile(importedUrl));
+    auto importer = new TopDUContext(importerUrl, {}, new ParsingEnvironmentFile(importerUrl));
+    DUChain::self()->addDocumentChain(imported);
+    DUChain::self()->addDocumentChain(importer);
+    importedIndex = imported->ownIndex();
+    importerIndex = importer->ownIndex();
+  }
+
+  // storing unloads the unreferenced top-contexts, so everything below is read back from disk
+  DUChain::self()->storeToDisk();
+  QVERIFY(!DUChain::self()->isInMemory(importedIndex));
+  QVERIFY(!DUChain::self()->isInMemory(importerIndex));
+
+  { // only the imports of the stored contexts change, which takes the metadata-only path
+    DUChainWriteLocker lock;
+    auto imported = DUChain::self()->chainForIndex(importedIndex);
+    auto importer = DUChain::self()->chainForIndex(importerIndex);
+    QVERIFY(imported);
+    QVERIFY(importer);
+    QVERIFY(imported->importers().isEmpty());
+    importer->addImportedParentContext(imported);
+  }
+
+  DUChain::self()->storeToDisk();
+  QVERIFY(!DUChain::self()->isInMemory(importedIndex));
+  QVERIFY(!DUChain::self()->isInMemory(importerIndex));
+
+  { // the newer metadata has to be applied when loading
+    DUChainWriteLocker lock;
+    auto imported = DUChain::self()->chainForIndex(importedIndex);
+    auto importer = DUChain::self()->chainForIndex(importerIndex);
+    QVERIFY(imported);
+    QVERIFY(importer);
+    QCOMPARE(imported->importers(), QVector<DUContext*>() << importer);
+    QCOMPARE(importer->importedParentContexts().size(), 1);
+    QCOMPARE(importer->importedParentContexts().first().context(nullptr), imported);
+
+    // now change both, the content and the imports
+    importer->removeImportedParentContext(imported);
+    importer->addProblem(ProblemPointer{new Problem});
+  }
+
+  DUChain::self()->storeToDisk();
+  QVERIFY(!DUChain::self()->isInMemory(importedIndex));
+  QVERIFY(!DUChain::self()->isInMemory(importerIndex));
+
+  {
+    DUChainWriteLocker lock;
+    auto imported = DUChain::self()->chainForIndex(importedIndex);
+    auto importer = DUChain::self()->chainForIndex(importerIndex);
+    QVERIFY(imported);
+    QVERIFY(importer);
+    QVERIFY(imported->importers().isEmpty());
+    QVERIFY(importer->importedParentContexts().isEmpty());
+    QCOMPARE(importer->problems().size(), 1);
+
+    DUChain::self()->removeDocumentChain(importer);
+    DUChain::self()->removeDocumentChain(imported);
+  }
+
+  DUChain::self()->disablePersistentStorage(true);
+}
+
+void TestDUChain::testCheckpoint()
+{
+  DUChain::self()->disablePersistentStorage(false);
+  DUChain::self()->resetCheckpointStatistics();
+
+  const IndexedString url("/my/test/checkpoint");
+  {
+    DUChainWriteLocker lock;
+    DUChain::self()->addDocumentChain(new TopDUContext(url, {}, new ParsingEnvironmentFile(url)));
+  }
+
+  DUChain::self()->checkpoint();
+
+  auto statistics = DUChain::self()->checkpointStatistics();
+  QCOMPARE(statistics.checkpoints, quint64(1));
+  QVERIFY(statistics.slices >= 1);
+  QVERIFY(statistics.storedContexts >= 1);
+  QCOMPARE(statistics.totalContexts, 0);
+  QVERIFY(statistics.maxPauseUs <= statistics.totalPauseUs);
+
+  {
+    DUChainReadLocker lock;
+    auto top = DUChain::self()->chainForDocument(url);
+    QVERIFY(top);
+    QVERIFY(top->isOnDisk());
+  }
+
+  // nothing changed since, so the next checkpoint has nothing to store
+  const auto stored = statistics.storedContexts;
+  DUChain::self()->checkpoint();
+  statistics = DUChain::self()->checkpointStatistics();
+  QCOMPARE(statistics.checkpoints, quint64(2));
+  QCOMPARE(statistics.storedContexts, stored);
+
+  // a document that is locked for parsing is left for a later checkpoint, without waiting for it
+  const IndexedString parsedUrl("/my/test/checkpoint_parsed");
+  {
+    DUChainWriteLocker lock;
+    DUChain::self()->addDocumentChain(new TopDUContext(parsedUrl, {}, new ParsingEnvironmentFile(parsedUrl)));
+  }
+  {
+    UrlParseLock urlLock(parsedUrl);
+    std::thread([] { DUChain::self()->checkpoint(); }).join();
+  }
+  statistics = DUChain::self()->checkpointStatistics();
+  QCOMPARE(statistics.skippedContexts, quint64(1));
+  {
+    DUChainReadLocker lock;
+    QVERIFY(!DUChain::self()->chainForDocument(parsedUrl)->isOnDisk());
+  }
+
+  DUChain::self()->checkpoint();
+  {
+    DUChainReadLocker lock;
+    QVERIFY(DUChain::self()->chainForDocument(parsedUrl)->isOnDisk());
+  }
+
+  DUChain::self()->storeToDisk();
+
+  {
+    DUChainWriteLocker lock;
+    DUChain::self()->removeDocumentChain(DUChain::self()->chainForDocument(url));
+    DUChain::self()->removeDocumentChain(DUChain::self()->chainForDocument(parsedUrl));
+  }
+
+  DUChain::self()->disablePersistentStorage(true);
+}
+
+void TestDUChain::testUsesIndex()
+{
+  DUChain::self()->disablePersistentStorage(false);
+
+  const IndexedString usedUrl("/my/test/used");
+  const IndexedString userUrl("/my/test/user");
+  DeclarationId id;
+  IndexedTopDUContext userIndex;
+
+  {
+    DUChainWriteLocker lock;
+    auto usedTop = new TopDUContext(usedUrl, {0, 0, 10, 0}, new ParsingEnvironmentFile(usedUrl));
+    DUChain::self()->addDocumentChain(usedTop);
+    auto declaration = new Declaration({0, 0, 0, 4}, usedTop);
+    declaration->setIdentifier(Identifier(QStringLiteral("used")));
+    id = declaration->id();
+
+    auto userTop = new TopDUContext(userUrl, {0, 0, 10, 0}, new ParsingEnvironmentFile(userUrl));
+    DUChain::self()->addDocumentChain(userTop);
+    userIndex = userTop->indexed();
+    userTop->addImportedParentContext(usedTop);
+    const int index = userTop->indexForUsedDeclaration(declaration);
+    userTop->createUse(index, {1, 0, 1, 4});
+    userTop->createUse(index, {3, 2, 3, 6});
+
+    // the ranges are indexed when the user is stored
+    QCOMPARE(DUChain::uses()->useCount(id), 0u);
+  }
+
+  // storing unloads the unreferenced top-contexts, the ranges are read from the index without loading the user again
+  DUChain::self()->storeToDisk();
+  QVERIFY(!DUChain::self()->isInMemory(userIndex.index()));
+
+  {
+    DUChainReadLocker lock;
+    QCOMPARE(DUChain::uses()->useCount(id), 2u);
+    QCOMPARE(DUChain::uses()->useRanges(id, userIndex), (QVector<RangeInRevision>{{1, 0, 1, 4}, {3, 2, 3, 6}}));
+  }
+  QVERIFY(!DUChain::self()->isInMemory(userIndex.index()));
+
+  {
+    DUChainWriteLocker lock;
+    auto userTop = DUChain::self()->chainForDocument(userUrl);
+
+    // removing the uses removes them from the index as well
+    userTop->deleteUsesRecursively();
+    QCOMPARE(DUChain::uses()->useCount(id), 0u);
+    QVERIFY(DUChain::uses()->useRanges(id, userTop).isEmpty());
+
+    DUChain::self()->removeDocumentChain(userTop);
+    DUChain::self()->removeDocumentChain(DUChain::self()->chainForDocument(usedUrl));
+  }
+
+  DUChain::self()->disablePersistentStorage(true);
+}
+
+void TestDUChain::testCodeModelSearch()
+{
+  const IndexedString file("/my/test/codemodel");
+  const IndexedQualifiedIdentifier widget(QualifiedIdentifier(QStringLiteral("ui::Widget")));
+  const IndexedQualifiedIdentifier widgetFactory(QualifiedIdentifier(QStringLiteral("WidgetFactory")));
+  const IndexedQualifiedIdentifier makeWidget(QualifiedIdentifier(QStringLiteral("makeWidget")));
+  const IndexedQualifiedIdentifier textWidgetOptions(QualifiedIdentifier(QStringLiteral("TextWidgetOptions")));
+
+  CodeModel::self().addItem(file, widget, CodeModelItem::Class);
+  CodeModel::self().addItem(file, widgetFactory, CodeModelItem::Class);
+  CodeModel::self().addItem(file, makeWidget, CodeModelItem::Function);
+  CodeModel::self().addItem(file, textWidgetOptions, CodeModelItem::Class);
+
+  auto ids = [](const QVector<CodeModelMatch>& matches) {
+    QVector<IndexedQualifiedIdentifier> ret;
+    for (const CodeModelMatch& match : matches) {
+      ret << match.id;
+    }
+    return ret;
+  };
+  const uint allKinds = CodeModelItem::Class | CodeModelItem::Function;
+
+  // exact matches come first, then prefixes and substrings, shorter names first
+  auto matches = CodeModel::self().search(QStringLiteral("widget"), allKinds);
+  QCOMPARE(ids(matches), (QVector<IndexedQualifiedIdentifier>{widget, widgetFactory, makeWidget, textWidgetOptions}));
+  QCOMPARE(matches[0].quality, CodeModelMatch::Exact);
+  QCOMPARE(matches[0].file, file);
+  QCOMPARE(matches[1].quality, CodeModelMatch::Prefix);
+  QCOMPARE(matches[2].quality, CodeModelMatch::Substring);
+
+  QCOMPARE(ids(CodeModel::self().search(QStringLiteral("wf"), allKinds)), QVector<IndexedQualifiedIdentifier>{widgetFactory});
+  QCOMPARE(ids(CodeModel::self().search(QStringLiteral("TWO"), allKinds)), QVector<IndexedQualifiedIdentifier>{textWidgetOptions});
+  QCOMPARE(ids(CodeModel::self().search(QStringLiteral("widget"), CodeModelItem::Function)), QVector<IndexedQualifiedIdentifier>{makeWidget});
+  QVERIFY(CodeModel::self().search(QStringLiteral("wx"), allKinds).isEmpty());
+
+  // the items are counted by kind without walking them, forward-declarations are left out
+  const IndexedQualifiedIdentifier widgetDeclaration(QualifiedIdentifier(QStringLiteral("WidgetDeclaration")));
+  CodeModel::self().addItem(file, widgetDeclaration, static_cast<CodeModelItem::Kind>(CodeModelItem::Class | CodeModelItem::ForwardDeclaration));
+  QCOMPARE(CodeModel::self().itemCount(file, CodeModelItem::Class), 3u);
+  QCOMPARE(CodeModel::self().itemCount(file, allKinds), 4u);
+  CodeModel::self().updateItem(file, widgetDeclaration, CodeModelItem::Class);
+  QCOMPARE(CodeModel::self().itemCount(file, CodeModelItem::Class), 4u);
+  CodeModel::self().removeItem(file, widgetDeclaration);
+
+  CodeModel::self().removeItem(file, widgetFactory);
+  QVERIFY(CodeModel::self().search(QStringLiteral("wf"), allKinds).isEmpty());
+  QCOMPARE(CodeModel::self().itemCount(file, CodeModelItem::Class), 2u);
+
+  CodeModel::self().removeItem(file, widget);
+  CodeModel::self().removeItem(file, makeWidget);
+  CodeModel::self().removeItem(file, textWidgetOptions);
+  QVERIFY(CodeModel::self().search(QStringLiteral("widget"), allKinds).isEmpty());
+  QCOMPARE(CodeModel::self().itemCount(file, allKinds), 0u);
+}
+
 void TestDUChain::testIdentifiers()
 {
   QualifiedIdentifier aj(QStringLiteral("::Area::jump"));
@@ -39,12 +39,19 @@ private Q_SLOTS:
     void testStringSets();
 #endif
     void testSymbolTableValid();
+    void testSymbolTableCache();
     void testIndexedStrings();
     void testImportStructure();
     void testLockForWrite();
     void testLockForRead();
     void testLockForReadWrite();
+    void testLockStatistics();
+    void testLockQuiescentGeneration();
     void testProblemSerialization();
+    void testImportsSerialization();
+    void testCheckpoint();
+    void testUsesIndex();
+    void testCodeModelSearch();
     void testIdentifiers();
     ///NOTE: these are not "automated"!
 //     void testImportCache();
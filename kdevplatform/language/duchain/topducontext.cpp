@@ -1093,6 +1093,32 @@ void TopDUContext::deleteUsesRecursively()
     KDevelop::DUContext::deleteUsesRecursively();
 }
 
+static void collectUseRanges(const DUContext* context, QVector<QVector<RangeInRevision>>& ranges)
+{
+  for(int a = 0; a < context->usesCount(); ++a) {
+    //Negative indices mark uses of local declarations, those are not indexed
+    const int declarationIndex = context->uses()[a].m_declarationIndex;
+    if(declarationIndex >= 0 && declarationIndex < ranges.size())
+      ranges[declarationIndex] << context->uses()[a].m_range;
+  }
+
+  foreach(DUContext* child, context->childContexts())
+    collectUseRanges(child, ranges);
+}
+
+void TopDUContext::storeUseRanges() {
+  const uint size = d_func()->m_usedDeclarationIdsSize();
+  if(!size)
+    return;
+
+  QVector<QVector<RangeInRevision>> ranges(size);
+  collectUseRanges(this, ranges);
+
+  const DeclarationId* ids = d_func()->m_usedDeclarationIds();
+  for(uint a = 0; a < size; ++a)
+    DUChain::uses()->setUseRanges(ids[a], this, ranges[a]);
+}
+
 Declaration* TopDUContext::usedDeclarationForIndex(unsigned int declarationIndex) const {
   ENSURE_CAN_READ
   if(declarationIndex & (1<<31)) {
@@ -343,6 +343,9 @@ protected:
   ///Called by DUChain::removeDocumentChain to destroy this top-context.
   void deleteSelf();
 
+  ///Called by TopDUContextDynamicData::store to update the ranges of the uses in Uses
+  void storeUseRanges();
+
   //Most of these classes need access to m_dynamicData
   friend class DUChain;
   friend class DUChainPrivate;
@@ -360,6 +363,7 @@ protected:
   friend class DeclarationId;
   friend class ParsingEnvironmentFile;
   friend class ReferencedTopDUContext;
+  friend class Uses;
   
   TopDUContextLocalPrivate* m_local;
   
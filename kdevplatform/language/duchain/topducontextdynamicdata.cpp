@@ -21,9 +21,13 @@
 #include "topducontextdynamicdata_p.h"
 #include "topducontextdynamicdata.h"
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <typeinfo>
 #include <QFile>
 #include <QByteArray>
+#include <QVarLengthArray>
 
 #include "declaration.h"
 #include "declarationdata.h"
@@ -34,6 +38,7 @@
 #include "ducontextdynamicdata.h"
 #include "duchainregister.h"
 #include "serialization/itemrepository.h"
+#include "serialization/repositorymanager.h"
 #include "problem.h"
 #include <debug.h>
 
@@ -182,6 +187,238 @@ void loadTopDUContextData(const uint topContextIndex, LoadType loadType, F callb
   callback(topData);
 }
 
+DEFINE_LIST_MEMBER_HASH(TopDUContextMetadataItem, m_importedContexts, DUContext::Import)
+DEFINE_LIST_MEMBER_HASH(TopDUContextMetadataItem, m_importers, IndexedDUContext)
+
+///The parts of a stored top-context that change independently of its content.
+///An item only exists while it is newer than the metadata within the stored top-context.
+///The lists are named like the ones in TopDUContextData, so they can be copied from and to it directly.
+class TopDUContextMetadataItem {
+  public:
+  ///Creates the constant item for the stored top-context @p data
+  explicit TopDUContextMetadataItem(const TopDUContextData& data)
+    : topContextIndex(data.m_ownIndex)
+    , features(data.m_features)
+  {
+    initializeAppendedLists(false);
+    m_importedContextsCopyFrom(data);
+    m_importersCopyFrom(data);
+  }
+
+  ~TopDUContextMetadataItem() {
+    freeAppendedLists();
+  }
+
+  unsigned int hash() const {
+    //Only the index is compared, this allows us using the repository as a map
+    return topContextIndex;
+  }
+
+  uint itemSize() const {
+    return dynamicSize();
+  }
+
+  uint classSize() const {
+    return sizeof(TopDUContextMetadataItem);
+  }
+
+  uint topContextIndex = 0;
+  uint features = 0;
+
+  START_APPENDED_LISTS(TopDUContextMetadataItem);
+  APPENDED_LIST_FIRST(TopDUContextMetadataItem, DUContext::Import, m_importedContexts);
+  APPENDED_LIST(TopDUContextMetadataItem, IndexedDUContext, m_importers, m_importedContexts);
+  END_APPENDED_LISTS(TopDUContextMetadataItem, m_importers);
+
+  private:
+  Q_DISABLE_COPY(TopDUContextMetadataItem)
+};
+
+class TopDUContextMetadataRequest {
+  public:
+  ///Looks up the item of the top-context @p topContextIndex
+  explicit TopDUContextMetadataRequest(uint topContextIndex) : m_topContextIndex(topContextIndex) {
+  }
+
+  ///Creates the item straight from the stored top-context @p data
+  explicit TopDUContextMetadataRequest(const TopDUContextData& data) : m_topContextIndex(data.m_ownIndex), m_data(&data) {
+    Q_ASSERT(!data.isDynamic());
+  }
+
+  enum {
+    AverageSize = sizeof(TopDUContextMetadataItem) + 10 * sizeof(IndexedDUContext)
+  };
+
+  unsigned int hash() const {
+    return m_topContextIndex;
+  }
+
+  uint itemSize() const {
+    Q_ASSERT(m_data);
+    return sizeof(TopDUContextMetadataItem) + m_data->m_importedContextsSize() * sizeof(DUContext::Import)
+           + m_data->m_importersSize() * sizeof(IndexedDUContext);
+  }
+
+  void createItem(TopDUContextMetadataItem* item) const {
+    Q_ASSERT(m_data);
+    new (item) TopDUContextMetadataItem(*m_data);
+    Q_ASSERT(item->itemSize() == itemSize());
+  }
+
+  static void destroy(TopDUContextMetadataItem* item, KDevelop::AbstractItemRepository&) {
+    item->~TopDUContextMetadataItem();
+  }
+
+  static bool persistent(const TopDUContextMetadataItem*) {
+    //Cleanup is done by TopDUContextDynamicData
+    return true;
+  }
+
+  bool equals(const TopDUContextMetadataItem* item) const {
+    return m_topContextIndex == item->topContextIndex;
+  }
+
+  uint m_topContextIndex;
+  const TopDUContextData* m_data = nullptr;
+};
+
+using TopDUContextMetadataRepository = ItemRepository<TopDUContextMetadataItem, TopDUContextMetadataRequest>;
+
+RepositoryManager<TopDUContextMetadataRepository>& metadataRepository()
+{
+  static RepositoryManager<TopDUContextMetadataRepository> repository(QStringLiteral("Top-Context Metadata"));
+  return repository;
+}
+
+uint findMetadata(uint topContextIndex)
+{
+  return metadataRepository()->findIndex(TopDUContextMetadataRequest(topContextIndex));
+}
+
+void removeMetadata(uint topContextIndex)
+{
+  QMutexLocker lock(metadataRepository()->mutex());
+  if (uint index = findMetadata(topContextIndex)) {
+    metadataRepository()->deleteItem(index);
+  }
+}
+
+///Writes the metadata of the stored top-context @p data, the lists are copied right into the repository
+void writeMetadata(const TopDUContextData& data)
+{
+  QMutexLocker lock(metadataRepository()->mutex());
+  if (uint index = findMetadata(data.m_ownIndex)) {
+    metadataRepository()->deleteItem(index);
+  }
+  metadataRepository()->index(TopDUContextMetadataRequest(data));
+}
+
+/**
+ * Replaces the metadata within the stored top-context @p data by the newer one
+ * from the metadata repository, if there is any.
+ */
+void applyStoredMetadata(uint topContextIndex, QByteArray& data)
+{
+  auto stored = reinterpret_cast<const DUChainBaseData*>(data.constData());
+  if (!DUChainItemSystem::self().dataClassSize(*stored)) {
+    //The language support is not loaded, the top-context cannot be created anyway
+    return;
+  }
+
+  QMutexLocker lock(metadataRepository()->mutex());
+  const uint index = findMetadata(topContextIndex);
+  if (!index) {
+    return;
+  }
+  const TopDUContextMetadataItem* item = metadataRepository()->itemFromIndex(index);
+
+  auto patched = static_cast<TopDUContextData*>(DUChainItemSystem::self().cloneData(*stored));
+  patched->m_features = static_cast<TopDUContext::Features>(item->features);
+  patched->m_importedContextsCopyFrom(*item);
+  patched->m_importersCopyFrom(*item);
+  lock.unlock();
+
+  QByteArray result(DUChainItemSystem::self().dynamicSize(*patched), 0);
+  DUChainItemSystem::self().copy(*patched, *reinterpret_cast<DUChainBaseData*>(result.data()), true);
+  DUChainItemSystem::self().callDestructor(patched);
+  delete patched;
+  data = result;
+}
+
+struct DataRange {
+  const char* begin;
+  uint size;
+  bool operator<(const DataRange& rhs) const { return begin < rhs.begin; }
+};
+
+/**
+ * @returns the parts of the constant top-context @p data that are not kept in the metadata repository
+ */
+QVarLengthArray<DataRange, 6> contentRanges(const TopDUContextData& data)
+{
+  Q_ASSERT(!data.isDynamic());
+  const char* begin = reinterpret_cast<const char*>(&data);
+  const uint size = DUChainItemSystem::self().dynamicSize(data);
+
+  DataRange skipped[] = {
+    {reinterpret_cast<const char*>(&data.m_features), sizeof(data.m_features)},
+    {reinterpret_cast<const char*>(&data.m_importedContextsData), sizeof(data.m_importedContextsData)},
+    {reinterpret_cast<const char*>(&data.m_importersData), sizeof(data.m_importersData)},
+    {reinterpret_cast<const char*>(data.m_importedContexts()), uint(data.m_importedContextsSize() * sizeof(DUContext::Import))},
+    {reinterpret_cast<const char*>(data.m_importers()), uint(data.m_importersSize() * sizeof(IndexedDUContext))},
+  };
+  std::sort(std::begin(skipped), std::end(skipped));
+
+  QVarLengthArray<DataRange, 6> ret;
+  const char* current = begin;
+  for (const DataRange& range : skipped) {
+    if (!range.size) {
+      continue;
+    }
+    Q_ASSERT(range.begin >= current && range.begin + range.size <= begin + size);
+    if (range.begin != current) {
+      ret.append({current, uint(range.begin - current)});
+    }
+    current = range.begin + range.size;
+  }
+  if (current != begin + size) {
+    ret.append({current, uint(begin + size - current)});
+  }
+  return ret;
+}
+
+/**
+ * @returns whether the constant top-contexts @p lhs and @p rhs only differ in the metadata
+ */
+bool sameContent(const TopDUContextData& lhs, const TopDUContextData& rhs)
+{
+  const auto lhsRanges = contentRanges(lhs);
+  const auto rhsRanges = contentRanges(rhs);
+
+  //The ranges are split at different offsets if the lists have different sizes, so compare them as one stream
+  int l = 0, r = 0;
+  uint lhsOffset = 0, rhsOffset = 0;
+  while (l < lhsRanges.size() && r < rhsRanges.size()) {
+    const DataRange& lhsRange = lhsRanges[l];
+    const DataRange& rhsRange = rhsRanges[r];
+    const uint size = std::min(lhsRange.size - lhsOffset, rhsRange.size - rhsOffset);
+    if (memcmp(lhsRange.begin + lhsOffset, rhsRange.begin + rhsOffset, size) != 0) {
+      return false;
+    }
+    lhsOffset += size;
+    rhsOffset += size;
+    if (lhsOffset == lhsRange.size) {
+      ++l;
+      lhsOffset = 0;
+    }
+    if (rhsOffset == rhsRange.size) {
+      ++r;
+      rhsOffset = 0;
+    }
+  }
+  return l == lhsRanges.size() && r == rhsRanges.size();
+}
+
 template<typename T>
 struct PtrType;
 
@@ -506,8 +743,38 @@ bool TopDUContextDynamicData::fileExists(uint topContextIndex)
   return TopDUContextStore::exists(topContextIndex);
 }
 
+void TopDUContextDynamicData::beginStoreBatch()
+{
+  TopDUContextStore::beginBatch();
+}
+
+void TopDUContextDynamicData::endStoreBatch()
+{
+  TopDUContextStore::endBatch();
+}
+
+void TopDUContextDynamicData::restoreCheckpoint()
+{
+  TopDUContextStore::restoreCheckpoint(globalItemRepositoryRegistry().checkpointGeneration());
+}
+
+void TopDUContextDynamicData::discardUndo()
+{
+  TopDUContextStore::discardUndo(globalItemRepositoryRegistry().checkpointGeneration());
+}
+
 QList<IndexedDUContext> TopDUContextDynamicData::loadImporters(uint topContextIndex) {
   QList<IndexedDUContext> ret;
+  {
+    QMutexLocker lock(metadataRepository()->mutex());
+    if (uint index = findMetadata(topContextIndex)) {
+      const TopDUContextMetadataItem* item = metadataRepository()->itemFromIndex(index);
+      ret.reserve(item->m_importersSize());
+      FOREACH_FUNCTION(const IndexedDUContext& importer, item->m_importers)
+        ret << importer;
+      return ret;
+    }
+  }
   loadTopDUContextData(topContextIndex, FullLoad, [&ret] (const TopDUContextData* topData) {
     ret.reserve(topData->m_importersSize());
     FOREACH_FUNCTION(const IndexedDUContext& importer, topData->m_importers)
@@ -518,6 +785,16 @@ QList<IndexedDUContext> TopDUContextDynamicData::loadImporters(uint topContextIn
 
 QList<IndexedDUContext> TopDUContextDynamicData::loadImports(uint topContextIndex) {
   QList<IndexedDUContext> ret;
+  {
+    QMutexLocker lock(metadataRepository()->mutex());
+    if (uint index = findMetadata(topContextIndex)) {
+      const TopDUContextMetadataItem* item = metadataRepository()->itemFromIndex(index);
+      ret.reserve(item->m_importedContextsSize());
+      FOREACH_FUNCTION(const DUContext::Import& import, item->m_importedContexts)
+        ret << import.indexedContext();
+      return ret;
+    }
+  }
   loadTopDUContextData(topContextIndex, FullLoad, [&ret] (const TopDUContextData* topData) {
     ret.reserve(topData->m_importedContextsSize());
     FOREACH_FUNCTION(const DUContext::Import& import, topData->m_importedContexts)
@@ -595,6 +872,7 @@ TopDUContext* TopDUContextDynamicData::load(uint topContextIndex) {
     store.read((char*)&readValue, sizeof(uint));
     //now readValue is filled with the top-context data size
     QByteArray topContextData = store.read(readValue);
+    applyStoredMetadata(topContextIndex, topContextData);
 
     DUChainBaseData* topData = reinterpret_cast<DUChainBaseData*>(topContextData.data());
     TopDUContext* ret = dynamic_cast<TopDUContext*>(DUChainItemSystem::self().create(topData));
@@ -636,6 +914,8 @@ void TopDUContextDynamicData::deleteOnDisk() {
 
   m_onDisk = false;
 
+  removeMetadata(m_topContext->ownIndex());
+
   bool successfullyRemoved = TopDUContextStore::remove(m_topContext->ownIndex());
   Q_UNUSED(successfullyRemoved);
   Q_ASSERT(successfullyRemoved);
@@ -672,15 +952,20 @@ void TopDUContextDynamicData::store() {
     return;
   }
 
-  ///@todo Save the meta-data into a repository, and only the actual content data into a file.
-  ///      This will make saving+loading more efficient, and will reduce the disk-usage.
-  ///      Then we also won't need to load the data if only the meta-data changed.
+  //If only imports, importers or features changed, they go to the metadata repository
+  //and the stored content is left alone, without loading or unmapping it.
+  if (storeMetadata())
+    return;
+
   if(!m_dataLoaded)
     loadData();
 
+  //The uses are indexed as they are stored, so they can be found without loading this context again
+  if(m_topContext->inDUChain())
+    m_topContext->storeUseRanges();
+
   ///If the data is mapped, and we re-write the file, we must make sure that the data is copied out of the map,
   ///even if only metadata is changed.
-  ///@todo If we split up data and metadata, we don't need to do this
   if(m_mappedData)
     contentDataChanged = true;
 
@@ -751,6 +1036,8 @@ void TopDUContextDynamicData::store() {
           store.write(pos.array.constData(), pos.position);
 
         m_onDisk = true;
+        //The stored top-context is up to date again, drop any newer metadata
+        removeMetadata(m_topContext->ownIndex());
 
         nBytes = store.size();
         if (store.size() == 0) {
@@ -781,6 +1068,37 @@ void TopDUContextDynamicData::store() {
     }
 }
 
+bool TopDUContextDynamicData::storeMetadata()
+{
+  //m_topContextData still holds the stored data, which the new data is compared to
+  if (!m_onDisk || m_topContextData.size() != 1
+      || m_contexts.itemsHaveChanged() || m_declarations.itemsHaveChanged() || m_problems.itemsHaveChanged())
+    return false;
+
+  //Detach the top-context data from the stored array that is replaced below. saveDUChainItem() then makes
+  //it constant again within the new array, so it is not checked on the next store either
+  m_topContext->makeDynamic();
+  QVector<ArrayWithPosition> topContextData;
+  const uint topContextDataSize = DUChainItemSystem::self().dynamicSize(*m_topContext->d_func());
+  topContextData.append({QByteArray(topContextDataSize, 0), 0u});
+  uint actualTopContextDataSize = 0;
+  saveDUChainItem(topContextData, *m_topContext, actualTopContextDataSize, false);
+  Q_ASSERT(actualTopContextDataSize == topContextDataSize);
+
+  const QByteArray storedData = m_topContextData.first().array;
+  const auto stored = reinterpret_cast<const TopDUContextData*>(storedData.constData());
+  m_topContextData = topContextData;
+
+  const auto data = static_cast<const TopDUContextData*>(m_topContext->d_func());
+  if (!sameContent(*data, *stored)) {
+    //The content changed too, store() will make the data dynamic again and rewrite everything
+    return false;
+  }
+
+  writeMetadata(*data);
+  return true;
+}
+
 TopDUContextDynamicData::ItemDataInfo TopDUContextDynamicData::writeDataInfo(const ItemDataInfo& info, const DUChainBaseData* data, uint& totalDataOffset) {
   ItemDataInfo ret(info);
   Q_ASSERT(info.dataOffset);
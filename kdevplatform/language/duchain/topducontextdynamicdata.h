@@ -109,6 +109,17 @@ class TopDUContextDynamicData {
   
   static QList<IndexedDUContext> loadImports(uint topContextIndex);
 
+  ///Stores of top-contexts between these calls may be collected and written together when the batch ends.
+  ///The stored data is available to loads right away. Batches can be nested.
+  static void beginStoreBatch();
+  static void endStoreBatch();
+
+  ///Brings the stored top-contexts back to the state of the last stored item-repositories,
+  ///undoing what was stored after it by a session that crashed. Must be called before any top-context is loaded.
+  static void restoreCheckpoint();
+  ///Drops what restoreCheckpoint() needs for the item-repository stores before the last one.
+  static void discardUndo();
+
   bool isTemporaryContextIndex(uint index) const;
   bool isTemporaryDeclarationIndex(uint index) const ;
   
@@ -128,8 +139,14 @@ class TopDUContextDynamicData {
   static QString basePath();
   static QString pathForTopContext(const uint topContextIndex);
 
+  ///Whether store() has anything to write
+  bool hasChanged() const;
+
   private:
-    bool hasChanged() const;
+
+    ///Stores only imports, importers and features if nothing else changed since the last store
+    ///@returns false if the content has to be stored as well
+    bool storeMetadata();
 
     void unmap();
     //Converts away from an mmap opened file to a data array
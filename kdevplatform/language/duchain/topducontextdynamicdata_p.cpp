@@ -20,7 +20,20 @@
 #include "topducontextdynamicdata_p.h"
 #include "topducontextdynamicdata.h"
 
+#include "serialization/itemrepositoryregistry.h"
+
+#include <QDir>
 #include <QFileInfo>
+#include <QSaveFile>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QThreadStorage>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
+#include <qtcompat_p.h>
 
 #ifndef KDEV_TOPCONTEXTS_USE_FILES
 #include <lmdb++.h>
@@ -254,15 +267,78 @@ static void printCompRatio()
     }
 }
 
+// the LZ4 compression state of the calling thread, so that threads can compress in parallel
+static char* lz4CompState()
+{
+    static QThreadStorage<QByteArray> state;
+    if (!state.hasLocalData()) {
+        state.setLocalData(QByteArray(LZ4_sizeofState(), 0));
+    }
+    return state.localData().data();
+}
+
+// the value to store for @p value: LZ4-compressed to an qint64-sized offset into the buffer,
+// with the original and compressed sizes stored in those first 64 bits. Values that don't
+// compress are stored as they are.
+static QByteArray encodeValue(const QByteArray& value, uint index)
+{
+    const int len = value.size();
+    const int lz4BufLen = len > int(2 * sizeof(qint64)) ? LZ4_compressBound(len) : 0;
+    if (lz4BufLen) {
+        QByteArray data(lz4BufLen + sizeof(qint64), Qt::Uninitialized);
+        const int dataLen = LZ4_compress_fast_extState(lz4CompState(), value.constData(), &data.data()[sizeof(qint64)],
+            len, lz4BufLen, 1);
+        if (dataLen && dataLen + sizeof(qint64) < size_t(len)) {
+            TopDUContextLMDB::LZ4Frame frame;
+            frame.bytes = data.data();
+            frame.qint32Ptr[0] = len;
+            frame.qint32Ptr[1] = dataLen;
+            data.resize(dataLen + sizeof(qint64));
+            return data;
+        }
+        qCDebug(LANGUAGE) << "Index" << index << "compression failed or useless: len=" << len
+            << "compressedLen=" << dataLen << "LZ4_compressBound=" << lz4BufLen;
+    }
+    return value;
+}
+
+// the inverse of encodeValue(), decompressing from the LMDB-mapped @p val straight into the result
+static QByteArray decodeValue(const lmdb::val& val)
+{
+    if (val.size() > sizeof(qint64)) {
+        TopDUContextLMDB::LZ4Frame frame;
+        frame.bytes = const_cast<char*>(val.data());
+        const int orgSize = frame.qint32Ptr[0];
+        const int compressedSize = val.size() - sizeof(qint64);
+        if (orgSize > 0 && frame.qint32Ptr[1] == compressedSize) {
+            QByteArray value(orgSize, Qt::Uninitialized);
+            const auto decompSize = LZ4_decompress_safe(&frame.bytes[sizeof(qint64)],
+                value.data(), compressedSize, orgSize);
+            if (decompSize == orgSize) {
+                return value;
+            }
+        }
+    }
+    return QByteArray(val.data(), val.size());
+}
+
 class LMDBHook
 {
 public:
     ~LMDBHook()
     {
       if (s_envExists) {
+          writePendingValues(false);
+          {
+              // the environment must not be closed with open transactions
+              QMutexLocker lock(&s_readTxnMutex);
+              for (MDB_txn* txn : qAsConst(s_readTxns)) {
+                  lmdb::txn_abort(txn);
+              }
+              s_readTxns.clear();
+          }
           s_lmdbEnv.close();
           s_envExists = false;
-          delete[] s_lz4CompState;
           printCompRatio();
       }
     }
@@ -286,7 +362,10 @@ public:
                     s_mapSize = stat.me_mapsize;
                 }
                 s_lmdbEnv.set_mapsize(s_mapSize);
-                s_lz4CompState = new char[LZ4_sizeofState()];
+                // the handle of the main database stays valid for the lifetime of the environment
+                auto txn = lmdb::txn::begin(s_lmdbEnv.handle());
+                s_dbi = lmdb::dbi::open(txn, nullptr).handle();
+                txn.commit();
                 s_envExists = true;
                 qCDebug(LANGUAGE) << "s_lmdbEnv=" << s_lmdbEnv << "mapsize=" << stat.me_mapsize << "LZ4 state buffer:" << LZ4_sizeofState();
             } catch (const lmdb::error &e) {
@@ -314,21 +393,262 @@ public:
         s_lmdbEnv.set_mapsize(s_mapSize);
     }
 
+    // Calls @p function with the read-only transaction of the calling thread. That transaction is
+    // created once, and only renewed for and reset after each read, which is much cheaper than
+    // beginning and aborting a new one. Throws lmdb::error.
+    template<typename F>
+    static void read(F function)
+    {
+        static QThreadStorage<ReadTransaction*> threadTxn;
+        if (!threadTxn.hasLocalData()) {
+            threadTxn.setLocalData(new ReadTransaction);
+        }
+        ReadTransaction* holder = threadTxn.localData();
+        if (!holder->txn) {
+            lmdb::txn_begin(s_lmdbEnv.handle(), nullptr, MDB_RDONLY, &holder->txn);
+            QMutexLocker lock(&s_readTxnMutex);
+            s_readTxns.insert(holder->txn);
+        } else {
+            lmdb::txn_renew(holder->txn);
+        }
+        try {
+            function(holder->txn, s_dbi);
+        } catch (const lmdb::error &) {
+            lmdb::txn_reset(holder->txn);
+            throw;
+        }
+        lmdb::txn_reset(holder->txn);
+    }
+
+    static QByteArray undoKey(const QByteArray& key)
+    {
+        return undoPrefix() + key;
+    }
+
+    static const QByteArray& undoPrefix()
+    {
+        static const QByteArray prefix("undo:");
+        return prefix;
+    }
+
+    // Saves the current value of @p key under undoKey(key), unless that was done already in
+    // checkpoint @p generation. The saved value starts with the generation and whether the key existed.
+    static void saveUndo(MDB_txn* txn, const QByteArray& key, quint32 generation)
+    {
+        const QByteArray undo = undoKey(key);
+        lmdb::val undoK(undo.constData(), undo.size());
+        lmdb::val saved {};
+        if (lmdb::dbi_get(txn, s_dbi, undoK, saved) && saved.size() >= undoHeaderSize) {
+            quint32 savedGeneration;
+            memcpy(&savedGeneration, saved.data(), sizeof(quint32));
+            if (savedGeneration == generation) {
+                return;
+            }
+        }
+        lmdb::val k(key.constData(), key.size());
+        lmdb::val current {};
+        const bool existed = lmdb::dbi_get(txn, s_dbi, k, current);
+        // copy before putting, that invalidates current
+        QByteArray value(undoHeaderSize + (existed ? current.size() : 0), Qt::Uninitialized);
+        memcpy(value.data(), &generation, sizeof(quint32));
+        value[int(sizeof(quint32))] = existed ? 1 : 0;
+        if (existed) {
+            memcpy(value.data() + undoHeaderSize, current.data(), current.size());
+        }
+        lmdb::val v(value.constData(), value.size());
+        lmdb::dbi_put(txn, s_dbi, undoK, v);
+    }
+
+    // Walks the saved values without copying them. @p visit gets the key a value belongs to and the
+    // saved value, which is only valid until the next write; the value is deleted in place if it returns true.
+    template<typename F>
+    static void visitUndoValues(MDB_txn* txn, F visit)
+    {
+        auto cursor = lmdb::cursor::open(txn, s_dbi);
+        lmdb::val key(undoPrefix().constData(), undoPrefix().size());
+        lmdb::val value {};
+        bool found = cursor.get(key, value, MDB_SET_RANGE);
+        while (found) {
+            if (key.size() < size_t(undoPrefix().size()) || memcmp(key.data(), undoPrefix().constData(), undoPrefix().size()) != 0) {
+                break;
+            }
+            const QByteArray k(key.data() + undoPrefix().size(), key.size() - undoPrefix().size());
+            if (value.size() >= undoHeaderSize && visit(k, value)) {
+                // this leaves the cursor on the following value, which MDB_NEXT then returns
+                const int rc = mdb_cursor_del(cursor.handle(), 0);
+                if (rc != MDB_SUCCESS) {
+                    lmdb::error::raise("mdb_cursor_del", rc);
+                }
+            }
+            found = cursor.get(key, value, MDB_NEXT);
+        }
+        cursor.close();
+    }
+
+    static quint32 undoGeneration(const lmdb::val& saved)
+    {
+        quint32 generation;
+        memcpy(&generation, saved.data(), sizeof(quint32));
+        return generation;
+    }
+
+    // Puts all @p keys and @p values in a single write transaction, growing the map as needed.
+    // @returns an error message on failure
+    QString write(const QVector<QByteArray>& keys, const QVector<QByteArray>& values)
+    {
+        const quint32 generation = globalItemRepositoryRegistry().checkpointGeneration();
+        try {
+            auto txn = lmdb::txn::begin(handle());
+            try {
+                for (int i = 0; i < keys.size(); ++i) {
+                    saveUndo(txn, keys[i], generation);
+                    lmdb::val key(keys[i].constData(), keys[i].size());
+                    lmdb::val value(values[i].constData(), values[i].size());
+                    lmdb::dbi_put(txn, s_dbi, key, value);
+                }
+                txn.commit();
+            } catch (const lmdb::error &e) {
+                if (e.code() != MDB_MAP_FULL) {
+                    throw;
+                }
+                qCDebug(LANGUAGE) << "aborting LMDB write to grow mapsize";
+                txn.abort();
+                try {
+                    growMapSize();
+                } catch (const lmdb::error &e) {
+                    return lmdbxx_exception_handler(e, QStringLiteral("growing mapsize to ")
+                        + QString::number(s_mapSize));
+                }
+                return write(keys, values);
+            }
+        } catch (const lmdb::error &e) {
+            return lmdbxx_exception_handler(e, QStringLiteral("committing %1 indices").arg(keys.size()));
+        }
+        return {};
+    }
+
+    static void updateCompRatio(const QByteArray& value, const QByteArray& stored)
+    {
+        if (stored.constData() == value.constData()) {
+            uncompN += 1;
+        } else {
+            compRatioSum += double(value.size()) / stored.size();
+            compRatioN += 1;
+        }
+    }
+
+    // Writes the values collected by TopDUContextLMDB::commit() during a batch, see TopDUContextLMDB::beginBatch().
+    // They stay visible to readers until they are in the database.
+    void writePendingValues(bool parallel)
+    {
+        QMutexLocker writeLock(&s_batchWriteMutex);
+        QVector<BatchItem> items;
+        {
+            QMutexLocker lock(&s_batchMutex);
+            items.reserve(s_pending.size());
+            for (auto it = s_pending.constBegin(); it != s_pending.constEnd(); ++it) {
+                BatchItem item;
+                item.key = it.key();
+                item.value = it.value();
+                items.append(item);
+            }
+        }
+        if (items.isEmpty()) {
+            return;
+        }
+
+        if (parallel) {
+            QtConcurrent::blockingMap(items, &BatchItem::encode);
+        } else {
+            std::for_each(items.begin(), items.end(), &BatchItem::encode);
+        }
+
+        QVector<QByteArray> keys;
+        QVector<QByteArray> values;
+        keys.reserve(items.size());
+        values.reserve(items.size());
+        for (const auto& item : qAsConst(items)) {
+            updateCompRatio(item.value, item.stored);
+            keys.append(item.key);
+            values.append(item.stored);
+        }
+        const QString error = write(keys, values);
+        if (!error.isEmpty()) {
+            qCWarning(LANGUAGE) << "Failed to store" << items.size() << "top-contexts:" << error;
+        }
+
+        QMutexLocker lock(&s_batchMutex);
+        for (const auto& item : qAsConst(items)) {
+            // keep values that were stored again in the meantime
+            auto it = s_pending.find(item.key);
+            if (it != s_pending.end() && it->constData() == item.value.constData()) {
+                s_pendingSize -= it->size();
+                s_pending.erase(it);
+            }
+        }
+    }
+
+    struct ReadTransaction
+    {
+        ~ReadTransaction()
+        {
+            // the environment may have been closed before this thread ends
+            QMutexLocker lock(&s_readTxnMutex);
+            if (txn && s_readTxns.remove(txn)) {
+                lmdb::txn_abort(txn);
+            }
+        }
+        MDB_txn* txn = nullptr;
+    };
+
+    struct BatchItem
+    {
+        static void encode(BatchItem& item)
+        {
+            item.stored = encodeValue(item.value, item.key.toUInt());
+        }
+        QByteArray key;
+        QByteArray value;
+        QByteArray stored;
+    };
 
     static lmdb::env s_lmdbEnv;
+    static MDB_dbi s_dbi;
     static bool s_envExists;
-    static char* s_lz4CompState;
     static size_t s_mapSize;
     static QString s_errorString;
+
+    static const size_t undoHeaderSize = sizeof(quint32) + 1;
+
+    static QMutex s_readTxnMutex;
+    static QSet<MDB_txn*> s_readTxns;
+
+    // values committed during a batch, by key
+    static QMutex s_batchMutex;
+    static QMutex s_batchWriteMutex;
+    static QHash<QByteArray, QByteArray> s_pending;
+    static qint64 s_pendingSize;
+    static int s_batchDepth;
 };
 static LMDBHook LMDB;
 
 lmdb::env LMDBHook::s_lmdbEnv{nullptr};
+MDB_dbi LMDBHook::s_dbi = 0;
 bool LMDBHook::s_envExists = false;
-char *LMDBHook::s_lz4CompState = nullptr;
 // set the initial map size to 64Mb
 size_t LMDBHook::s_mapSize = 1024UL * 1024UL * 64UL;
 QString LMDBHook::s_errorString;
+QMutex LMDBHook::s_readTxnMutex;
+QSet<MDB_txn*> LMDBHook::s_readTxns;
+QMutex LMDBHook::s_batchMutex;
+QMutex LMDBHook::s_batchWriteMutex;
+QHash<QByteArray, QByteArray> LMDBHook::s_pending;
+qint64 LMDBHook::s_pendingSize = 0;
+int LMDBHook::s_batchDepth = 0;
+
+// write the pending values of a batch once they exceed this size, so a batch doesn't keep
+// everything in memory
+static const qint64 maxPendingSize = 64 * 1024 * 1024;
 
 uint TopDUContextLMDB::s_DbRefCount = 0;
 
@@ -368,6 +688,26 @@ bool TopDUContextLMDB::open(QIODevice::OpenMode mode)
     return TopDUContextDB::open(mode, QStringLiteral("LMDB"));
 }
 
+void TopDUContextLMDB::beginBatch()
+{
+    QMutexLocker lock(&LMDB.s_batchMutex);
+    ++LMDB.s_batchDepth;
+}
+
+void TopDUContextLMDB::endBatch()
+{
+    {
+        QMutexLocker lock(&LMDB.s_batchMutex);
+        Q_ASSERT(LMDB.s_batchDepth > 0);
+        if (--LMDB.s_batchDepth > 0) {
+            return;
+        }
+    }
+    if (LMDB.instance()) {
+        LMDB.writePendingValues(true);
+    }
+}
+
 void TopDUContextLMDB::commit()
 {
     if (LMDB.instance() && m_mode != MDB_RDONLY) {
@@ -375,71 +715,34 @@ void TopDUContextLMDB::commit()
             // m_currentLen is the true size
             qCDebug(LANGUAGE) << "TopDUContextLMDB index" << QByteArray::number(m_currentIndex) << "internal size mismatch:"
               << m_currentValue.size() << "vs" << m_currentLen;
+            m_currentValue.resize(m_currentLen);
         }
-        char *data;
-        size_t dataLen = 0;
-        int lz4BufLen = m_currentLen > 2 * sizeof(qint64) ? LZ4_compressBound(m_currentLen) : 0;
-        lmdb::val value;
-        if (lz4BufLen) {
-            data = new char[lz4BufLen + sizeof(qint64)];
-            // compress to an qint64-sized offset into the dest buffer; the original size will be stored in
-            // those first 64 bits.
-            dataLen = LZ4_compress_fast_extState(LMDB.s_lz4CompState, m_currentValue.constData(), &data[sizeof(qint64)],
-              m_currentLen, lz4BufLen, 1);
-            if (dataLen && dataLen + sizeof(qint64) < m_currentLen) {
-                LZ4Frame frame;
-                frame.bytes = data;
-                frame.qint32Ptr[0] = m_currentLen;
-                frame.qint32Ptr[1] = dataLen;
-                value = lmdb::val(data, dataLen + sizeof(qint64));
-                compRatioSum += double(m_currentLen) / value.size();
-                compRatioN += 1;
-            } else {
-                qCDebug(LANGUAGE) << "Index" << m_currentIndex << "compression failed or useless: m_currentLen=" << m_currentLen
-                  << "compressedLen=" << dataLen << "LZ4_compressBound=" << lz4BufLen;
-                delete data;
-                dataLen = 0;
-                lz4BufLen = 0;
+        bool batched = false;
+        bool writeBatch = false;
+        {
+            QMutexLocker lock(&LMDB.s_batchMutex);
+            if (LMDB.s_batchDepth > 0) {
+                auto& pending = LMDB.s_pending[m_currentKey];
+                LMDB.s_pendingSize += m_currentValue.size() - pending.size();
+                pending = m_currentValue;
+                batched = true;
+                writeBatch = LMDB.s_pendingSize >= maxPendingSize;
             }
         }
-        if (!dataLen) {
-            value = lmdb::val(m_currentValue.constData(), m_currentLen);
-            uncompN += 1;
+        if (writeBatch) {
+            LMDB.writePendingValues(true);
         }
-        lmdb::val key(m_currentKey.constData(), m_currentKey.size());
-        try {
-            auto txn = lmdb::txn::begin(LMDB.handle());
-            auto dbi = lmdb::dbi::open(txn, nullptr);
-            try {
-                lmdb::dbi_put(txn, dbi, key, value);
-                txn.commit();
-            } catch (const lmdb::error &e) {
-                if (e.code() == MDB_MAP_FULL) {
-                    try {
-                        qCDebug(LANGUAGE) << "aborting LMDB write to grow mapsize";
-                        txn.abort();
-                        lmdb::dbi_close(LMDB.handle(), dbi);
-                        LMDB.growMapSize();
-                        commit();
-                    } catch (const lmdb::error &e) {
-                        m_errorString = lmdbxx_exception_handler(e, QStringLiteral("growing mapsize to ")
-                            + QString::number(LMDB.s_mapSize));
-                    }
-                } else {
-                    m_errorString = lmdbxx_exception_handler(e, QStringLiteral("committing index ")
-                        + QByteArray::number(m_currentIndex) + " size " + QString::number(m_currentLen));
-                }
+        if (!batched) {
+            const QByteArray value = encodeValue(m_currentValue, m_currentIndex);
+            LMDBHook::updateCompRatio(m_currentValue, value);
+            const QString error = LMDB.write({m_currentKey}, {value});
+            if (!error.isEmpty()) {
+                m_errorString = error;
             }
-        } catch (const lmdb::error &e) {
-            m_errorString = lmdbxx_exception_handler(e, QStringLiteral("committing index ")
-                + QByteArray::number(m_currentIndex) + " size " + QString::number(m_currentLen));
         }
         m_currentKey.clear();
         m_currentValue.clear();
         m_currentLen = 0;
-        if (lz4BufLen && data) {
-            delete data;
-        }
     }
 }
 
@@ -461,43 +764,28 @@ bool TopDUContextLMDB::getCurrentKeyValue()
     // m_currentValue will remain empty.
     bool ret = true;
     if (m_currentValue.isEmpty()) {
+        {
+            // values of a running batch may not be in the database yet
+            QMutexLocker lock(&LMDB.s_batchMutex);
+            auto it = LMDB.s_pending.constFind(m_currentKey);
+            if (it != LMDB.s_pending.constEnd()) {
+                m_currentValue = it.value();
+                m_currentLen = m_currentValue.size();
+                m_readCursor = 0;
+                return true;
+            }
+        }
         // read the key value from storage into cache
         try {
-            auto rtxn = lmdb::txn::begin(LMDB.handle(), nullptr, MDB_RDONLY);
-            auto dbi = lmdb::dbi::open(rtxn, nullptr);
-            auto cursor = lmdb::cursor::open(rtxn, dbi);
-            lmdb::val key(m_currentKey.constData(), m_currentKey.size());
-            lmdb::val val {};
-            bool found = cursor.get(key, val, MDB_SET);
-            if (found) {
-                bool isRaw = true;
-                if (val.size() > sizeof(qint64)) {
-                    LZ4Frame frame;
-                    frame.bytes = val.data();
-                    int orgSize = frame.qint32Ptr[0];
-                    int compressedSize = val.size() - sizeof(qint64);
-                    if (orgSize > 0 && frame.qint32Ptr[1] == compressedSize) {
-                        // size m_currentValue so decompression can go into the final destination directly
-                        m_currentValue.resize(orgSize);
-                        const auto decompSize = LZ4_decompress_safe(&frame.bytes[sizeof(qint64)],
-                            m_currentValue.data(), compressedSize, orgSize);
-                        if (decompSize == orgSize) {
-                            isRaw = false;
-                            m_currentLen = m_currentValue.size();
-                        } else {
-//                           qCDebug(LANGUAGE) << "Index" << m_currentIndex << "failed LZ4 decompression from size" << compressedSize << "to size" << orgSize;
-                        }
-                    }
-                }
-                if (isRaw) {
-//                     qCDebug(LANGUAGE) << "Index" << m_currentIndex << "is uncompressed, size=" << val.size();
-                    m_currentValue = QByteArray(val.data(), val.size());
+            LMDBHook::read([this](MDB_txn* txn, MDB_dbi dbi) {
+                lmdb::val key(m_currentKey.constData(), m_currentKey.size());
+                lmdb::val val {};
+                if (lmdb::dbi_get(txn, dbi, key, val)) {
+                    m_currentValue = decodeValue(val);
                     m_currentLen = m_currentValue.size();
+                    m_readCursor = 0;
                 }
-                m_readCursor = 0;
-            }
-            cursor.close();
-            rtxn.abort();
+            });
         } catch (const lmdb::error &e) {
             m_errorString = lmdbxx_exception_handler(e, QStringLiteral("reading index ") + QByteArray::number(m_currentIndex));
             ret = false;
@@ -519,14 +807,19 @@ bool TopDUContextLMDB::currentKeyExists()
 bool TopDUContextLMDB::exists(const QByteArray &key)
 {
     if (LMDB.instance()) {
+        {
+            QMutexLocker lock(&LMDB.s_batchMutex);
+            if (LMDB.s_pending.contains(key)) {
+                return true;
+            }
+        }
         try {
-            auto rtxn = lmdb::txn::begin(LMDB.handle(), nullptr, MDB_RDONLY);
-            auto dbi = lmdb::dbi::open(rtxn, nullptr);
-            auto cursor = lmdb::cursor::open(rtxn, dbi);
-            lmdb::val k(key.constData(), key.size());
-            bool ret = cursor.get(k, nullptr, MDB_SET);
-            cursor.close();
-            rtxn.abort();
+            bool ret = false;
+            LMDBHook::read([&key, &ret](MDB_txn* txn, MDB_dbi dbi) {
+                lmdb::val k(key.constData(), key.size());
+                lmdb::val val {};
+                ret = lmdb::dbi_get(txn, dbi, k, val);
+            });
             return ret;
         } catch (const lmdb::error &e) {
             lmdbxx_exception_handler(e, QStringLiteral("checking for index") + key);
@@ -549,15 +842,27 @@ bool TopDUContextLMDB::remove(uint topContextIndex)
 {
     if (LMDB.instance()) {
         const auto key = indexKey(topContextIndex);
+        // a batch being written may still hold the value, it must not write it back after the deletion
+        QMutexLocker writeLock(&LMDB.s_batchWriteMutex);
+        bool wasPending = false;
+        {
+            QMutexLocker lock(&LMDB.s_batchMutex);
+            auto it = LMDB.s_pending.find(key);
+            if (it != LMDB.s_pending.end()) {
+                LMDB.s_pendingSize -= it->size();
+                LMDB.s_pending.erase(it);
+                wasPending = true;
+            }
+        }
         lmdb::val k {key.constData(), static_cast<size_t>(key.size())};
         try {
             auto txn = lmdb::txn::begin(LMDB.handle());
-            auto dbi = lmdb::dbi::open(txn, nullptr);
-            bool ret = lmdb::dbi_del(txn, dbi, k, nullptr);
+            LMDBHook::saveUndo(txn, key, globalItemRepositoryRegistry().checkpointGeneration());
+            bool ret = lmdb::dbi_del(txn, LMDB.s_dbi, k, nullptr);
             txn.commit();
             // also remove the file if it (still) exists
             QFile::remove(TopDUContextDynamicData::pathForTopContext(topContextIndex));
-            return ret;
+            return ret || wasPending;
         } catch (const lmdb::error &e) {
             lmdbxx_exception_handler(e, QStringLiteral("removing index %1").arg(topContextIndex));
         }
@@ -565,15 +870,113 @@ bool TopDUContextLMDB::remove(uint topContextIndex)
     return false;
 }
 
+void TopDUContextLMDB::restoreCheckpoint(uint generation)
+{
+    if (!LMDB.instance() && QFileInfo(TopDUContextDynamicData::basePath()).isWritable()) {
+        LMDB.init();
+    }
+    if (!LMDB.instance()) {
+        return;
+    }
+    try {
+        auto txn = lmdb::txn::begin(LMDB.handle());
+        int restored = 0;
+        LMDBHook::visitUndoValues(txn, [&](const QByteArray& k, const lmdb::val& saved) {
+            if (LMDBHook::undoGeneration(saved) >= generation) {
+                // changed after the item-repositories were stored for the last time
+                lmdb::val key(k.constData(), k.size());
+                if (saved.data()[sizeof(quint32)]) {
+                    // copy before putting, that invalidates the saved value
+                    const QByteArray value(saved.data() + LMDBHook::undoHeaderSize, saved.size() - LMDBHook::undoHeaderSize);
+                    lmdb::val v(value.constData(), value.size());
+                    lmdb::dbi_put(txn, LMDB.s_dbi, key, v);
+                } else {
+                    lmdb::dbi_del(txn, LMDB.s_dbi, key, nullptr);
+                }
+                ++restored;
+            }
+            return true;
+        });
+        txn.commit();
+        if (restored) {
+            qCDebug(LANGUAGE) << "restored" << restored << "top-contexts of checkpoint" << generation;
+        }
+    } catch (const lmdb::error &e) {
+        lmdbxx_exception_handler(e, QStringLiteral("restoring checkpoint %1").arg(generation));
+    }
+}
+
+void TopDUContextLMDB::discardUndo(uint generation)
+{
+    if (!LMDB.instance()) {
+        return;
+    }
+    try {
+        auto txn = lmdb::txn::begin(LMDB.handle());
+        LMDBHook::visitUndoValues(txn, [generation](const QByteArray&, const lmdb::val& saved) {
+            // values saved since belong to the next checkpoint
+            return LMDBHook::undoGeneration(saved) < generation;
+        });
+        txn.commit();
+    } catch (const lmdb::error &e) {
+        lmdbxx_exception_handler(e, QStringLiteral("discarding checkpoint %1").arg(generation));
+    }
+}
+
 #endif // !KDEV_TOPCONTEXTS_USE_FILES
 
+static QString undoPath()
+{
+    return TopDUContextDynamicData::basePath() + QLatin1String("undo/");
+}
+
 // TopDUContextFile : thin wrapper around the QFile API needed for TopDUContexts
 // so TopDUContextLMDB can be used as a drop-in replacement instead of this class.
 TopDUContextFile::TopDUContextFile(uint topContextIndex)
     : QFile(TopDUContextDynamicData::pathForTopContext(topContextIndex))
+    , m_index(topContextIndex)
 {
 }
 
+// Saves the current state of the file of @p topContextIndex as undo/<index>, unless that was done
+// already in checkpoint @p generation. The copy starts with the generation and whether the file existed.
+static void saveUndo(uint topContextIndex, quint32 generation)
+{
+    const QString path = undoPath() + QString::number(topContextIndex);
+    QFile saved(path);
+    if (saved.open(QIODevice::ReadOnly)) {
+        quint32 savedGeneration;
+        if (saved.read(reinterpret_cast<char*>(&savedGeneration), sizeof(quint32)) == sizeof(quint32)
+            && savedGeneration == generation) {
+            return;
+        }
+        saved.close();
+    }
+
+    QFile current(TopDUContextDynamicData::pathForTopContext(topContextIndex));
+    const char existed = current.open(QIODevice::ReadOnly) ? 1 : 0;
+    QDir().mkpath(undoPath());
+    QSaveFile undo(path);
+    if (!undo.open(QIODevice::WriteOnly)) {
+        qCWarning(LANGUAGE) << "cannot save the previous state of" << current.fileName() << undo.errorString();
+        return;
+    }
+    undo.write(reinterpret_cast<const char*>(&generation), sizeof(quint32));
+    undo.write(&existed, 1);
+    if (existed) {
+        undo.write(current.readAll());
+    }
+    undo.commit();
+}
+
+bool TopDUContextFile::open(OpenMode mode)
+{
+    if (mode & QIODevice::WriteOnly) {
+        saveUndo(m_index, globalItemRepositoryRegistry().checkpointGeneration());
+    }
+    return QFile::open(mode);
+}
+
 bool TopDUContextFile::exists(uint topContextIndex)
 {
     return QFile::exists(TopDUContextDynamicData::pathForTopContext(topContextIndex));
@@ -581,9 +984,61 @@ bool TopDUContextFile::exists(uint topContextIndex)
 
 bool TopDUContextFile::remove(uint topContextIndex)
 {
+    saveUndo(topContextIndex, globalItemRepositoryRegistry().checkpointGeneration());
     return QFile::remove(TopDUContextDynamicData::pathForTopContext(topContextIndex));
 }
 
+void TopDUContextFile::restoreCheckpoint(uint generation)
+{
+    QDir dir(undoPath());
+    const auto names = dir.entryList(QDir::Files);
+    int restored = 0;
+    for (const QString& name : names) {
+        QFile saved(dir.filePath(name));
+        quint32 savedGeneration;
+        char existed;
+        if (saved.open(QIODevice::ReadOnly)
+            && saved.read(reinterpret_cast<char*>(&savedGeneration), sizeof(quint32)) == sizeof(quint32)
+            && saved.read(&existed, 1) == 1 && savedGeneration >= generation) {
+            // changed after the item-repositories were stored for the last time
+            const QString path = TopDUContextDynamicData::basePath() + name;
+            if (existed) {
+                QSaveFile file(path);
+                if (file.open(QIODevice::WriteOnly)) {
+                    file.write(saved.readAll());
+                    file.commit();
+                }
+            } else {
+                QFile::remove(path);
+            }
+            ++restored;
+        }
+        saved.close();
+        saved.remove();
+    }
+    if (restored) {
+        qCDebug(LANGUAGE) << "restored" << restored << "top-contexts of checkpoint" << generation;
+    }
+}
+
+void TopDUContextFile::discardUndo(uint generation)
+{
+    QDir dir(undoPath());
+    const auto names = dir.entryList(QDir::Files);
+    for (const QString& name : names) {
+        QFile saved(dir.filePath(name));
+        quint32 savedGeneration;
+        if (saved.open(QIODevice::ReadOnly)
+            && saved.read(reinterpret_cast<char*>(&savedGeneration), sizeof(quint32)) == sizeof(quint32)
+            && savedGeneration >= generation) {
+            // belongs to the next checkpoint
+            continue;
+        }
+        saved.close();
+        saved.remove();
+    }
+}
+
 void TopDUContextFile::commit()
 {
     QFile::close();
@@ -35,9 +35,21 @@ class KDEVPLATFORMLANGUAGE_EXPORT TopDUContextFile : public QFile
 {
 public:
     TopDUContextFile(uint topContextIndex);
+    bool open(OpenMode mode) override;
     void commit();
     static bool exists(uint topContextIndex);
     static bool remove(uint topContextIndex);
+    // files are written as they are committed
+    static void beginBatch() {}
+    static void endBatch() {}
+    // Before a top-context is overwritten or removed for the first time in a checkpoint generation
+    // of the item-repositories, its previous state is saved. restoreCheckpoint() brings back the
+    // states saved since @p generation, discardUndo() forgets those saved before it.
+    static void restoreCheckpoint(uint generation);
+    static void discardUndo(uint generation);
+
+private:
+    uint m_index;
 };
 
 #if !defined(KDEV_TOPCONTEXTS_USE_FILES)
@@ -90,6 +102,14 @@ public:
   QString fileName() const;
   static bool exists(uint topContextIndex);
   static bool remove(uint topContextIndex);
+  // Between these calls, commits only collect their values; endBatch() then compresses them
+  // in parallel and writes them in a single transaction. Batches can be nested.
+  static void beginBatch();
+  static void endBatch();
+  // The previous value of each key is saved within the transaction that overwrites or removes
+  // it, see TopDUContextFile::restoreCheckpoint().
+  static void restoreCheckpoint(uint generation);
+  static void discardUndo(uint generation);
 
 protected:
   virtual bool getCurrentKeyValue() override;
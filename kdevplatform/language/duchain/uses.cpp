@@ -19,9 +19,14 @@
 #include "uses.h"
 
 #include "declarationid.h"
+#include "duchain.h"
 #include "duchainpointer.h"
 #include "serialization/itemrepository.h"
 #include "topducontext.h"
+#include "topducontextdata.h"
+#include "util/kdevhash.h"
+
+#include <algorithm>
 
 namespace KDevelop {
 
@@ -99,14 +104,89 @@ class UsesRequestItem {
 };
 
 
+DEFINE_LIST_MEMBER_HASH(UseRangesItem, ranges, RangeInRevision)
+
+class UseRangesItem {
+  public:
+  UseRangesItem() {
+    initializeAppendedLists();
+  }
+  UseRangesItem(const UseRangesItem& rhs, bool dynamic = true) : declaration(rhs.declaration), topContext(rhs.topContext) {
+    initializeAppendedLists(dynamic);
+    copyListsFrom(rhs);
+  }
+
+  ~UseRangesItem() {
+    freeAppendedLists();
+  }
+
+  unsigned int hash() const {
+    //Like UsesItem, only the key is hashed
+    return KDevHash() << declaration.hash() << topContext.index();
+  }
+
+  unsigned int itemSize() const {
+    return dynamicSize();
+  }
+
+  uint classSize() const {
+    return sizeof(UseRangesItem);
+  }
+
+  DeclarationId declaration;
+  IndexedTopDUContext topContext;
+
+  START_APPENDED_LISTS(UseRangesItem);
+  APPENDED_LIST_FIRST(UseRangesItem, RangeInRevision, ranges);
+  END_APPENDED_LISTS(UseRangesItem, ranges);
+};
+
+class UseRangesRequestItem {
+  public:
+
+  UseRangesRequestItem(const UseRangesItem& item) : m_item(item) {
+  }
+  enum {
+    AverageSize = 60 //This should be the approximate average size of an Item
+  };
+
+  unsigned int hash() const {
+    return m_item.hash();
+  }
+
+  uint itemSize() const {
+      return m_item.itemSize();
+  }
+
+  void createItem(UseRangesItem* item) const {
+    new (item) UseRangesItem(m_item, false);
+  }
+
+  static void destroy(UseRangesItem* item, KDevelop::AbstractItemRepository&) {
+    item->~UseRangesItem();
+  }
+
+  static bool persistent(const UseRangesItem* /*item*/) {
+    return true;
+  }
+
+  bool equals(const UseRangesItem* item) const {
+    return m_item.declaration == item->declaration && m_item.topContext == item->topContext;
+  }
+
+  const UseRangesItem& m_item;
+};
+
 class UsesPrivate
 {
 public:
 
-  UsesPrivate() : m_uses(QStringLiteral("Use Map")) {
+  UsesPrivate() : m_uses(QStringLiteral("Use Map")), m_useRanges(QStringLiteral("Use Range Map")) {
   }
   //Maps declaration-ids to Uses
   ItemRepository<UsesItem, UsesRequestItem> m_uses;
+  //Maps pairs of declaration-id and top-context to the ranges of the uses
+  ItemRepository<UseRangesItem, UseRangesRequestItem> m_useRanges;
 };
 
 Uses::Uses() : d(new UsesPrivate())
@@ -162,6 +242,32 @@ void Uses::removeUse(const DeclarationId& id, const IndexedTopDUContext& use)
     if(item.usesSize() != 0)
       d->m_uses.index(request);
   }
+
+  setUseRanges(id, use, QVector<RangeInRevision>());
+}
+
+void Uses::setUseRanges(const DeclarationId& id, const IndexedTopDUContext& use, const QVector<RangeInRevision>& ranges)
+{
+  UseRangesItem item;
+  item.declaration = id;
+  item.topContext = use;
+
+  uint index = d->m_useRanges.findIndex(item);
+  if(index) {
+    const UseRangesItem* oldItem = d->m_useRanges.itemFromIndex(index);
+    if(oldItem->rangesSize() == static_cast<uint>(ranges.size())
+        && std::equal(ranges.constBegin(), ranges.constEnd(), oldItem->ranges()))
+      return; //Unchanged, don't touch the repository
+
+    d->m_useRanges.deleteItem(index);
+  }
+
+  if(ranges.isEmpty())
+    return;
+
+  for(const RangeInRevision& range : ranges)
+    item.rangesList().append(range);
+  d->m_useRanges.index(UseRangesRequestItem(item));
 }
 
 bool Uses::hasUses(const DeclarationId& id) const
@@ -190,5 +296,50 @@ KDevVarLengthArray<IndexedTopDUContext> Uses::uses(const DeclarationId& id) cons
   return ret;
 }
 
+QVector<RangeInRevision> Uses::useRanges(const DeclarationId& id, const IndexedTopDUContext& use) const
+{
+  QVector<RangeInRevision> ret;
+
+  if(DUChain::self()->isInMemory(use.index())) {
+    //The loaded top-context may have changed since it was stored
+    TopDUContext* top = use.data();
+    const TopDUContextData* data = top->d_func();
+    for(uint a = 0; a < data->m_usedDeclarationIdsSize(); ++a) {
+      if(data->m_usedDeclarationIds()[a] == id)
+        return allUses(top, static_cast<int>(a));
+    }
+    return ret;
+  }
+
+  UseRangesItem item;
+  item.declaration = id;
+  item.topContext = use;
+
+  uint index = d->m_useRanges.findIndex(item);
+  if(index) {
+    const UseRangesItem* repositoryItem = d->m_useRanges.itemFromIndex(index);
+    ret.reserve(repositoryItem->rangesSize());
+    FOREACH_FUNCTION(const RangeInRevision& range, repositoryItem->ranges)
+      ret.append(range);
+  }
+
+  return ret;
+}
+
+uint Uses::useCount(const DeclarationId& id) const
+{
+  uint count = 0;
+  UseRangesItem item;
+  item.declaration = id;
+
+  const auto tops = uses(id);
+  for(const IndexedTopDUContext& top : tops) {
+    item.topContext = top;
+    if(uint index = d->m_useRanges.findIndex(item))
+      count += d->m_useRanges.itemFromIndex(index)->rangesSize();
+  }
+  return count;
+}
+
 
 }
@@ -23,16 +23,19 @@
 #include <util/kdevvarlengtharray.h>
 
 #include <QScopedPointer>
+#include <QVector>
 
 namespace KDevelop {
 
   class DeclarationId;
   class IndexedTopDUContext;
+  class RangeInRevision;
 
 /**
  * Global mapping of Declaration-Ids to top-contexts, protected through DUChainLock.
  *
- * To retrieve the actual uses, query the duchain for the files.
+ * Additionally the ranges of the uses within each of those top-contexts are indexed, as of the last time
+ * the top-context was stored. That way uses can be listed, counted and paged without loading the top-contexts.
  * */
   class KDEVPLATFORMLANGUAGE_EXPORT Uses {
     public:
@@ -45,9 +48,14 @@ namespace KDevelop {
      * */
     void addUse(const DeclarationId& id, const IndexedTopDUContext& use);
     /**
-     * Removes the given top-context from the list of uses
+     * Removes the given top-context from the list of uses, together with the ranges of the uses in it
      * */
     void removeUse(const DeclarationId& id, const IndexedTopDUContext& use);
+    /**
+     * Replaces the indexed ranges of the uses of the given id within the top-context @p use.
+     * This is done by the top-context whenever it is stored.
+     * */
+    void setUseRanges(const DeclarationId& id, const IndexedTopDUContext& use, const QVector<RangeInRevision>& ranges);
     /**
      * Checks whether the given DeclarationID is is used
      * */
@@ -56,6 +64,13 @@ namespace KDevelop {
     ///Gets the top-contexts of all users assigned to the declaration-id
     KDevVarLengthArray<IndexedTopDUContext> uses(const DeclarationId& id) const;
 
+    ///Gets the ranges of the uses of the declaration-id within the top-context @p use.
+    ///If the top-context is loaded, the ranges are taken from it, else from the index.
+    QVector<RangeInRevision> useRanges(const DeclarationId& id, const IndexedTopDUContext& use) const;
+
+    ///Counts the indexed uses of the declaration-id within all top-contexts, without loading any of them
+    uint useCount(const DeclarationId& id) const;
+
     private:
       const QScopedPointer<class UsesPrivate> d;
   };
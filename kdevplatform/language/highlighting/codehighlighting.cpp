@@ -46,11 +46,22 @@
 
 #include <KTextEditor/Document>
 #include <KTextEditor/MovingInterface>
+#include <KTextEditor/View>
+
+#include <QTimer>
+
+#include <qtcompat_p.h>
 
 using namespace KTextEditor;
 
 static const float highlightingZDepth = -500;
 
+// How long applying a highlighting may block the foreground thread at once
+static const int applySliceMilliseconds = 5;
+
+// Lines assumed visible below the top of a view when its bottom line can't be determined
+static const int fallbackVisibleLines = 100;
+
 #define ifDebug(x)
 
 namespace KDevelop {
@@ -70,6 +81,7 @@ CodeHighlighting::CodeHighlighting( QObject * parent )
 
 CodeHighlighting::~CodeHighlighting( )
 {
+  qDeleteAll(m_pending);
   qDeleteAll(m_highlights);
 }
 
@@ -157,6 +169,18 @@ bool CodeHighlighting::hasHighlighting(IndexedString url) const
   return false;
 }
 
+CodeHighlighting::ApplyStatistics CodeHighlighting::applyStatistics() const
+{
+  QMutexLocker lock(&m_dataMutex);
+  return m_applyStatistics;
+}
+
+void CodeHighlighting::resetApplyStatistics()
+{
+  QMutexLocker lock(&m_dataMutex);
+  m_applyStatistics = ApplyStatistics();
+}
+
 void CodeHighlighting::highlightDUChain(ReferencedTopDUContext context)
 {
   ENSURE_CHAIN_NOT_LOCKED
@@ -498,6 +522,10 @@ void CodeHighlighting::clearHighlightingForDocument(const IndexedString& documen
   if(m_highlights.contains(tracker))
   {
     disconnect(tracker, &DocumentChangeTracker::destroyed, this, &CodeHighlighting::trackerDestroyed);
+    if(PendingApply* pending = m_pending.take(tracker)) {
+      qDeleteAll(pending->m_oldRanges);
+      delete pending;
+    }
     qDeleteAll(m_highlights[tracker]->m_highlightedRanges);
     delete m_highlights[tracker];
     m_highlights.remove(tracker);
@@ -526,11 +554,24 @@ void CodeHighlighting::applyHighlighting(void* _highlighting)
     return;
   }
 
+  startApply(tracker, highlighting);
+  applyPendingSlices();
+}
+
+void CodeHighlighting::startApply(DocumentChangeTracker* tracker, DocumentHighlighting* highlighting)
+{
   QVector< MovingRange* > oldHighlightedRanges;
 
+  if(PendingApply* pending = m_pending.take(tracker))
+  {
+    // The highlighting that is still being applied is outdated, what remains of the one before it is reused as well
+    oldHighlightedRanges = pending->m_oldRanges.values().toVector();
+    delete pending;
+  }
+
   if(m_highlights.contains(tracker))
   {
-    oldHighlightedRanges = m_highlights[tracker]->m_highlightedRanges;
+    oldHighlightedRanges += m_highlights[tracker]->m_highlightedRanges;
     delete m_highlights[tracker];
   }else{
     // we newly add this tracker, so add the connection
@@ -544,54 +585,183 @@ void CodeHighlighting::applyHighlighting(void* _highlighting)
 
   m_highlights[tracker] = highlighting;
 
-  // Now create MovingRanges (match old ones with the incoming ranges)
+  // The moving ranges are created in slices, so typing in large documents doesn't stutter.
+  // The lines shown by the views come first, so the highlighting appears where the user looks right away.
+  PendingApply* pending = new PendingApply;
+  pending->m_highlighting = highlighting;
+  pending->m_timer.start();
 
-  KTextEditor::Range tempRange;
+  for(MovingRange* range : qAsConst(oldHighlightedRanges))
+    pending->m_oldRanges.insert(range->start().line(), range);
+  pending->m_oldRangesRevision = tracker->documentMovingInterface()->revision();
 
-  QVector<MovingRange*>::iterator movingIt = oldHighlightedRanges.begin();
-  QVector<HighlightedRange>::iterator rangeIt = highlighting->m_waiting.begin();
+  const auto views = tracker->document()->views();
+  for(View* view : views)
+  {
+    if(!view->isVisible())
+      continue;
+    // coordinatesToCursor() is invalid below the last line or on a scroll-bar
+    const int x = view->width() / 2;
+    const Cursor top = view->coordinatesToCursor(QPoint(x, 0));
+    const Cursor bottom = view->coordinatesToCursor(QPoint(x, view->height() - 1));
+    const int first = top.isValid() ? top.line() : view->cursorPosition().line();
+    pending->m_visibleLines.append(qMakePair(first, bottom.isValid() ? bottom.line() : first + fallbackVisibleLines));
+  }
+
+  const auto isVisible = [pending](int line) {
+    for(const auto& lines : qAsConst(pending->m_visibleLines)) {
+      if(line >= lines.first && line <= lines.second)
+        return true;
+    }
+    return false;
+  };
+
+  const int count = highlighting->m_waiting.size();
+  pending->m_order.reserve(count);
+  for(int a = 0; a < count; ++a) {
+    if(isVisible(highlighting->m_waiting[a].range.start.line))
+      pending->m_order.append(a);
+  }
+  pending->m_visibleCount = pending->m_order.size();
+  for(int a = 0; a < count; ++a) {
+    if(!isVisible(highlighting->m_waiting[a].range.start.line))
+      pending->m_order.append(a);
+  }
+  highlighting->m_highlightedRanges.reserve(count);
 
-  while(rangeIt != highlighting->m_waiting.end())
+  m_pending.insert(tracker, pending);
+}
+
+void CodeHighlighting::updateOldRanges(PendingApply* pending, MovingInterface* moving)
+{
+  if(pending->m_oldRangesRevision == moving->revision())
+    return;
+
+  const auto ranges = pending->m_oldRanges.values();
+  pending->m_oldRanges.clear();
+  for(MovingRange* range : ranges)
+    pending->m_oldRanges.insert(range->start().line(), range);
+  pending->m_oldRangesRevision = moving->revision();
+}
+
+bool CodeHighlighting::applySlice(DocumentChangeTracker* tracker, PendingApply* pending, const QElapsedTimer& slice)
+{
+  DocumentHighlighting* highlighting = pending->m_highlighting;
+  MovingInterface* moving = tracker->documentMovingInterface();
+
+  if(pending->m_next < pending->m_order.size() && !tracker->holdingRevision(highlighting->m_waitingRevision))
   {
-    // Translate the range into the current revision
-    KTextEditor::Range transformedRange = tracker->transformToCurrentRevision(rangeIt->range, highlighting->m_waitingRevision);
+    // A newer parse job released the revision, and its highlighting will follow. Until then, keep the
+    // previous highlighting where the outdated one was not applied yet.
+    for(MovingRange* range : qAsConst(pending->m_oldRanges))
+      highlighting->m_highlightedRanges.push_back(range);
+    pending->m_oldRanges.clear();
+    return true;
+  }
+
+  // The document may have been edited since the last slice
+  updateOldRanges(pending, moving);
 
-    while(movingIt != oldHighlightedRanges.end() &&
-      ((*movingIt)->start().line() < transformedRange.start().line() ||
-      ((*movingIt)->start().line() == transformedRange.start().line() && (*movingIt)->start().column() < transformedRange.start().column())))
+  for(;;)
+  {
+    if(!pending->m_visibleDone && pending->m_next >= pending->m_visibleCount)
     {
-      delete *movingIt; // Skip ranges that are in front of the current matched range
-      ++movingIt;
+      // The visible lines are done, remove the outdated highlighting that is left there
+      for(const auto& lines : qAsConst(pending->m_visibleLines)) {
+        for(int line = lines.first; line <= lines.second; ++line) {
+          const auto outdated = pending->m_oldRanges.values(line);
+          qDeleteAll(outdated);
+          pending->m_oldRanges.remove(line);
+        }
+      }
+      pending->m_visibleUs = pending->m_timer.nsecsElapsed() / 1000;
+      pending->m_visibleDone = true;
     }
 
+    if(pending->m_next >= pending->m_order.size())
+      return true;
+
+    // Don't ask for the time after every range, that costs more than a range
+    if(pending->m_next % 64 == 0 && slice.elapsed() >= applySliceMilliseconds)
+      return false;
+
+    const HighlightedRange& waiting = highlighting->m_waiting[pending->m_order[pending->m_next]];
+    ++pending->m_next;
 
-    tempRange = transformedRange;
+    // Translate the range into the current revision
+    const KTextEditor::Range transformedRange = tracker->transformToCurrentRevision(waiting.range, highlighting->m_waitingRevision);
+    Q_ASSERT(waiting.attribute);
 
-    if(movingIt == oldHighlightedRanges.end() ||
-      transformedRange.start().line() != (*movingIt)->start().line() ||
-      transformedRange.start().column() != (*movingIt)->start().column() ||
-      transformedRange.end().line() != (*movingIt)->end().line() ||
-      transformedRange.end().column() != (*movingIt)->end().column())
+    // Keep the moving range if there is one at exactly this place already, so unchanged regions are not touched
+    MovingRange* reused = nullptr;
+    for(auto it = pending->m_oldRanges.find(transformedRange.start().line()); it != pending->m_oldRanges.end() && it.key() == transformedRange.start().line(); ++it)
     {
-      Q_ASSERT(rangeIt->attribute);
-      // The moving range is behind or unequal, create a new range
-      highlighting->m_highlightedRanges.push_back(tracker->documentMovingInterface()->newMovingRange(tempRange));
-      highlighting->m_highlightedRanges.back()->setAttribute(rangeIt->attribute);
-      highlighting->m_highlightedRanges.back()->setZDepth(highlightingZDepth);
+      if((*it)->toRange() == transformedRange) {
+        reused = *it;
+        pending->m_oldRanges.erase(it);
+        break;
+      }
+    }
+
+    if(reused)
+    {
+      if(reused->attribute() != waiting.attribute)
+        reused->setAttribute(waiting.attribute);
+      highlighting->m_highlightedRanges.push_back(reused);
+      ++m_applyStatistics.reusedRanges;
     }
     else
     {
-      // Update the existing moving range
-      (*movingIt)->setAttribute(rangeIt->attribute);
-      (*movingIt)->setRange(tempRange);
-      highlighting->m_highlightedRanges.push_back(*movingIt);
-      ++movingIt;
+      highlighting->m_highlightedRanges.push_back(moving->newMovingRange(transformedRange));
+      highlighting->m_highlightedRanges.back()->setAttribute(waiting.attribute);
+      highlighting->m_highlightedRanges.back()->setZDepth(highlightingZDepth);
+      ++m_applyStatistics.createdRanges;
+    }
+  }
+}
+
+void CodeHighlighting::applyPendingSlices()
+{
+  VERIFY_FOREGROUND_LOCKED
+  QMutexLocker lock(&m_dataMutex);
+
+  QElapsedTimer slice;
+  slice.start();
+
+  for(auto it = m_pending.begin(); it != m_pending.end() && slice.elapsed() < applySliceMilliseconds; )
+  {
+    PendingApply* pending = it.value();
+    if(!applySlice(it.key(), pending, slice)) {
+      ++it;
+      continue;
     }
-    ++rangeIt;
+
+    qDeleteAll(pending->m_oldRanges); // Delete unmatched moving ranges
+
+    const quint64 elapsedUs = pending->m_timer.nsecsElapsed() / 1000;
+    ++m_applyStatistics.applies;
+    m_applyStatistics.lastApplyUs = elapsedUs;
+    m_applyStatistics.lastVisibleUs = pending->m_visibleUs;
+    ifDebug(qCDebug(LANGUAGE) << "applied highlighting of" << pending->m_highlighting->m_document.str() << "in" << elapsedUs << "us";)
+
+    delete pending;
+    it = m_pending.erase(it);
   }
 
-  for(; movingIt != oldHighlightedRanges.end(); ++movingIt)
-    delete *movingIt; // Delete unmatched moving ranges behind
+  const quint64 sliceUs = slice.nsecsElapsed() / 1000;
+  ++m_applyStatistics.slices;
+  m_applyStatistics.totalSliceUs += sliceUs;
+  m_applyStatistics.maxSliceUs = qMax(m_applyStatistics.maxSliceUs, sliceUs);
+
+  if(!m_pending.isEmpty() && !m_sliceScheduled)
+  {
+    // Continue once the events that queued up in the meantime, like key presses, were handled
+    m_sliceScheduled = true;
+    QTimer::singleShot(0, this, [this]() {
+      m_sliceScheduled = false;
+      applyPendingSlices();
+    });
+  }
 }
 
 void CodeHighlighting::trackerDestroyed(QObject* object)
@@ -601,6 +771,7 @@ void CodeHighlighting::trackerDestroyed(QObject* object)
   QMutexLocker lock(&m_dataMutex);
   DocumentChangeTracker* tracker = static_cast<DocumentChangeTracker*>(object);
   Q_ASSERT(m_highlights.contains(tracker));
+  delete m_pending.take(tracker);
   delete m_highlights[tracker]; // No need to care about the individual ranges, as the document is being destroyed
   m_highlights.remove(tracker);
 }
@@ -635,6 +806,17 @@ void CodeHighlighting::aboutToRemoveText( const KTextEditor::Range& range )
       }
     }
   }
+  if(PendingApply* pending = m_pending.value(tracker))
+  {
+    for(auto it = pending->m_oldRanges.begin(); it != pending->m_oldRanges.end(); ) {
+      if (range.contains((*it)->toRange())) {
+        delete (*it);
+        it = pending->m_oldRanges.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
 }
 
 }
@@ -25,6 +25,7 @@
 #define KDEVPLATFORM_CODEHIGHLIGHTING_H
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QHash>
 
 #include <serialization/indexedstring.h>
@@ -35,6 +36,8 @@
 #include <KTextEditor/Attribute>
 #include <KTextEditor/MovingRange>
 
+class TestHighlighting;
+
 namespace KDevelop
 {
 class DUContext;
@@ -163,6 +166,28 @@ class KDEVPLATFORMLANGUAGE_EXPORT CodeHighlighting : public QObject, public KDev
     /// Returns whether a highlighting is already given for the given url
     bool hasHighlighting(IndexedString url) const override;
 
+    /**
+     * Timing of applying the computed highlighting to the documents, which happens in
+     * time-slices on the foreground thread. Times are given in microseconds.
+     */
+    struct ApplyStatistics
+    {
+      quint64 applies = 0;
+      quint64 slices = 0;
+      /// Moving ranges that were kept from the previous highlighting, and newly created ones
+      quint64 reusedRanges = 0;
+      quint64 createdRanges = 0;
+      quint64 totalSliceUs = 0;
+      quint64 maxSliceUs = 0;
+      /// Time from receiving the last completed highlighting until the visible lines, and until all lines were highlighted
+      quint64 lastVisibleUs = 0;
+      quint64 lastApplyUs = 0;
+    };
+
+    /// This function is thread-safe
+    ApplyStatistics applyStatistics() const;
+    void resetApplyStatistics();
+
   private:
     //Returns whether the given attribute was set by the code highlighting, and not by something else
     //Always returns true when the attribute is zero
@@ -186,8 +211,42 @@ class KDEVPLATFORMLANGUAGE_EXPORT CodeHighlighting : public QObject, public KDev
 
     QMap<DocumentChangeTracker*, DocumentHighlighting*> m_highlights;
 
+    /// Highlighting that is still being applied to a document, see applyHighlighting()
+    struct PendingApply
+    {
+      DocumentHighlighting* m_highlighting;
+      /// Indices into m_highlighting->m_waiting in the order they are applied, those on visible lines first
+      QVector<int> m_order;
+      int m_visibleCount = 0;
+      int m_next = 0;
+      /// First and last line shown by each view of the document
+      QVector<QPair<int, int>> m_visibleLines;
+      /// The moving ranges of the previous highlighting that were not reused yet, by their start line in m_oldRangesRevision
+      QMultiHash<int, KTextEditor::MovingRange*> m_oldRanges;
+      /// The document revision m_oldRanges is keyed for, edits in between two slices move the ranges
+      qint64 m_oldRangesRevision = -1;
+      bool m_visibleDone = false;
+      QElapsedTimer m_timer;
+      quint64 m_visibleUs = 0;
+    };
+
+    QMap<DocumentChangeTracker*, PendingApply*> m_pending;
+    bool m_sliceScheduled = false;
+    ApplyStatistics m_applyStatistics;
+
+    /// Replaces the highlighting of @p tracker by @p highlighting, which is then applied by applyPendingSlices()
+    void startApply(DocumentChangeTracker* tracker, DocumentHighlighting* highlighting);
+
+    /// Applies the next ranges of @p pending until @p slice exceeds the time budget
+    /// @returns whether all ranges are applied
+    bool applySlice(DocumentChangeTracker* tracker, PendingApply* pending, const QElapsedTimer& slice);
+
+    /// Keys the old ranges of @p pending by their current start line, if the document changed since they were keyed
+    static void updateOldRanges(PendingApply* pending, KTextEditor::MovingInterface* moving);
+
 
     friend class CodeHighlightingInstance;
+    friend class ::TestHighlighting;
 
     mutable QHash<Types, KTextEditor::Attribute::Ptr> m_definitionAttributes;
     mutable QHash<Types, KTextEditor::Attribute::Ptr> m_declarationAttributes;
@@ -203,6 +262,7 @@ class KDEVPLATFORMLANGUAGE_EXPORT CodeHighlighting : public QObject, public KDev
   private Q_SLOTS:
     void clearHighlightingForDocument(const KDevelop::IndexedString& document);
     void applyHighlighting(void* highlighting);
+    void applyPendingSlices();
 
     void trackerDestroyed(QObject* object);
 
@@ -22,10 +22,15 @@
 #include "test_highlighting.h"
 
 #include <QTest>
+#include <QTemporaryFile>
+#include <KTextEditor/Document>
+#include <KTextEditor/Editor>
 #include <tests/autotestshell.h>
 #include <tests/testcore.h>
 #include <language/duchain/duchain.h>
 #include <language/codegen/coderepresentation.h>
+#include <language/backgroundparser/documentchangetracker.h>
+#include <util/foregroundlock.h>
 #include <language/highlighting/codehighlighting.h>
 
 QTEST_MAIN(TestHighlighting)
@@ -52,4 +57,60 @@ void TestHighlighting::testInitialization()
     QVERIFY(highlighting.attributeForDepth(0));
 }
 
+void TestHighlighting::testSlicedApply()
+{
+    ForegroundLock foreground;
+
+    const int lines = 1000;
+    QString text;
+    for (int i = 0; i < lines; ++i) {
+        text += QStringLiteral("int variable%1;\n").arg(i);
+    }
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QScopedPointer<KTextEditor::Document> doc(KTextEditor::Editor::instance()->createDocument(nullptr));
+    doc->setText(text);
+    QVERIFY(doc->saveAs(QUrl::fromLocalFile(file.fileName())));
+
+    CodeHighlighting codeHighlighting(this);
+    DocumentChangeTracker tracker(doc.data());
 
+    const auto highlightingForDocument = [&]() {
+        auto highlighting = new CodeHighlighting::DocumentHighlighting;
+        highlighting->m_document = IndexedString(doc->url());
+        highlighting->m_waitingRevision = tracker.revisionAtLastReset()->revision();
+        for (int i = 0; i < lines; ++i) {
+            highlighting->m_waiting.append({RangeInRevision(i, 4, i, 12), codeHighlighting.attributeForDepth(0)});
+        }
+        return highlighting;
+    };
+    const auto applyAllSlices = [&]() {
+        while (codeHighlighting.m_pending.contains(&tracker)) {
+            codeHighlighting.applyPendingSlices();
+        }
+    };
+
+    codeHighlighting.startApply(&tracker, highlightingForDocument());
+    applyAllSlices();
+    QCOMPARE(codeHighlighting.applyStatistics().createdRanges, quint64(lines));
+    QCOMPARE(codeHighlighting.m_highlights[&tracker]->m_highlightedRanges.size(), lines);
+
+    // Editing the document while the slices are applied moves the ranges that are reused
+    codeHighlighting.resetApplyStatistics();
+    codeHighlighting.startApply(&tracker, highlightingForDocument());
+    doc->insertLine(0, QStringLiteral("// inserted"));
+    codeHighlighting.applyPendingSlices();
+    // Without views nothing is visible, so that part is done with the first slice
+    const auto pending = codeHighlighting.m_pending.value(&tracker);
+    QVERIFY(!pending || pending->m_visibleDone);
+    applyAllSlices();
+    QCOMPARE(codeHighlighting.applyStatistics().reusedRanges, quint64(lines));
+    QCOMPARE(codeHighlighting.applyStatistics().createdRanges, quint64(0));
+    QCOMPARE(codeHighlighting.applyStatistics().applies, quint64(1));
+    QVERIFY(codeHighlighting.applyStatistics().lastVisibleUs <= codeHighlighting.applyStatistics().lastApplyUs);
+
+    const auto highlightedRanges = codeHighlighting.m_highlights[&tracker]->m_highlightedRanges;
+    QCOMPARE(highlightedRanges.size(), lines);
+    QCOMPARE(highlightedRanges.first()->start().line(), 1);
+}
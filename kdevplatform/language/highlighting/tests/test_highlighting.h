@@ -34,6 +34,7 @@ private Q_SLOTS:
 
     // for valgrind
     void testInitialization();
+    void testSlicedApply();
 };
 
 #endif // KDEVPLATFORM_TEST_HIGHLIGHTING_H
@@ -19,7 +19,11 @@ Boston, MA 02110-1301, USA.
 
 #include "abbreviations.h"
 
+#include <numeric>
+
 #include <QStringList>
+#include <QVector>
+#include <QtConcurrentMap>
 #include <util/path.h>
 
 namespace KDevelop {
@@ -233,4 +237,61 @@ int matchPathFilter(const Path &toFilter, const QStringList &text, const Path &p
     }
 }
 
+static inline quint64 asciiCharacterBit(ushort c)
+{
+    if (c >= 'a' && c <= 'z') {
+        return quint64(1) << (c - 'a');
+    } else if (c >= '0' && c <= '9') {
+        return quint64(1) << (26 + c - '0');
+    } else if (c < 0x80) {
+        return quint64(1) << (36 + c % 28);
+    }
+    return 0;
+}
+
+quint64 matchPathFilterMask(const Path& path)
+{
+    quint64 mask = 0;
+    for (const QString& segment : path.segments()) {
+        for (const QChar c : segment) {
+            // QString::indexOf compares folded characters, the abbreviation matching lower-cased ones
+            mask |= asciiCharacterBit(c.toLower().unicode()) | asciiCharacterBit(c.toCaseFolded().unicode());
+        }
+    }
+    return mask;
+}
+
+quint64 matchPathFilterMask(const QStringList& text)
+{
+    quint64 mask = 0;
+    for (const QString& segment : text) {
+        for (const QChar c : segment) {
+            const QChar lower = c.toLower();
+            // non-ASCII characters may match different characters depending on the comparison, skip them
+            if (lower.unicode() < 0x80 && c.toCaseFolded() == lower) {
+                mask |= asciiCharacterBit(lower.unicode());
+            }
+        }
+    }
+    return mask;
+}
+
+void forEachChunk(int count, int chunkSize, const std::function<void(int chunk, int begin, int end)>& function)
+{
+    const int chunks = (count + chunkSize - 1) / chunkSize;
+    if (chunks <= 1) {
+        if (count) {
+            function(0, 0, count);
+        }
+        return;
+    }
+
+    QVector<int> chunkNumbers(chunks);
+    std::iota(chunkNumbers.begin(), chunkNumbers.end(), 0);
+    QtConcurrent::blockingMap(chunkNumbers, [&](int chunk) {
+        const int begin = chunk * chunkSize;
+        function(chunk, begin, qMin(begin + chunkSize, count));
+    });
+}
+
 } // namespace KDevelop
@@ -22,6 +22,8 @@ Boston, MA 02110-1301, USA.
 
 #include <QVarLengthArray>
 
+#include <functional>
+
 #include <language/languageexport.h>
 
 class QStringList;
@@ -52,6 +54,27 @@ KDEVPLATFORMLANGUAGE_EXPORT bool matchesAbbreviationMulti(const QString& word, c
  * @return -1 when no match is found, otherwise a positive integer, higher values mean lower quality
  */
 KDEVPLATFORMLANGUAGE_EXPORT int matchPathFilter(const Path& toFilter, const QStringList& text, const Path& prefixPath);
+
+/**
+ * @brief Computes a bitmask of the (case-folded, ASCII) characters that occur in a path.
+ * An item can only be matched by matchPathFilter() when every bit of matchPathFilterMask(text)
+ * is also set in its matchPathFilterMask(path).
+ */
+KDEVPLATFORMLANGUAGE_EXPORT quint64 matchPathFilterMask(const Path& path);
+
+/**
+ * @brief Computes the bitmask of the characters that a path matching @p text must contain.
+ * @see matchPathFilterMask(const Path&)
+ */
+KDEVPLATFORMLANGUAGE_EXPORT quint64 matchPathFilterMask(const QStringList& text);
+
+/**
+ * @brief Calls @p function for consecutive chunks of the range [0, count), in parallel on the global thread pool.
+ * Returns once all chunks have been processed. Small ranges are processed on the calling thread.
+ * @param function is called with the chunk number and the begin and end of the chunk
+ */
+KDEVPLATFORMLANGUAGE_EXPORT void forEachChunk(int count, int chunkSize,
+                                              const std::function<void(int chunk, int begin, int end)>& function);
 }
 
 #endif
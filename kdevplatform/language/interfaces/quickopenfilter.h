@@ -24,6 +24,8 @@
 
 #include <QStringList>
 
+#include <algorithm>
+
 #include "abbreviations.h"
 
 #include <util/path.h>
@@ -139,6 +141,13 @@ private:
     QVector<Item> m_items;
 };
 
+/**
+ * Filters items by their path, see matchPathFilter().
+ *
+ * For every item, a bitmask of the characters in its path is kept, so that items which cannot
+ * match the filter are skipped cheaply. The remaining items are scored in parallel chunks,
+ * so Parent::itemPath() and Parent::itemPrefixPath() must be safe to call from multiple threads.
+ */
 template<class Item, class Parent>
 class PathFilter
 {
@@ -147,6 +156,7 @@ public:
     void clearFilter()
     {
         m_filtered = m_items;
+        m_filteredIndices.clear();
         m_oldFilterText.clear();
     }
 
@@ -154,6 +164,13 @@ public:
     void setItems(const QVector<Item>& data)
     {
         m_items = data;
+        m_itemMasks.resize(m_items.size());
+        quint64* masks = m_itemMasks.data();
+        forEachChunk(m_items.size(), ChunkSize, [this, masks](int /*chunk*/, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                masks[i] = matchPathFilterMask(static_cast<const Parent*>(this)->itemPath(m_items.at(i)));
+            }
+        });
         clearFilter();
     }
 
@@ -179,10 +196,10 @@ public:
             return;
         }
 
-        QVector<Item> filterBase = m_filtered;
+        bool filterAll = false;
 
         if ( m_oldFilterText.isEmpty()) {
-            filterBase = m_items;
+            filterAll = true;
         } else if (m_oldFilterText.mid(0, m_oldFilterText.count() - 1) == text.mid(0, text.count() - 1)
                    && text.last().startsWith(m_oldFilterText.last())) {
             //Good, the prefix is the same, and the last item has been extended
@@ -190,18 +207,37 @@ public:
             //Good, an item has been added
         } else {
             //Start filtering based on the whole data, there was a big change to the filter
-            filterBase = m_items;
+            filterAll = true;
         }
 
-        QVector<QPair<int, int>> matches;
-        for (int i = 0, c = filterBase.size(); i < c; ++i) {
-            const auto& data = filterBase.at(i);
-            const auto matchQuality = matchPathFilter(static_cast<Parent*>(this)->itemPath(data), text,
-                                                      static_cast<Parent*>(this)->itemPrefixPath(data));
-            if (matchQuality == -1) {
-                continue;
+        // indices into m_items of the items to filter, all items if filterAll is set
+        const QVector<int> filterBase = filterAll ? QVector<int>() : m_filteredIndices;
+        const int baseCount = filterAll ? m_items.size() : filterBase.size();
+        const quint64 textMask = matchPathFilterMask(text);
+
+        // every chunk collects its matches in order, so the sort below stays stable across chunks
+        QVector<QVector<QPair<int, int>>> chunkMatches((baseCount + ChunkSize - 1) / ChunkSize);
+        QVector<QPair<int, int>>* chunkMatchesData = chunkMatches.data();
+        forEachChunk(baseCount, ChunkSize, [&](int chunk, int begin, int end) {
+            auto& matches = chunkMatchesData[chunk];
+            const auto* parent = static_cast<const Parent*>(this);
+            for (int i = begin; i < end; ++i) {
+                const int index = filterAll ? i : filterBase.at(i);
+                if ((m_itemMasks.at(index) & textMask) != textMask) {
+                    continue;
+                }
+                const auto& data = m_items.at(index);
+                const auto matchQuality = matchPathFilter(parent->itemPath(data), text, parent->itemPrefixPath(data));
+                if (matchQuality == -1) {
+                    continue;
+                }
+                matches.push_back({matchQuality, index});
             }
-            matches.push_back({matchQuality, i});
+        });
+
+        QVector<QPair<int, int>> matches;
+        for (const auto& chunk : chunkMatches) {
+            matches += chunk;
         }
         std::stable_sort(matches.begin(), matches.end(),
                   [](const QPair<int, int>& lhs, const QPair<int, int>& rhs)
@@ -209,17 +245,26 @@ public:
                     return lhs.first < rhs.first;
                   });
         m_filtered.resize(matches.size());
-        std::transform(matches.begin(), matches.end(), m_filtered.begin(),
-                       [&filterBase](const QPair<int, int>& match) {
-                            return filterBase.at(match.second);
-                       });
+        m_filteredIndices.resize(matches.size());
+        for (int i = 0; i < matches.size(); ++i) {
+            m_filtered[i] = m_items.at(matches.at(i).second);
+            m_filteredIndices[i] = matches.at(i).second;
+        }
         m_oldFilterText = text;
     }
 
 private:
+    enum {
+        ChunkSize = 4096
+    };
+
     QStringList m_oldFilterText;
     QVector<Item> m_filtered;
+    /// Indices into m_items of the entries in m_filtered, only valid while m_oldFilterText is not empty
+    QVector<int> m_filteredIndices;
     QVector<Item> m_items;
+    /// matchPathFilterMask() of every item
+    QVector<quint64> m_itemMasks;
 };
 
 }
@@ -26,7 +26,9 @@ Boston, MA 02110-1301, USA.
 #include <interfaces/iruntimecontroller.h>
 #include <util/environmentprofilelist.h>
 #include <util/processlinemaker.h>
+#include <KConfigGroup>
 #include <KProcess>
+#include <KSharedConfig>
 #include <KLocalizedString>
 #include <KShell>
 #include <QFileInfo>
@@ -231,7 +233,11 @@ void OutputExecuteJob::start()
             }
         }
 
-        setModel( new OutputModel( effectiveWorkingDirectory ) );
+        auto* model = new OutputModel( effectiveWorkingDirectory );
+        // Long running processes can produce more output than should be kept in memory
+        const KConfigGroup config = KSharedConfig::openConfig()->group( "Output View" );
+        model->setMaxLinesInMemory( config.readEntry( "MaxLinesInMemory", 0 ) );
+        setModel( model );
     }
     Q_ASSERT( model() );
 
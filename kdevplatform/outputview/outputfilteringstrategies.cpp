@@ -58,6 +58,79 @@ FilteredItem match(const ErrorFormats& errorFormats, const QString& line)
     return item;
 }
 
+/**
+ * A cheap test whether a line can match a format at all. Most lines of a build output only
+ * pass the prefilters of few formats, so the others' regular expressions don't run on them.
+ * A prefilter must accept every line its format matches.
+ */
+class LinePrefilter
+{
+public:
+    enum Feature {
+        NoFeature = 0,
+        HasColon = 1,
+        HasDigit = 2
+    };
+
+    /// @param features The features the line must have
+    /// @param literals If given, the line must contain one of them
+    explicit LinePrefilter(int features, std::initializer_list<const char*> literals = {})
+        : m_features(features)
+    {
+        m_literals.reserve(literals.size());
+        for (const char* literal : literals) {
+            m_literals.append(QLatin1String(literal));
+        }
+    }
+
+    /// The features of @p line, determined in a single pass
+    static int featuresOf(const QString& line)
+    {
+        int features = NoFeature;
+        for (const QChar c : line) {
+            if (c == QLatin1Char(':')) {
+                features |= HasColon;
+            } else if (c >= QLatin1Char('0') && c <= QLatin1Char('9')) {
+                features |= HasDigit;
+            }
+            if (features == (HasColon | HasDigit)) {
+                break;
+            }
+        }
+        return features;
+    }
+
+    bool accepts(const QString& line, int lineFeatures) const
+    {
+        if ((lineFeatures & m_features) != m_features) {
+            return false;
+        }
+        if (m_literals.isEmpty()) {
+            return true;
+        }
+        for (const auto& literal : m_literals) {
+            if (line.contains(literal)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    int m_features;
+    QVector<QLatin1String> m_literals;
+};
+
+template<typename Format>
+struct PrefilteredFormat
+{
+    LinePrefilter prefilter;
+    Format format;
+};
+
+using PrefilteredActionFormat = PrefilteredFormat<ActionFormat>;
+using PrefilteredErrorFormat = PrefilteredFormat<ErrorFormat>;
+
 /// --- No filter strategy ---
 
 NoFilterStrategy::NoFilterStrategy()
@@ -161,50 +234,75 @@ QVector<QString> CompilerFilterStrategy::currentDirs() const
 FilteredItem CompilerFilterStrategy::actionInLine(const QString& line)
 {
     // A list of filters for possible compiler, linker, and make actions
-    static const ActionFormat ACTION_FILTERS[] = {
-        ActionFormat( 2,
-                      QStringLiteral("(?:^|[^=])\\b(gcc|CC|cc|distcc|c\\+\\+|g\\+\\+|clang(?:\\+\\+)|mpicc|icc|icpc)\\s+.*-c.*[/ '\\\\]+(\\w+\\.(?:cpp|CPP|c|C|cxx|CXX|cs|m|M|mm|MM|java|hpf|f|F|f90|F90|f95|F95))")),
+    static const PrefilteredActionFormat ACTION_FILTERS[] = {
+        { LinePrefilter( LinePrefilter::NoFeature, {"-c"} ),
+          ActionFormat( 2,
+                      QStringLiteral("(?:^|[^=])\\b(gcc|CC|cc|distcc|c\\+\\+|g\\+\\+|clang(?:\\+\\+)|mpicc|icc|icpc)\\s+.*-c.*[/ '\\\\]+(\\w+\\.(?:cpp|CPP|c|C|cxx|CXX|cs|m|M|mm|MM|java|hpf|f|F|f90|F90|f95|F95))")) },
         //moc and uic
-        ActionFormat( 2, QStringLiteral("/(moc|uic)\\b.*\\s-o\\s([^\\s;]+)")),
+        { LinePrefilter( LinePrefilter::NoFeature, {"/moc", "/uic"} ),
+          ActionFormat( 2, QStringLiteral("/(moc|uic)\\b.*\\s-o\\s([^\\s;]+)")) },
         //libtool linking
-        ActionFormat( QStringLiteral("libtool"), QStringLiteral("/bin/sh\\s.*libtool.*--mode=link\\s.*\\s-o\\s([^\\s;]+)"), 1 ),
+        { LinePrefilter( LinePrefilter::NoFeature, {"--mode=link"} ),
+          ActionFormat( QStringLiteral("libtool"), QStringLiteral("/bin/sh\\s.*libtool.*--mode=link\\s.*\\s-o\\s([^\\s;]+)"), 1 ) },
         //unsermake
-        ActionFormat( 1, QStringLiteral("^compiling (.*)") ),
-        ActionFormat( 2, QStringLiteral("^generating (.*)") ),
-        ActionFormat( 2, QStringLiteral("(gcc|cc|c\\+\\+|g\\+\\+|clang(?:\\+\\+)|mpicc|icc|icpc)\\S* (?:\\S* )*-o ([^\\s;]+)")),
-        ActionFormat( 2, QStringLiteral("^linking (.*)") ),
+        { LinePrefilter( LinePrefilter::NoFeature, {"compiling "} ),
+          ActionFormat( 1, QStringLiteral("^compiling (.*)") ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"generating "} ),
+          ActionFormat( 2, QStringLiteral("^generating (.*)") ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"-o "} ),
+          ActionFormat( 2, QStringLiteral("(gcc|cc|c\\+\\+|g\\+\\+|clang(?:\\+\\+)|mpicc|icc|icpc)\\S* (?:\\S* )*-o ([^\\s;]+)")) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"linking "} ),
+          ActionFormat( 2, QStringLiteral("^linking (.*)") ) },
         //cmake
-        ActionFormat( 1, QStringLiteral("\\[.+%\\] Built target (.*)") ),
-        ActionFormat( QStringLiteral("cmake"),
-                      QStringLiteral("\\[.+%\\] Building .* object (.*)"), 1 ),
-        ActionFormat( 1, QStringLiteral("\\[.+%\\] Generating (.*)") ),
-        ActionFormat( 1, QStringLiteral("^Linking (.*)") ),
-        ActionFormat( QStringLiteral("cmake"),
-                      QStringLiteral("(-- Configuring (done|incomplete)|-- Found|-- Adding|-- Enabling)"), -1 ),
-        ActionFormat( 1, QStringLiteral("-- Installing (.*)") ),
+        { LinePrefilter( LinePrefilter::NoFeature, {"] Built target "} ),
+          ActionFormat( 1, QStringLiteral("\\[.+%\\] Built target (.*)") ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"] Building "} ),
+          ActionFormat( QStringLiteral("cmake"),
+                      QStringLiteral("\\[.+%\\] Building .* object (.*)"), 1 ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"] Generating "} ),
+          ActionFormat( 1, QStringLiteral("\\[.+%\\] Generating (.*)") ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"Linking "} ),
+          ActionFormat( 1, QStringLiteral("^Linking (.*)") ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"-- "} ),
+          ActionFormat( QStringLiteral("cmake"),
+                      QStringLiteral("(-- Configuring (done|incomplete)|-- Found|-- Adding|-- Enabling)"), -1 ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"-- Installing "} ),
+          ActionFormat( 1, QStringLiteral("-- Installing (.*)") ) },
         //cmake - cd - filter for project directory
-        ActionFormat( QStringLiteral("cd"),
-                      QStringLiteral("(?:)cmake(?:\\.exe|\\.bat)? (?:.*?) ((?:[A-Za-z]:|/).*$)"), 1),
+        { LinePrefilter( LinePrefilter::NoFeature, {"cmake"} ),
+          ActionFormat( QStringLiteral("cd"),
+                      QStringLiteral("(?:)cmake(?:\\.exe|\\.bat)? (?:.*?) ((?:[A-Za-z]:|/).*$)"), 1) },
         //libtool install
-        ActionFormat( {},
-                      QStringLiteral("/(?:bin/sh\\s.*mkinstalldirs).*\\s([^\\s;]+)"), 1 ),
-        ActionFormat( {},
-                      QStringLiteral("/(?:usr/bin/install|bin/sh\\s.*mkinstalldirs|bin/sh\\s.*libtool.*--mode=install).*\\s([^\\s;]+)"), 1 ),
+        { LinePrefilter( LinePrefilter::NoFeature, {"mkinstalldirs"} ),
+          ActionFormat( {},
+                      QStringLiteral("/(?:bin/sh\\s.*mkinstalldirs).*\\s([^\\s;]+)"), 1 ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"/usr/bin/install", "mkinstalldirs", "--mode=install"} ),
+          ActionFormat( {},
+                      QStringLiteral("/(?:usr/bin/install|bin/sh\\s.*mkinstalldirs|bin/sh\\s.*libtool.*--mode=install).*\\s([^\\s;]+)"), 1 ) },
         //dcop
-        ActionFormat( QStringLiteral("dcopidl"),
-                      QStringLiteral("dcopidl .* > ([^\\s;]+)"), 1 ),
-        ActionFormat( QStringLiteral("dcopidl2cpp"),
-                      QStringLiteral("dcopidl2cpp (?:\\S* )*([^\\s;]+)"), 1 ),
+        { LinePrefilter( LinePrefilter::NoFeature, {"dcopidl "} ),
+          ActionFormat( QStringLiteral("dcopidl"),
+                      QStringLiteral("dcopidl .* > ([^\\s;]+)"), 1 ) },
+        { LinePrefilter( LinePrefilter::NoFeature, {"dcopidl2cpp "} ),
+          ActionFormat( QStringLiteral("dcopidl2cpp"),
+                      QStringLiteral("dcopidl2cpp (?:\\S* )*([^\\s;]+)"), 1 ) },
         // match against Entering directory to update current build dir
-        ActionFormat( QStringLiteral("cd"),
-                      QStringLiteral("make\\[\\d+\\]: Entering directory (\\`|\\')(.+)'"), 2),
+        { LinePrefilter( LinePrefilter::HasDigit, {"Entering directory "} ),
+          ActionFormat( QStringLiteral("cd"),
+                      QStringLiteral("make\\[\\d+\\]: Entering directory (\\`|\\')(.+)'"), 2) },
         // waf and scons use the same basic convention as make
-        ActionFormat( QStringLiteral("cd"),
-                      QStringLiteral("(Waf|scons): Entering directory (\\`|\\')(.+)'"), 3)
+        { LinePrefilter( LinePrefilter::NoFeature, {"Entering directory "} ),
+          ActionFormat( QStringLiteral("cd"),
+                      QStringLiteral("(Waf|scons): Entering directory (\\`|\\')(.+)'"), 3) }
     };
 
     FilteredItem item(line);
-    for (const auto& curActFilter : ACTION_FILTERS) {
+    const int features = LinePrefilter::featuresOf(line);
+    for (const auto& candidate : ACTION_FILTERS) {
+        if (!candidate.prefilter.accepts(line, features)) {
+            continue;
+        }
+        const ActionFormat& curActFilter = candidate.format;
         const auto match = curActFilter.expression.match(line);
         if( match.hasMatch() ) {
             item.type = FilteredItem::ActionItem;
@@ -253,55 +351,78 @@ FilteredItem CompilerFilterStrategy::errorInLine(const QString& line)
     };
 
     // A list of filters for possible compiler, linker, and make errors
-    static const ErrorFormat ERROR_FILTERS[] = {
+    static const PrefilteredErrorFormat ERROR_FILTERS[] = {
 #ifdef Q_OS_WIN
         // MSVC
-        ErrorFormat( QStringLiteral("^([a-zA-Z]:\\\\.+)\\(([1-9][0-9]*)\\): ((?:error|warning) .+\\:).*$"), 1, 2, 3 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit, {"): "} ),
+          ErrorFormat( QStringLiteral("^([a-zA-Z]:\\\\.+)\\(([1-9][0-9]*)\\): ((?:error|warning) .+\\:).*$"), 1, 2, 3 ) },
 #endif
         // GCC - another case, eg. for #include "pixmap.xpm" which does not exists
-        ErrorFormat( QStringLiteral("^(.:?[^:\\t]+):([0-9]+):([0-9]+):([^0-9]+)"), 1, 2, 4, 3 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit ),
+          ErrorFormat( QStringLiteral("^(.:?[^:\\t]+):([0-9]+):([0-9]+):([^0-9]+)"), 1, 2, 4, 3 ) },
         // ant
-        ErrorFormat( QStringLiteral("\\[javac\\][\\s]+([^:\\t]+):([0-9]+): (warning: .*|error: .*)"), 1, 2, 3, QStringLiteral("javac")),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit, {"[javac]"} ),
+          ErrorFormat( QStringLiteral("\\[javac\\][\\s]+([^:\\t]+):([0-9]+): (warning: .*|error: .*)"), 1, 2, 3, QStringLiteral("javac")) },
         // GCC
-        ErrorFormat( QStringLiteral("^(.:?[^:\\t]+):([0-9]+):([^0-9]+)"), 1, 2, 3 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit ),
+          ErrorFormat( QStringLiteral("^(.:?[^:\\t]+):([0-9]+):([^0-9]+)"), 1, 2, 3 ) },
         // GCC
-        ErrorFormat( QStringLiteral("^(In file included from |[ ]+from )(..[^:\\t]+):([0-9]+)(:|,)(|[0-9]+)"), 2, 3, 5 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit, {"from "} ),
+          ErrorFormat( QStringLiteral("^(In file included from |[ ]+from )(..[^:\\t]+):([0-9]+)(:|,)(|[0-9]+)"), 2, 3, 5 ) },
         // ICC
-        ErrorFormat( QStringLiteral("^(.:?[^:\\t]+)\\(([0-9]+)\\):([^0-9]+)"), 1, 2, 3, QStringLiteral("intel") ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit, {"):"} ),
+          ErrorFormat( QStringLiteral("^(.:?[^:\\t]+)\\(([0-9]+)\\):([^0-9]+)"), 1, 2, 3, QStringLiteral("intel") ) },
         //libtool link
-        ErrorFormat( QStringLiteral("^(libtool):( link):( warning): "), 0, 0, 0 ),
+        { LinePrefilter( LinePrefilter::HasColon, {"libtool: link: warning: "} ),
+          ErrorFormat( QStringLiteral("^(libtool):( link):( warning): "), 0, 0, 0 ) },
         // make
-        ErrorFormat( QStringLiteral("No rule to make target"), 0, 0, 0 ),
+        { LinePrefilter( LinePrefilter::NoFeature, {"No rule to make target"} ),
+          ErrorFormat( QStringLiteral("No rule to make target"), 0, 0, 0 ) },
         // cmake - multiline expression
-        ErrorFormat( QStringLiteral("((^\\/|^[a-zA-Z]:)[\\w|\\/| |\\.]+):([0-9]+):"), 1, 2, 0, QStringLiteral("cmake") ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit ),
+          ErrorFormat( QStringLiteral("((^\\/|^[a-zA-Z]:)[\\w|\\/| |\\.]+):([0-9]+):"), 1, 2, 0, QStringLiteral("cmake") ) },
         // cmake
-        ErrorFormat( QStringLiteral("CMake (Error|Warning) (|\\([a-zA-Z]+\\) )(in|at) ([^:]+):($|[0-9]+)"), 4, 5, 1, QStringLiteral("cmake") ),
+        { LinePrefilter( LinePrefilter::HasColon, {"CMake "} ),
+          ErrorFormat( QStringLiteral("CMake (Error|Warning) (|\\([a-zA-Z]+\\) )(in|at) ([^:]+):($|[0-9]+)"), 4, 5, 1, QStringLiteral("cmake") ) },
         // cmake/automoc
         // example: AUTOMOC: error: /foo/bar.cpp The file includes (...),
         // example: AUTOMOC: error: /foo/bar.cpp: The file includes (...)
         // note: ':' after file name isn't always appended, see http://cmake.org/gitweb?p=cmake.git;a=commitdiff;h=317d8498aa02c9f486bf5071963bb2034777cdd6
         // example: AUTOGEN: error: /foo/bar.cpp: The file includes (...)
         // note: AUTOMOC got renamed to AUTOGEN at some point
-        ErrorFormat( QStringLiteral("^(AUTOMOC|AUTOGEN): error: (.*?) (The file .*)$"), 2, 0, 0 ),
+        { LinePrefilter( LinePrefilter::HasColon, {"AUTOMOC: error: ", "AUTOGEN: error: "} ),
+          ErrorFormat( QStringLiteral("^(AUTOMOC|AUTOGEN): error: (.*?) (The file .*)$"), 2, 0, 0 ) },
         // via qt4_automoc
         // example: automoc4: The file "/foo/bar.cpp" includes the moc file "bar1.moc", but ...
-        ErrorFormat( QStringLiteral("^automoc4: The file \"([^\"]+)\" includes the moc file"), 1, 0, 0 ),
+        { LinePrefilter( LinePrefilter::HasColon, {"automoc4: The file "} ),
+          ErrorFormat( QStringLiteral("^automoc4: The file \"([^\"]+)\" includes the moc file"), 1, 0, 0 ) },
         // Fortran
-        ErrorFormat( QStringLiteral("\"(.*)\", line ([0-9]+):(.*)"), 1, 2, 3 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit, {"\", line "} ),
+          ErrorFormat( QStringLiteral("\"(.*)\", line ([0-9]+):(.*)"), 1, 2, 3 ) },
         // GFortran
-        ErrorFormat( QStringLiteral("^(.*):([0-9]+)\\.([0-9]+):(.*)"), 1, 2, 4, QStringLiteral("gfortran"), 3 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit ),
+          ErrorFormat( QStringLiteral("^(.*):([0-9]+)\\.([0-9]+):(.*)"), 1, 2, 4, QStringLiteral("gfortran"), 3 ) },
         // Jade
-        ErrorFormat( QStringLiteral("^[a-zA-Z]+:([^:\\t]+):([0-9]+):[0-9]+:[a-zA-Z]:(.*)"), 1, 2, 3 ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit ),
+          ErrorFormat( QStringLiteral("^[a-zA-Z]+:([^:\\t]+):([0-9]+):[0-9]+:[a-zA-Z]:(.*)"), 1, 2, 3 ) },
         // ifort
-        ErrorFormat( QStringLiteral("^fortcom: (.*): (.*), line ([0-9]+):(.*)"), 2, 3, 1, QStringLiteral("intel") ),
+        { LinePrefilter( LinePrefilter::HasColon | LinePrefilter::HasDigit, {"fortcom: "} ),
+          ErrorFormat( QStringLiteral("^fortcom: (.*): (.*), line ([0-9]+):(.*)"), 2, 3, 1, QStringLiteral("intel") ) },
         // PGI
-        ErrorFormat( QStringLiteral("PGF9(.*)-(.*)-(.*)-(.*) \\((.*): ([0-9]+)\\)"), 5, 6, 4, QStringLiteral("pgi") ),
+        { LinePrefilter( LinePrefilter::HasDigit, {"PGF9"} ),
+          ErrorFormat( QStringLiteral("PGF9(.*)-(.*)-(.*)-(.*) \\((.*): ([0-9]+)\\)"), 5, 6, 4, QStringLiteral("pgi") ) },
         // PGI (2)
-        ErrorFormat( QStringLiteral("PGF9(.*)-(.*)-(.*)-Symbol, (.*) \\((.*)\\)"), 5, 5, 4, QStringLiteral("pgi") ),
+        { LinePrefilter( LinePrefilter::HasDigit, {"PGF9"} ),
+          ErrorFormat( QStringLiteral("PGF9(.*)-(.*)-(.*)-Symbol, (.*) \\((.*)\\)"), 5, 5, 4, QStringLiteral("pgi") ) },
     };
 
     FilteredItem item(line);
-    for (const auto& curErrFilter : ERROR_FILTERS) {
+    const int features = LinePrefilter::featuresOf(line);
+    for (const auto& candidate : ERROR_FILTERS) {
+        if (!candidate.prefilter.accepts(line, features)) {
+            continue;
+        }
+        const ErrorFormat& curErrFilter = candidate.format;
         const auto match = curErrFilter.expression.match(line);
         if( match.hasMatch() && !( line.contains( QLatin1String("Each undeclared identifier is reported only once") )
                                || line.contains( QLatin1String("for each function it appears in.") ) ) )
@@ -29,8 +29,11 @@
 #include <interfaces/idocumentcontroller.h>
 #include <util/kdevstringhandler.h>
 
+#include <QHash>
+#include <QMutex>
 #include <QStringList>
 #include <QTimer>
+#include <QTemporaryFile>
 #include <QThread>
 #include <QFont>
 #include <QFontDatabase>
@@ -38,6 +41,8 @@
 #include <functional>
 #include <set>
 
+#include <qtcompat_p.h>
+
 Q_DECLARE_METATYPE(QVector<KDevelop::FilteredItem>)
 
 namespace KDevelop
@@ -152,33 +157,297 @@ private:
     IFilterStrategy::Progress m_progress;
 };
 
-class ParsingThread
+/**
+ * The threads the ParseWorkers run in. Each output model gets a thread of its own, so the output of
+ * jobs running in parallel is filtered in parallel as well. Once there are as many threads as cores,
+ * new workers share the thread with the fewest workers. Threads without workers are stopped again.
+ */
+class ParsingThread : public QObject
 {
+    Q_OBJECT
 public:
     ParsingThread()
+        : m_maxThreads(qMax(1, QThread::idealThreadCount()))
     {
-        m_thread.setObjectName(QStringLiteral("OutputFilterThread"));
     }
-    virtual ~ParsingThread()
+    ~ParsingThread() override
     {
-        if (m_thread.isRunning()) {
-            m_thread.quit();
-            m_thread.wait();
+        for (Thread* thread : qAsConst(m_threads)) {
+            stop(thread);
         }
     }
     void addWorker(ParseWorker* worker)
     {
-        if (!m_thread.isRunning()) {
-            m_thread.start();
+        QMutexLocker lock(&m_mutex);
+        Thread* thread = nullptr;
+        for (Thread* candidate : qAsConst(m_threads)) {
+            if (!thread || candidate->workers < thread->workers) {
+                thread = candidate;
+            }
+        }
+        if (!thread || (thread->workers > 0 && m_threads.size() < m_maxThreads)) {
+            thread = new Thread;
+            thread->thread.setObjectName(QStringLiteral("OutputFilterThread"));
+            thread->thread.start();
+            m_threads.append(thread);
         }
-        worker->moveToThread(&m_thread);
+        ++thread->workers;
+        worker->moveToThread(&thread->thread);
+        // Emitted in the worker's thread when it is deleted there, the thread is retired from ours
+        connect(worker, &QObject::destroyed, this, [this, thread]() {
+            removeWorker(thread);
+        }, Qt::QueuedConnection);
     }
 private:
-    QThread m_thread;
+    struct Thread
+    {
+        QThread thread;
+        int workers = 0;
+    };
+
+    void removeWorker(Thread* thread)
+    {
+        QMutexLocker lock(&m_mutex);
+        if (--thread->workers > 0) {
+            return;
+        }
+        m_threads.removeOne(thread);
+        stop(thread);
+    }
+
+    static void stop(Thread* thread)
+    {
+        if (thread->thread.isRunning()) {
+            thread->thread.quit();
+            thread->thread.wait();
+        }
+        delete thread;
+    }
+
+    const int m_maxThreads;
+    QMutex m_mutex;
+    QVector<Thread*> m_threads;
 };
 
 Q_GLOBAL_STATIC(ParsingThread, s_parsingThread)
 
+/**
+ * Number of lines that are stored together as one chunk of UTF-8 text.
+ * Whole chunks are spilled to disk and read back.
+ */
+static const int LINES_PER_CHUNK = 1024;
+
+/**
+ * Number of spilled chunks that are kept in memory after they were read back,
+ * enough for the lines visible in the view and some scrolling around them.
+ */
+static const int PAGED_IN_CHUNKS = 8;
+
+/**
+ * The lines of an OutputModel.
+ *
+ * The text is kept as UTF-8 in chunks of LINES_PER_CHUNK lines, only the type of each line
+ * and the location of activatable lines are kept apart. With a limit on the lines in memory,
+ * the text of the oldest chunks is moved to a temporary file and read back when it is shown.
+ */
+class OutputLines
+{
+public:
+    int count() const
+    {
+        return m_count;
+    }
+
+    void append(const FilteredItem& item)
+    {
+        if (m_count % LINES_PER_CHUNK == 0) {
+            m_chunks.append(Chunk());
+            m_chunks.last().ends.reserve(LINES_PER_CHUNK);
+        }
+        Chunk& chunk = m_chunks.last();
+        chunk.text += item.originalLine.toUtf8();
+        chunk.ends.append(chunk.text.size());
+
+        m_types.append(static_cast<char>(item.type | (item.isActivatable ? ActivatableFlag : 0)));
+        if (item.isActivatable) {
+            m_locations.insert(m_count, Location{item.url, item.lineNo, item.columnNo});
+        }
+        ++m_count;
+
+        if (m_maxLinesInMemory > 0 && m_count % LINES_PER_CHUNK == 0) {
+            spill();
+        }
+    }
+
+    FilteredItem::FilteredOutputItemType type(int row) const
+    {
+        return static_cast<FilteredItem::FilteredOutputItemType>(static_cast<uchar>(m_types.at(row)) & ~ActivatableFlag);
+    }
+
+    bool isActivatable(int row) const
+    {
+        return static_cast<uchar>(m_types.at(row)) & ActivatableFlag;
+    }
+
+    QString line(int row) const
+    {
+        const Chunk* chunk = load(row / LINES_PER_CHUNK);
+        if (!chunk) {
+            return QString();
+        }
+        const int index = row % LINES_PER_CHUNK;
+        const int begin = index ? chunk->ends.at(index - 1) : 0;
+        return QString::fromUtf8(chunk->text.constData() + begin, chunk->ends.at(index) - begin);
+    }
+
+    FilteredItem item(int row) const
+    {
+        FilteredItem item(line(row), type(row));
+        item.isActivatable = isActivatable(row);
+        const auto location = m_locations.constFind(row);
+        if (location != m_locations.constEnd()) {
+            item.url = location->url;
+            item.lineNo = location->lineNo;
+            item.columnNo = location->columnNo;
+        }
+        return item;
+    }
+
+    int maxLinesInMemory() const
+    {
+        return m_maxLinesInMemory;
+    }
+
+    void setMaxLinesInMemory(int lines)
+    {
+        m_maxLinesInMemory = qMax(0, lines);
+        if (m_maxLinesInMemory > 0) {
+            spill();
+        }
+    }
+
+    void clear()
+    {
+        m_chunks.clear();
+        m_types.clear();
+        m_locations.clear();
+        m_pagedIn.clear();
+        m_pagedInOrder.clear();
+        m_spillFile.reset();
+        m_firstInMemory = 0;
+        m_count = 0;
+    }
+
+private:
+    enum {
+        ActivatableFlag = 0x80
+    };
+
+    struct Chunk
+    {
+        QByteArray text;
+        /// End offset of each line within text
+        QVector<int> ends;
+        /// Position of the chunk within the spill file, -1 while it is in memory
+        qint64 spillPosition = -1;
+        int textSize = 0;
+    };
+
+    struct Location
+    {
+        QUrl url;
+        int lineNo;
+        int columnNo;
+    };
+
+    void spill()
+    {
+        // The last chunk is still being filled, so it always stays in memory
+        while (m_firstInMemory < m_chunks.size() - 1
+               && (m_chunks.size() - m_firstInMemory - 1) * LINES_PER_CHUNK >= m_maxLinesInMemory) {
+            if (!spillChunk(m_chunks[m_firstInMemory])) {
+                qCWarning(OUTPUTVIEW) << "keeping all output lines in memory";
+                m_maxLinesInMemory = 0;
+                return;
+            }
+            ++m_firstInMemory;
+        }
+    }
+
+    bool spillChunk(Chunk& chunk)
+    {
+        if (!m_spillFile) {
+            m_spillFile.reset(new QTemporaryFile);
+            if (!m_spillFile->open()) {
+                qCWarning(OUTPUTVIEW) << "cannot create a file for spilling output lines:" << m_spillFile->errorString();
+                return false;
+            }
+        }
+
+        const qint64 position = m_spillFile->size();
+        const qint64 endsSize = chunk.ends.size() * sizeof(int);
+        if (!m_spillFile->seek(position)
+            || m_spillFile->write(reinterpret_cast<const char*>(chunk.ends.constData()), endsSize) != endsSize
+            || m_spillFile->write(chunk.text) != chunk.text.size()) {
+            qCWarning(OUTPUTVIEW) << "failed spilling output lines to" << m_spillFile->fileName() << m_spillFile->errorString();
+            m_spillFile->resize(position);
+            return false;
+        }
+
+        chunk.spillPosition = position;
+        chunk.textSize = chunk.text.size();
+        chunk.text = QByteArray();
+        chunk.ends = QVector<int>();
+        return true;
+    }
+
+    const Chunk* load(int index) const
+    {
+        const Chunk& chunk = m_chunks.at(index);
+        if (chunk.spillPosition < 0) {
+            return &chunk;
+        }
+
+        auto pagedIn = m_pagedIn.find(index);
+        if (pagedIn != m_pagedIn.end()) {
+            m_pagedInOrder.removeOne(index);
+            m_pagedInOrder.append(index);
+            return &pagedIn.value();
+        }
+
+        Chunk loaded;
+        loaded.ends.resize(LINES_PER_CHUNK);
+        loaded.text.resize(chunk.textSize);
+        const qint64 endsSize = LINES_PER_CHUNK * sizeof(int);
+        if (!m_spillFile->seek(chunk.spillPosition)
+            || m_spillFile->read(reinterpret_cast<char*>(loaded.ends.data()), endsSize) != endsSize
+            || m_spillFile->read(loaded.text.data(), chunk.textSize) != chunk.textSize) {
+            qCWarning(OUTPUTVIEW) << "failed reading spilled output lines from" << m_spillFile->fileName() << m_spillFile->errorString();
+            return nullptr;
+        }
+
+        if (m_pagedInOrder.size() >= PAGED_IN_CHUNKS) {
+            m_pagedIn.remove(m_pagedInOrder.takeFirst());
+        }
+        m_pagedInOrder.append(index);
+        return &m_pagedIn.insert(index, loaded).value();
+    }
+
+    QVector<Chunk> m_chunks;
+    /// Item type of each line, with ActivatableFlag
+    QByteArray m_types;
+    QHash<int, Location> m_locations;
+    int m_count = 0;
+
+    int m_maxLinesInMemory = 0;
+    /// Index of the first chunk that was not spilled
+    int m_firstInMemory = 0;
+    QScopedPointer<QTemporaryFile> m_spillFile;
+    mutable QHash<int, Chunk> m_pagedIn;
+    /// Least recently used paged in chunk first
+    mutable QList<int> m_pagedInOrder;
+};
+
 class OutputModelPrivate
 {
 public:
@@ -189,7 +458,7 @@ public:
     OutputModel* model;
     ParseWorker* worker;
 
-    QVector<FilteredItem> m_filteredItems;
+    OutputLines m_lines;
     // We use std::set because that is ordered
     std::set<int> m_errorItems; // Indices of all items that we want to move to using previous and next
     QUrl m_buildDir;
@@ -198,12 +467,11 @@ public:
     {
         model->beginInsertRows( QModelIndex(), model->rowCount(), model->rowCount() + items.size() -  1);
 
-        m_filteredItems.reserve(m_filteredItems.size() + items.size());
         for (const FilteredItem& item : items) {
             if( item.type == FilteredItem::ErrorItem ) {
-                m_errorItems.insert(m_filteredItems.size());
+                m_errorItems.insert(m_lines.count());
             }
-            m_filteredItems << item;
+            m_lines.append(item);
         }
 
         model->endInsertRows();
@@ -259,10 +527,10 @@ QVariant OutputModel::data(const QModelIndex& idx , int role ) const
         switch( role )
         {
             case Qt::DisplayRole:
-                return d->m_filteredItems.at( idx.row() ).originalLine;
+                return d->m_lines.line( idx.row() );
                 break;
             case OutputModel::OutputItemTypeRole:
-                return static_cast<int>(d->m_filteredItems.at( idx.row() ).type);
+                return static_cast<int>(d->m_lines.type( idx.row() ));
                 break;
             case Qt::FontRole:
                 return QFontDatabase::systemFont(QFontDatabase::FixedFont);
@@ -277,7 +545,7 @@ QVariant OutputModel::data(const QModelIndex& idx , int role ) const
 int OutputModel::rowCount( const QModelIndex& parent ) const
 {
     if( !parent.isValid() )
-        return d->m_filteredItems.count();
+        return d->m_lines.count();
     return 0;
 }
 
@@ -295,7 +563,7 @@ void OutputModel::activate( const QModelIndex& index )
     qCDebug(OUTPUTVIEW) << "Model activated" << index.row();
 
 
-    FilteredItem item = d->m_filteredItems.at( index.row() );
+    FilteredItem item = d->m_lines.item( index.row() );
     if( item.isActivatable )
     {
         qCDebug(OUTPUTVIEW) << "activating:" << item.lineNo << item.url;
@@ -323,7 +591,7 @@ QModelIndex OutputModel::firstHighlightIndex()
     }
 
     for( int row = 0; row < rowCount(); ++row ) {
-        if( d->m_filteredItems.at( row ).isActivatable ) {
+        if( d->m_lines.isActivatable( row ) ) {
             return index( row, 0, QModelIndex() );
         }
     }
@@ -349,7 +617,7 @@ QModelIndex OutputModel::nextHighlightIndex( const QModelIndex &currentIdx )
     for( int row = 0; row < rowCount(); ++row )
     {
         int currow = (startrow + row) % rowCount();
-        if( d->m_filteredItems.at( currow ).isActivatable )
+        if( d->m_lines.isActivatable( currow ) )
         {
             return index( currow, 0, QModelIndex() );
         }
@@ -380,7 +648,7 @@ QModelIndex OutputModel::previousHighlightIndex( const QModelIndex &currentIdx )
     for ( int row = 0; row < rowCount(); ++row )
     {
         int currow = (startrow - row) % rowCount();
-        if( d->m_filteredItems.at( currow ).isActivatable )
+        if( d->m_lines.isActivatable( currow ) )
         {
             return index( currow, 0, QModelIndex() );
         }
@@ -395,7 +663,7 @@ QModelIndex OutputModel::lastHighlightIndex()
     }
 
     for( int row = rowCount()-1; row >=0; --row ) {
-        if( d->m_filteredItems.at( row ).isActivatable ) {
+        if( d->m_lines.isActivatable( row ) ) {
             return index( row, 0, QModelIndex() );
         }
     }
@@ -448,6 +716,16 @@ void OutputModel::appendLines( const QStringList& lines )
                               Q_ARG(QStringList, lines));
 }
 
+void OutputModel::setMaxLinesInMemory(int lines)
+{
+    d->m_lines.setMaxLinesInMemory(lines);
+}
+
+int OutputModel::maxLinesInMemory() const
+{
+    return d->m_lines.maxLinesInMemory();
+}
+
 void OutputModel::appendLine( const QString& line )
 {
     appendLines( QStringList() << line );
@@ -462,7 +740,8 @@ void OutputModel::clear()
 {
     ensureAllDone();
     beginResetModel();
-    d->m_filteredItems.clear();
+    d->m_lines.clear();
+    d->m_errorItems.clear();
     endResetModel();
 }
 
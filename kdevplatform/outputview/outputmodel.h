@@ -70,6 +70,16 @@ public:
     void setFilteringStrategy(const OutputFilterStrategy& currentStrategy);
     void setFilteringStrategy(IFilterStrategy* filterStrategy);
 
+    /**
+     * Limits the number of lines whose text is kept in memory. The text of older lines is
+     * moved to a temporary file and read back when it is shown. Their type and location
+     * stay in memory, so navigating between errors works as before.
+     *
+     * @param lines The limit, 0 keeps all lines in memory, which is the default
+     */
+    void setMaxLinesInMemory(int lines);
+    int maxLinesInMemory() const;
+
 public Q_SLOTS:
     void appendLine( const QString& );
     void appendLines( const QStringList& );
@@ -119,6 +119,10 @@ void TestFilteringStrategy::testCompilerFilterStrategy_data()
 
     QTest::newRow("cppcheck-info-line")
     << buildCppCheckInformationLine() << FilteredItem::InvalidItem << FilteredItem::InvalidItem << UnixFilePathNoSpaces;
+    QTest::newRow("javac-error-line")
+    << "    [javac] /home/user/project/Foo.java:12: error: cannot find symbol" << FilteredItem::ErrorItem << FilteredItem::InvalidItem << UnixFilePathNoSpaces;
+    QTest::newRow("make-entering-directory-line")
+    << "make[2]: Entering directory '/home/user/build'" << FilteredItem::InvalidItem << FilteredItem::ActionItem << UnixFilePathNoSpaces;
     for (TestPathType pathType :
 #ifdef Q_OS_WIN
         {WindowsFilePathNoSpaces, WindowsFilePathWithSpaces}
@@ -19,6 +19,7 @@
 #include "test_outputmodel.h"
 #include "testlinebuilderfunctions.h"
 #include "../outputmodel.h"
+#include "../filtereditem.h"
 
 #include <QTest>
 
@@ -122,4 +123,39 @@ void TestOutputModel::bench_data()
     QTest::newRow("static-analysis-filter-longline") << OutputModel::StaticAnalysisFilter << longLine;
 }
 
+void TestOutputModel::testSpilledLines()
+{
+    const QStringList lines = generateLines();
+
+    OutputModel testee(QUrl::fromLocalFile(QStringLiteral("/tmp/build-foo")));
+    testee.setFilteringStrategy(OutputModel::CompilerFilter);
+    testee.setMaxLinesInMemory(100);
+    QCOMPARE(testee.maxLinesInMemory(), 100);
+
+    testee.appendLines(lines);
+    while(testee.rowCount() != lines.count()) {
+        QCoreApplication::instance()->processEvents();
+    }
+
+    // reading back in random order pages spilled lines in and out
+    for (int row : {0, lines.count() - 1, 1, 5000, 1023, 1024, 2047, 3, lines.count() / 2}) {
+        QCOMPARE(testee.data(testee.index(row, 0)).toString(), lines.at(row));
+    }
+
+    // the errors at the start were spilled, but can still be navigated to
+    const QModelIndex first = testee.firstHighlightIndex();
+    QVERIFY(first.isValid());
+    QCOMPARE(testee.data(first, OutputModel::OutputItemTypeRole).toInt(), int(FilteredItem::ErrorItem));
+    QCOMPARE(testee.data(first).toString(), lines.at(first.row()));
+
+    const QModelIndex next = testee.nextHighlightIndex(first);
+    QVERIFY(next.row() > first.row());
+    QCOMPARE(testee.data(next, OutputModel::OutputItemTypeRole).toInt(), int(FilteredItem::ErrorItem));
+    QCOMPARE(testee.previousHighlightIndex(next), first);
+
+    testee.clear();
+    QCOMPARE(testee.rowCount(), 0);
+    QVERIFY(!testee.firstHighlightIndex().isValid());
+}
+
 }
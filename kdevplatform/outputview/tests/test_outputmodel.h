@@ -34,6 +34,7 @@ public:
 private Q_SLOTS:
     void bench();
     void bench_data();
+    void testSpilledLines();
 };
 
 }
@@ -155,8 +155,8 @@ using IndexedStringRepositoryManagerBase = RepositoryManager<IndexedStringReposi
 class IndexedStringRepositoryManager : public IndexedStringRepositoryManagerBase
 {
 public:
-    IndexedStringRepositoryManager()
-      : IndexedStringRepositoryManagerBase(QStringLiteral("String Index"))
+    explicit IndexedStringRepositoryManager(const QString& name)
+      : IndexedStringRepositoryManagerBase(name)
     {
         repository()->setMutex(&m_mutex);
     }
@@ -166,24 +166,117 @@ private:
     QMutex m_mutex;
 };
 
-IndexedStringRepository* globalIndexedStringRepository()
+/**
+ * The strings are distributed over several independent repositories by their hash,
+ * each protected by its own mutex, so that concurrent parsers rarely contend
+ * on the same lock.
+ *
+ * The shard is encoded in the bucket part of the public index:
+ * globalBucket = localBucket * StringRepositoryShardCount + shard
+ *
+ * So each shard only gets an eighth of the bucket range. A string whose shard is full
+ * spills over into the following shards instead.
+ */
+enum {
+    StringRepositoryShardBits = 3,
+    StringRepositoryShardCount = 1 << StringRepositoryShardBits
+};
+
+class IndexedStringRepositoryShards
+{
+public:
+    IndexedStringRepositoryShards()
+    {
+        for (uint shard = 0; shard < StringRepositoryShardCount; ++shard) {
+            m_managers[shard].reset(new IndexedStringRepositoryManager(QStringLiteral("String Index %1").arg(shard)));
+            m_repositories[shard] = m_managers[shard]->repository();
+            // the largest local bucket must map to a global bucket below the reserved 0xffff
+            m_repositories[shard]->setBucketLimit((0xfffe - shard) / StringRepositoryShardCount + 1);
+            if (m_repositories[shard]->bucketLimitReached()) {
+                m_spilled = 1;
+            }
+        }
+    }
+
+    IndexedStringRepository* repository(uint shard) const
+    {
+        return m_repositories[shard];
+    }
+
+    /// Whether a string had to be stored outside of its shard, so lookups must search all shards
+    bool hasSpilled() const
+    {
+        return m_spilled.loadAcquire();
+    }
+
+    void setSpilled()
+    {
+        m_spilled.storeRelease(1);
+    }
+
+    /// Serializes the lookups and insertions once strings spill over, so no string is stored twice
+    QMutex* spillMutex()
+    {
+        return &m_spillMutex;
+    }
+
+private:
+    QScopedPointer<IndexedStringRepositoryManager> m_managers[StringRepositoryShardCount];
+    IndexedStringRepository* m_repositories[StringRepositoryShardCount];
+    QAtomicInt m_spilled;
+    QMutex m_spillMutex;
+};
+
+IndexedStringRepositoryShards& indexedStringRepositoryShards()
+{
+    static IndexedStringRepositoryShards shards;
+    return shards;
+}
+
+IndexedStringRepository* indexedStringRepositoryShard(uint shard)
+{
+    return indexedStringRepositoryShards().repository(shard);
+}
+
+inline uint shardForHash(uint hash)
+{
+    // the low bits are used for bucket selection inside the repository, mix the hash to pick the shard
+    return (hash * 0x9E3779B1u) >> (32 - StringRepositoryShardBits);
+}
+
+inline uint shardFromIndex(uint index)
+{
+    return (index >> 16) & (StringRepositoryShardCount - 1);
+}
+
+inline uint localIndexFromIndex(uint index)
 {
-    static IndexedStringRepositoryManager manager;
-    return manager.repository();
+    return ((index >> 16) >> StringRepositoryShardBits) << 16 | (index & 0xffff);
+}
+
+inline uint indexFromLocalIndex(uint shard, uint localIndex)
+{
+    if (!localIndex) {
+        return 0;
+    }
+    const uint bucket = ((localIndex >> 16) << StringRepositoryShardBits) | shard;
+    // the bucket limit of the shards keeps clear of the range 0xffff____ reserved for single-char strings
+    Q_ASSERT(bucket < 0xffff);
+    return (bucket << 16) | (localIndex & 0xffff);
 }
 
 template<typename ReadAction>
-auto readRepo(ReadAction action) -> decltype(action(globalIndexedStringRepository()))
+auto readRepo(uint index, ReadAction action) -> decltype(action(indexedStringRepositoryShard(0), index))
 {
-    const auto* repo = globalIndexedStringRepository();
+    const auto* repo = indexedStringRepositoryShard(shardFromIndex(index));
     QMutexLocker lock(repo->mutex());
-    return action(repo);
+    return action(repo, localIndexFromIndex(index));
 }
 
 template<typename EditAction>
-auto editRepo(EditAction action) -> decltype(action(globalIndexedStringRepository()))
+auto editRepo(uint shard, EditAction action) -> decltype(action(indexedStringRepositoryShard(0)))
 {
-    auto* repo = globalIndexedStringRepository();
+    auto* repo = indexedStringRepositoryShard(shard);
     QMutexLocker lock(repo->mutex());
     return action(repo);
 }
@@ -193,20 +286,63 @@ inline void ref(IndexedString* string)
     const uint index = string->index();
     if (index && !isSingleCharIndex(index)) {
         if (shouldDoDUChainReferenceCounting(string)) {
-            editRepo([index] (IndexedStringRepository* repo) {
-                increase(repo->dynamicItemFromIndexSimple(index)->refCount);
+            const uint localIndex = localIndexFromIndex(index);
+            editRepo(shardFromIndex(index), [localIndex] (IndexedStringRepository* repo) {
+                increase(repo->dynamicItemFromIndexSimple(localIndex)->refCount);
             });
         }
     }
 }
 
+/**
+ * Returns the index of the string described by @p request, inserting it if necessary, or 0 if all shards are full.
+ * If @p refcount is true, a reference is taken while the shard is still locked.
+ */
+uint insertString(const IndexedStringRepositoryItemRequest& request, bool refcount)
+{
+    auto& shards = indexedStringRepositoryShards();
+    const uint home = shardForHash(request.m_hash);
+
+    auto insertInto = [&request, refcount] (uint shard, bool insert) {
+        return editRepo(shard, [&request, refcount, shard, insert] (IndexedStringRepository* repo) {
+            const uint localIndex = insert ? repo->index(request) : repo->findIndex(request);
+            if (refcount && localIndex) {
+                increase(repo->dynamicItemFromIndexSimple(localIndex)->refCount);
+            }
+            return indexFromLocalIndex(shard, localIndex);
+        });
+    };
+
+    if (!shards.hasSpilled()) {
+        if (const uint index = insertInto(home, true)) {
+            return index;
+        }
+        shards.setSpilled();
+    }
+
+    // the string may be in any shard now, search all of them before it is stored in the first one with room
+    QMutexLocker lock(shards.spillMutex());
+    for (uint i = 0; i < StringRepositoryShardCount; ++i) {
+        if (const uint index = insertInto((home + i) % StringRepositoryShardCount, false)) {
+            return index;
+        }
+    }
+    for (uint i = 0; i < StringRepositoryShardCount; ++i) {
+        if (const uint index = insertInto((home + i) % StringRepositoryShardCount, true)) {
+            return index;
+        }
+    }
+    return 0;
+}
+
 inline void deref(IndexedString* string)
 {
     const uint index = string->index();
     if (index && !isSingleCharIndex(index)) {
         if (shouldDoDUChainReferenceCounting(string)) {
-            editRepo([index] (IndexedStringRepository* repo) {
-                decrease(repo->dynamicItemFromIndexSimple(index)->refCount);
+            const uint localIndex = localIndexFromIndex(index);
+            editRepo(shardFromIndex(index), [localIndex] (IndexedStringRepository* repo) {
+                decrease(repo->dynamicItemFromIndexSimple(localIndex)->refCount);
             });
         }
     }
@@ -228,14 +364,7 @@ IndexedString::IndexedString(const char* str, unsigned short length, uint hash)
         m_index = charToIndex(str[0]);
     } else {
         const auto request = IndexedStringRepositoryItemRequest(str, hash ? hash : hashString(str, length), length);
-        bool refcount = shouldDoDUChainReferenceCounting(this);
-        m_index = editRepo([request, refcount] (IndexedStringRepository* repo) {
-            auto index = repo->index(request);
-            if (refcount) {
-                increase(repo->dynamicItemFromIndexSimple(index)->refCount);
-            }
-            return index;
-        });
+        m_index = insertString(request, shouldDoDUChainReferenceCounting(this));
     }
 }
 
@@ -311,8 +440,8 @@ QString IndexedString::str() const
         return QString(QLatin1Char(indexToChar(m_index)));
     } else {
         const uint index = m_index;
-        return readRepo([index] (const IndexedStringRepository* repo) {
-            return stringFromItem(repo->itemFromIndex(index));
+        return readRepo(index, [] (const IndexedStringRepository* repo, uint localIndex) {
+            return stringFromItem(repo->itemFromIndex(localIndex));
         });
     }
 }
@@ -329,8 +458,8 @@ int IndexedString::lengthFromIndex(uint index)
     } else if (isSingleCharIndex(index)) {
         return 1;
     } else {
-        return readRepo([index] (const IndexedStringRepository* repo) {
-            return repo->itemFromIndex(index)->length;
+        return readRepo(index, [] (const IndexedStringRepository* repo, uint localIndex) {
+            return repo->itemFromIndex(localIndex)->length;
         });
     }
 }
@@ -348,8 +477,8 @@ const char* IndexedString::c_str() const
         return reinterpret_cast<const char*>(&m_index) + offset;
     } else {
         const uint index = m_index;
-        return readRepo([index] (const IndexedStringRepository* repo) {
-            return c_strFromItem(repo->itemFromIndex(index));
+        return readRepo(index, [] (const IndexedStringRepository* repo, uint localIndex) {
+            return c_strFromItem(repo->itemFromIndex(localIndex));
         });
     }
 
@@ -363,8 +492,8 @@ QByteArray IndexedString::byteArray() const
         return QByteArray(1, indexToChar(m_index));
     } else {
         const uint index = m_index;
-        return readRepo([index] (const IndexedStringRepository* repo) {
-            return arrayFromItem(repo->itemFromIndex(index));
+        return readRepo(index, [] (const IndexedStringRepository* repo, uint localIndex) {
+            return arrayFromItem(repo->itemFromIndex(localIndex));
         });
     }
 }
@@ -387,9 +516,7 @@ uint IndexedString::indexForString(const char* str, short unsigned length, uint
         return charToIndex(str[0]);
     } else {
         const auto request = IndexedStringRepositoryItemRequest(str, hash ? hash : hashString(str, length), length);
-        return editRepo([request] (IndexedStringRepository* repo) {
-            return repo->index(request);
-        });
+        return insertString(request, false);
     }
 }
 
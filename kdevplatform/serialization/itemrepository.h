@@ -30,6 +30,7 @@
 #include "abstractitemrepository.h"
 #include "repositorymanager.h"
 #include "itemrepositoryregistry.h"
+#include "itemrepositoryjournal.h"
 
 //#define DEBUG_MONSTERBUCKETS
 
@@ -55,6 +56,13 @@
 #endif
 
 #define ITEMREPOSITORY_USE_MMAP_LOADING
+//Map the repository files copy-on-write, so buckets are changed in place instead of being copied to the heap
+#define ITEMREPOSITORY_USE_PRIVATE_MMAP
+
+#if defined(ITEMREPOSITORY_USE_PRIVATE_MMAP) && defined(Q_OS_LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 //Assertion macro that prevents warnings if debugging is disabled
 //Only use it to verify values, it should not call any functions, since else the function will even be called in release mode
@@ -96,7 +104,8 @@ namespace KDevelop {
 
 enum {
   ItemRepositoryBucketSize = 1<<16,
-  ItemRepositoryBucketLimit = 1<<16
+  ItemRepositoryBucketLimit = 1<<16,
+  ItemRepositoryStorePageSize = 1<<12 //Granularity in which changed buckets are written back to disk
 };
 
 /**
@@ -163,9 +172,12 @@ class Bucket {
       from += sizeof(T);
     }
 
-    void initializeFromMap(char* current) {
+    ///@param writableMapping Whether @p current points into a private (copy-on-write) file mapping that stays valid
+    ///                       as long as this bucket lives. Then changes are done in place instead of copying the data.
+    void initializeFromMap(char* current, bool writableMapping = false) {
       if(!m_data) {
           char* start = current;
+          m_mappedBucket = writableMapping ? start : nullptr;
           readValue(current, m_monsterBucketExtent);
           Q_ASSERT(current - start == 4);
           readValue(current, m_available);
@@ -185,33 +197,68 @@ class Bucket {
       }
     }
 
-    void store(QFile* file, size_t offset) {
-      if(!m_data)
-        return;
+    ///Remembers the on-disk state of this bucket, so the next store() only needs to write the pages that differ from it.
+    ///@param image The serialized bucket as it is currently stored on disk
+    void setStoredImage(const QByteArray& image) {
+      m_storedImage = image;
+    }
 
-      if(static_cast<size_t>(file->size()) < offset + (1+m_monsterBucketExtent)*DataSize)
-        file->resize(offset + (1+m_monsterBucketExtent)*DataSize);
+    ///Forgets which pages are on disk, so the next store() writes the whole bucket again
+    void forgetStoredImage() {
+      m_storedImage.clear();
+      m_changed = true;
+    }
 
-      file->seek(offset);
+    ///Writes the pages of this bucket that changed since it was loaded or last stored.
+    ///@param mapImage If the bucket lies within the file mapping of the repository, the first @p mapImageSize bytes of it,
+    ///                which are kept equal to the file contents.
+    ///@param journal If non-zero, the writes are recorded there instead of being written to @p file directly
+    void store(QFile* file, size_t offset, char* mapImage = nullptr, uint mapImageSize = 0, ItemRepositoryJournal* journal = nullptr) {
+      if(!m_data)
+        return;
 
-      file->write((char*)&m_monsterBucketExtent, sizeof(unsigned int));
-      file->write((char*)&m_available, sizeof(unsigned int));
-      file->write((char*)m_objectMap, sizeof(short unsigned int) * ObjectMapSize);
-      file->write((char*)m_nextBucketHash, sizeof(short unsigned int) * NextBucketHashSize);
-      file->write((char*)&m_largestFreeItem, sizeof(short unsigned int));
-      file->write((char*)&m_freeItemCount, sizeof(unsigned int));
-      file->write((char*)&m_dirty, sizeof(bool));
-      file->write(m_data, ItemRepositoryBucketSize + m_monsterBucketExtent * DataSize);
+      const uint size = storedSize();
+      if(journal)
+        journal->extend(file->fileName(), offset + size);
+      else if(static_cast<size_t>(file->size()) < offset + size)
+        file->resize(offset + size);
+
+      QByteArray buffer;
+      char* image;
+      if(m_mappedBucket) {
+        //Object-map, next-bucket hash and data were changed in place, only the header values need to be updated
+        image = m_mappedBucket;
+        writeHeader(image);
+      } else {
+        buffer = serializedImage();
+        image = buffer.data();
+      }
 
-      if(static_cast<size_t>(file->pos()) != offset + (1+m_monsterBucketExtent)*DataSize)
-      {
-        KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full", file->fileName()));
-        abort();
+      const bool haveStoredImage = (static_cast<uint>(m_storedImage.size()) == size);
+      for(uint pageOffset = 0; pageOffset < size; pageOffset += ItemRepositoryStorePageSize) {
+        const uint pageSize = qMin<uint>(ItemRepositoryStorePageSize, size - pageOffset);
+        //The header values may change without prepareChange(), so their pages are always written
+        const bool headerPage = pageOffset < ObjectMapOffset
+                             || (pageOffset < ItemDataOffset && pageOffset + pageSize > LargestFreeItemOffset);
+        if(haveStoredImage && !headerPage && memcmp(m_storedImage.constData() + pageOffset, image + pageOffset, pageSize) == 0)
+          continue;
+
+        if(journal) {
+          journal->write(file->fileName(), offset + pageOffset, image + pageOffset, pageSize);
+        } else if(!file->seek(offset + pageOffset) || file->write(image + pageOffset, pageSize) != static_cast<qint64>(pageSize))
+        {
+          KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full", file->fileName()));
+          abort();
+        }
+        if(mapImage && mapImage != image && pageOffset < mapImageSize)
+          memcpy(mapImage + pageOffset, image + pageOffset, qMin(pageSize, mapImageSize - pageOffset));
       }
 
+      //prepareChange() takes a new snapshot before the bucket is changed again
+      m_storedImage.clear();
       m_changed = false;
 #ifdef DEBUG_ITEMREPOSITORY_LOADING
-      {
+      if(!journal) {
         file->flush();
         file->seek(offset);
 
@@ -779,6 +826,10 @@ class Bucket {
     }
 
     void prepareChange() {
+      if(!m_changed && m_storedImage.isEmpty()) {
+        //The bucket still equals the file contents, remember them before they are changed (in place if mapped)
+        m_storedImage = serializedImage();
+      }
       m_changed = true;
       m_dirty = true;
       makeDataPrivate();
@@ -820,8 +871,41 @@ class Bucket {
 
   private:
 
+    enum {
+      ObjectMapOffset = sizeof(unsigned int) * 2,
+      NextBucketHashOffset = ObjectMapOffset + sizeof(short unsigned int) * ObjectMapSize,
+      LargestFreeItemOffset = NextBucketHashOffset + sizeof(short unsigned int) * NextBucketHashSize,
+      FreeItemCountOffset = LargestFreeItemOffset + sizeof(short unsigned int),
+      DirtyOffset = FreeItemCountOffset + sizeof(unsigned int),
+      ItemDataOffset = DirtyOffset + sizeof(bool)
+    };
+
+    uint storedSize() const {
+      return (1 + m_monsterBucketExtent) * DataSize;
+    }
+
+    ///Writes the scalar header values into the serialized bucket @p image
+    void writeHeader(char* image) const {
+      memcpy(image, &m_monsterBucketExtent, sizeof(unsigned int));
+      memcpy(image + sizeof(unsigned int), &m_available, sizeof(unsigned int));
+      memcpy(image + LargestFreeItemOffset, &m_largestFreeItem, sizeof(short unsigned int));
+      memcpy(image + FreeItemCountOffset, &m_freeItemCount, sizeof(unsigned int));
+      memcpy(image + DirtyOffset, &m_dirty, sizeof(bool));
+    }
+
+    ///@return The bucket serialized the way it is stored to disk
+    QByteArray serializedImage() const {
+      QByteArray buffer(storedSize(), Qt::Uninitialized);
+      char* image = buffer.data();
+      writeHeader(image);
+      memcpy(image + ObjectMapOffset, m_objectMap, sizeof(short unsigned int) * ObjectMapSize);
+      memcpy(image + NextBucketHashOffset, m_nextBucketHash, sizeof(short unsigned int) * NextBucketHashSize);
+      memcpy(image + ItemDataOffset, m_data, ItemRepositoryBucketSize + m_monsterBucketExtent * DataSize);
+      return buffer;
+    }
+
     void makeDataPrivate() {
-      if(m_mappedData == m_data) {
+      if(m_mappedData == m_data && !m_mappedBucket) {
         short unsigned int* oldObjectMap = m_objectMap;
         short unsigned int* oldNextBucketHash = m_nextBucketHash;
 
@@ -993,7 +1077,9 @@ class Bucket {
     int m_monsterBucketExtent = 0; //If this is a monster-bucket, this contains the count of follower-buckets that belong to this one
     unsigned int m_available = 0;
     char* m_data = nullptr; //Structure of the data: <Position of next item with same hash modulo ItemRepositoryBucketSize>(2 byte), <Item>(item.size() byte)
-    char* m_mappedData  = nullptr; //Read-only memory-mapped data. If this equals m_data, m_data must not be written
+    char* m_mappedData  = nullptr; //Memory-mapped data. If this equals m_data and m_mappedBucket is zero, m_data must not be written
+    char* m_mappedBucket = nullptr; //Start of this bucket within a private file mapping that may be written, or zero
+    QByteArray m_storedImage; //The bucket as it is stored on disk, taken before the first change since it was last stored. Empty if unknown
     short unsigned int* m_objectMap  = nullptr; //Points to the first object in m_data with (hash % ObjectMapSize) == index. Points to the item itself, so subtract 1 to get the pointer to the next item with same local hash.
     short unsigned int m_largestFreeItem  = 0; //Points to the largest item that is currently marked as free, or zero. That one points to the next largest one through followerIndex
     unsigned int m_freeItemCount  = 0;
@@ -1095,6 +1181,7 @@ class ItemRepository : public AbstractItemRepository {
     : m_ownMutex(QMutex::Recursive)
     , m_mutex(&m_ownMutex)
     , m_repositoryName(repositoryName)
+    , m_bucketLimit(0xfffe) //We have reserved the last bucket index 0xffff for special purposes
     , m_registry(registry)
     , m_file(nullptr)
     , m_dynamicFile(nullptr)
@@ -1201,15 +1288,14 @@ class ItemRepository : public AbstractItemRepository {
 
     //The item isn't in the repository yet, find a new bucket for it
     while(1) {
+      if(useBucket >= static_cast<int>(m_bucketLimit)) {
+        //the repository has overflown.
+        qWarning() << "Found no room for an item in" << m_repositoryName << "size of the item:" << request.itemSize();
+        return 0;
+      }
       if(useBucket >= m_buckets.size()) {
-          if(m_buckets.size() >= 0xfffe) { //We have reserved the last bucket index 0xffff for special purposes
-          //the repository has overflown.
-          qWarning() << "Found no room for an item in" << m_repositoryName << "size of the item:" << request.itemSize();
-          return 0;
-        }else{
-          //Allocate new buckets
-          m_buckets.resize(m_buckets.size() + 10);
-        }
+        //Allocate new buckets
+        m_buckets.resize(m_buckets.size() + 10);
       }
       MyBucket* bucketPtr = m_buckets.at(useBucket);
       if(!bucketPtr) {
@@ -1266,6 +1352,10 @@ class ItemRepository : public AbstractItemRepository {
           //Create a new monster-bucket at the end of the data
           int needMonsterExtent = (totalSize - ItemRepositoryBucketSize) / MyBucket::DataSize + 1;
           Q_ASSERT(needMonsterExtent);
+          if(m_currentBucket + needMonsterExtent >= static_cast<int>(m_bucketLimit)) {
+            qWarning() << "Found no room for an item in" << m_repositoryName << "size of the item:" << request.itemSize();
+            return 0;
+          }
           if(m_currentBucket + needMonsterExtent + 1 > m_buckets.size()) {
             m_buckets.resize(m_buckets.size() + 10 + needMonsterExtent + 1);
           }
@@ -1721,57 +1811,50 @@ class ItemRepository : public AbstractItemRepository {
   void store() override {
     QMutexLocker lock(m_mutex);
     if(m_file) {
+      //While the registry stores all repositories, the writes go through its journal
+      ItemRepositoryJournal* journal = m_registry ? m_registry->journal() : nullptr;
 
       if(!m_file->open( QFile::ReadWrite ) || !m_dynamicFile->open( QFile::ReadWrite )) {
         qFatal("cannot re-open repository file for storing");
         return;
       }
 
+      QVector<int> storedBuckets;
       for(int a = 0; a < m_buckets.size(); ++a) {
-        if(m_buckets[a]) {
-          if(m_buckets[a]->changed()) {
-            storeBucket(a);
-          }
-          if(m_unloadingEnabled) {
-            const int unloadAfterTicks = 2;
-            if(m_buckets[a]->lastUsed() > unloadAfterTicks) {
-                delete m_buckets[a];
-                m_buckets[a] = nullptr;
-            }else{
-                m_buckets[a]->tick();
-            }
-          }
+        if(m_buckets[a] && m_buckets[a]->changed()) {
+          storeBucket(a, journal);
+          storedBuckets << a;
         }
       }
 
       if(m_metaDataChanged) {
         Q_ASSERT(m_dynamicFile);
-
-        m_file->seek(0);
-        m_file->write((char*)&m_repositoryVersion, sizeof(uint));
-        uint hashSize = bucketHashSize;
-        m_file->write((char*)&hashSize, sizeof(uint));
-        uint itemRepositoryVersion  = staticItemRepositoryVersion();
-        m_file->write((char*)&itemRepositoryVersion, sizeof(uint));
-        m_file->write((char*)&m_statBucketHashClashes, sizeof(uint));
-        m_file->write((char*)&m_statItemCount, sizeof(uint));
-
-        const uint bucketCount = static_cast<uint>(m_buckets.size());
-        m_file->write((char*)&bucketCount, sizeof(uint));
-        m_file->write((char*)&m_currentBucket, sizeof(uint));
-        m_file->write((char*)m_firstBucketForHash, sizeof(short unsigned int) * bucketHashSize);
-        Q_ASSERT(m_file->pos() == BucketStartOffset);
-
-        m_dynamicFile->seek(0);
-        const uint freeSpaceBucketsSize = static_cast<uint>(m_freeSpaceBuckets.size());
-        m_dynamicFile->write((char*)&freeSpaceBucketsSize, sizeof(uint));
-        m_dynamicFile->write((char*)m_freeSpaceBuckets.data(), sizeof(uint) * freeSpaceBucketsSize);
+        writeMetaData(journal);
       }
       //To protect us from inconsistency due to crashes. flush() is not enough. We need to close.
       m_file->close();
       m_dynamicFile->close();
       Q_ASSERT(!m_file->isOpen());
       Q_ASSERT(!m_dynamicFile->isOpen());
+
+      if(journal) {
+        //Until the journal is applied, the file does not contain the stored buckets yet, so they must not be
+        //unloaded, and their mapped pages must not be given back
+        journal->afterApply([this, storedBuckets](bool applied) {
+          QMutexLocker lock(m_mutex);
+          if(applied) {
+            finishStore(storedBuckets);
+            return;
+          }
+          //Everything has to be written again with the next store
+          for(int bucket : storedBuckets) {
+            if(m_buckets[bucket])
+              m_buckets[bucket]->forgetStoredImage();
+          }
+        });
+      } else {
+        finishStore(storedBuckets);
+      }
     }
   }
 
@@ -1790,6 +1873,20 @@ class ItemRepository : public AbstractItemRepository {
     m_mutex = mutex;
   }
 
+  ///Restricts the repository to the buckets below @p limit, so that the created indices fit into a smaller range.
+  ///Once these are used up, index() returns zero for items that do not fit into the existing buckets.
+  ///The limit is not stored, it has to be set again before the repository is used after loading.
+  void setBucketLimit(uint limit) {
+    Q_ASSERT(limit && limit <= 0xfffe);
+    m_bucketLimit = limit;
+  }
+
+  ///Returns whether all buckets below the bucket limit have been taken into use
+  bool bucketLimitReached() const {
+    ThisLocker lock(m_mutex);
+    return m_currentBucket >= static_cast<int>(m_bucketLimit);
+  }
+
   QString repositoryName() const override {
     return m_repositoryName;
   }
@@ -1958,40 +2055,29 @@ class ItemRepository : public AbstractItemRepository {
     }
 
     m_metaDataChanged = true;
-    if(m_file->size() == 0) {
+    if(m_file->size() != 0 && !metaDataValid()) {
+      //The other repositories reference the items of this one, so the registry has to clear all of them
+      delete m_file;
+      m_file = nullptr;
+      delete m_dynamicFile;
+      m_dynamicFile = nullptr;
+      return false;
+    }
 
-      m_file->resize(0);
-      m_file->write((char*)&m_repositoryVersion, sizeof(uint));
-      uint hashSize = bucketHashSize;
-      m_file->write((char*)&hashSize, sizeof(uint));
-      uint itemRepositoryVersion  = staticItemRepositoryVersion();
-      m_file->write((char*)&itemRepositoryVersion, sizeof(uint));
+    if(m_file->size() == 0) {
 
       m_statBucketHashClashes = m_statItemCount = 0;
 
-      m_file->write((char*)&m_statBucketHashClashes, sizeof(uint));
-      m_file->write((char*)&m_statItemCount, sizeof(uint));
-
       m_buckets.resize(10);
       m_buckets.fill(nullptr);
-      uint bucketCount = m_buckets.size();
-      m_file->write((char*)&bucketCount, sizeof(uint));
 
       memset(m_firstBucketForHash, 0, bucketHashSize * sizeof(short unsigned int));
 
       m_currentBucket = 1; //Skip the first bucket, we won't use it so we have the zero indices for special purposes
-      m_file->write((char*)&m_currentBucket, sizeof(uint));
-      m_file->write((char*)m_firstBucketForHash, sizeof(short unsigned int) * bucketHashSize);
-      //We have completely initialized the file now
-      if(m_file->pos() != BucketStartOffset)
-      {
-        KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full", m_file->fileName()));
-        abort();
-      }
-
-      const uint freeSpaceBucketsSize = 0;
-      m_dynamicFile->write((char*)&freeSpaceBucketsSize, sizeof(uint));
       m_freeSpaceBuckets.clear();
+
+      //We have completely initialized the file now
+      writeMetaData(nullptr);
     }else{
       m_file->close();
       bool res = m_file->open( QFile::ReadOnly ); //Re-open in read-only mode, so we create a read-only m_fileMap
@@ -2035,7 +2121,11 @@ class ItemRepository : public AbstractItemRepository {
 
 #ifdef ITEMREPOSITORY_USE_MMAP_LOADING
     if(m_file->size() > BucketStartOffset){
+#ifdef ITEMREPOSITORY_USE_PRIVATE_MMAP
+      m_fileMap = m_file->map(BucketStartOffset, m_file->size() - BucketStartOffset, QFileDevice::MapPrivateOption);
+#else
       m_fileMap = m_file->map(BucketStartOffset, m_file->size() - BucketStartOffset);
+#endif
       Q_ASSERT(m_file->isOpen());
       Q_ASSERT(m_file->size() >= BucketStartOffset);
       if(m_fileMap){
@@ -2141,7 +2231,11 @@ class ItemRepository : public AbstractItemRepository {
       uint offset = ((bucketNumber-1) * MyBucket::DataSize);
       if(m_file && offset < m_fileMapSize && doMMapLoading && *reinterpret_cast<uint*>(m_fileMap + offset) == 0) {
 //         qDebug() << "loading bucket mmap:" << bucketNumber;
+#ifdef ITEMREPOSITORY_USE_PRIVATE_MMAP
+        m_buckets[bucketNumber]->initializeFromMap(reinterpret_cast<char*>(m_fileMap + offset), true);
+#else
         m_buckets[bucketNumber]->initializeFromMap(reinterpret_cast<char*>(m_fileMap + offset));
+#endif
       } else if(m_file) {
         //Either memory-mapping is disabled, or the item is not in the existing memory-map,
         //so we have to load it the classical way.
@@ -2157,6 +2251,7 @@ class ItemRepository : public AbstractItemRepository {
           ///FIXME: use the data here instead of copying it again in prepareChange
           QByteArray data = m_file->read((1+monsterBucketExtent) * MyBucket::DataSize);
           m_buckets[bucketNumber]->initializeFromMap(data.data());
+          m_buckets[bucketNumber]->setStoredImage(data);
           m_buckets[bucketNumber]->prepareChange();
         }else{
           m_buckets[bucketNumber]->initialize(0);
@@ -2180,13 +2275,148 @@ class ItemRepository : public AbstractItemRepository {
     m_buckets[bucketNumber] = nullptr;
   }
 
+  ///The part of the file mapping that holds the given bucket, if any
+  QPair<char*, uint> mappedRange(int bucketNumber) const {
+    const uint offset = (bucketNumber-1) * MyBucket::DataSize;
+    if(m_fileMap && offset < m_fileMapSize && m_buckets[bucketNumber]) {
+      return qMakePair(reinterpret_cast<char*>(m_fileMap + offset),
+                       qMin<uint>(m_fileMapSize - offset, (1 + m_buckets[bucketNumber]->monsterBucketExtent()) * MyBucket::DataSize));
+    }
+    return qMakePair(static_cast<char*>(nullptr), 0u);
+  }
+
   //m_file must be opened
-  void storeBucket(int bucketNumber) const {
+  void storeBucket(int bucketNumber, ItemRepositoryJournal* journal = nullptr) const {
     if(m_file && m_buckets[bucketNumber]) {
-      m_buckets[bucketNumber]->store(m_file, BucketStartOffset + (bucketNumber-1) * MyBucket::DataSize);
+      const uint offset = (bucketNumber-1) * MyBucket::DataSize;
+      //Keep the mapping in sync with the file, the bucket may be loaded from it again later
+      const auto range = mappedRange(bucketNumber);
+      m_buckets[bucketNumber]->store(m_file, BucketStartOffset + offset, range.first, range.second, journal);
     }
   }
 
+  ///Unloads unused buckets and gives the mapped pages of the stored buckets back, once they are on disk
+  void finishStore(const QVector<int>& storedBuckets) {
+    for(int bucket : storedBuckets) {
+      //Buckets changed again since they were stored still need their private pages
+      if(!m_buckets[bucket] || m_buckets[bucket]->changed())
+        continue;
+      const auto range = mappedRange(bucket);
+      if(range.first)
+        releaseMappedPages(range.first, range.second);
+    }
+
+    if(!m_unloadingEnabled)
+      return;
+
+    const int unloadAfterTicks = 2;
+    for(int a = 0; a < m_buckets.size(); ++a) {
+      if(!m_buckets[a] || m_buckets[a]->changed())
+        continue;
+      if(m_buckets[a]->lastUsed() > unloadAfterTicks) {
+          delete m_buckets[a];
+          m_buckets[a] = nullptr;
+      }else{
+          m_buckets[a]->tick();
+      }
+    }
+  }
+
+  ///The header of the repository file, up to BucketStartOffset
+  QByteArray metaDataHeader() const {
+    QByteArray header;
+    header.reserve(BucketStartOffset);
+    const uint hashSize = bucketHashSize;
+    const uint itemRepositoryVersion = staticItemRepositoryVersion();
+    const uint bucketCount = static_cast<uint>(m_buckets.size());
+    header.append((const char*)&m_repositoryVersion, sizeof(uint));
+    header.append((const char*)&hashSize, sizeof(uint));
+    header.append((const char*)&itemRepositoryVersion, sizeof(uint));
+    header.append((const char*)&m_statBucketHashClashes, sizeof(uint));
+    header.append((const char*)&m_statItemCount, sizeof(uint));
+    header.append((const char*)&bucketCount, sizeof(uint));
+    header.append((const char*)&m_currentBucket, sizeof(uint));
+    header.append((const char*)m_firstBucketForHash, sizeof(short unsigned int) * bucketHashSize);
+    Q_ASSERT(header.size() == BucketStartOffset);
+    return header;
+  }
+
+  ///The contents of the dynamic file, without the trailing checksum
+  QByteArray dynamicData() const {
+    QByteArray data;
+    const uint freeSpaceBucketsSize = static_cast<uint>(m_freeSpaceBuckets.size());
+    data.append((const char*)&freeSpaceBucketsSize, sizeof(uint));
+    data.append((const char*)m_freeSpaceBuckets.data(), sizeof(uint) * freeSpaceBucketsSize);
+    return data;
+  }
+
+  static quint64 metaDataChecksum(const QByteArray& header, const QByteArray& dynamic) {
+    return ItemRepositoryJournal::checksum(dynamic.constData(), dynamic.size(),
+                                           ItemRepositoryJournal::checksum(header.constData(), header.size()));
+  }
+
+  ///Writes the header and the dynamic file. A checksum over both is stored at the end of the dynamic file,
+  ///so a corrupted repository is recognized when it is opened again.
+  ///The bucket data is not covered, checking it would read the whole repository on every start.
+  ///Torn bucket writes after a crash are repaired by the journal instead, see ItemRepositoryJournal.
+  void writeMetaData(ItemRepositoryJournal* journal) {
+    const QByteArray header = metaDataHeader();
+    QByteArray dynamic = dynamicData();
+    const quint64 checksum = metaDataChecksum(header, dynamic);
+    dynamic.append((const char*)&checksum, sizeof(quint64));
+
+    if(journal) {
+      journal->write(m_file->fileName(), 0, header.constData(), header.size());
+      journal->write(m_dynamicFile->fileName(), 0, dynamic.constData(), dynamic.size());
+      return;
+    }
+    m_file->seek(0);
+    m_dynamicFile->seek(0);
+    if(m_file->write(header) != header.size() || m_dynamicFile->write(dynamic) != dynamic.size())
+    {
+      KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full", m_file->fileName()));
+      abort();
+    }
+  }
+
+  ///Whether the header and the dynamic file match the checksum stored with them
+  bool metaDataValid() {
+    m_file->seek(0);
+    m_dynamicFile->seek(0);
+    const QByteArray header = m_file->read(BucketStartOffset);
+    uint freeSpaceBucketsSize = 0;
+    bool valid = header.size() == BucketStartOffset
+              && m_dynamicFile->read((char*)&freeSpaceBucketsSize, sizeof(uint)) == sizeof(uint);
+    const qint64 dynamicSize = sizeof(uint) * (1 + static_cast<qint64>(freeSpaceBucketsSize));
+    valid = valid && m_dynamicFile->size() >= dynamicSize + static_cast<qint64>(sizeof(quint64));
+    if(valid) {
+      m_dynamicFile->seek(0);
+      const QByteArray dynamic = m_dynamicFile->read(dynamicSize);
+      quint64 checksum = 0;
+      valid = m_dynamicFile->read((char*)&checksum, sizeof(quint64)) == sizeof(quint64)
+           && checksum == metaDataChecksum(header, dynamic);
+    }
+    m_file->seek(0);
+    m_dynamicFile->seek(0);
+    return valid;
+  }
+
+  ///Gives the pages of a private file mapping that were copied on write back to the kernel once the same data
+  ///has been written to the file, so they can be evicted like any other clean page again.
+  static void releaseMappedPages(char* start, uint size) {
+#if defined(ITEMREPOSITORY_USE_PRIVATE_MMAP) && defined(Q_OS_LINUX) && defined(MADV_DONTNEED)
+    static const quintptr pageSize = sysconf(_SC_PAGESIZE);
+    //Only pages that are completely covered by the range, the others may contain unstored changes of neighbor buckets
+    const quintptr begin = (reinterpret_cast<quintptr>(start) + pageSize - 1) & ~(pageSize - 1);
+    const quintptr end = (reinterpret_cast<quintptr>(start) + size) & ~(pageSize - 1);
+    if(begin < end)
+      madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#else
+    Q_UNUSED(start);
+    Q_UNUSED(size);
+#endif
+  }
+
   /// If mustFindBucket is zero, the whole chain is just walked. This is good for debugging for infinite recursion.
   /// @return whether @p mustFindBucket was found
   bool walkBucketLinks(uint checkBucket, uint hash, uint mustFindBucket = 0) const {
@@ -2268,6 +2498,7 @@ class ItemRepository : public AbstractItemRepository {
   mutable QMutex* m_mutex;
   QString m_repositoryName;
   mutable int m_currentBucket;
+  uint m_bucketLimit;
   //List of buckets that have free space available that can be assigned. Sorted by size: Smallest space first. Second order sorting: Bucket index
   QVector<uint> m_freeSpaceBuckets;
   mutable QVector<MyBucket* > m_buckets;
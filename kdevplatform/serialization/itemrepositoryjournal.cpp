@@ -0,0 +1,313 @@
+/*
+   Copyright 2026 KDevelop developers
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "itemrepositoryjournal.h"
+
+#include <QDir>
+#include <QHash>
+
+#include <qtcompat_p.h>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+
+using namespace KDevelop;
+
+namespace {
+
+const quint32 journalMagic = 0x4b444a31; // "KDJ1"
+const QString journalName = QStringLiteral("journal");
+
+struct RecordHeader
+{
+  quint8 type;
+  quint16 nameSize;
+  qint64 offset;
+  qint64 size;
+};
+
+///Makes sure the contents of @p file reached the disk, closing alone does not guarantee that
+bool syncFile(QFile* file)
+{
+  if(!file->flush())
+    return false;
+#ifdef Q_OS_UNIX
+  return ::fsync(file->handle()) == 0;
+#else
+  return true;
+#endif
+}
+
+bool readFully(QFile* file, char* data, qint64 size)
+{
+  return file->read(data, size) == size;
+}
+
+}
+
+ItemRepositoryJournal::ItemRepositoryJournal(const QString& path)
+  : m_path(path)
+  , m_journal(QDir(path).filePath(journalName))
+  , m_checksum(checksum(nullptr, 0))
+{
+}
+
+ItemRepositoryJournal::~ItemRepositoryJournal()
+{
+  if(m_journal.isOpen()) {
+    //Never committed, so the files are still in the state of the last store
+    m_journal.close();
+    m_journal.remove();
+  }
+  finish(false);
+}
+
+void ItemRepositoryJournal::finish(bool applied)
+{
+  const auto functions = m_afterApply;
+  m_afterApply.clear();
+  for(const auto& function : functions)
+    function(applied);
+}
+
+bool ItemRepositoryJournal::begin()
+{
+  if(m_journal.exists() && recover(m_path) == Failed) {
+    qCWarning(SERIALIZATION) << "overwriting the journal" << m_journal.fileName() << "that could not be applied";
+  }
+  if(!m_journal.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+    qCWarning(SERIALIZATION) << "cannot create journal" << m_journal.fileName() << m_journal.errorString();
+    return false;
+  }
+  if(m_journal.write(reinterpret_cast<const char*>(&journalMagic), sizeof(journalMagic)) != sizeof(journalMagic)) {
+    m_failed = true;
+  }
+  return !m_failed;
+}
+
+quint64 ItemRepositoryJournal::checksum(const char* data, qint64 size, quint64 seed)
+{
+  //FNV-1a, like the page hashes of the item-repository buckets
+  quint64 hash = seed;
+  qint64 pos = 0;
+  for(; pos + qint64(sizeof(quint64)) <= size; pos += sizeof(quint64)) {
+    quint64 word;
+    memcpy(&word, data + pos, sizeof(quint64));
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  for(; pos < size; ++pos)
+    hash = (hash ^ static_cast<uchar>(data[pos])) * 1099511628211ULL;
+  return hash;
+}
+
+void ItemRepositoryJournal::append(Record::Type type, const QString& fileName, qint64 offset, const char* data, qint64 size)
+{
+  Q_ASSERT(m_journal.isOpen());
+  if(m_failed)
+    return;
+
+  const QByteArray name = QDir(m_path).relativeFilePath(fileName).toUtf8();
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.type = type;
+  header.nameSize = name.size();
+  header.offset = offset;
+  header.size = size;
+
+  m_checksum = checksum(reinterpret_cast<const char*>(&header), sizeof(header), m_checksum);
+  m_checksum = checksum(name.constData(), name.size(), m_checksum);
+  bool ok = m_journal.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header)
+         && m_journal.write(name) == name.size();
+
+  const qint64 dataPosition = m_journal.pos();
+  if(data) {
+    m_checksum = checksum(data, size, m_checksum);
+    ok = ok && m_journal.write(data, size) == size;
+  }
+  //The checksum chains all records up to this one, so a torn tail is detected
+  ok = ok && m_journal.write(reinterpret_cast<const char*>(&m_checksum), sizeof(m_checksum)) == sizeof(m_checksum);
+
+  if(!ok) {
+    qCWarning(SERIALIZATION) << "failed writing journal" << m_journal.fileName() << m_journal.errorString();
+    m_failed = true;
+    return;
+  }
+
+  if(type != Record::Commit)
+    m_records.append(Record{type, QString::fromUtf8(name), offset, size, dataPosition});
+}
+
+void ItemRepositoryJournal::write(const QString& fileName, qint64 offset, const char* data, qint64 size)
+{
+  append(Record::Write, fileName, offset, data, size);
+}
+
+void ItemRepositoryJournal::extend(const QString& fileName, qint64 size)
+{
+  append(Record::Extend, fileName, 0, nullptr, size);
+}
+
+void ItemRepositoryJournal::replace(const QString& fileName, const QByteArray& contents)
+{
+  append(Record::Replace, fileName, 0, contents.constData(), contents.size());
+}
+
+void ItemRepositoryJournal::afterApply(const std::function<void(bool)>& function)
+{
+  m_afterApply.append(function);
+}
+
+bool ItemRepositoryJournal::commit()
+{
+  //The offset of the commit record is the count of records it commits
+  append(Record::Commit, QString(), m_records.size(), nullptr, 0);
+  if(m_failed || !syncFile(&m_journal)) {
+    qCWarning(SERIALIZATION) << "failed committing journal" << m_journal.fileName() << m_journal.errorString();
+    return false;
+  }
+  return true;
+}
+
+bool ItemRepositoryJournal::apply()
+{
+  Q_ASSERT(!m_failed);
+  const bool applied = applyRecords(m_path, &m_journal, m_records);
+  if(!applied) {
+    //Leave the journal in place, it will be replayed on the next start
+    qCWarning(SERIALIZATION) << "failed applying journal" << m_journal.fileName();
+    m_journal.close();
+    return false;
+  }
+
+  m_journal.close();
+  m_journal.remove();
+  m_records.clear();
+
+  finish(true);
+  return true;
+}
+
+bool ItemRepositoryJournal::applyRecords(const QString& path, QFile* journal, const QVector<Record>& records)
+{
+  const QDir dir(path);
+  QHash<QString, QFile*> files;
+  bool ok = true;
+
+  for(const Record& record : records) {
+    QFile*& file = files[record.fileName];
+    if(!file) {
+      file = new QFile(dir.filePath(record.fileName));
+      if(!file->open(QIODevice::ReadWrite)) {
+        qCWarning(SERIALIZATION) << "cannot open" << file->fileName() << "to apply the journal:" << file->errorString();
+        ok = false;
+        break;
+      }
+    }
+
+    switch(record.type) {
+      case Record::Extend:
+        if(file->size() < record.size)
+          ok = file->resize(record.size);
+        break;
+      case Record::Replace:
+        ok = file->resize(0);
+        Q_FALLTHROUGH();
+      case Record::Write: {
+        QByteArray data(record.size, Qt::Uninitialized);
+        ok = ok && journal->seek(record.dataPosition) && readFully(journal, data.data(), record.size)
+                && file->seek(record.offset) && file->write(data) == record.size;
+        break;
+      }
+      case Record::Commit:
+        break;
+    }
+    if(!ok) {
+      qCWarning(SERIALIZATION) << "failed applying the journal to" << file->fileName() << file->errorString();
+      break;
+    }
+  }
+
+  for(QFile* file : qAsConst(files)) {
+    if(ok && file->isOpen())
+      ok = syncFile(file);
+    delete file;
+  }
+  return ok;
+}
+
+ItemRepositoryJournal::Recovery ItemRepositoryJournal::recover(const QString& path)
+{
+  QFile journal(QDir(path).filePath(journalName));
+  if(!journal.exists())
+    return NoJournal;
+
+  bool committed = false;
+  QVector<Record> records;
+
+  if(journal.open(QIODevice::ReadOnly)) {
+    quint32 magic = 0;
+    quint64 chain = checksum(nullptr, 0);
+    if(readFully(&journal, reinterpret_cast<char*>(&magic), sizeof(magic)) && magic == journalMagic) {
+      RecordHeader header;
+      while(readFully(&journal, reinterpret_cast<char*>(&header), sizeof(header))) {
+        chain = checksum(reinterpret_cast<const char*>(&header), sizeof(header), chain);
+        const QByteArray name = journal.read(header.nameSize);
+        if(name.size() != header.nameSize)
+          break;
+        chain = checksum(name.constData(), name.size(), chain);
+
+        const qint64 dataPosition = journal.pos();
+        if(header.type == Record::Write || header.type == Record::Replace) {
+          if(header.size < 0 || dataPosition + header.size > journal.size())
+            break;
+          const QByteArray data = journal.read(header.size);
+          chain = checksum(data.constData(), data.size(), chain);
+        }
+
+        quint64 stored = 0;
+        if(!readFully(&journal, reinterpret_cast<char*>(&stored), sizeof(stored)) || stored != chain)
+          break;
+
+        if(header.type == Record::Commit) {
+          committed = (header.offset == records.size());
+          break;
+        }
+        records.append(Record{static_cast<Record::Type>(header.type), QString::fromUtf8(name), header.offset, header.size, dataPosition});
+      }
+    }
+  }
+
+  Recovery result = Discarded;
+  if(committed) {
+    if(!applyRecords(path, &journal, records)) {
+      qCWarning(SERIALIZATION) << "failed replaying the journal in" << path;
+      return Failed;
+    }
+    qCDebug(SERIALIZATION) << "replayed" << records.size() << "journal records in" << path;
+    result = Replayed;
+  } else {
+    qCDebug(SERIALIZATION) << "discarding incomplete journal in" << path;
+  }
+
+  journal.close();
+  journal.remove();
+  return result;
+}
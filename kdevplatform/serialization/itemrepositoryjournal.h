@@ -0,0 +1,115 @@
+/*
+   Copyright 2026 KDevelop developers
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef KDEVPLATFORM_ITEMREPOSITORYJOURNAL_H
+#define KDEVPLATFORM_ITEMREPOSITORYJOURNAL_H
+
+#include "serializationexport.h"
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+namespace KDevelop {
+
+/**
+ * A write-ahead journal that makes storing a set of files in a directory atomic.
+ *
+ * The writes are first recorded in the file "journal" within the directory, and only applied
+ * to the actual files once all of them have been recorded and commit() made the journal durable.
+ * If the application crashes before that, the files are unchanged. If it crashes while
+ * applying the journal, recover() replays it on the next start.
+ */
+class KDEVPLATFORMSERIALIZATION_EXPORT ItemRepositoryJournal
+{
+public:
+  enum Recovery {
+    /// There was no journal, the last store completed
+    NoJournal,
+    /// A committed journal was applied
+    Replayed,
+    /// An incomplete journal was discarded, the files are in the state of the store before
+    Discarded,
+    /// A committed journal could not be applied, the files are inconsistent
+    Failed
+  };
+
+  /// @param path The directory containing the journaled files
+  explicit ItemRepositoryJournal(const QString& path);
+  ~ItemRepositoryJournal();
+
+  /// Creates the journal file, after applying a journal that an earlier failure left behind.
+  /// Nothing can be recorded if this fails.
+  bool begin();
+
+  /// Records writing @p size bytes of @p data at @p offset into the file @p fileName.
+  void write(const QString& fileName, qint64 offset, const char* data, qint64 size);
+  /// Records growing the file @p fileName to at least @p size bytes.
+  void extend(const QString& fileName, qint64 size);
+  /// Records replacing the contents of the file @p fileName with @p contents.
+  void replace(const QString& fileName, const QByteArray& contents);
+
+  /// Registers @p function to be called once it is known whether the recorded writes reached the files.
+  /// Its argument is false if the journal could not be committed or applied.
+  void afterApply(const std::function<void(bool applied)>& function);
+
+  /// Makes the recorded writes durable. From now on, they will be applied even after a crash.
+  bool commit();
+  /// Applies the committed writes to the files and removes the journal.
+  bool apply();
+
+  /// Applies a committed journal that was left over by a crash in @p path, or discards an incomplete one.
+  static Recovery recover(const QString& path);
+
+  /// Checksum used to validate the journal records and the repository metadata.
+  static quint64 checksum(const char* data, qint64 size, quint64 seed = 14695981039346656037ULL);
+
+private:
+  struct Record
+  {
+    enum Type : quint8 {
+      Write = 1,
+      Extend = 2,
+      Replace = 3,
+      Commit = 4
+    };
+    Type type;
+    QString fileName;
+    qint64 offset;
+    qint64 size;
+    /// Position of the data within the journal file
+    qint64 dataPosition;
+  };
+
+  void append(Record::Type type, const QString& fileName, qint64 offset, const char* data, qint64 size);
+  static bool applyRecords(const QString& path, QFile* journal, const QVector<Record>& records);
+  void finish(bool applied);
+
+  const QString m_path;
+  QFile m_journal;
+  QVector<Record> m_records;
+  QVector<std::function<void(bool)>> m_afterApply;
+  quint64 m_checksum;
+  bool m_failed = false;
+};
+
+}
+
+#endif // KDEVPLATFORM_ITEMREPOSITORYJOURNAL_H
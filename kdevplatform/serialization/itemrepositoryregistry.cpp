@@ -19,9 +19,12 @@
 #include "itemrepositoryregistry.h"
 
 #include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
 #include <QProcessEnvironment>
 #include <QCoreApplication>
 #include <QDataStream>
+#include <QTextStream>
 #include <QStandardPaths>
 
 #include <KLocalizedString>
@@ -30,6 +33,7 @@
 #include <interfaces/icore.h>
 
 #include "abstractitemrepository.h"
+#include "itemrepositoryjournal.h"
 #include "debug.h"
 
 using namespace KDevelop;
@@ -37,7 +41,10 @@ using namespace KDevelop;
 namespace {
 
 //If KDevelop crashed this many times consicutively, clean up the repository
-const int crashesBeforeCleanup = 1;
+//A single crash does not corrupt the repository, the last store is recovered from its journal
+const int crashesBeforeCleanup = 3;
+
+const QString checkpointCounter = QStringLiteral("Checkpoint Generation");
 
 void setCrashCounter(QFile& crashesFile, int count)
 {
@@ -60,11 +67,6 @@ bool shouldClear(const QString& path)
     return true;
   }
 
-  if (dir.exists(QStringLiteral("is_writing"))) {
-    qCWarning(SERIALIZATION) << "repository" << path << "was write-locked, it probably is inconsistent";
-    return true;
-  }
-
   if (!dir.exists(QStringLiteral("version_%1").arg(staticItemRepositoryVersion(), 0, 16))) {
     qCWarning(SERIALIZATION) << "version mismatch or no version hint; expected version:" << QString().setNum(staticItemRepositoryVersion(), 16);
     return true;
@@ -116,6 +118,10 @@ public:
   QString m_path;
   QMap<AbstractItemRepository*, AbstractRepositoryManager*> m_repositories;
   QMap<QString, QAtomicInt*> m_customCounters;
+  ///Files to store together with the repositories, see ItemRepositoryRegistry::storeFile()
+  QMap<QString, QByteArray> m_pendingFiles;
+  ///The journal of the running store(), if any
+  ItemRepositoryJournal* m_journal = nullptr;
   mutable QMutex m_mutex;
 
   explicit ItemRepositoryRegistryPrivate(ItemRepositoryRegistry* owner)
@@ -127,6 +133,7 @@ public:
 
   void lockForWriting();
   void unlockForWriting();
+  void storeFile(const QString& fileName, const QByteArray& contents);
   void deleteDataDirectory(const QString& path, bool recreate = true);
 
   /// @param path  A shared directory-path that the item-repositories are to be loaded from.
@@ -180,6 +187,42 @@ void ItemRepositoryRegistry::deleteRepositoryFromDisk(const QString& repositoryP
   }
 }
 
+bool ItemRepositoryRegistry::copyRepository(const QString& sourcePath, const QString& targetPath)
+{
+  const QDir source(sourcePath);
+  const QString versionFile = QStringLiteral("version_%1").arg(staticItemRepositoryVersion(), 0, 16);
+  if (!source.exists(versionFile)) {
+    qCWarning(SERIALIZATION) << "not copying" << sourcePath << "- version mismatch or no version hint; expected version:" << QString().setNum(staticItemRepositoryVersion(), 16);
+    return false;
+  }
+  if (source.exists(QStringLiteral("is_writing")) || source.exists(QStringLiteral("journal"))) {
+    qCWarning(SERIALIZATION) << "not copying" << sourcePath << "- the repository was not stored completely";
+    return false;
+  }
+
+  QDir target(targetPath);
+  if (target.exists() && !target.removeRecursively()) {
+    qCWarning(SERIALIZATION) << "cannot clear" << targetPath;
+    return false;
+  }
+
+  //The version file is copied last, so an interrupted copy is cleared when the repository is opened
+  QDirIterator it(sourcePath, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    const QString file = it.next();
+    const QString relative = source.relativeFilePath(file);
+    if (relative == versionFile || relative == QLatin1String("crash_counter")) {
+      continue;
+    }
+    const QString targetFile = target.filePath(relative);
+    if (!QDir().mkpath(QFileInfo(targetFile).absolutePath()) || !QFile::copy(file, targetFile)) {
+      qCWarning(SERIALIZATION) << "failed copying" << file << "to" << targetFile;
+      return false;
+    }
+  }
+  return QFile::copy(source.filePath(versionFile), target.filePath(versionFile));
+}
+
 QMutex& ItemRepositoryRegistry::mutex()
 {
   return d->m_mutex;
@@ -261,8 +304,9 @@ void ItemRepositoryRegistryPrivate::deleteDataDirectory(const QString& path, boo
 {
   QMutexLocker lock(&m_mutex);
 
-  //lockForWriting creates a file, that prevents any other KDevelop instance from using the directory as it is.
-  //Instead, the other instance will try to delete the directory as well.
+  //Removing the version file first makes sure that a partially deleted directory is never used again.
+  //Instead, another KDevelop instance will try to delete the directory as well.
+  QFile::remove(path + QStringLiteral("/version_%1").arg(staticItemRepositoryVersion(), 0, 16));
   lockForWriting();
 
   bool result = QDir(path).removeRecursively();
@@ -285,14 +329,41 @@ bool ItemRepositoryRegistryPrivate::open(const QString& path)
   if (shouldClear(path)) {
     qCWarning(SERIALIZATION) << QStringLiteral("The data-repository at %1 has to be cleared.").arg(path);
     deleteDataDirectory(path);
+  } else {
+    // Complete or roll back a store that was interrupted by a crash
+    const auto recovery = ItemRepositoryJournal::recover(path);
+    if (recovery == ItemRepositoryJournal::Failed) {
+      qCWarning(SERIALIZATION) << QStringLiteral("The journal of the data-repository at %1 could not be applied, clearing it.").arg(path);
+      deleteDataDirectory(path);
+    } else if (QFile::exists(path + QLatin1String("/is_writing"))) {
+      qCWarning(SERIALIZATION) << "repository" << path << "was write-locked, recovered the last stored state:"
+                               << (recovery == ItemRepositoryJournal::Replayed ? "replayed the journal" : "no changes were lost");
+    }
+    QFile::remove(path + QLatin1String("/is_writing"));
   }
 
   QDir().mkpath(path);
 
-  foreach(AbstractItemRepository* repository, m_repositories.keys()) {
-    if(!repository->open(path)) {
-      deleteDataDirectory(path);
-      qCritical() << "failed to open repository" << repository->repositoryName() << "at" << path;
+  auto openRepositories = [this, &path]() -> AbstractItemRepository* {
+    foreach(AbstractItemRepository* repository, m_repositories.keys()) {
+      if(!repository->open(path)) {
+        return repository;
+      }
+    }
+    return nullptr;
+  };
+
+  if(AbstractItemRepository* failed = openRepositories()) {
+    //The repositories reference each other's items, so one that is corrupted or of another version
+    //invalidates all of them. Start over with a cleared directory, like when the cache is cleared above.
+    qCWarning(SERIALIZATION) << "repository" << failed->repositoryName() << "at" << path
+                             << "is corrupted or of another version, clearing the data-repository";
+    foreach(AbstractItemRepository* repository, m_repositories.keys()) {
+      repository->close();
+    }
+    deleteDataDirectory(path);
+    if((failed = openRepositories())) {
+      qCritical() << "failed to open repository" << failed->repositoryName() << "at" << path;
       abort();
     }
   }
@@ -310,6 +381,8 @@ bool ItemRepositoryRegistryPrivate::open(const QString& path)
       m_owner->customCounter(counterName, 0) = counterValue;
     }
   }
+  //Created here, so checkpointGeneration() never has to insert it
+  m_owner->customCounter(checkpointCounter, 0);
 
   m_path = path;
 
@@ -319,33 +392,84 @@ bool ItemRepositoryRegistryPrivate::open(const QString& path)
 void ItemRepositoryRegistry::store()
 {
   QMutexLocker lock(&d->m_mutex);
+
+  //All files are written through the journal, so a crash leaves either the previous or the new state
+  ItemRepositoryJournal journal(d->m_path);
+  if(journal.begin()) {
+    d->m_journal = &journal;
+  } else {
+    qCWarning(SERIALIZATION) << "storing the repositories without journal, they may become inconsistent on a crash";
+  }
+
   foreach(AbstractItemRepository* repository, d->m_repositories.keys()) {
     repository->store();
   }
 
-  QFile versionFile(d->m_path + QStringLiteral("/version_%1").arg(staticItemRepositoryVersion(), 0, 16));
-  if(versionFile.open(QIODevice::WriteOnly)) {
-    QTextStream out(&versionFile);
+  QByteArray version;
+  {
+    QTextStream out(&version);
     out << QCoreApplication::applicationPid();
-    versionFile.close();
-  } else {
-    qCWarning(SERIALIZATION) << "Could not open version file for writing";
   }
+  d->storeFile(QStringLiteral("version_%1").arg(staticItemRepositoryVersion(), 0, 16), version);
+
+  QAtomicInt& generation = customCounter(checkpointCounter, 0);
+  generation.ref();
 
   //Store all custom counter values
-  QFile f(d->m_path + QLatin1String("/Counters"));
-  if(f.open(QIODevice::WriteOnly)) {
-    f.resize(0);
-    QDataStream stream(&f);
+  QByteArray counters;
+  {
+    QDataStream stream(&counters, QIODevice::WriteOnly);
     for(QMap<QString, QAtomicInt*>::const_iterator it = d->m_customCounters.constBegin();
         it != d->m_customCounters.constEnd();
         ++it) {
       stream << it.key();
       stream << it.value()->fetchAndAddRelaxed(0);
     }
-  } else {
-    qCWarning(SERIALIZATION) << "Could not open counter file for writing";
   }
+  d->storeFile(QStringLiteral("Counters"), counters);
+
+  for(auto it = d->m_pendingFiles.constBegin(); it != d->m_pendingFiles.constEnd(); ++it) {
+    d->storeFile(it.key(), it.value());
+  }
+  d->m_pendingFiles.clear();
+
+  if(d->m_journal) {
+    d->m_journal = nullptr;
+    if(!journal.commit() || !journal.apply()) {
+      //If the journal was committed, it is replayed on the next start
+      qCWarning(SERIALIZATION) << "Could not store the repositories at" << d->m_path;
+      generation.deref();
+    }
+  }
+}
+
+void ItemRepositoryRegistryPrivate::storeFile(const QString& fileName, const QByteArray& contents)
+{
+  if(m_journal) {
+    m_journal->replace(m_path + QLatin1Char('/') + fileName, contents);
+    return;
+  }
+
+  QFile f(m_path + QLatin1Char('/') + fileName);
+  if(!f.open(QIODevice::WriteOnly) || f.write(contents) != contents.size()) {
+    qCWarning(SERIALIZATION) << "Could not write" << f.fileName();
+  }
+}
+
+void ItemRepositoryRegistry::storeFile(const QString& fileName, const QByteArray& contents)
+{
+  QMutexLocker lock(&d->m_mutex);
+  d->m_pendingFiles[fileName] = contents;
+}
+
+ItemRepositoryJournal* ItemRepositoryRegistry::journal() const
+{
+  return d->m_journal;
+}
+
+uint ItemRepositoryRegistry::checkpointGeneration()
+{
+  return customCounter(checkpointCounter, 0).load();
 }
 
 void ItemRepositoryRegistry::printAllStatistics() const
@@ -23,6 +23,7 @@
 
 #include <QScopedPointer>
 
+class QByteArray;
 class QString;
 class QMutex;
 class QAtomicInt;
@@ -30,6 +31,7 @@ class QAtomicInt;
 namespace KDevelop {
 
 class ISession;
+class ItemRepositoryJournal;
 class AbstractRepositoryManager;
 class AbstractItemRepository;
 
@@ -53,6 +55,12 @@ class KDEVPLATFORMSERIALIZATION_EXPORT ItemRepositoryRegistry {
     /// Deletes the item-repository of a specified session; or, if it is currently used, marks it for deletion at exit.
     static void deleteRepositoryFromDisk(const QString& repositoryPath);
 
+    /// Copies the item-repositories stored at @p sourcePath to @p targetPath, replacing what is there.
+    /// Neither directory may be opened by a registry while copying. Files that only describe the state of
+    /// the session that wrote them, like the crash counter or the write mark, are not copied.
+    /// @returns false if @p sourcePath does not hold a complete repository of the current version, or copying failed.
+    static bool copyRepository(const QString& sourcePath, const QString& targetPath);
+
     /// Add a new repository.
     /// It will automatically be opened with the current path, if one is set.
     void registerRepository(AbstractItemRepository* repository, AbstractRepositoryManager* manager);
@@ -65,9 +73,23 @@ class KDEVPLATFORMSERIALIZATION_EXPORT ItemRepositoryRegistry {
     QString path() const;
 
     /// Stores all repositories to disk, eventually unloading unused data to save memory.
+    /// The files are written through a journal, so after a crash either this or the previous store is recovered.
     /// @note Should be called on a regular basis.
     void store();
 
+    /// Stores @p contents as the file @p fileName within the repository directory with the next store(),
+    /// so it stays consistent with the repositories.
+    void storeFile(const QString& fileName, const QByteArray& contents);
+
+    /// @returns The journal that repositories record their writes into, while store() is running.
+    ///          Repositories stored on their own write to their files directly.
+    ItemRepositoryJournal* journal() const;
+
+    /// @returns The count of completed store() calls, which is persisted with the repositories.
+    /// Data that is stored outside of the repositories can be tagged with it, to find out after a crash
+    /// whether it belongs to the recovered state.
+    uint checkpointGeneration();
+
     /// Indicates that the application has been closed gracefully.
     /// @note Must be called somewhere at the end of the shutdown sequence.
     void shutdown();
@@ -79,8 +101,8 @@ class KDEVPLATFORMSERIALIZATION_EXPORT ItemRepositoryRegistry {
     /// Prints the statistics of all registered item-repositories to the command line using qDebug().
     void printAllStatistics() const;
 
-    /// Marks the directory as inconsistent, so it will be discarded
-    /// on next startup if the application crashes during the write process.
+    /// Marks the directory as being written. If the application crashes during the write process,
+    /// the last completed store() is recovered on the next startup.
     void lockForWriting();
 
     /// Removes the inconsistency mark set by @ref lockForWriting().
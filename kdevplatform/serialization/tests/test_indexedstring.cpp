@@ -25,6 +25,7 @@
 #include <serialization/itemrepositoryregistry.h>
 #include <serialization/indexedstring.h>
 #include <QTest>
+#include <QThread>
 
 #include <utility>
 
@@ -246,3 +247,48 @@ void TestIndexedString::testCString()
     QCOMPARE(str.index(), 0u);
     QVERIFY(str.isEmpty());
 }
+
+void TestIndexedString::testConcurrentIndexing()
+{
+    class IndexingThread : public QThread
+    {
+    public:
+        explicit IndexingThread(const QVector<QString>& data)
+            : m_data(data)
+        {}
+        void run() override
+        {
+            indices.reserve(m_data.size());
+            for (const QString& item : m_data) {
+                IndexedString idx(item);
+                IndexedString copy = idx;
+                indices << copy.index();
+            }
+        }
+        const QVector<QString>& m_data;
+        QVector<uint> indices;
+    };
+
+    QVector<QString> data = generateData();
+    data.resize(10000);
+
+    QVector<QSharedPointer<IndexingThread>> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads << QSharedPointer<IndexingThread>(new IndexingThread(data));
+        threads.last()->start();
+    }
+    for (const auto& thread : threads) {
+        QVERIFY(thread->wait(10000));
+        QCOMPARE(thread->indices, threads.first()->indices);
+    }
+
+    QSet<uint> buckets;
+    for (int i = 0; i < data.size(); ++i) {
+        const uint index = threads.first()->indices.at(i);
+        QVERIFY(index);
+        QCOMPARE(IndexedString::fromIndex(index).str(), data.at(i));
+        buckets.insert(index >> 16);
+    }
+    // the strings are spread over multiple repositories
+    QVERIFY(buckets.size() > 1);
+}
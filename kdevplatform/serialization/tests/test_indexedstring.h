@@ -49,6 +49,7 @@ private Q_SLOTS:
     void test_data();
 
     void testCString();
+    void testConcurrentIndexing();
 
 private:
     QString m_repositoryPath = QDir::tempPath() + QStringLiteral("/test_indexedstring");
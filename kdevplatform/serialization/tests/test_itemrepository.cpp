@@ -1,6 +1,8 @@
 #include <QObject>
 #include <QTest>
 #include <serialization/itemrepository.h>
+#include <serialization/itemrepositoryjournal.h>
+#include <serialization/itemrepositoryregistry.h>
 #include <serialization/indexedstring.h>
 #include <stdlib.h>
 #include <time.h>
@@ -252,6 +254,36 @@ class TestItemRepository : public QObject {
       QVERIFY(!repository.findIndex(TestItemRequest(*monsterItem, true)));
       repository.deleteItem(smallIndex);
     }
+    void respectBucketLimit()
+    {
+      ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("BucketLimit"));
+      repository.setBucketLimit(4);
+      QVERIFY(!repository.bucketLimitReached());
+
+      QList<TestItem*> items;
+      QVector<uint> indices;
+      for(uint i = 0; i < 100; ++i) {
+        TestItem* item = createItem(i, 20000);
+        items << item;
+        const uint index = repository.index(TestItemRequest(*item));
+        if(!index) {
+          break;
+        }
+        QVERIFY((index >> 16) < 4);
+        indices << index;
+      }
+      QVERIFY(indices.size() < items.size());
+      QVERIFY(repository.bucketLimitReached());
+
+      // the stored items are still found, and no monster-bucket is created beyond the limit either
+      QCOMPARE(repository.findIndex(TestItemRequest(*items.first())), indices.first());
+      QScopedArrayPointer<TestItem> monsterItem(createItem(1000, ItemRepositoryBucketSize + 10));
+      QVERIFY(!repository.index(TestItemRequest(*monsterItem)));
+
+      foreach(auto item, items) {
+          delete[] item;
+      }
+    }
     void usePermissiveModuloWhenRemovingClashLinks()
     {
       ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("PermissiveModulo"));
@@ -359,7 +391,239 @@ class TestItemRepository : public QObject {
        */
     }
 
+    void storeChangedPagesOnly()
+    {
+      const QString path = m_repositoryPath + QStringLiteral("/storeChangedPagesOnly");
+      QVERIFY(QDir().mkpath(path));
+
+      QVector<QSharedPointer<TestItem>> items;
+      QVector<uint> indices;
+      {
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("ChangedPages"), nullptr);
+        QVERIFY(repository.open(path));
+        for(uint i = 1; i <= 500; ++i) {
+          items << QSharedPointer<TestItem>(createItem(i, (i % 300) + sizeof(TestItem)), [](TestItem* item) { delete[] reinterpret_cast<char*>(item); });
+          indices << repository.index(TestItemRequest(*items.last(), true));
+        }
+        repository.store();
+        repository.close();
+      }
+
+      {
+        // buckets are now loaded from the file mapping and changed in place
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("ChangedPages"), nullptr);
+        QVERIFY(repository.open(path));
+        char* data = reinterpret_cast<char*>(repository.dynamicItemFromIndexSimple(indices.at(42))) + sizeof(TestItem);
+        char* expected = reinterpret_cast<char*>(items.at(42).data()) + sizeof(TestItem);
+        data[0] = expected[0] = 'X';
+        repository.store();
+        repository.close();
+      }
+
+      {
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("ChangedPages"), nullptr);
+        QVERIFY(repository.open(path));
+        for(int i = 0; i < items.size(); ++i) {
+          QCOMPARE(repository.findIndex(TestItemRequest(*items.at(i), true)), indices.at(i));
+        }
+        repository.close();
+      }
+    }
+
+    void storeChangesOfEqualHighBits()
+    {
+      const QString path = m_repositoryPath + QStringLiteral("/storeChangesOfEqualHighBits");
+      QVERIFY(QDir().mkpath(path));
+
+      QVector<QSharedPointer<TestItem>> items;
+      QVector<uint> indices;
+      {
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("EqualHighBits"), nullptr);
+        QVERIFY(repository.open(path));
+        for(uint i = 1; i <= 100; ++i) {
+          items << QSharedPointer<TestItem>(createItem(i, 32 + sizeof(TestItem)), [](TestItem* item) { delete[] reinterpret_cast<char*>(item); });
+          indices << repository.index(TestItemRequest(*items.last(), true));
+        }
+        repository.store();
+        repository.close();
+      }
+
+      // flipping the same bit in two words of a page still changes the page, try every position within a word
+      for(int offset = 0; offset < 8; ++offset) {
+        {
+          ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("EqualHighBits"), nullptr);
+          QVERIFY(repository.open(path));
+          char* data = reinterpret_cast<char*>(repository.dynamicItemFromIndexSimple(indices.at(42))) + sizeof(TestItem);
+          char* expected = reinterpret_cast<char*>(items.at(42).data()) + sizeof(TestItem);
+          for(int pos : {offset, offset + 8}) {
+            data[pos] ^= 0x80;
+            expected[pos] ^= 0x80;
+          }
+          repository.store();
+          repository.close();
+        }
+
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("EqualHighBits"), nullptr);
+        QVERIFY(repository.open(path));
+        QCOMPARE(repository.findIndex(TestItemRequest(*items.at(42), true)), indices.at(42));
+        repository.close();
+      }
+    }
+
+    void replayCommittedJournal()
+    {
+      const QString path = m_repositoryPath + QStringLiteral("/replayCommittedJournal");
+      QVERIFY(QDir().mkpath(path));
+      writeFile(path + QStringLiteral("/data"), "aaaa");
+
+      bool applied = true;
+      {
+        ItemRepositoryJournal journal(path);
+        QVERIFY(journal.begin());
+        journal.write(path + QStringLiteral("/data"), 1, "bc", 2);
+        journal.extend(path + QStringLiteral("/data"), 6);
+        journal.replace(path + QStringLiteral("/other"), "new");
+        journal.afterApply([&applied](bool wasApplied) { applied = wasApplied; });
+        QVERIFY(journal.commit());
+        // simulate a crash right after the commit
+        QVERIFY(QFile::copy(path + QStringLiteral("/journal"), path + QStringLiteral("/journal.crashed")));
+      }
+      QVERIFY(!applied);
+      QVERIFY(QFile::rename(path + QStringLiteral("/journal.crashed"), path + QStringLiteral("/journal")));
+      QCOMPARE(readFile(path + QStringLiteral("/data")), QByteArray("aaaa"));
+
+      QCOMPARE(ItemRepositoryJournal::recover(path), ItemRepositoryJournal::Replayed);
+      QCOMPARE(readFile(path + QStringLiteral("/data")), QByteArray("abca\0\0", 6));
+      QCOMPARE(readFile(path + QStringLiteral("/other")), QByteArray("new"));
+      QVERIFY(!QFile::exists(path + QStringLiteral("/journal")));
+      QCOMPARE(ItemRepositoryJournal::recover(path), ItemRepositoryJournal::NoJournal);
+    }
+
+    void discardIncompleteJournal_data()
+    {
+      QTest::addColumn<bool>("committed");
+      QTest::addColumn<int>("truncate");
+
+      QTest::newRow("uncommitted") << false << 0;
+      QTest::newRow("torn-commit") << true << 3;
+    }
+
+    void discardIncompleteJournal()
+    {
+      QFETCH(bool, committed);
+      QFETCH(int, truncate);
+
+      const QString path = m_repositoryPath + QStringLiteral("/discardIncompleteJournal");
+      QVERIFY(QDir().mkpath(path));
+      writeFile(path + QStringLiteral("/data"), "aaaa");
+
+      {
+        ItemRepositoryJournal journal(path);
+        QVERIFY(journal.begin());
+        journal.write(path + QStringLiteral("/data"), 0, "bbbb", 4);
+        if(committed)
+          QVERIFY(journal.commit());
+        QVERIFY(QFile::copy(path + QStringLiteral("/journal"), path + QStringLiteral("/journal.crashed")));
+      }
+      QFile crashed(path + QStringLiteral("/journal.crashed"));
+      QVERIFY(crashed.resize(crashed.size() - truncate));
+      QVERIFY(crashed.rename(path + QStringLiteral("/journal")));
+
+      QCOMPARE(ItemRepositoryJournal::recover(path), ItemRepositoryJournal::Discarded);
+      QCOMPARE(readFile(path + QStringLiteral("/data")), QByteArray("aaaa"));
+      QVERIFY(!QFile::exists(path + QStringLiteral("/journal")));
+    }
+
+    void applyJournal()
+    {
+      const QString path = m_repositoryPath + QStringLiteral("/applyJournal");
+      QVERIFY(QDir().mkpath(path));
+      writeFile(path + QStringLiteral("/data"), "aaaa");
+
+      bool applied = false;
+      ItemRepositoryJournal journal(path);
+      QVERIFY(journal.begin());
+      journal.write(path + QStringLiteral("/data"), 2, "cc", 2);
+      journal.afterApply([&applied](bool wasApplied) { applied = wasApplied; });
+      QVERIFY(journal.commit());
+      QVERIFY(journal.apply());
+      QVERIFY(applied);
+      QCOMPARE(readFile(path + QStringLiteral("/data")), QByteArray("aacc"));
+      QVERIFY(!QFile::exists(path + QStringLiteral("/journal")));
+    }
+
+    void resetCorruptedRepository()
+    {
+      const QString path = m_repositoryPath + QStringLiteral("/resetCorruptedRepository");
+      QVERIFY(QDir().mkpath(path));
+
+      QSharedPointer<TestItem> item(createItem(1, 100 + sizeof(TestItem)), [](TestItem* item) { delete[] reinterpret_cast<char*>(item); });
+      {
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("Corrupted"), nullptr);
+        QVERIFY(repository.open(path));
+        QVERIFY(repository.index(TestItemRequest(*item, true)));
+        repository.store();
+        repository.close();
+      }
+
+      {
+        // a torn write of the header, changing the statistics
+        QFile file(path + QStringLiteral("/Corrupted"));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.seek(3 * sizeof(uint)));
+        QVERIFY(file.write("\xff\xff\xff\xff", 4) == 4);
+      }
+
+      ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("Corrupted"), nullptr);
+      QVERIFY(repository.open(path));
+      QCOMPARE(repository.findIndex(TestItemRequest(*item, true)), 0u);
+      QVERIFY(repository.index(TestItemRequest(*item, true)));
+      repository.close();
+    }
+
+    void copyRepository()
+    {
+      const QString source = m_repositoryPath + QStringLiteral("/copyRepositorySource");
+      const QString target = m_repositoryPath + QStringLiteral("/copyRepositoryTarget");
+      const QString versionFile = QStringLiteral("/version_%1").arg(staticItemRepositoryVersion(), 0, 16);
+      QVERIFY(QDir().mkpath(source + QStringLiteral("/topcontexts")));
+      QVERIFY(QDir().mkpath(target));
+      writeFile(source + QStringLiteral("/data"), "data");
+      writeFile(source + QStringLiteral("/topcontexts/1"), "context");
+      writeFile(source + QStringLiteral("/crash_counter"), "1");
+      writeFile(target + QStringLiteral("/stale"), "stale");
+
+      // without a version hint, the source is not a complete repository
+      QVERIFY(!ItemRepositoryRegistry::copyRepository(source, target));
+      QVERIFY(QFile::exists(target + QStringLiteral("/stale")));
+
+      writeFile(source + versionFile, QByteArray());
+      QVERIFY(ItemRepositoryRegistry::copyRepository(source, target));
+      QCOMPARE(readFile(target + QStringLiteral("/data")), QByteArray("data"));
+      QCOMPARE(readFile(target + QStringLiteral("/topcontexts/1")), QByteArray("context"));
+      QVERIFY(QFile::exists(target + versionFile));
+      QVERIFY(!QFile::exists(target + QStringLiteral("/crash_counter")));
+      QVERIFY(!QFile::exists(target + QStringLiteral("/stale")));
+
+      // an interrupted store is not copied
+      writeFile(source + QStringLiteral("/is_writing"), QByteArray());
+      QVERIFY(!ItemRepositoryRegistry::copyRepository(source, target));
+    }
+
 private:
+    static void writeFile(const QString& fileName, const QByteArray& contents)
+    {
+      QFile file(fileName);
+      QVERIFY(file.open(QIODevice::WriteOnly));
+      QCOMPARE(file.write(contents), qint64(contents.size()));
+    }
+
+    static QByteArray readFile(const QString& fileName)
+    {
+      QFile file(fileName);
+      return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
     QString m_repositoryPath = QDir::tempPath() + QStringLiteral("/test_itemrepository");
 };
 
@@ -23,6 +23,7 @@
 #include <shell/shellextension.h>
 
 #include <language/backgroundparser/backgroundparser.h>
+#include <language/backgroundparser/parsejob.h>
 #include <language/duchain/definitions.h>
 #include <language/duchain/duchain.h>
 #include <language/duchain/duchainlock.h>
@@ -32,21 +33,34 @@
 #include <language/duchain/persistentsymboltable.h>
 
 #include <interfaces/ilanguagecontroller.h>
+#include <interfaces/iproject.h>
+#include <interfaces/iprojectcontroller.h>
 #include <tests/autotestshell.h>
 #include <tests/testcore.h>
+#include <util/jsonarrayreader.h>
+
+#include <qtcompat_p.h>
 
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QDebug>
 #include <QDirIterator>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
 #include <QStringList>
+#include <QThread>
 #include <QTimer>
 
+#include <algorithm>
+
 #include <stdio.h>
 
 #include <KAboutData>
 #include <KLocalizedString>
+#include <KShell>
 
 
 bool verbose=false, warnings=false;
@@ -77,14 +91,48 @@ void messageOutput(QtMsgType type, const QMessageLogContext& context, const QStr
 }
 
 
+void CompileCommandsProvider::addCommand(const QString& file, const QString& command, const QString& directory)
+{
+    const QString canonicalPath = QFileInfo(file).canonicalFilePath();
+    // a file compiled by several commands is parsed with the flags of the first one
+    if(canonicalPath.isEmpty() || m_flags.contains(canonicalPath)) {
+        return;
+    }
+
+    const PathResolutionResult result = m_resolver.processOutput(command, directory);
+    m_flags.insert(canonicalPath, Flags{result.paths, result.frameworkDirectories, result.defines});
+}
+
+Path::List CompileCommandsProvider::includesInBackground(const QString& path) const
+{
+    return m_flags.value(path).includes;
+}
+
+Path::List CompileCommandsProvider::frameworkDirectoriesInBackground(const QString& path) const
+{
+    return m_flags.value(path).frameworkDirectories;
+}
+
+Defines CompileCommandsProvider::definesInBackground(const QString& path) const
+{
+    return m_flags.value(path).defines;
+}
+
+IDefinesAndIncludesManager::Type CompileCommandsProvider::type() const
+{
+    return IDefinesAndIncludesManager::ProjectSpecific;
+}
+
 Manager::Manager(QCommandLineParser* args) : m_total(0), m_args(args), m_allFilesAdded(0)
+    , m_features(TopDUContext::VisibleDeclarationsAndContexts)
 {
 }
 
 void Manager::init()
 {
-    if(m_args->positionalArguments().isEmpty()) {
-        std::cerr << "Need file or directory to duchainify" << std::endl;
+    if(m_args->positionalArguments().isEmpty() && !m_args->isSet(QStringLiteral("project"))
+        && !m_args->isSet(QStringLiteral("compile-commands"))) {
+        std::cerr << "Need file, directory, project or compilation database to duchainify" << std::endl;
         QCoreApplication::exit(1);
     }
 
@@ -127,17 +175,19 @@ void Manager::init()
     if(m_args->isSet(QStringLiteral("force-update-recursive")))
         features |= TopDUContext::ForceUpdateRecursive;
 
+    // by default, keep all cores busy
+    int threads = QThread::idealThreadCount();
     if(m_args->isSet(QStringLiteral("threads")))
     {
         bool ok = false;
-        int count = m_args->value(QStringLiteral("threads")).toInt(&ok);
-        ICore::self()->languageController()->backgroundParser()->setThreadCount(count);
+        threads = m_args->value(QStringLiteral("threads")).toInt(&ok);
         if(!ok) {
             std::cerr << "bad thread count\n";
             QCoreApplication::exit(3);
             return;
         }
     }
+    ICore::self()->languageController()->backgroundParser()->setThreadCount(threads);
 
     // quit when everything is done
     // background parser emits hideProgress() signal in two situations:
@@ -145,9 +195,113 @@ void Manager::init()
     // later doesn't happen in duchain, so just rely on hideProgress()
     // and quit when it's emitted
     connect(ICore::self()->languageController()->backgroundParser(), &BackgroundParser::hideProgress, this, &Manager::finish);
+    connect(ICore::self()->languageController()->backgroundParser(), &BackgroundParser::parseJobFinished, this, &Manager::parseJobFinished);
+
+    m_features = static_cast<TopDUContext::Features>(features);
+    if(m_args->isSet(QStringLiteral("root"))) {
+        m_root = QFileInfo(m_args->value(QStringLiteral("root"))).absoluteFilePath();
+    }
+
+    if(m_args->isSet(QStringLiteral("project"))) {
+        // the project manager provides the include paths and defines; parse once it is loaded
+        const QFileInfo projectFile(m_args->value(QStringLiteral("project")));
+        if(!projectFile.isFile()) {
+            std::cerr << "no project file at " << qPrintable(projectFile.absoluteFilePath()) << std::endl;
+            QCoreApplication::exit(6);
+            return;
+        }
+        const QUrl projectUrl = QUrl::fromLocalFile(projectFile.absoluteFilePath());
+        connect(ICore::self()->projectController(), &IProjectController::projectOpened, this, &Manager::projectOpened);
+        connect(ICore::self()->projectController(), &IProjectController::projectOpeningAborted, this, &Manager::projectOpeningAborted);
+        std::cerr << "opening project " << qPrintable(projectUrl.toLocalFile()) << std::endl;
+        ICore::self()->projectController()->openProject(projectUrl);
+        return;
+    }
+
+    startParsing();
+}
+
+void Manager::projectOpened(IProject* project)
+{
+    if(m_root.isEmpty()) {
+        m_root = project->path().toLocalFile();
+    }
+    m_timer.start();
+    foreach (const auto& file, project->fileSet()) {
+        addToBackgroundParser(file.str(), m_features);
+    }
+    startParsing();
+}
+
+void Manager::projectOpeningAborted(IProject* project)
+{
+    std::cerr << "failed opening project " << qPrintable(project->projectFile().pathOrUrl()) << std::endl;
+    QCoreApplication::exit(6);
+}
+
+bool Manager::addCompileCommands(const QString& path, TopDUContext::Features features)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "cannot open " << qPrintable(path) << ": " << qPrintable(file.errorString()) << std::endl;
+        return false;
+    }
+
+    // read the whole database before adding any file, so the flags of all files are known once parsing starts
+    QStringList files;
+    JsonArrayReader reader(&file);
+    QJsonValue value;
+    while(reader.readNext(&value)) {
+        const QJsonObject entry = value.toObject();
+        // relative file names are relative to the directory the compiler ran in
+        const QString directory = entry.value(QStringLiteral("directory")).toString();
+        const QString fileName = entry.value(QStringLiteral("file")).toString();
+        if(fileName.isEmpty()) {
+            continue;
+        }
+
+        QString command = entry.value(QStringLiteral("command")).toString();
+        if(command.isEmpty()) {
+            QStringList arguments;
+            foreach (const auto& argument, entry.value(QStringLiteral("arguments")).toArray()) {
+                arguments << argument.toString();
+            }
+            command = KShell::joinArgs(arguments);
+        }
+
+        const QString filePath = QDir(directory).absoluteFilePath(fileName);
+        m_compileCommands.addCommand(filePath, command, directory);
+        files << filePath;
+    }
+    if(!reader.errorString().isEmpty()) {
+        std::cerr << "bad compilation database " << qPrintable(path) << ": " << qPrintable(reader.errorString()) << std::endl;
+        return false;
+    }
+
+    if(!m_compileCommandsRegistered) {
+        IDefinesAndIncludesManager::manager()->registerBackgroundProvider(&m_compileCommands);
+        m_compileCommandsRegistered = true;
+    }
+    foreach (const auto& filePath, files) {
+        addToBackgroundParser(filePath, features);
+    }
+    return true;
+}
+
+void Manager::startParsing()
+{
+    if(!m_timer.isValid()) {
+        m_timer.start();
+    }
 
     foreach (const auto& file, m_args->positionalArguments()) {
-        addToBackgroundParser(file, (TopDUContext::Features)features);
+        addToBackgroundParser(file, m_features);
+    }
+
+    if(m_args->isSet(QStringLiteral("compile-commands"))
+        && !addCompileCommands(m_args->value(QStringLiteral("compile-commands")), m_features)) {
+        QCoreApplication::exit(4);
+        return;
     }
     m_allFilesAdded = 1;
 
@@ -239,6 +393,9 @@ void Manager::addToBackgroundParser(const QString& path, TopDUContext::Features
     {
         qDebug() << "adding file" << path;
         QUrl pathUrl = QUrl::fromLocalFile(info.canonicalFilePath());
+        if(m_waiting.contains(pathUrl)) {
+            return;
+        }
 
         m_waiting << pathUrl;
         ++m_total;
@@ -261,10 +418,73 @@ QSet< QUrl > Manager::waiting()
     return m_waiting;
 }
 
+void Manager::parseJobFinished(ParseJob* job)
+{
+    m_parseTimes.append(qMakePair(job->parseTime(), job->document().str()));
+}
+
+void Manager::report()
+{
+    const qint64 elapsed = qMax<qint64>(m_timer.elapsed(), 1);
+    std::cerr << "parsed " << m_parseTimes.size() << " files in " << (elapsed / 1000.0) << " s, "
+              << (m_parseTimes.size() * 1000.0 / elapsed) << " files/s" << std::endl;
+
+    std::sort(m_parseTimes.begin(), m_parseTimes.end(), [](const QPair<qint64, QString>& lhs, const QPair<qint64, QString>& rhs) {
+        return lhs.first > rhs.first;
+    });
+
+    if(m_args->isSet(QStringLiteral("report"))) {
+        QFile file(m_args->value(QStringLiteral("report")));
+        if(file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            QTextStream stream(&file);
+            for (const auto& parseTime : qAsConst(m_parseTimes)) {
+                stream << parseTime.first << '\t' << parseTime.second << '\n';
+            }
+        } else {
+            std::cerr << "cannot write the report to " << qPrintable(file.fileName()) << ": " << qPrintable(file.errorString()) << std::endl;
+        }
+    }
+
+    const int slowest = qMin(m_parseTimes.size(), 10);
+    if(slowest) {
+        std::cerr << "slowest files:" << std::endl;
+    }
+    for (int i = 0; i < slowest; ++i) {
+        std::cerr << "  " << m_parseTimes[i].first << " ms " << qPrintable(m_parseTimes[i].second) << std::endl;
+    }
+}
+
+bool Manager::exportCache(const QString& path)
+{
+    const QString root = m_root.isEmpty() ? QDir::currentPath() : m_root;
+    if(!DUChain::self()->exportCache(path, root)) {
+        std::cerr << "failed exporting the cache to " << qPrintable(path) << std::endl;
+        return false;
+    }
+    std::cerr << "exported the cache to " << qPrintable(path) << std::endl;
+    return true;
+}
+
 void Manager::finish()
 {
+    // the background parser may become idle while the project is loading
+    if(!m_allFilesAdded) {
+        return;
+    }
+
     std::cerr << "ready" << std::endl;
-    QApplication::quit();
+    report();
+
+    if(m_compileCommandsRegistered) {
+        IDefinesAndIncludesManager::manager()->unregisterBackgroundProvider(&m_compileCommands);
+        m_compileCommandsRegistered = false;
+    }
+
+    int ret = 0;
+    if(m_args->isSet(QStringLiteral("export-cache")) && !exportCache(m_args->value(QStringLiteral("export-cache")))) {
+        ret = 5;
+    }
+    QApplication::exit(ret);
 }
 
 using namespace KDevelop;
@@ -287,7 +507,12 @@ int main(int argc, char** argv)
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("V"), QStringLiteral("verbose")}, i18n("Show warnings and debug output")});
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("u"), QStringLiteral("force-update")}, i18n("Enforce an update of the top-contexts corresponding to the given files")});
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("r"), QStringLiteral("force-update-recursive")}, i18n("Enforce an update of the top-contexts corresponding to the given files and all included files")});
-    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("t"), QStringLiteral("threads")}, i18n("Number of threads to use"), QStringLiteral("count")});
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("t"), QStringLiteral("threads")}, i18n("Number of threads to use, by default one per core"), QStringLiteral("count")});
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("p"), QStringLiteral("project")}, i18n("Open the project and parse all of its files"), QStringLiteral("project file")});
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("compile-commands")}, i18n("Parse all files listed in the compilation database"), QStringLiteral("compile_commands.json")});
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("export-cache")}, i18n("When done, store the DUChain and copy it to the directory, so sessions can import it by setting KDEV_DUCHAIN_IMPORT_DIR"), QStringLiteral("directory")});
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("root")}, i18n("Directory the files in the exported cache are recorded relative to, by default the project directory or the current directory"), QStringLiteral("directory")});
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("report")}, i18n("Write the parse time in milliseconds of each file to the report file"), QStringLiteral("file")});
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("f"), QStringLiteral("features")}, i18n("Features to build. Options: empty, simplified-visible-declarations, visible-declarations (default), all-declarations, all-declarations-and-uses, all-declarations-and-uses-and-AST"), QStringLiteral("features")});
 
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("dump-context")}, i18n("Print complete Definition-Use Chain on successful parse")});
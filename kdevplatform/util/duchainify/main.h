@@ -22,28 +22,79 @@
 
 #include <QObject>
 #include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
 #include <QUrl>
+#include <QVector>
 
+#include <custom-definesandincludes/idefinesandincludesmanager.h>
 #include <language/duchain/topducontext.h>
+#include <makefileresolver/makefileresolver.h>
 #include <serialization/indexedstring.h>
 
 class QCommandLineParser;
 
+namespace KDevelop {
+class IProject;
+class ParseJob;
+}
+
+/// Provides the include paths and defines of the compilation database to the parse jobs
+class CompileCommandsProvider : public KDevelop::IDefinesAndIncludesManager::BackgroundProvider
+{
+    public:
+        /// Records the flags of @p command, run in @p directory, as those of @p file
+        void addCommand(const QString& file, const QString& command, const QString& directory);
+
+        KDevelop::Path::List includesInBackground(const QString& path) const override;
+        KDevelop::Path::List frameworkDirectoriesInBackground(const QString& path) const override;
+        KDevelop::Defines definesInBackground(const QString& path) const override;
+        KDevelop::IDefinesAndIncludesManager::Type type() const override;
+
+    private:
+        struct Flags
+        {
+            KDevelop::Path::List includes;
+            KDevelop::Path::List frameworkDirectories;
+            KDevelop::Defines defines;
+        };
+        MakeFileResolver m_resolver;
+        /// The flags of each file by its canonical path, only written before parsing starts
+        QHash<QString, Flags> m_flags;
+};
+
 class Manager : public QObject {
     Q_OBJECT
     public:
         explicit Manager(QCommandLineParser* args);
         void addToBackgroundParser(const QString& path, KDevelop::TopDUContext::Features features);
+        bool addCompileCommands(const QString& path, KDevelop::TopDUContext::Features features);
         QSet<QUrl> waiting();
     private:
+        void startParsing();
+        void report();
+        bool exportCache(const QString& path);
+
+        CompileCommandsProvider m_compileCommands;
+        bool m_compileCommandsRegistered = false;
         QSet<QUrl> m_waiting;
         uint m_total;
         QCommandLineParser* m_args;
         QAtomicInt m_allFilesAdded;
+        KDevelop::TopDUContext::Features m_features;
+        /// Directory the files in the exported cache are recorded relative to
+        QString m_root;
+        QElapsedTimer m_timer;
+        /// Wall-clock parse time in milliseconds of each finished parse job
+        QVector<QPair<qint64, QString>> m_parseTimes;
 
     public Q_SLOTS:
         // delay init into event loop so the DUChain can always shutdown gracefully
         void init();
+        void projectOpened(KDevelop::IProject* project);
+        void projectOpeningAborted(KDevelop::IProject* project);
+        void parseJobFinished(KDevelop::ParseJob* job);
         void updateReady(const KDevelop::IndexedString& url, const KDevelop::ReferencedTopDUContext& topContext);
         void finish();
         void dump(const KDevelop::ReferencedTopDUContext& topContext);
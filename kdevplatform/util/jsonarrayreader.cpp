@@ -0,0 +1,204 @@
+/*
+ * This file is part of KDevelop
+ * Copyright 2026 KDevelop developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jsonarrayreader.h"
+
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+using namespace KDevelop;
+
+JsonArrayReader::JsonArrayReader(QIODevice* device)
+    : m_device(device)
+{
+}
+
+bool JsonArrayReader::readNext(QJsonValue* value)
+{
+    if (!m_error.isEmpty() || m_finished) {
+        return false;
+    }
+
+    if (!skipWhitespace()) {
+        return fail(QStringLiteral("unexpected end of file"));
+    }
+
+    if (!m_started) {
+        if (m_buffer.at(m_pos) != '[') {
+            return fail(QStringLiteral("document is not an array"));
+        }
+        m_started = true;
+        ++m_pos;
+        if (!skipWhitespace()) {
+            return fail(QStringLiteral("unexpected end of file"));
+        }
+        if (m_buffer.at(m_pos) == ']') {
+            return finish();
+        }
+        return readElement(value);
+    }
+
+    // every element but the first one has to be preceded by a separator
+    switch (m_buffer.at(m_pos)) {
+    case ']':
+        return finish();
+    case ',':
+        ++m_pos;
+        if (!skipWhitespace()) {
+            return fail(QStringLiteral("unexpected end of file"));
+        }
+        return readElement(value);
+    default:
+        return fail(QStringLiteral("missing comma between array elements"));
+    }
+}
+
+QString JsonArrayReader::errorString() const
+{
+    return m_error;
+}
+
+bool JsonArrayReader::fail(const QString& error)
+{
+    m_error = error;
+    return false;
+}
+
+bool JsonArrayReader::finish()
+{
+    m_finished = true;
+    ++m_pos;
+    if (skipWhitespace()) {
+        return fail(QStringLiteral("garbage at the end of the document"));
+    }
+    return false;
+}
+
+bool JsonArrayReader::readElement(QJsonValue* value)
+{
+    int end = 0;
+    while ((end = elementEnd()) == -1) {
+        if (!fill()) {
+            return fail(QStringLiteral("unexpected end of file"));
+        }
+    }
+    if (end == m_pos) {
+        return fail(QStringLiteral("missing value"));
+    }
+
+    const QByteArray element = QByteArray::fromRawData(m_buffer.constData() + m_pos, end - m_pos);
+    const char first = element.at(0);
+    QJsonParseError error;
+    if (first == '{' || first == '[') {
+        const auto document = QJsonDocument::fromJson(element, &error);
+        if (error.error) {
+            return fail(error.errorString());
+        }
+        *value = document.isObject() ? QJsonValue(document.object()) : QJsonValue(document.array());
+    } else {
+        // scalars are never valid entries, but they still have to be valid JSON
+        const auto document = QJsonDocument::fromJson('[' + element + ']', &error);
+        if (error.error) {
+            return fail(error.errorString());
+        }
+        *value = document.array().at(0);
+    }
+    m_pos = end;
+    return true;
+}
+
+bool JsonArrayReader::fill()
+{
+    if (m_device->atEnd()) {
+        return false;
+    }
+    // drop what was consumed already, then append the next block
+    m_buffer.remove(0, m_pos);
+    m_pos = 0;
+    const QByteArray block = m_device->read(BlockSize);
+    if (block.isEmpty()) {
+        return false;
+    }
+    m_buffer += block;
+    return true;
+}
+
+bool JsonArrayReader::skipWhitespace()
+{
+    forever {
+        while (m_pos < m_buffer.size()) {
+            const char c = m_buffer.at(m_pos);
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                return true;
+            }
+            ++m_pos;
+        }
+        if (!fill()) {
+            return false;
+        }
+    }
+}
+
+int JsonArrayReader::elementEnd() const
+{
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    for (int i = m_pos, c = m_buffer.size(); i < c; ++i) {
+        const char ch = m_buffer.at(i);
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == '"') {
+                inString = false;
+            }
+            continue;
+        }
+        switch (ch) {
+        case '"':
+            inString = true;
+            break;
+        case '{':
+        case '[':
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (depth == 0) {
+                return i;
+            }
+            if (--depth == 0) {
+                return i + 1;
+            }
+            break;
+        case ',':
+            if (depth == 0) {
+                return i;
+            }
+            break;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of KDevelop
+ * Copyright 2026 KDevelop developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KDEVPLATFORM_JSONARRAYREADER_H
+#define KDEVPLATFORM_JSONARRAYREADER_H
+
+#include "utilexport.h"
+
+#include <QByteArray>
+#include <QJsonValue>
+#include <QString>
+
+class QIODevice;
+
+namespace KDevelop {
+
+/**
+ * Reads the elements of a top-level JSON array one at a time, so that
+ * huge compile_commands.json files never have to be held in memory at once.
+ *
+ * Malformed documents are rejected like QJsonDocument::fromJson does, though the
+ * elements read before the error was found have already been returned.
+ */
+class KDEVPLATFORMUTIL_EXPORT JsonArrayReader
+{
+public:
+    explicit JsonArrayReader(QIODevice* device);
+
+    /**
+     * Reads the next element of the array into @p value.
+     *
+     * @return false at the end of the array or when an error occurred, see errorString()
+     */
+    bool readNext(QJsonValue* value);
+
+    /// @return the error found in the document, or an empty string
+    QString errorString() const;
+
+private:
+    bool fail(const QString& error);
+    bool fill();
+    bool skipWhitespace();
+    /// @return the end of the element starting at m_pos, or -1 when more data is needed
+    int elementEnd() const;
+    bool readElement(QJsonValue* value);
+    bool finish();
+
+    enum {
+        BlockSize = 1024 * 1024
+    };
+
+    QIODevice* m_device;
+    QByteArray m_buffer;
+    int m_pos = 0;
+    bool m_started = false;
+    bool m_finished = false;
+    QString m_error;
+};
+
+}
+
+#endif // KDEVPLATFORM_JSONARRAYREADER_H
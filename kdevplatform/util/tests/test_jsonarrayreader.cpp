@@ -0,0 +1,139 @@
+/*
+ * This file is part of KDevelop
+ *
+ * Copyright 2026 KDevelop developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "test_jsonarrayreader.h"
+
+#include <util/jsonarrayreader.h>
+
+#include <QBuffer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+#include <QVector>
+
+QTEST_GUILESS_MAIN(TestJsonArrayReader)
+
+using namespace KDevelop;
+
+namespace {
+/// Reads all elements of @p json, @return whether the end of the array was reached without error
+bool readAll(const QByteArray& json, QVector<QJsonValue>* values, QString* error)
+{
+    QByteArray data = json;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    JsonArrayReader reader(&buffer);
+    QJsonValue value;
+    while (reader.readNext(&value)) {
+        values->append(value);
+    }
+    *error = reader.errorString();
+    return error->isEmpty();
+}
+}
+
+void TestJsonArrayReader::testValid_data()
+{
+    QTest::addColumn<QByteArray>("json");
+
+    QTest::newRow("empty") << QByteArray("[]");
+    QTest::newRow("empty-whitespace") << QByteArray(" \n[ \t\r\n] \n");
+    QTest::newRow("single") << QByteArray(R"([{"file": "a.cpp", "command": "c++ a.cpp"}])");
+    QTest::newRow("multiple") << QByteArray(R"([{"file": "a.cpp"}, {"file": "b.cpp"},{"file":"c.cpp"}])");
+    QTest::newRow("nested") << QByteArray(R"([{"arguments": ["c++", "-DFOO={1,2}"], "x": {"y": []}}, [1, [2]]])");
+    QTest::newRow("brackets-in-strings") << QByteArray(R"([{"command": "echo ] } , [ {"}, {"file": "\"]\\"}])");
+    QTest::newRow("scalars") << QByteArray(R"([1, "two", true, null])");
+}
+
+void TestJsonArrayReader::testValid()
+{
+    QFETCH(QByteArray, json);
+
+    QVector<QJsonValue> values;
+    QString error;
+    QVERIFY2(readAll(json, &values, &error), qPrintable(error));
+
+    // the result must be the same as reading the whole document at once
+    QJsonParseError parseError;
+    const auto document = QJsonDocument::fromJson(json, &parseError);
+    QCOMPARE(parseError.error, QJsonParseError::NoError);
+    const auto array = document.array();
+    QCOMPARE(values.size(), array.size());
+    for (int i = 0; i < values.size(); ++i) {
+        QCOMPARE(values.at(i), array.at(i));
+    }
+}
+
+void TestJsonArrayReader::testMalformed_data()
+{
+    QTest::addColumn<QByteArray>("json");
+    QTest::addColumn<int>("validElements");
+
+    QTest::newRow("empty-file") << QByteArray("") << 0;
+    QTest::newRow("not-an-array") << QByteArray(R"({"file": "a.cpp"})") << 0;
+    QTest::newRow("truncated-start") << QByteArray("[") << 0;
+    QTest::newRow("truncated-element") << QByteArray(R"([{"file": "a.cpp")") << 0;
+    QTest::newRow("truncated-string") << QByteArray(R"([{"file": "a.cpp}])") << 0;
+    QTest::newRow("truncated-after-element") << QByteArray(R"([{"file": "a.cpp"})") << 1;
+    QTest::newRow("truncated-after-comma") << QByteArray(R"([{"file": "a.cpp"},)") << 1;
+    QTest::newRow("missing-comma") << QByteArray(R"([{"file": "a.cpp"} {"file": "b.cpp"}])") << 1;
+    QTest::newRow("missing-comma-no-space") << QByteArray(R"([{"file": "a.cpp"}{"file": "b.cpp"}])") << 1;
+    QTest::newRow("missing-comma-scalars") << QByteArray("[1 2]") << 0;
+    QTest::newRow("missing-comma-in-object") << QByteArray(R"([{"file": "a.cpp" "command": "c++"}])") << 0;
+    QTest::newRow("leading-comma") << QByteArray(R"([, {"file": "a.cpp"}])") << 0;
+    QTest::newRow("trailing-comma") << QByteArray(R"([{"file": "a.cpp"},])") << 1;
+    QTest::newRow("double-comma") << QByteArray(R"([{"file": "a.cpp"},,{"file": "b.cpp"}])") << 1;
+    QTest::newRow("invalid-scalar") << QByteArray("[tru]") << 0;
+    QTest::newRow("garbage-after-array") << QByteArray(R"([{"file": "a.cpp"}] x)") << 1;
+}
+
+void TestJsonArrayReader::testMalformed()
+{
+    QFETCH(QByteArray, json);
+    QFETCH(int, validElements);
+
+    QJsonParseError parseError;
+    QJsonDocument::fromJson(json, &parseError);
+    QVERIFY(parseError.error != QJsonParseError::NoError);
+
+    QVector<QJsonValue> values;
+    QString error;
+    QVERIFY(!readAll(json, &values, &error));
+    QVERIFY(!error.isEmpty());
+    QCOMPARE(values.size(), validElements);
+}
+
+void TestJsonArrayReader::testLargeElement()
+{
+    // spans several of the blocks the reader fills its buffer with
+    const QString command = QString(3 * 1024 * 1024, QLatin1Char('x'));
+    QJsonObject entry;
+    entry.insert(QStringLiteral("command"), command);
+    const QByteArray element = QJsonDocument(entry).toJson(QJsonDocument::Compact);
+    const QByteArray json = '[' + element + ",\n" + element + ']';
+
+    QVector<QJsonValue> values;
+    QString error;
+    QVERIFY2(readAll(json, &values, &error), qPrintable(error));
+    QCOMPARE(values.size(), 2);
+    QCOMPARE(values.at(1).toObject().value(QStringLiteral("command")).toString(), command);
+}
@@ -116,6 +116,29 @@ Path userDefinedPchIncludeForFile(const QString& sourcefile)
     return paths.isEmpty() ? Path() : paths.first();
 }
 
+/**
+ * @returns the beginning of @p sourcefile, preferring unsaved editor contents
+ *
+ * Only the include block at the top is of interest, so don't read the whole file.
+ */
+QByteArray translationUnitHead(const QString& sourcefile, const QVector<UnsavedFile>& unsavedFiles)
+{
+    const qint64 maxHeadSize = 64 * 1024;
+    const QByteArray fileName = sourcefile.toUtf8();
+    for (const auto& unsavedFile : unsavedFiles) {
+        const auto file = unsavedFile.toClangApi();
+        if (fileName == file.Filename) {
+            return QByteArray(file.Contents, qMin<qint64>(file.Length, maxHeadSize));
+        }
+    }
+
+    QFile file(sourcefile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return file.read(maxHeadSize);
+}
+
 ProjectFileItem* findProjectFileItem(const IndexedString& url, bool* hasBuildSystemInfo)
 {
     ProjectFileItem* file = nullptr;
@@ -222,6 +245,7 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
     QReadLocker parseLock(languageSupport()->parseLock());
 
     if (abortRequested()) {
+        setPreempted();
         return;
     }
 
@@ -238,9 +262,14 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
         m_environment.addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectoriesInBackground(tuUrlStr));
         m_environment.addDefines(IDefinesAndIncludesManager::manager()->definesInBackground(tuUrlStr));
         m_environment.setPchInclude(userDefinedPchIncludeForFile(tuUrlStr));
+        if (!m_environment.pchInclude().isValid() && m_environment.quality() != ClangParsingEnvironment::Unknown) {
+            const auto head = translationUnitHead(tuUrlStr, m_unsavedFiles);
+            m_environment.setPchInclude(clang()->index()->sharedPreamble(m_environment, head));
+        }
     }
 
     if (abortRequested()) {
+        setPreempted();
         return;
     }
 
@@ -272,13 +301,18 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
 
     {
         UrlParseLock urlLock(document());
-        if (abortRequested() || !isUpdateRequired(ParseSession::languageString())) {
+        if (abortRequested()) {
+            setPreempted();
+            return;
+        }
+        if (!isUpdateRequired(ParseSession::languageString())) {
             return;
         }
     }
 
     ParseSession session(ClangIntegration::DUChainUtils::findParseSessionData(document(), m_environment.translationUnitUrl()));
     if (abortRequested()) {
+        setPreempted();
         return;
     }
 
@@ -316,6 +350,7 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
     }
 
     if (abortRequested()) {
+        setPreempted();
         return;
     }
 
@@ -325,6 +360,7 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
     setDuChain(context);
 
     if (abortRequested()) {
+        setPreempted();
         return;
     }
 
@@ -63,6 +63,7 @@
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <tuple>
 
 #include <KTextEditor/Document>
 #include <KTextEditor/View>
@@ -73,6 +74,9 @@ namespace {
 /// Maximum return-type string length in completion items
 const int MAX_RETURN_TYPE_STRING_LENGTH = 20;
 
+/// Maximum count of results that are turned into full completion items right away, the others are built on demand
+const int MAX_MATERIALIZED_ITEMS = 500;
+
 /// Priority of code-completion results. NOTE: Keep in sync with Clang code base.
 enum CodeCompletionPriority {
   /// Priority for the next initialization in a constructor initializer list.
@@ -595,6 +599,60 @@ bool isValidSpecialCompletionIdentifier(const QualifiedIdentifier& identifier)
     return false;
 }
 
+/**
+ * @return The text the user has to type for the completion string @p completionString
+ *
+ * This is a lot cheaper than walking all the chunks of the completion string.
+ */
+QString typedTextOf(CXCompletionString completionString)
+{
+    const uint chunks = clang_getNumCompletionChunks(completionString);
+    for (uint j = 0; j < chunks; ++j) {
+        if (clang_getCompletionChunkKind(completionString, j) == CXCompletionChunk_TypedText) {
+            return ClangString(clang_getCompletionChunkText(completionString, j)).toString();
+        }
+    }
+    return {};
+}
+
+/// @return The identifier the user is typing at the end of @p text
+QString typedPrefix(const QString& text)
+{
+    int start = text.size();
+    while (start > 0 && (text.at(start - 1).isLetterOrNumber() || text.at(start - 1) == QLatin1Char('_'))) {
+        --start;
+    }
+    return text.mid(start);
+}
+
+/// How well the text of a completion result matches the prefix typed by the user, lower is better
+enum PrefixMatch {
+    ExactlyMatched,
+    PrefixMatched,
+    /// The characters of the prefix occur in order, like an abbreviation
+    AbbreviationMatched,
+    NotMatched
+};
+
+PrefixMatch matchPrefix(const QString& typed, const QString& prefix)
+{
+    if (typed.compare(prefix, Qt::CaseInsensitive) == 0) {
+        return ExactlyMatched;
+    }
+    if (typed.startsWith(prefix, Qt::CaseInsensitive)) {
+        return PrefixMatched;
+    }
+    int pos = 0;
+    for (const QChar c : prefix) {
+        pos = typed.indexOf(c, pos, Qt::CaseInsensitive);
+        if (pos == -1) {
+            return NotMatched;
+        }
+        ++pos;
+    }
+    return AbbreviationMatched;
+}
+
 Declaration* findDeclaration(const QualifiedIdentifier& qid, const DUContextPointer& ctx, const CursorInRevision& position, QSet<Declaration*>& handled)
 {
     PersistentSymbolTable::Declarations decl = PersistentSymbolTable::self().declarations(qid);
@@ -788,252 +846,62 @@ private:
     bool m_enabled;
 };
 
-struct MemberAccessReplacer : public QObject
+/**
+ * Turns Clang code-completion results into completion items
+ *
+ * It is shared by all items of one completion request, so that the results which
+ * are not built right away can still be built later on, see LazyItem.
+ */
+class ItemBuilder
 {
-    Q_OBJECT
-
 public:
-    enum Type {
-        None,
-        DotToArrow,
-        ArrowToDot
+    enum Kind {
+        Normal,
+        Special,
+        Macro,
+        Builtin
     };
 
-public Q_SLOTS:
-    void replaceCurrentAccess(MemberAccessReplacer::Type type)
-    {
-        if (auto document = ICore::self()->documentController()->activeDocument()) {
-            if (auto textDocument = document->textDocument()) {
-                auto activeView = document->activeTextView();
-                if (!activeView) {
-                    return;
-                }
-
-                auto cursor = activeView->cursorPosition();
-
-                QString oldAccess, newAccess;
-                if (type == ArrowToDot) {
-                    oldAccess = QStringLiteral("->");
-                    newAccess = QStringLiteral(".");
-                } else {
-                    oldAccess = QStringLiteral(".");
-                    newAccess = QStringLiteral("->");
-                }
-
-                auto oldRange = KTextEditor::Range(cursor - KTextEditor::Cursor(0, oldAccess.length()), cursor);
-
-                // This code needed for testReplaceMemberAccess test
-                // Maybe we should do a similar thing for '->' to '.' direction, but this is not so important
-                while (textDocument->text(oldRange) == QLatin1String(" ") && oldRange.start().column() >= 0) {
-                    oldRange = KTextEditor::Range({oldRange.start().line(), oldRange.start().column() - 1},
-                                                  {oldRange.end().line(), oldRange.end().column() - 1});
-                }
-
-                if (oldRange.start().column() >= 0 && textDocument->text(oldRange) == oldAccess) {
-                    textDocument->replaceText(oldRange, newAccess);
-                }
-            }
-        }
-    }
-};
-static MemberAccessReplacer s_memberAccessReplacer;
-
-}
-
-Q_DECLARE_METATYPE(MemberAccessReplacer::Type)
-
-ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& context,
-                                                       const ParseSessionData::Ptr& sessionData,
-                                                       const QUrl& url,
-                                                       const KTextEditor::Cursor& position,
-                                                       const QString& text,
-                                                       const QString& followingText
-                                                      )
-    : CodeCompletionContext(context, text + followingText, CursorInRevision::castFromSimpleCursor(position), 0)
-    , m_results(nullptr, clang_disposeCodeCompleteResults)
-    , m_parseSessionData(sessionData)
-{
-    qRegisterMetaType<MemberAccessReplacer::Type>();
-    const QByteArray file = url.toLocalFile().toUtf8();
-    ParseSession session(m_parseSessionData);
+    ItemBuilder(const std::shared_ptr<CXCodeCompleteResults>& results, const DUContextPointer& context,
+                const CursorInRevision& position)
+        : m_results(results)
+        , m_context(context)
+        , m_position(position)
+        , m_currentClassContext(classDeclarationForContext(context, position))
+    {}
 
-    QVector<UnsavedFile> otherUnsavedFiles;
+    /// If the context is/inside the Class context, this represents that context.
+    Declaration* currentClassContext() const
     {
-        ForegroundLock lock;
-        otherUnsavedFiles = ClangUtils::unsavedFiles();
+        return m_currentClassContext.data();
     }
-    QVector<CXUnsavedFile> allUnsaved;
 
+    /**
+     * Builds the item for the result at @p index and stores its group in @p kind
+     *
+     * @return A null pointer if the result should not be offered
+     * @note The DUChain must be read-locked
+     */
+    CompletionTreeItemPointer build(uint index, CXAvailabilityKind availability, Kind* kind,
+                                    LookAheadItemMatcher* lookAheadMatcher = nullptr)
     {
-        const unsigned int completeOptions = clang_defaultCodeCompleteOptions();
-
-        CXUnsavedFile unsaved;
-        unsaved.Filename = file.constData();
-        const QByteArray content = m_text.toUtf8();
-        unsaved.Contents = content.constData();
-        unsaved.Length = content.size();
-
-        allUnsaved.reserve(otherUnsavedFiles.size() + 1);
-        for (const auto& f : qAsConst(otherUnsavedFiles)) {
-            allUnsaved.append(f.toClangApi());
-        }
-        allUnsaved.append(unsaved);
-
-        m_results.reset(clang_codeCompleteAt(session.unit(), file.constData(),
-                        position.line() + 1, position.column() + 1,
-                        allUnsaved.data(), allUnsaved.size(),
-                        completeOptions));
-
-        if (!m_results) {
-            qCWarning(KDEV_CLANG) << "Something went wrong during 'clang_codeCompleteAt' for file" << file;
-            return;
-        }
-
-        auto numDiagnostics = clang_codeCompleteGetNumDiagnostics(m_results.get());
-        for (uint i = 0; i < numDiagnostics; i++) {
-            auto diagnostic = clang_codeCompleteGetDiagnostic(m_results.get(), i);
-            auto diagnosticType = ClangDiagnosticEvaluator::diagnosticType(diagnostic);
-            clang_disposeDiagnostic(diagnostic);
-            if (diagnosticType == ClangDiagnosticEvaluator::ReplaceWithArrowProblem || diagnosticType == ClangDiagnosticEvaluator::ReplaceWithDotProblem) {
-                MemberAccessReplacer::Type replacementType;
-                if (diagnosticType == ClangDiagnosticEvaluator::ReplaceWithDotProblem) {
-                    replacementType = MemberAccessReplacer::ArrowToDot;
-                } else {
-                    replacementType = MemberAccessReplacer::DotToArrow;
-                }
-
-                QMetaObject::invokeMethod(&s_memberAccessReplacer, "replaceCurrentAccess", Qt::QueuedConnection,
-                                          Q_ARG(MemberAccessReplacer::Type, replacementType));
-
-                m_valid = false;
-                return;
-            }
-        }
-
-        auto addMacros = ClangSettingsManager::self()->codeCompletionSettings().macros;
-        if (!addMacros) {
-            m_filters |= NoMacros;
-        }
-    }
-
-    if (!m_results->NumResults) {
-        const auto trimmedText = text.trimmed();
-        if (trimmedText.endsWith(QLatin1Char('.'))) {
-            // TODO: This shouldn't be needed if Clang provided diagnostic.
-            // But it doesn't always do it, so let's try to manually determine whether '.' is used instead of '->'
-            m_text = trimmedText.leftRef(trimmedText.size() - 1) + QStringLiteral("->");
-
-            CXUnsavedFile unsaved;
-            unsaved.Filename = file.constData();
-            const QByteArray content = m_text.toUtf8();
-            unsaved.Contents = content.constData();
-            unsaved.Length = content.size();
-            allUnsaved[allUnsaved.size() - 1] = unsaved;
-
-            m_results.reset(clang_codeCompleteAt(session.unit(), file.constData(),
-                                                 position.line() + 1, position.column() + 1 + 1,
-                                                 allUnsaved.data(), allUnsaved.size(),
-                                                 clang_defaultCodeCompleteOptions()));
-
-            if (m_results && m_results->NumResults) {
-                QMetaObject::invokeMethod(&s_memberAccessReplacer, "replaceCurrentAccess", Qt::QueuedConnection,
-                                          Q_ARG(MemberAccessReplacer::Type, MemberAccessReplacer::DotToArrow));
-            }
-
-            m_valid = false;
-            return;
-        }
-    }
-
-    // check 'isValidPosition' after parsing the new content
-    auto clangFile = session.file(file);
-    if (!isValidPosition(session.unit(), clangFile)) {
-        m_valid = false;
-        return;
-    }
-
-    m_completionHelper.computeCompletions(session, clangFile, position);
-}
-
-ClangCodeCompletionContext::~ClangCodeCompletionContext()
-{
-}
-
-bool ClangCodeCompletionContext::isValidPosition(CXTranslationUnit unit, CXFile file) const
-{
-    if (isInsideComment(unit, file, m_position.castToSimpleCursor())) {
-        clangDebug() << "Invalid completion context: Inside comment";
-        return false;
-    }
-    return true;
-}
-
-QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(bool& abort, bool /*fullCompletion*/)
-{
-    if (!m_valid || !m_duContext || !m_results) {
-        return {};
-    }
-
-    const auto ctx = DUContextPointer(m_duContext->findContextAt(m_position));
-
-    /// Normal completion items, such as 'void Foo::foo()'
-    QList<CompletionTreeItemPointer> items;
-    /// Stuff like 'Foo& Foo::operator=(const Foo&)', etc. Not regularly used by our users.
-    QList<CompletionTreeItemPointer> specialItems;
-    /// Macros from the current context
-    QList<CompletionTreeItemPointer> macros;
-    /// Builtins reported by Clang
-    QList<CompletionTreeItemPointer> builtin;
-
-    // two sets of handled declarations to prevent duplicates and make sure we show
-    // all available overloads
-    QSet<Declaration*> handled;
-    // this is only used for the CXCursor_OverloadCandidate completion items
-    QSet<Declaration*> overloadsHandled;
-
-    LookAheadItemMatcher lookAheadMatcher(TopDUContextPointer(ctx->topContext()));
-
-    // If ctx is/inside the Class context, this represents that context.
-    const auto currentClassContext = classDeclarationForContext(ctx, m_position);
-
-    clangDebug() << "Clang found" << m_results->NumResults << "completion results";
-
-    for (uint i = 0; i < m_results->NumResults; ++i) {
-        if (abort) {
+        if (!m_context) {
             return {};
         }
 
-        auto result = m_results->Results[i];
+        static const auto noIcon = QIcon(QStandardPaths::locate(QStandardPaths::GenericDataLocation,
+                                                                QStringLiteral("kdevelop/pics/namespace.png")));
+
+        auto result = m_results->Results[index];
+        const bool isMacroDefinition = result.CursorKind == CXCursor_MacroDefinition;
+        const bool isBuiltin = (result.CursorKind == CXCursor_NotImplemented);
+        const bool isDeclaration = !isMacroDefinition && !isBuiltin;
         #if CINDEX_VERSION_MINOR >= 30
         const bool isOverloadCandidate = result.CursorKind == CXCursor_OverloadCandidate;
         #else
         const bool isOverloadCandidate = false;
         #endif
 
-        const auto availability = clang_getCompletionAvailability(result.CompletionString);
-        if (availability == CXAvailability_NotAvailable) {
-            continue;
-        }
-
-        const bool isMacroDefinition = result.CursorKind == CXCursor_MacroDefinition;
-        if (isMacroDefinition && m_filters & NoMacros) {
-            continue;
-        }
-
-        const bool isBuiltin = (result.CursorKind == CXCursor_NotImplemented);
-        if (isBuiltin && m_filters & NoBuiltins) {
-            continue;
-        }
-
-        const bool isDeclaration = !isMacroDefinition && !isBuiltin;
-        if (isDeclaration && m_filters & NoDeclarations) {
-            continue;
-        }
-
-        if (availability == CXAvailability_NotAccessible && (!isDeclaration || !currentClassContext)) {
-            continue;
-        }
-
         // the string that would be needed to type, usually the identifier of something. Also we use it as name for code completion declaration items.
         QString typed;
         // the return type of a function e.g.
@@ -1140,9 +1008,6 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
         // ellide text to the right for overly long result types (templates especially)
         elideStringRight(resultType, MAX_RETURN_TYPE_STRING_LENGTH);
 
-        static const auto noIcon = QIcon(QStandardPaths::locate(QStandardPaths::GenericDataLocation,
-                                                                QStringLiteral("kdevelop/pics/namespace.png")));
-
         if (isDeclaration) {
             const Identifier id(typed);
             QualifiedIdentifier qid;
@@ -1153,7 +1018,7 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
             qid.push(id);
 
             if (!isValidCompletionIdentifier(qid)) {
-                continue;
+                return {};
             }
 
             if (isOverloadCandidate && resultType.isEmpty() && parent.isEmpty()) {
@@ -1162,7 +1027,7 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
                 qid.push(id);
             }
 
-            auto found = findDeclaration(qid, ctx, m_position, isOverloadCandidate ? overloadsHandled : handled);
+            auto found = findDeclaration(qid, m_context, m_position, isOverloadCandidate ? m_overloadsHandled : m_handled);
 
             CompletionTreeItemPointer item;
             if (found) {
@@ -1170,18 +1035,18 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
                 if (availability == CXAvailability_NotAccessible) {
                     if (auto cl = dynamic_cast<ClassMemberDeclaration*>(found)) {
                         if (cl->accessPolicy() != Declaration::Protected) {
-                            continue;
+                            return {};
                         }
 
                         auto declarationClassContext = classDeclarationForContext(DUContextPointer(found->context()), m_position);
 
                         uint steps = 10;
                         auto inheriters = DUChainUtils::inheriters(declarationClassContext, steps);
-                        if(!inheriters.contains(currentClassContext)){
-                            continue;
+                        if(!inheriters.contains(m_currentClassContext.data())){
+                            return {};
                         }
                     } else {
-                        continue;
+                        return {};
                     }
                 }
 
@@ -1203,11 +1068,15 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
                     declarationItem->setMatchQuality(matchQuality);
 
                     // TODO: LibClang missing API to determine expected code completion type.
-                    lookAheadMatcher.addMatchedType(found->indexedType());
+                    if (lookAheadMatcher) {
+                        lookAheadMatcher->addMatchedType(found->indexedType());
+                    }
                 } else {
                     declarationItem->setInheritanceDepth(completionPriority);
 
-                    lookAheadMatcher.addDeclarations(found);
+                    if (lookAheadMatcher) {
+                        lookAheadMatcher->addDeclarations(found);
+                    }
                 }
                 if ( isInternal ) {
                     declarationItem->markAsUnimportant();
@@ -1232,13 +1101,14 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
             if (isValidSpecialCompletionIdentifier(qid)) {
                 // If it's a special completion identifier e.g. "operator=(const&)" and we don't have a declaration for it, don't add it into completion list, as this item is completely useless and pollutes the test case.
                 // This happens e.g. for "class A{}; a.|".  At | we have "operator=(const A&)" as a special completion identifier without a declaration.
-                if(item->declaration()){
-                    specialItems.append(item);
+                if(!item->declaration()){
+                    return {};
                 }
+                *kind = Special;
             } else {
-                items.append(item);
+                *kind = Normal;
             }
-            continue;
+            return item;
         }
 
         if (result.CursorKind == CXCursor_MacroDefinition) {
@@ -1249,12 +1119,460 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
             if ( text.startsWith(QLatin1Char('_')) ) {
                 instance->markAsUnimportant();
             }
-            macros.append(item);
+            *kind = Macro;
+            return item;
         } else if (result.CursorKind == CXCursor_NotImplemented) {
             auto instance = new SimpleItem(typed, resultType, replacement, noIcon);
             auto item = CompletionTreeItemPointer(instance);
+            *kind = Builtin;
+            return item;
+        }
+        return {};
+    }
+
+private:
+    std::shared_ptr<CXCodeCompleteResults> m_results;
+    DUContextPointer m_context;
+    CursorInRevision m_position;
+    DeclarationPointer m_currentClassContext;
+
+    // two sets of handled declarations to prevent duplicates and make sure we show
+    // all available overloads
+    QSet<Declaration*> m_handled;
+    // this is only used for the CXCursor_OverloadCandidate completion items
+    QSet<Declaration*> m_overloadsHandled;
+};
+
+/**
+ * Completion item for a result that is not among the MAX_MATERIALIZED_ITEMS best ones
+ *
+ * It only knows the typed text, which is all the completion popup needs for filtering,
+ * and builds the full item once it gets shown, selected or executed.
+ */
+class LazyItem : public CompletionTreeItem
+{
+public:
+    LazyItem(const std::shared_ptr<ItemBuilder>& builder, uint index, CXAvailabilityKind availability,
+             const QString& typed, int priority)
+        : m_builder(builder)
+        , m_index(index)
+        , m_availability(availability)
+        , m_typed(typed)
+        , m_priority(priority)
+    {
+    }
+
+    QVariant data(const QModelIndex& index, int role, const CodeCompletionModel* model) const override
+    {
+        switch (role) {
+        case Qt::DisplayRole:
+            if (index.column() == CodeCompletionModel::Name) {
+                return m_typed;
+            }
+            break;
+        case CodeCompletionModel::UnimportantItemRole:
+            return true;
+        case Qt::DecorationRole:
+        case Qt::ToolTipRole:
+        case CodeCompletionModel::IsExpandable:
+        case CodeCompletionModel::ExpandingWidget:
+        case CodeCompletionModel::ItemSelected:
+        case CodeCompletionModel::HighlightingMethod:
+        case CodeCompletionModel::CustomHighlight:
+            break;
+        default:
+            // the other roles are queried for all items while filtering and sorting
+            return {};
+        }
+
+        const auto item = built();
+        return item ? item->data(index, role, model) : QVariant();
+    }
+
+    void execute(KTextEditor::View* view, const KTextEditor::Range& word) override
+    {
+        if (const auto item = built()) {
+            item->execute(view, word);
+        } else {
+            view->document()->replaceText(word, m_typed);
+        }
+    }
+
+    int inheritanceDepth() const override
+    {
+        return m_priority;
+    }
+
+    KTextEditor::CodeCompletionModel::CompletionProperties completionProperties() const override
+    {
+        // the items get grouped by this, which must not build all of them
+        return {};
+    }
+
+    DeclarationPointer declaration() const override
+    {
+        const auto item = built();
+        return item ? item->declaration() : DeclarationPointer();
+    }
+
+private:
+    CompletionTreeItemPointer built() const
+    {
+        if (!m_built) {
+            m_built = true;
+            DUChainReadLocker lock;
+            ItemBuilder::Kind kind;
+            m_item = m_builder->build(m_index, m_availability, &kind);
+        }
+        return m_item;
+    }
+
+    std::shared_ptr<ItemBuilder> m_builder;
+    uint m_index;
+    CXAvailabilityKind m_availability;
+    QString m_typed;
+    int m_priority;
+    mutable bool m_built = false;
+    mutable CompletionTreeItemPointer m_item;
+};
+
+struct MemberAccessReplacer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Type {
+        None,
+        DotToArrow,
+        ArrowToDot
+    };
+
+public Q_SLOTS:
+    void replaceCurrentAccess(MemberAccessReplacer::Type type)
+    {
+        if (auto document = ICore::self()->documentController()->activeDocument()) {
+            if (auto textDocument = document->textDocument()) {
+                auto activeView = document->activeTextView();
+                if (!activeView) {
+                    return;
+                }
+
+                auto cursor = activeView->cursorPosition();
+
+                QString oldAccess, newAccess;
+                if (type == ArrowToDot) {
+                    oldAccess = QStringLiteral("->");
+                    newAccess = QStringLiteral(".");
+                } else {
+                    oldAccess = QStringLiteral(".");
+                    newAccess = QStringLiteral("->");
+                }
+
+                auto oldRange = KTextEditor::Range(cursor - KTextEditor::Cursor(0, oldAccess.length()), cursor);
+
+                // This code needed for testReplaceMemberAccess test
+                // Maybe we should do a similar thing for '->' to '.' direction, but this is not so important
+                while (textDocument->text(oldRange) == QLatin1String(" ") && oldRange.start().column() >= 0) {
+                    oldRange = KTextEditor::Range({oldRange.start().line(), oldRange.start().column() - 1},
+                                                  {oldRange.end().line(), oldRange.end().column() - 1});
+                }
+
+                if (oldRange.start().column() >= 0 && textDocument->text(oldRange) == oldAccess) {
+                    textDocument->replaceText(oldRange, newAccess);
+                }
+            }
+        }
+    }
+};
+static MemberAccessReplacer s_memberAccessReplacer;
+
+}
+
+Q_DECLARE_METATYPE(MemberAccessReplacer::Type)
+
+ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& context,
+                                                       const ParseSessionData::Ptr& sessionData,
+                                                       const QUrl& url,
+                                                       const KTextEditor::Cursor& position,
+                                                       const QString& text,
+                                                       const QString& followingText
+                                                      )
+    : CodeCompletionContext(context, text + followingText, CursorInRevision::castFromSimpleCursor(position), 0)
+    , m_parseSessionData(sessionData)
+    , m_typedPrefix(typedPrefix(text))
+{
+    qRegisterMetaType<MemberAccessReplacer::Type>();
+    const QByteArray file = url.toLocalFile().toUtf8();
+    ParseSession session(m_parseSessionData);
+
+    QVector<UnsavedFile> otherUnsavedFiles;
+    {
+        ForegroundLock lock;
+        otherUnsavedFiles = ClangUtils::unsavedFiles();
+    }
+    QVector<CXUnsavedFile> allUnsaved;
+
+    {
+        const unsigned int completeOptions = clang_defaultCodeCompleteOptions();
+
+        CXUnsavedFile unsaved;
+        unsaved.Filename = file.constData();
+        const QByteArray content = m_text.toUtf8();
+        unsaved.Contents = content.constData();
+        unsaved.Length = content.size();
+
+        allUnsaved.reserve(otherUnsavedFiles.size() + 1);
+        for (const auto& f : qAsConst(otherUnsavedFiles)) {
+            allUnsaved.append(f.toClangApi());
+        }
+        allUnsaved.append(unsaved);
+
+        m_results.reset(clang_codeCompleteAt(session.unit(), file.constData(),
+                        position.line() + 1, position.column() + 1,
+                        allUnsaved.data(), allUnsaved.size(),
+                        completeOptions), clang_disposeCodeCompleteResults);
+
+        if (!m_results) {
+            qCWarning(KDEV_CLANG) << "Something went wrong during 'clang_codeCompleteAt' for file" << file;
+            return;
+        }
+
+        auto numDiagnostics = clang_codeCompleteGetNumDiagnostics(m_results.get());
+        for (uint i = 0; i < numDiagnostics; i++) {
+            auto diagnostic = clang_codeCompleteGetDiagnostic(m_results.get(), i);
+            auto diagnosticType = ClangDiagnosticEvaluator::diagnosticType(diagnostic);
+            clang_disposeDiagnostic(diagnostic);
+            if (diagnosticType == ClangDiagnosticEvaluator::ReplaceWithArrowProblem || diagnosticType == ClangDiagnosticEvaluator::ReplaceWithDotProblem) {
+                MemberAccessReplacer::Type replacementType;
+                if (diagnosticType == ClangDiagnosticEvaluator::ReplaceWithDotProblem) {
+                    replacementType = MemberAccessReplacer::ArrowToDot;
+                } else {
+                    replacementType = MemberAccessReplacer::DotToArrow;
+                }
+
+                QMetaObject::invokeMethod(&s_memberAccessReplacer, "replaceCurrentAccess", Qt::QueuedConnection,
+                                          Q_ARG(MemberAccessReplacer::Type, replacementType));
+
+                m_valid = false;
+                return;
+            }
+        }
+
+        auto addMacros = ClangSettingsManager::self()->codeCompletionSettings().macros;
+        if (!addMacros) {
+            m_filters |= NoMacros;
+        }
+    }
+
+    if (!m_results->NumResults) {
+        const auto trimmedText = text.trimmed();
+        if (trimmedText.endsWith(QLatin1Char('.'))) {
+            // TODO: This shouldn't be needed if Clang provided diagnostic.
+            // But it doesn't always do it, so let's try to manually determine whether '.' is used instead of '->'
+            m_text = trimmedText.leftRef(trimmedText.size() - 1) + QStringLiteral("->");
+
+            CXUnsavedFile unsaved;
+            unsaved.Filename = file.constData();
+            const QByteArray content = m_text.toUtf8();
+            unsaved.Contents = content.constData();
+            unsaved.Length = content.size();
+            allUnsaved[allUnsaved.size() - 1] = unsaved;
+
+            m_results.reset(clang_codeCompleteAt(session.unit(), file.constData(),
+                                                 position.line() + 1, position.column() + 1 + 1,
+                                                 allUnsaved.data(), allUnsaved.size(),
+                                                 clang_defaultCodeCompleteOptions()),
+                            clang_disposeCodeCompleteResults);
+
+            if (m_results && m_results->NumResults) {
+                QMetaObject::invokeMethod(&s_memberAccessReplacer, "replaceCurrentAccess", Qt::QueuedConnection,
+                                          Q_ARG(MemberAccessReplacer::Type, MemberAccessReplacer::DotToArrow));
+            }
+
+            m_valid = false;
+            return;
+        }
+    }
+
+    // check 'isValidPosition' after parsing the new content
+    auto clangFile = session.file(file);
+    if (!isValidPosition(session.unit(), clangFile)) {
+        m_valid = false;
+        return;
+    }
+
+    m_completionHelper.computeCompletions(session, clangFile, position);
+}
+
+ClangCodeCompletionContext::~ClangCodeCompletionContext()
+{
+}
+
+bool ClangCodeCompletionContext::isValidPosition(CXTranslationUnit unit, CXFile file) const
+{
+    if (isInsideComment(unit, file, m_position.castToSimpleCursor())) {
+        clangDebug() << "Invalid completion context: Inside comment";
+        return false;
+    }
+    return true;
+}
+
+QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(bool& abort, bool /*fullCompletion*/)
+{
+    if (!m_valid || !m_duContext || !m_results) {
+        return {};
+    }
+
+    const auto ctx = DUContextPointer(m_duContext->findContextAt(m_position));
+
+    /// Normal completion items, such as 'void Foo::foo()'
+    QList<CompletionTreeItemPointer> items;
+    /// Stuff like 'Foo& Foo::operator=(const Foo&)', etc. Not regularly used by our users.
+    QList<CompletionTreeItemPointer> specialItems;
+    /// Macros from the current context
+    QList<CompletionTreeItemPointer> macros;
+    /// Builtins reported by Clang
+    QList<CompletionTreeItemPointer> builtin;
+
+    auto addItem = [&](const CompletionTreeItemPointer& item, ItemBuilder::Kind kind) {
+        switch (kind) {
+        case ItemBuilder::Normal:
+            items.append(item);
+            break;
+        case ItemBuilder::Special:
+            specialItems.append(item);
+            break;
+        case ItemBuilder::Macro:
+            macros.append(item);
+            break;
+        case ItemBuilder::Builtin:
             builtin.append(item);
+            break;
+        }
+    };
+
+    LookAheadItemMatcher lookAheadMatcher(TopDUContextPointer(ctx->topContext()));
+
+    const auto builder = std::make_shared<ItemBuilder>(m_results, ctx, m_position);
+
+    clangDebug() << "Clang found" << m_results->NumResults << "completion results";
+
+    // Walking all chunks of a result and looking up its declaration is expensive, and Clang easily reports
+    // tens of thousands of results, e.g. after 'std::'. Hence first rank the results by their typed text
+    // and only build full items for the best ones. The others are offered by their name and only get
+    // built once they are shown, so that they can still be found when the user continues typing.
+    struct Candidate
+    {
+        uint index;
+        CXAvailabilityKind availability;
+        QString typed;
+        PrefixMatch match;
+        uint priority;
+        bool materialize;
+    };
+    QVector<Candidate> candidates;
+    candidates.reserve(m_results->NumResults);
+    // indices into candidates of the results that compete for being materialized
+    QVector<int> ranked;
+    ranked.reserve(m_results->NumResults);
+
+    for (uint i = 0; i < m_results->NumResults; ++i) {
+        if (abort) {
+            return {};
+        }
+
+        auto result = m_results->Results[i];
+        #if CINDEX_VERSION_MINOR >= 30
+        const bool isOverloadCandidate = result.CursorKind == CXCursor_OverloadCandidate;
+        #else
+        const bool isOverloadCandidate = false;
+        #endif
+
+        const auto availability = clang_getCompletionAvailability(result.CompletionString);
+        if (availability == CXAvailability_NotAvailable) {
+            continue;
+        }
+
+        const bool isMacroDefinition = result.CursorKind == CXCursor_MacroDefinition;
+        if (isMacroDefinition && m_filters & NoMacros) {
+            continue;
+        }
+
+        const bool isBuiltin = (result.CursorKind == CXCursor_NotImplemented);
+        if (isBuiltin && m_filters & NoBuiltins) {
+            continue;
+        }
+
+        const bool isDeclaration = !isMacroDefinition && !isBuiltin;
+        if (isDeclaration && m_filters & NoDeclarations) {
+            continue;
+        }
+
+        if (availability == CXAvailability_NotAccessible && (!isDeclaration || !builder->currentClassContext())) {
+            continue;
+        }
+
+        Candidate candidate{i, availability, {}, PrefixMatched, 0, true};
+        // argument hints are always shown, independent of the prefix
+        if (!isOverloadCandidate) {
+            candidate.typed = typedTextOf(result.CompletionString);
+            candidate.match = matchPrefix(candidate.typed, m_typedPrefix);
+            candidate.priority = clang_getCompletionPriority(result.CompletionString);
+            ranked.append(candidates.size());
+        }
+        candidates.append(candidate);
+    }
+
+    if (ranked.size() > MAX_MATERIALIZED_ITEMS) {
+        auto rankedBefore = [&candidates](int lhs, int rhs) {
+            const auto& left = candidates.at(lhs);
+            const auto& right = candidates.at(rhs);
+            const bool leftInternal = left.typed.startsWith(QLatin1Char('_'));
+            const bool rightInternal = right.typed.startsWith(QLatin1Char('_'));
+            return std::tie(left.match, leftInternal, left.priority, left.index)
+                 < std::tie(right.match, rightInternal, right.priority, right.index);
+        };
+        const auto last = ranked.begin() + MAX_MATERIALIZED_ITEMS;
+        std::nth_element(ranked.begin(), last, ranked.end(), rankedBefore);
+        for (auto it = last; it != ranked.end(); ++it) {
+            candidates[*it].materialize = false;
+        }
+        clangDebug() << "Materializing" << MAX_MATERIALIZED_ITEMS << "of" << ranked.size() << "completion results for prefix" << m_typedPrefix;
+    }
+
+    for (const auto& candidate : qAsConst(candidates)) {
+        if (abort) {
+            return {};
+        }
+
+        ItemBuilder::Kind kind;
+        if (candidate.materialize) {
+            if (const auto item = builder->build(candidate.index, candidate.availability, &kind, &lookAheadMatcher)) {
+                addItem(item, kind);
+            }
+            continue;
+        }
+
+        const auto result = m_results->Results[candidate.index];
+        // whether a protected member is accessible after all is only known from its declaration
+        if (candidate.availability == CXAvailability_NotAccessible || candidate.typed.isEmpty()) {
+            continue;
+        }
+        // see isValidCompletionIdentifier and isValidSpecialCompletionIdentifier
+        if (result.CursorKind == CXCursor_Constructor || result.CursorKind == CXCursor_Destructor
+            || candidate.typed.startsWith(QLatin1String("operator"))) {
+            continue;
+        }
+
+        if (result.CursorKind == CXCursor_MacroDefinition) {
+            kind = ItemBuilder::Macro;
+        } else if (result.CursorKind == CXCursor_NotImplemented) {
+            kind = ItemBuilder::Builtin;
+        } else {
+            kind = ItemBuilder::Normal;
         }
+        addItem(CompletionTreeItemPointer(new LazyItem(builder, candidate.index, candidate.availability,
+                                                       candidate.typed, candidate.priority)), kind);
     }
 
     if (abort) {
@@ -71,11 +71,14 @@ private:
     /// Returns whether the we are at a valid completion-position
     bool isValidPosition(CXTranslationUnit unit, CXFile file) const;
 
-    std::unique_ptr<CXCodeCompleteResults, void(*)(CXCodeCompleteResults*)> m_results;
+    /// Shared with the completion items that are only built on demand
+    std::shared_ptr<CXCodeCompleteResults> m_results;
     QList<KDevelop::CompletionTreeElementPointer> m_ungrouped;
     CompletionHelper m_completionHelper;
     ParseSessionData::Ptr m_parseSessionData;
     ContextFilters m_filters = NoFilter;
+    /// The part of the identifier at the completion position the user has already typed
+    QString m_typedPrefix;
 };
 
 #endif // CLANGCODECOMPLETIONCONTEXT_H
@@ -26,6 +26,7 @@
 #include <language/duchain/declaration.h>
 #include <language/duchain/parsingenvironment.h>
 #include <language/backgroundparser/urlparselock.h>
+#include <language/util/kdevhash.h>
 
 #include "builder.h"
 #include "parsesession.h"
@@ -37,10 +38,13 @@
 
 #include "libclang_include_path.h"
 
+#include <kdevplatform/qtcompat_p.h>
+
 #include <QCoreApplication>
 #include <QDir>
 #include <QFileInfo>
 #include <QRegularExpression>
+#include <QVector>
 
 #include <algorithm>
 
@@ -86,6 +90,131 @@ ReferencedTopDUContext createTopContext(const IndexedString& path, const ClangPa
     return context;
 }
 
+QAtomicInt builtHeaders;
+QAtomicInt reusedHeaders;
+
+/// A file the preprocessor entered, and the locations of the include directives that led there, innermost first
+struct Inclusion
+{
+    CXFile file;
+    QVector<QPair<CXFile, uint>> stack;
+};
+
+void visitInclusion(CXFile file, CXSourceLocation* stack, unsigned depth, CXClientData data)
+{
+    Inclusion inclusion{file, {}};
+    inclusion.stack.reserve(depth);
+    for (unsigned i = 0; i < depth; ++i) {
+        CXFile includer;
+        uint offset;
+        clang_getFileLocation(stack[i], &includer, nullptr, nullptr, &offset);
+        inclusion.stack.append(qMakePair(includer, offset));
+    }
+    static_cast<QVector<Inclusion>*>(data)->append(inclusion);
+}
+
+/**
+ * Computes the fingerprints of the headers of one translation unit.
+ *
+ * The macros a header sees are defined by everything the preprocessor read before entering it: the files
+ * it left again before, and the files including the header up to their include directive. A header's
+ * fingerprint hashes all of that, so it changes with anything that could change the macros in the header.
+ */
+class HeaderFingerprints
+{
+public:
+    explicit HeaderFingerprints(CXTranslationUnit unit)
+        : m_unit(unit)
+    {
+    }
+
+    /// @returns The fingerprint of @p file with the given @p imports, or 0 if its contents are not available
+    uint compute(CXFile file, const QList<Import>& imports, uint environmentHash)
+    {
+        const QByteArray contents = fileContents(file);
+        if (contents.isEmpty()) {
+            return 0;
+        }
+        collectPrefixes();
+
+        KDevHash hash;
+        hash << contents << m_prefixes.value(file) << environmentHash;
+        for (const auto& import : imports) {
+            hash << m_fingerprints.value(import.file);
+        }
+        const uint fingerprint = hash;
+        return fingerprint ? fingerprint : 1;
+    }
+
+    /// Remembers the fingerprint of an up to date @p file, for the files importing it
+    void setFingerprint(CXFile file, uint fingerprint)
+    {
+        m_fingerprints[file] = fingerprint;
+    }
+
+    uint built = 0;
+    uint reused = 0;
+
+private:
+    QByteArray fileContents(CXFile file) const
+    {
+#if CINDEX_VERSION_MINOR >= 47
+        size_t size = 0;
+        if (const char* contents = clang_getFileContents(m_unit, file, &size)) {
+            return QByteArray::fromRawData(contents, size);
+        }
+#else
+        Q_UNUSED(file);
+#endif
+        return {};
+    }
+
+    /// Hashes what the preprocessor read before entering each file, in the order it entered them
+    void collectPrefixes()
+    {
+        if (m_prefixesCollected) {
+            return;
+        }
+        m_prefixesCollected = true;
+
+        QVector<Inclusion> inclusions;
+        clang_getInclusions(m_unit, &visitInclusion, &inclusions);
+
+        // the files that are being read, outermost first
+        QVector<CXFile> open;
+        // the files that were read completely, in the order they were left
+        uint left = 0;
+        for (const auto& inclusion : qAsConst(inclusions)) {
+            const int depth = inclusion.stack.size();
+            int common = 0;
+            while (common < open.size() && common < depth && open[common] == inclusion.stack[depth - common - 1].first) {
+                ++common;
+            }
+            while (open.size() > common) {
+                left = KDevHash::hash_combine(left, qHash(fileContents(open.takeLast())));
+            }
+            open.append(inclusion.file);
+
+            if (m_prefixes.contains(inclusion.file)) {
+                // an included file is only built once, as seen by the first inclusion
+                continue;
+            }
+            KDevHash prefix;
+            prefix << left;
+            for (int i = depth - 1; i >= 0; --i) {
+                const auto& includer = inclusion.stack[i];
+                prefix << qHash(QByteArray::fromRawData(fileContents(includer.first).constData(), includer.second));
+            }
+            m_prefixes.insert(inclusion.file, prefix);
+        }
+    }
+
+    CXTranslationUnit m_unit;
+    QHash<CXFile, uint> m_fingerprints;
+    QHash<CXFile, uint> m_prefixes;
+    bool m_prefixesCollected = false;
+};
+
 }
 
 Imports ClangHelpers::tuImports(CXTranslationUnit tu)
@@ -105,9 +234,12 @@ bool importLocationLessThan(const Import& lhs, const Import& rhs)
     return lhs.location.line < rhs.location.line;
 }
 
-ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& imports, const ParseSession& session,
-                                                  TopDUContext::Features features, IncludeFileContexts& includedFiles,
-                                                  ClangIndex* index, const std::function<bool()>& abortFunction)
+namespace {
+
+ReferencedTopDUContext buildDUChain(CXFile file, const Imports& imports, const ParseSession& session,
+                                    TopDUContext::Features features, IncludeFileContexts& includedFiles,
+                                    HeaderFingerprints& fingerprints, ClangIndex* index,
+                                    const std::function<bool()>& abortFunction)
 {
     if (includedFiles.contains(file)) {
         return {};
@@ -125,7 +257,7 @@ ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& im
     std::sort(sortedImports.begin(), sortedImports.end(), importLocationLessThan);
 
     foreach(const auto& import, sortedImports) {
-        buildDUChain(import.file, imports, session, features, includedFiles, index, abortFunction);
+        buildDUChain(import.file, imports, session, features, includedFiles, fingerprints, index, abortFunction);
     }
 
     const IndexedString path(QDir(ClangString(clang_getFileName(file)).toString()).canonicalPath());
@@ -135,8 +267,11 @@ ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& im
     }
 
     const auto& environment = session.environment();
+    const bool isHeader = path != environment.translationUnitUrl();
 
     bool update = false;
+    bool reuse = false;
+    uint fingerprint = 0;
     UrlParseLock urlLock(path);
     ReferencedTopDUContext context;
     {
@@ -161,9 +296,23 @@ ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& im
              *       This assumes that headers are independent, we may need to improve that in the future
              *       and also update header files more often when other files included therein got updated.
              */
-            if (path != environment.translationUnitUrl() && !envFile->needsUpdate(&environment) && envFile->featuresSatisfied(features)) {
+            if (isHeader && !envFile->needsUpdate(&environment) && envFile->featuresSatisfied(features)) {
+                fingerprints.setFingerprint(file, envFile->fingerprint());
                 return context;
             } else {
+                // a header that only looks outdated, because its modification time changed or the translation unit
+                // is updated without ForceUpdateRecursive, is not built again while its contents and the macros
+                // it sees stay the same
+                const bool forcedRecursively = (features & TopDUContext::ForceUpdateRecursive) == TopDUContext::ForceUpdateRecursive;
+                const auto requestedFeatures = static_cast<TopDUContext::Features>(features & ~TopDUContext::ForceUpdate);
+                if (isHeader && !forcedRecursively && envFile->featuresSatisfied(requestedFeatures) && envFile->fingerprint()) {
+                    const uint storedFingerprint = envFile->fingerprint();
+                    lock.unlock();
+                    fingerprint = fingerprints.compute(file, sortedImports, environment.hash());
+                    lock.lock();
+                    reuse = fingerprint == storedFingerprint;
+                }
+
                 //TODO: don't attempt to update if this environment is worse quality than the outdated one
                 if (index && envFile->environmentQuality() < environment.quality()) {
                     index->pinTranslationUnitForUrl(environment.translationUnitUrl(), path);
@@ -174,7 +323,9 @@ ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& im
 
             context->clearImportedParentContexts();
         }
-        context->setFeatures(features);
+        if (!reuse) {
+            context->setFeatures(features);
+        }
 
         foreach(const auto& import, sortedImports) {
             auto ctx = includedFiles.value(import.file);
@@ -187,10 +338,27 @@ ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& im
         context->updateImportsCache();
     }
 
+    if (reuse) {
+        fingerprints.setFingerprint(file, fingerprint);
+        ++fingerprints.reused;
+        return context;
+    }
+
+    if (isHeader && !fingerprint) {
+        fingerprint = fingerprints.compute(file, sortedImports, environment.hash());
+    }
+    fingerprints.setFingerprint(file, fingerprint);
+    if (isHeader) {
+        ++fingerprints.built;
+    }
+
     const auto problems = session.problemsForFile(file);
     {
         DUChainWriteLocker lock;
         context->setProblems(problems);
+        if (auto envFile = dynamic_cast<ClangParsingEnvironmentFile*>(context->parsingEnvironmentFile().data())) {
+            envFile->setFingerprint(fingerprint);
+        }
     }
 
     Builder::visit(session.unit(), file, includedFiles, update);
@@ -200,6 +368,32 @@ ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& im
     return context;
 }
 
+}
+
+ReferencedTopDUContext ClangHelpers::buildDUChain(CXFile file, const Imports& imports, const ParseSession& session,
+                                                  TopDUContext::Features features, IncludeFileContexts& includedFiles,
+                                                  ClangIndex* index, const std::function<bool()>& abortFunction)
+{
+    HeaderFingerprints fingerprints(session.unit());
+    auto context = ::buildDUChain(file, imports, session, features, includedFiles, fingerprints, index, abortFunction);
+
+    if (fingerprints.built || fingerprints.reused) {
+        builtHeaders.fetchAndAddRelaxed(fingerprints.built);
+        reusedHeaders.fetchAndAddRelaxed(fingerprints.reused);
+        clangDebug() << "built" << fingerprints.built << "headers of" << session.environment().translationUnitUrl()
+                     << "and reused" << fingerprints.reused << "unchanged ones";
+    }
+    return context;
+}
+
+ClangHelpers::BuildStatistics ClangHelpers::buildStatistics()
+{
+    BuildStatistics statistics;
+    statistics.builtHeaders = builtHeaders.load();
+    statistics.reusedHeaders = reusedHeaders.load();
+    return statistics;
+}
+
 DeclarationPointer ClangHelpers::findDeclaration(CXSourceLocation location, const QualifiedIdentifier& id, const ReferencedTopDUContext& top)
 {
     if (!top) {
@@ -80,6 +80,19 @@ KDEVCLANGPRIVATE_EXPORT KDevelop::ReferencedTopDUContext buildDUChain(
     KDevelop::TopDUContext::Features features, IncludeFileContexts& includedFiles,
     ClangIndex* index = nullptr, const std::function<bool()>& abortFunction = {});
 
+/**
+ * Counts how buildDUChain() handled the headers since the start of the application.
+ */
+struct BuildStatistics
+{
+    /// Headers whose DUChain was built
+    uint builtHeaders = 0;
+    /// Outdated headers that were not built again, because their fingerprint did not change
+    uint reusedHeaders = 0;
+};
+
+KDEVCLANGPRIVATE_EXPORT BuildStatistics buildStatistics();
+
 /**
  * @return List of possible header extensions used for definition/declaration fallback switching
  */
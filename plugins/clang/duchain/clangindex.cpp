@@ -32,10 +32,152 @@
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/duchain.h>
 
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
 #include <clang-c/Index.h>
 
 using namespace KDevelop;
 
+namespace {
+
+/// PCHs of shared preambles that no session used for this long are removed from the cache directory
+const int maxPreambleAgeDays = 30;
+
+/// the number of PCH translation units kept in memory
+const int maxCachedPCHs = 8;
+
+QString sharedPreambleDirectory()
+{
+    static const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                                   + QLatin1String("/clang-preambles");
+    return directory;
+}
+
+/**
+ * Removes the shared preambles whose header and PCH were not used for @c maxPreambleAgeDays,
+ * as well as PCHs left half-written by a crashed session.
+ */
+void pruneSharedPreambles(const QString& directory)
+{
+    const auto now = QDateTime::currentDateTime();
+    const auto entries = QDir(directory).entryInfoList(QDir::Files);
+
+    // the header, its PCH and a partial PCH all start with the same key
+    QHash<QString, QDateTime> lastUsed;
+    for (const auto& entry : entries) {
+        if (entry.suffix() == QLatin1String("part")) {
+            if (entry.lastModified().daysTo(now) >= 1) {
+                QFile::remove(entry.filePath());
+            }
+            continue;
+        }
+        auto& used = lastUsed[entry.fileName().section(QLatin1Char('.'), 0, 0)];
+        used = qMax(used, qMax(entry.lastModified(), entry.lastRead()));
+    }
+
+    for (const auto& entry : entries) {
+        const auto used = lastUsed.constFind(entry.fileName().section(QLatin1Char('.'), 0, 0));
+        if (used != lastUsed.constEnd() && used->daysTo(now) >= maxPreambleAgeDays) {
+            QFile::remove(entry.filePath());
+        }
+    }
+}
+
+/**
+ * @returns the leading #include <...> lines of @p contents
+ *
+ * Scanning stops at the first line that is neither a comment nor a system include,
+ * as any other directive might change the meaning of the following headers.
+ * This includes local headers: the prefix is injected in front of the translation
+ * unit, so it has to be exactly what the file starts with.
+ */
+QByteArray systemIncludePrefix(const QByteArray& contents)
+{
+    QByteArray prefix;
+    bool inComment = false;
+    const auto lines = contents.split('\n');
+    for (const auto& rawLine : lines) {
+        auto line = rawLine.trimmed();
+        if (inComment) {
+            const int end = line.indexOf("*/");
+            if (end == -1) {
+                continue;
+            }
+            line = line.mid(end + 2).trimmed();
+            inComment = false;
+        }
+        if (line.startsWith("/*")) {
+            const int end = line.indexOf("*/", 2);
+            if (end == -1) {
+                inComment = true;
+                continue;
+            }
+            line = line.mid(end + 2).trimmed();
+        }
+        if (line.isEmpty() || line.startsWith("//")) {
+            continue;
+        }
+        if (!line.startsWith('#')) {
+            break;
+        }
+        line = line.mid(1).trimmed();
+        if (!line.startsWith("include")) {
+            break;
+        }
+        line = line.mid(7).trimmed();
+        if (!line.startsWith('<')) {
+            break;
+        }
+        const int end = line.indexOf('>');
+        if (end == -1) {
+            break;
+        }
+        prefix += "#include " + line.left(end + 1) + '\n';
+    }
+    return prefix;
+}
+
+void addPaths(QCryptographicHash* hash, const QByteArray& kind, const Path::List& paths)
+{
+    for (const auto& path : paths) {
+        hash->addData(kind);
+        hash->addData(path.pathOrUrl().toUtf8());
+        hash->addData("\n", 1);
+    }
+}
+
+/**
+ * @returns a key for all the inputs that influence the PCH built from @p prefix
+ */
+QByteArray preambleKey(const QByteArray& prefix, const ClangParsingEnvironment& environment)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(prefix);
+    hash.addData(ClangHelpers::clangVersion().toUtf8());
+    hash.addData(qgetenv("KDEV_CLANG_EXTRA_ARGUMENTS"));
+    hash.addData(environment.parserSettings().parserOptions.toUtf8());
+
+    const auto includes = environment.includes();
+    addPaths(&hash, QByteArrayLiteral("-isystem"), includes.system);
+    addPaths(&hash, QByteArrayLiteral("-I"), includes.project);
+    const auto frameworkDirectories = environment.frameworkDirectories();
+    addPaths(&hash, QByteArrayLiteral("-iframework"), frameworkDirectories.system);
+    addPaths(&hash, QByteArrayLiteral("-F"), frameworkDirectories.project);
+
+    const auto defines = environment.defines();
+    for (auto it = defines.constBegin(); it != defines.constEnd(); ++it) {
+        hash.addData(it.key().toUtf8() + '=' + it.value().toUtf8() + '\n');
+    }
+    return hash.result().toHex();
+}
+
+}
+
 ClangIndex::ClangIndex()
     // NOTE: We don't exclude PCH declarations. That way we could retrieve imports manually, as clang_getInclusions returns nothing on reparse with CXTranslationUnit_PrecompiledPreamble flag.
     : m_index(clang_createIndex(0 /*Exclude PCH Decls*/, qEnvironmentVariableIsSet("KDEV_CLANG_DISPLAY_DIAGS") /*Display diags*/))
@@ -66,17 +208,80 @@ QSharedPointer<const ClangPCH> ClangIndex::pch(const ClangParsingEnvironment& en
     if (QFile::exists(pchInclude.toLocalFile() + pchExt)) {
         QReadLocker lock(&m_pchLock);
         auto pch = m_pch.constFind(pchInclude);
-        if (pch != m_pch.constEnd()) {
-            return pch.value();
+        if (pch != m_pch.constEnd() && pch->pch->isUpToDate()) {
+            pch->lastUsed.store(m_pchClock.fetchAndAddRelaxed(1));
+            return pch->pch;
         }
     }
 
     auto pch = QSharedPointer<ClangPCH>::create(environment, this);
     QWriteLocker lock(&m_pchLock);
-    m_pch.insert(pchInclude, pch);
+    auto& cached = m_pch[pchInclude];
+    cached.pch = pch;
+    cached.lastUsed.store(m_pchClock.fetchAndAddRelaxed(1));
+
+    // evict the least recently used PCH, parse jobs still using it keep it alive until they are done
+    if (m_pch.size() > maxCachedPCHs) {
+        auto leastRecentlyUsed = m_pch.begin();
+        for (auto it = m_pch.begin(); it != m_pch.end(); ++it) {
+            if (it->lastUsed.load() < leastRecentlyUsed->lastUsed.load()) {
+                leastRecentlyUsed = it;
+            }
+        }
+        m_pch.erase(leastRecentlyUsed);
+    }
     return pch;
 }
 
+Path ClangIndex::sharedPreamble(const ClangParsingEnvironment& environment, const QByteArray& contents)
+{
+    static const bool disabled = qEnvironmentVariableIsSet("KDEV_CLANG_NO_SHARED_PREAMBLES");
+    if (disabled) {
+        return {};
+    }
+
+    const QString tuPath = environment.translationUnitUrl().str();
+    const QFileInfo tuInfo(tuPath);
+    // the header is precompiled as C or C++, other languages would not be able to use it
+    static const QStringList unsupportedSuffixes = {
+        QStringLiteral("m"), QStringLiteral("mm"), QStringLiteral("cu"), QStringLiteral("cuh"), QStringLiteral("cl")
+    };
+    if (unsupportedSuffixes.contains(tuInfo.suffix(), Qt::CaseInsensitive)) {
+        return {};
+    }
+
+    const auto prefix = systemIncludePrefix(contents);
+    if (prefix.isEmpty()) {
+        return {};
+    }
+
+    const auto directory = sharedPreambleDirectory();
+    static const bool pruned = (pruneSharedPreambles(directory), true);
+    Q_UNUSED(pruned);
+    const QString header = directory + QLatin1Char('/') + QString::fromLatin1(preambleKey(prefix, environment))
+                         + QLatin1String(".h");
+    if (QFile::exists(header)) {
+        return Path(header);
+    }
+
+    // the file name covers the contents, so concurrent writers all write the same file
+    if (!QDir().mkpath(directory)) {
+        qCWarning(KDEV_CLANG) << "Failed to create the shared preamble directory" << directory;
+        return {};
+    }
+    QSaveFile file(header);
+    if (!file.open(QIODevice::WriteOnly) || file.write(prefix) != prefix.size() || !file.commit()) {
+        qCWarning(KDEV_CLANG) << "Failed to write shared preamble" << header << file.errorString();
+        return {};
+    }
+    return Path(header);
+}
+
+bool ClangIndex::isSharedPreamble(const Path& pchInclude)
+{
+    return pchInclude.isLocalFile() && pchInclude.parent().toLocalFile() == sharedPreambleDirectory();
+}
+
 ClangIndex::~ClangIndex()
 {
     clang_disposeIndex(m_index);
@@ -29,6 +29,7 @@
 
 #include <util/path.h>
 
+#include <QAtomicInt>
 #include <QReadWriteLock>
 #include <QSharedPointer>
 
@@ -49,10 +50,31 @@ public:
      * @returns the existing ClangPCH for @p environment
      *
      * The PCH is created using @p environment if it doesn't exist
+     * Only the most recently used PCHs are kept, the translation unit of an evicted one is
+     * disposed as soon as the last parse job using it is done.
      * This function is thread safe.
      */
     QSharedPointer<const ClangPCH> pch(const ClangParsingEnvironment& environment);
 
+    /**
+     * @returns the shared preamble header to use as PCH include for the translation unit of @p environment
+     *
+     * The leading block of system includes in @p contents, the beginning of the translation unit,
+     * is written to a header in the user's cache directory. Only the includes the file itself starts
+     * with are used, so that injecting them with -include does not change the order of the headers. Its name is derived from the include lines
+     * and the arguments of @p environment, so that all translation units with the same prefix share
+     * the header and the PCH built from it, also across sessions.
+     *
+     * An invalid path is returned if the translation unit has no such prefix.
+     * This function is thread safe.
+     */
+    KDevelop::Path sharedPreamble(const ClangParsingEnvironment& environment, const QByteArray& contents);
+
+    /**
+     * @returns true if @p pchInclude was created by sharedPreamble()
+     */
+    static bool isSharedPreamble(const KDevelop::Path& pchInclude);
+
     /**
      * Gets the currently pinned TU for @p url
      *
@@ -73,8 +95,16 @@ public:
 private:
     CXIndex m_index;
 
+    struct CachedPCH
+    {
+        QSharedPointer<const ClangPCH> pch;
+        /// value of m_pchClock when the PCH was last used, updated under the read lock
+        mutable QAtomicInt lastUsed;
+    };
+
     QReadWriteLock m_pchLock;
-    QHash<KDevelop::Path, QSharedPointer<const ClangPCH>> m_pch;
+    QHash<KDevelop::Path, CachedPCH> m_pch;
+    QAtomicInt m_pchClock;
 
     QMutex m_mappingMutex;
     QHash<KDevelop::IndexedString, KDevelop::IndexedString> m_tuForUrl;
@@ -37,6 +37,7 @@ public:
         , environmentHash(0)
         , tuUrl()
         , quality(ClangParsingEnvironment::Unknown)
+        , fingerprint(0)
     {
     }
 
@@ -45,6 +46,7 @@ public:
         , environmentHash(rhs.environmentHash)
         , tuUrl(rhs.tuUrl)
         , quality(rhs.quality)
+        , fingerprint(rhs.fingerprint)
     {
     }
 
@@ -53,6 +55,7 @@ public:
     uint environmentHash;
     IndexedString tuUrl;
     ClangParsingEnvironment::Quality quality;
+    uint fingerprint;
 };
 
 ClangParsingEnvironmentFile::ClangParsingEnvironmentFile(const IndexedString& url,
@@ -122,4 +125,14 @@ uint ClangParsingEnvironmentFile::environmentHash() const
     return d_func()->environmentHash;
 }
 
+uint ClangParsingEnvironmentFile::fingerprint() const
+{
+    return d_func()->fingerprint;
+}
+
+void ClangParsingEnvironmentFile::setFingerprint(uint fingerprint)
+{
+    d_func_dynamic()->fingerprint = fingerprint;
+}
+
 DUCHAIN_DEFINE_TYPE(ClangParsingEnvironmentFile)
@@ -50,6 +50,17 @@ public:
 
     uint environmentHash() const;
 
+    /**
+     * A hash of the file contents, of everything the preprocessor read before entering the file,
+     * of the environment and of the fingerprints of the imports when the file was built,
+     * or 0 if that was not available.
+     *
+     * An outdated header with an unchanged fingerprint does not need to be built again,
+     * as long as it has the requested features.
+     */
+    uint fingerprint() const;
+    void setFingerprint(uint fingerprint);
+
     enum {
         Identity = 142
     };
@@ -25,6 +25,9 @@
 #include "clanghelpers.h"
 #include "util/clangtypes.h"
 #include "clangparsingenvironment.h"
+#include "clangindex.h"
+
+#include <QFile>
 
 using namespace KDevelop;
 
@@ -48,12 +51,28 @@ ClangPCH::ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index
     const IndexedString doc(pchInclude.pathOrUrl());
 
     ClangParsingEnvironment pchEnv;
+    if (ClangIndex::isSharedPreamble(pchInclude)) {
+        // shared preambles are keyed on the arguments of their users, build them with the very same arguments
+        pchEnv = environment;
+    }
     pchEnv.setPchInclude(Path());
     pchEnv.setTranslationUnitUrl(doc);
-    m_session.setData(ParseSessionData::Ptr(new ParseSessionData({}, index, pchEnv, ParseSessionData::PrecompiledHeader)));
+
+    m_pchFile = pchInclude.toLocalFile() + QLatin1String(".pch");
+    if (QFile::exists(m_pchFile)) {
+        // reuse the PCH from a previous session unless one of its headers changed in the meantime
+        m_session.setData(ParseSessionData::Ptr(new ParseSessionData({}, index, pchEnv, ParseSessionData::ReusePrecompiledHeader)));
+        if (m_session.unit() && !collectInputs()) {
+            m_session.setData({});
+        }
+    }
 
     if (!m_session.unit()) {
-        return;
+        m_session.setData(ParseSessionData::Ptr(new ParseSessionData({}, index, pchEnv, ParseSessionData::PrecompiledHeader)));
+        if (!m_session.unit()) {
+            return;
+        }
+        collectInputs();
     }
 
     auto imports = ClangHelpers::tuImports(m_session.unit());
@@ -75,7 +94,44 @@ CXFile ClangPCH::mapFile(CXTranslationUnit tu) const
     return ::mapFile(m_session.mainFile(), tu);
 }
 
+ClangPCH::~ClangPCH()
+{
+    // the set is reference counted in its repository
+    m_inputs.clear();
+}
+
 ReferencedTopDUContext ClangPCH::context() const
 {
     return m_context;
 }
+
+bool ClangPCH::isUpToDate() const
+{
+    return !m_inputs.needsUpdate();
+}
+
+bool ClangPCH::collectInputs()
+{
+    struct Inputs
+    {
+        ModificationRevisionSet* revisions;
+        ModificationRevision builtAt;
+        bool newer;
+    };
+
+    const IndexedString pchFile(m_pchFile);
+    // the PCH was possibly just written, don't use a cached revision for it
+    ModificationRevision::clearModificationCache(pchFile);
+    Inputs inputs = {&m_inputs, ModificationRevision::revisionForFile(pchFile), false};
+
+    m_inputs.clear();
+    m_inputs.addModificationRevision(pchFile, inputs.builtAt);
+    clang_getInclusions(m_session.unit(), [](CXFile file, CXSourceLocation*, unsigned, CXClientData data) {
+        auto inputs = static_cast<Inputs*>(data);
+        const IndexedString input(ClangString(clang_getFileName(file)).toString());
+        const auto revision = ModificationRevision::revisionForFile(input);
+        inputs->newer |= revision.modificationTime > inputs->builtAt.modificationTime;
+        inputs->revisions->addModificationRevision(input, revision);
+    }, &inputs);
+    return !inputs.newer && m_inputs.size() > 1;
+}
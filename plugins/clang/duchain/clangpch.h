@@ -24,6 +24,8 @@
 #include <language/duchain/topducontext.h>
 #include <util/path.h>
 
+#include <language/editor/modificationrevisionset.h>
+
 #include "parsesession.h"
 #include "clanghelpers.h"
 
@@ -33,6 +35,7 @@ class KDEVCLANGPRIVATE_EXPORT ClangPCH
 {
 public:
     ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index);
+    ~ClangPCH();
 
     IncludeFileContexts mapIncludes(CXTranslationUnit tu) const;
 
@@ -40,10 +43,26 @@ public:
 
     KDevelop::ReferencedTopDUContext context() const;
 
+    /**
+     * @returns false if the PCH file or one of the headers it was built from changed since
+     *
+     * This uses the cached modification revisions, it does not stat the inputs on every call.
+     */
+    bool isUpToDate() const;
+
 private:
     Q_DISABLE_COPY(ClangPCH)
 
+    /**
+     * Records the modification revisions of the PCH file and all the headers it was built from
+     *
+     * @returns false if one of the headers is newer than the PCH file
+     */
+    bool collectInputs();
+
     IncludeFileContexts m_includes;
+    QString m_pchFile;
+    KDevelop::ModificationRevisionSet m_inputs;
     KDevelop::ReferencedTopDUContext m_context;
     ParseSession m_session;
 };
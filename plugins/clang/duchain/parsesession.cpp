@@ -41,11 +41,14 @@
 #include <KShell>
 
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QMimeDatabase>
 #include <QMimeType>
+#include <QTemporaryFile>
 
 #include <algorithm>
+#include <cstdio>
 #ifdef Q_OS_UNIX
 #include <unistd.h>
 #endif
@@ -238,6 +241,19 @@ ParseSessionData::ParseSessionData(const QVector<UnsavedFile>& unsavedFiles, Cla
     const auto tuUrl = environment.translationUnitUrl();
     Q_ASSERT(!tuUrl.isEmpty());
 
+    if (options.testFlag(ReusePrecompiledHeader)) {
+        const QByteArray pchFile = tuUrl.byteArray() + ".pch";
+        const CXErrorCode code = clang_createTranslationUnit2(index->index(), pchFile.constData(), &m_unit);
+        if (code == CXError_Success && m_unit) {
+            setUnit(m_unit);
+            m_environment = environment;
+        } else {
+            qCDebug(KDEV_CLANG) << "Failed to load precompiled header" << pchFile << code;
+            m_unit = nullptr;
+        }
+        return;
+    }
+
     const auto arguments = argsForSession(tuUrl.str(), options, environment.parserSettings());
     QVector<const char*> clangArguments;
 
@@ -330,7 +346,26 @@ ParseSessionData::ParseSessionData(const QVector<UnsavedFile>& unsavedFiles, Cla
         m_environment = environment;
 
         if (options.testFlag(PrecompiledHeader)) {
-            clang_saveTranslationUnit(m_unit, QByteArray(tuUrl.byteArray() + ".pch").constData(), CXSaveTranslationUnit_None);
+            // save next to the final file and move it in place, a PCH shared between sessions
+            // must never be observed half-written
+            const QString pchFile = tuUrl.str() + QLatin1String(".pch");
+            // a unique name, so sessions building the same PCH concurrently don't write into each other's file
+            QTemporaryFile partFile(pchFile + QLatin1String(".XXXXXX"));
+            if (partFile.open()) {
+                partFile.close();
+                const QByteArray partPath = QFile::encodeName(partFile.fileName());
+                if (clang_saveTranslationUnit(m_unit, partPath.constData(), CXSaveTranslationUnit_None) == CXSaveError_None) {
+#ifdef Q_OS_WIN
+                    // rename() does not replace existing files there
+                    QFile::remove(pchFile);
+#endif
+                    if (::rename(partPath.constData(), QFile::encodeName(pchFile).constData()) == 0) {
+                        partFile.setAutoRemove(false);
+                    } else {
+                        qCWarning(KDEV_CLANG) << "Failed to store precompiled header" << pchFile;
+                    }
+                }
+            }
         }
     } else {
         qCWarning(KDEV_CLANG) << "Failed to parse translation unit:" << tuUrl;
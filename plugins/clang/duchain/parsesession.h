@@ -50,7 +50,8 @@ public:
     enum Option {
         NoOption,                     ///< No special options
         SkipFunctionBodies,           ///< Pass CXTranslationUnit_SkipFunctionBodies (likely unwanted)
-        PrecompiledHeader             ///< Pass CXTranslationUnit_PrecompiledPreamble and others to cache precompiled headers
+        PrecompiledHeader = 2,        ///< Pass CXTranslationUnit_PrecompiledPreamble and others to cache precompiled headers
+        ReusePrecompiledHeader = 4    ///< Load the PCH saved by a previous PrecompiledHeader session instead of parsing
     };
     Q_DECLARE_FLAGS(Options, Option)
 
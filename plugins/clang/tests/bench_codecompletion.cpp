@@ -75,6 +75,27 @@ void BenchCodeCompletion::benchCodeCompletion_data()
         return 0;
     }
     )" << KTextEditor::Cursor(7, 0);
+
+    QTest::newRow("std-scope") << R"(
+    #include <vector>
+    #include <string>
+    #include <algorithm>
+
+    int main()
+    {
+        std::
+    }
+    )" << KTextEditor::Cursor(7, 13);
+
+    QString declarations;
+    for (int i = 0; i < 20000; ++i) {
+        declarations += QStringLiteral("int function%1(int);\n").arg(i);
+    }
+
+    QTest::newRow("many-declarations") << declarations + QLatin1String("int main()\n{\n\n}\n")
+                                       << KTextEditor::Cursor(20002, 0);
+    QTest::newRow("many-declarations-prefix") << declarations + QLatin1String("int main()\n{\nfunction12\n}\n")
+                                              << KTextEditor::Cursor(20002, 10);
 }
 
 void BenchCodeCompletion::benchCodeCompletion()
@@ -1103,6 +1103,52 @@ void TestCodeCompletion::testOverloadedFunctions()
     QVERIFY(tester.items[1]->declaration().data() != tester.items[2]->declaration().data());
 }
 
+void TestCodeCompletion::testManyResults()
+{
+    QString code;
+    for (int i = 0; i < 2000; ++i) {
+        code += QStringLiteral("int someFunction%1();\n").arg(i);
+    }
+    code += QLatin1String("int main() {\nsomeFunction1");
+    TestFile file(code, QStringLiteral("cpp"));
+    QVERIFY(file.parseAndWait(TopDUContext::AllDeclarationsContextsUsesAndAST));
+    DUChainReadLocker lock;
+    auto top = file.topContext();
+    QVERIFY(top);
+    const ParseSessionData::Ptr sessionData(dynamic_cast<ParseSessionData*>(top->ast().data()));
+    QVERIFY(sessionData);
+
+    lock.unlock();
+
+    const auto context = createContext(top, sessionData, {2001, 13});
+    context->setFilters(NoMacroOrBuiltin);
+    lock.lock();
+    const auto tester = ClangCodeCompletionItemTester(context);
+
+    // only the best results are built right away, all others are offered by their name
+    int unimportant = 0;
+    for (const auto& item : tester.items) {
+        if (tester.itemData(item, KTextEditor::CodeCompletionModel::Name, KTextEditor::CodeCompletionModel::UnimportantItemRole).toBool()) {
+            ++unimportant;
+        }
+    }
+    QVERIFY(unimportant > 0);
+    QVERIFY(unimportant < tester.items.size());
+    QVERIFY(tester.findItem(QStringLiteral("someFunction1"))->declaration());
+    QCOMPARE(tester.names.count(QStringLiteral("someFunction1999")), 1);
+    // results that don't match the typed prefix are kept, they match again after a backspace
+    QVERIFY(tester.names.contains(QStringLiteral("someFunction2")));
+
+    // the others are built on demand
+    for (const auto& name : {QStringLiteral("someFunction1999"), QStringLiteral("someFunction2")}) {
+        const auto item = tester.findItem(name);
+        QVERIFY(item);
+        QVERIFY(item->declaration());
+        QCOMPARE(item->declaration()->identifier().toString(), name);
+        QCOMPARE(tester.itemData(item, KTextEditor::CodeCompletionModel::Prefix).toString(), QStringLiteral("int"));
+    }
+}
+
 void TestCodeCompletion::testCompletionPriority()
 {
     QFETCH(QString, code);
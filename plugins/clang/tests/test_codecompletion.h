@@ -53,6 +53,7 @@ private Q_SLOTS:
     void testArgumentHintCompletion_data();
 
     void testOverloadedFunctions();
+    void testManyResults();
     void testVariableScope();
     void testArgumentHintCompletionDefaultParameters();
 
@@ -51,6 +51,8 @@
 #include "duchain/clangparsingenvironmentfile.h"
 #include "duchain/clangparsingenvironment.h"
 #include "duchain/parsesession.h"
+#include "duchain/clangindex.h"
+#include "duchain/clanghelpers.h"
 
 #include <custom-definesandincludes/idefinesandincludesmanager.h>
 
@@ -1201,6 +1203,94 @@ void TestDUChain::testReparseChangeEnvironment()
     }
 }
 
+void TestDUChain::testReuseUnchangedHeader()
+{
+#if CINDEX_VERSION_MINOR < 47
+    QSKIP("The header contents are not available from libclang");
+#endif
+    TestFile header(QStringLiteral("struct Foo { VALUE_TYPE value; };\n"), QStringLiteral("h"));
+    TestFile impl("#define VALUE_TYPE int\n"
+                  "#include \"" + header.url().str() + "\"\n"
+                  "int main() { return Foo().value; }", QStringLiteral("cpp"), &header);
+    const auto features = TopDUContext::Features(TopDUContext::AllDeclarationsContextsAndUses|TopDUContext::AST|TopDUContext::ForceUpdate);
+
+    impl.parse(features);
+    QVERIFY(impl.waitForParsed(5000));
+
+    // updating only the translation unit does not build the unchanged header again
+    auto statistics = ClangHelpers::buildStatistics();
+    impl.parse(features);
+    QVERIFY(impl.waitForParsed(5000));
+    QCOMPARE(ClangHelpers::buildStatistics().reusedHeaders, statistics.reusedHeaders + 1);
+    QCOMPARE(ClangHelpers::buildStatistics().builtHeaders, statistics.builtHeaders);
+
+    // a changed macro used by the header does
+    impl.setFileContents("#define VALUE_TYPE float\n"
+                         "#include \"" + header.url().str() + "\"\n"
+                         "int main() { return Foo().value; }");
+    statistics = ClangHelpers::buildStatistics();
+    impl.parse(features);
+    QVERIFY(impl.waitForParsed(5000));
+    QCOMPARE(ClangHelpers::buildStatistics().reusedHeaders, statistics.reusedHeaders);
+    QCOMPARE(ClangHelpers::buildStatistics().builtHeaders, statistics.builtHeaders + 1);
+
+    DUChainReadLocker lock;
+    auto headerCtx = DUChain::self()->chainForDocument(header.url());
+    QVERIFY(headerCtx);
+    auto foo = headerCtx->findDeclarations(QualifiedIdentifier(QStringLiteral("Foo::value")));
+    QCOMPARE(foo.size(), 1);
+    QCOMPARE(foo.first()->abstractType()->toString(), QStringLiteral("float"));
+}
+
+void TestDUChain::testRebuildHeaderForChangedMacros_data()
+{
+    QTest::addColumn<QString>("definitions");
+    QTest::addColumn<QString>("changedDefinitions");
+    QTest::addColumn<QString>("type");
+
+    // the header only mentions VALUE_TYPE, the changed macro is expanded within it
+    QTest::newRow("chain") << QStringLiteral("#define INNER int\n#define VALUE_TYPE INNER\n")
+                           << QStringLiteral("#define INNER float\n#define VALUE_TYPE INNER\n")
+                           << QStringLiteral("float");
+    // the same definitions in a different order
+    QTest::newRow("order") << QStringLiteral("#define VALUE_TYPE int\n#undef VALUE_TYPE\n#define VALUE_TYPE float\n")
+                           << QStringLiteral("#define VALUE_TYPE float\n#undef VALUE_TYPE\n#define VALUE_TYPE int\n")
+                           << QStringLiteral("int");
+}
+
+void TestDUChain::testRebuildHeaderForChangedMacros()
+{
+#if CINDEX_VERSION_MINOR < 47
+    QSKIP("The header contents are not available from libclang");
+#endif
+    QFETCH(QString, definitions);
+    QFETCH(QString, changedDefinitions);
+    QFETCH(QString, type);
+
+    TestFile header(QStringLiteral("struct Foo { VALUE_TYPE value; };\n"), QStringLiteral("h"));
+    const QString include = "#include \"" + header.url().str() + "\"\n";
+    const QString body = QStringLiteral("int main() { return Foo().value; }");
+    TestFile impl(definitions + include + body, QStringLiteral("cpp"), &header);
+    const auto features = TopDUContext::Features(TopDUContext::AllDeclarationsContextsAndUses|TopDUContext::AST|TopDUContext::ForceUpdate);
+
+    impl.parse(features);
+    QVERIFY(impl.waitForParsed(5000));
+
+    impl.setFileContents(changedDefinitions + include + body);
+    const auto statistics = ClangHelpers::buildStatistics();
+    impl.parse(features);
+    QVERIFY(impl.waitForParsed(5000));
+    QCOMPARE(ClangHelpers::buildStatistics().reusedHeaders, statistics.reusedHeaders);
+    QCOMPARE(ClangHelpers::buildStatistics().builtHeaders, statistics.builtHeaders + 1);
+
+    DUChainReadLocker lock;
+    auto headerCtx = DUChain::self()->chainForDocument(header.url());
+    QVERIFY(headerCtx);
+    auto foo = headerCtx->findDeclarations(QualifiedIdentifier(QStringLiteral("Foo::value")));
+    QCOMPARE(foo.size(), 1);
+    QCOMPARE(foo.first()->abstractType()->toString(), type);
+}
+
 void TestDUChain::testMacroDependentHeader()
 {
     TestFile header(QStringLiteral("struct MY_CLASS { struct Q{Q(); int m;}; int m; };\n"), QStringLiteral("h"));
@@ -2128,3 +2218,43 @@ void TestDUChain::testSameFunctionDefinition()
 
     m_projectController->closeAllProjects();
 }
+
+void TestDUChain::testSharedPreamble()
+{
+    ClangIndex index;
+
+    ClangParsingEnvironment environment;
+    environment.setTranslationUnitUrl(IndexedString(QStringLiteral("/tmp/foo.cpp")));
+    const QByteArray code = "// license\n/* multi\n   line */\n"
+                            "#include <vector>\n"
+                            "#  include <string> // strings\n"
+                            "#include \"foo.h\"\n"
+                            "#include <map>\n";
+    const auto preamble = index.sharedPreamble(environment, code);
+    QVERIFY(preamble.isValid());
+    QVERIFY(ClangIndex::isSharedPreamble(preamble));
+
+    QFile file(preamble.toLocalFile());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), QByteArray("#include <vector>\n#include <string>\n"));
+
+    // the same prefix with the same arguments shares the header
+    ClangParsingEnvironment otherEnvironment;
+    otherEnvironment.setTranslationUnitUrl(IndexedString(QStringLiteral("/tmp/bar.cpp")));
+    QCOMPARE(index.sharedPreamble(otherEnvironment, "#include <vector>\n#include <string>\nint i;\n"), preamble);
+
+    // but different arguments may not
+    otherEnvironment.addDefines({{QStringLiteral("FOO"), QStringLiteral("1")}});
+    const auto definesPreamble = index.sharedPreamble(otherEnvironment, code);
+    QVERIFY(definesPreamble.isValid());
+    QVERIFY(definesPreamble != preamble);
+
+    // only what the file itself starts with is shared, injecting it must not reorder any header
+    QVERIFY(!index.sharedPreamble(environment, "#include \"foo.h\"\n#include <vector>\n").isValid());
+    QVERIFY(!index.sharedPreamble(environment, "int i;\n#include <vector>\n").isValid());
+    QVERIFY(!index.sharedPreamble(environment, "#define FOO\n#include <vector>\n").isValid());
+    QVERIFY(!ClangIndex::isSharedPreamble(Path(QStringLiteral("/tmp/foo.h"))));
+
+    QVERIFY(QFile::remove(preamble.toLocalFile()));
+    QVERIFY(QFile::remove(definesPreamble.toLocalFile()));
+}
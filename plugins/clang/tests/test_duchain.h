@@ -71,6 +71,9 @@ private Q_SLOTS:
     void testSystemIncludes();
     void testReparseInclude();
     void testReparseChangeEnvironment();
+    void testReuseUnchangedHeader();
+    void testRebuildHeaderForChangedMacros_data();
+    void testRebuildHeaderForChangedMacros();
     void testMacrosRanges();
     void testMacroUses();
     void testHeaderParsingOrder1();
@@ -104,6 +107,8 @@ private Q_SLOTS:
 
     void testSameFunctionDefinition();
 
+    void testSharedPreamble();
+
 private:
     QScopedPointer<TestEnvironmentProvider> m_provider;
     KDevelop::TestProjectController* m_projectController;
@@ -32,11 +32,13 @@
 #include <interfaces/icore.h>
 #include <interfaces/iruntime.h>
 #include <interfaces/iruntimecontroller.h>
+#include <util/jsonarrayreader.h>
 
 #include <KShell>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 #include <QFutureWatcher>
 #include <QRegularExpression>
@@ -45,6 +47,86 @@ using namespace KDevelop;
 
 namespace {
 
+struct CommandEntry
+{
+    QString file;
+    QString command;
+    QString directory;
+};
+
+struct ResolvedEntry
+{
+    Path file;
+    PathResolutionResult result;
+};
+
+/**
+ * Resolves the command lines of a chunk of entries. Every chunk gets its own
+ * resolver as the resolver's caches are not thread-safe.
+ */
+QVector<ResolvedEntry> resolveCommands(const QVector<CommandEntry>& entries)
+{
+    MakeFileResolver resolver;
+    QVector<ResolvedEntry> ret;
+    ret.reserve(entries.size());
+    for (const auto& entry : entries) {
+        const auto entryInfo = QFileInfo(entry.file);
+        ret.append(ResolvedEntry{Path(entryInfo.exists() ? entryInfo.canonicalFilePath() : entry.file),
+                                 resolver.processOutput(entry.command, entry.directory)});
+    }
+    return ret;
+}
+
+/**
+ * Deduplicates the include and define sets of the compilation database:
+ * files with the same flags share one implicitly shared instance of each set.
+ */
+template<typename Set>
+class SetInterner
+{
+public:
+    /// @p convert is applied once to every distinct set
+    template<typename Convert>
+    Set intern(const Set& set, uint hash, Convert convert)
+    {
+        for (auto it = m_sets.constFind(hash); it != m_sets.constEnd() && it.key() == hash; ++it) {
+            if (it->first == set) {
+                return it->second;
+            }
+        }
+        const Set converted = convert(set);
+        m_sets.insert(hash, qMakePair(set, converted));
+        return converted;
+    }
+
+    int size() const
+    {
+        return m_sets.size();
+    }
+
+private:
+    QMultiHash<uint, QPair<Set, Set>> m_sets;
+};
+
+uint hashPaths(const Path::List& paths)
+{
+    uint hash = paths.size();
+    for (const auto& path : paths) {
+        hash = hash * 31 + qHash(path);
+    }
+    return hash;
+}
+
+uint hashDefines(const QHash<QString, QString>& defines)
+{
+    // must not depend on the iteration order
+    uint hash = defines.size();
+    for (auto it = defines.constBegin(), end = defines.constEnd(); it != end; ++it) {
+        hash += qHash(it.key()) ^ (qHash(it.value()) * 16777619u);
+    }
+    return hash;
+}
+
 CMakeFilesCompilationData importCommands(const Path& commandsFile)
 {
     // NOTE: to get compile_commands.json, you need -DCMAKE_EXPORT_COMPILE_COMMANDS=ON
@@ -57,51 +139,87 @@ CMakeFilesCompilationData importCommands(const Path& commandsFile)
 
     qCDebug(CMAKE) << "Found commands file" << commandsFile;
 
-    CMakeFilesCompilationData data;
-    QJsonParseError error;
-    const QJsonDocument document = QJsonDocument::fromJson(f.readAll(), &error);
-    if (error.error) {
-        qCWarning(CMAKE) << "Failed to parse JSON in commands file:" << error.errorString() << commandsFile;
-        data.isValid = false;
-        return data;
-    } else if (!document.isArray()) {
-        qCWarning(CMAKE) << "JSON document in commands file is not an array: " << commandsFile;
-        data.isValid = false;
-        return data;
-    }
+    // the entries are read in batches, and the command lines of a batch are resolved
+    // in parallel chunks while the next batch is being read
+    enum {
+        BatchSize = 4096,
+        ChunkSize = 256
+    };
 
-    MakeFileResolver resolver;
+    CMakeFilesCompilationData data;
     static const QString KEY_COMMAND = QStringLiteral("command");
     static const QString KEY_DIRECTORY = QStringLiteral("directory");
     static const QString KEY_FILE = QStringLiteral("file");
     auto rt = ICore::self()->runtimeController()->currentRuntime();
-    foreach(const QJsonValue& value, document.array()) {
-        if (!value.isObject()) {
-            qCWarning(CMAKE) << "JSON command file entry is not an object:" << value;
-            continue;
-        }
-        const QJsonObject entry = value.toObject();
-        if (!entry.contains(KEY_FILE) || !entry.contains(KEY_COMMAND) || !entry.contains(KEY_DIRECTORY)) {
-            qCWarning(CMAKE) << "JSON command file entry does not contain required keys:" << entry;
-            continue;
+    auto convert = [rt](const Path::List& paths) {
+        return kTransform<Path::List>(paths, [rt](const Path &path) { return rt->pathInHost(path); });
+    };
+    auto identity = [](const QHash<QString, QString>& defines) { return defines; };
+
+    SetInterner<Path::List> includes;
+    SetInterner<Path::List> frameworkDirectories;
+    SetInterner<QHash<QString, QString>> defines;
+
+    auto merge = [&](const QFuture<QVector<ResolvedEntry>>& future) {
+        for (const auto& chunk : future.results()) {
+            for (const auto& entry : chunk) {
+                const auto& result = entry.result;
+                CMakeFile ret;
+                ret.includes = includes.intern(result.paths, hashPaths(result.paths), convert);
+                ret.frameworkDirectories = frameworkDirectories.intern(result.frameworkDirectories,
+                                                                       hashPaths(result.frameworkDirectories), convert);
+                ret.defines = defines.intern(result.defines, hashDefines(result.defines), identity);
+                const Path path(rt->pathInHost(entry.file));
+                data.files[path] = ret;
+            }
         }
+    };
 
-        PathResolutionResult result = resolver.processOutput(entry[KEY_COMMAND].toString(), entry[KEY_DIRECTORY].toString());
+    JsonArrayReader reader(&f);
+    QFuture<QVector<ResolvedEntry>> pending;
+    QVector<QVector<CommandEntry>> chunks;
+    QJsonValue value;
+    bool atEnd = false;
+    while (!atEnd) {
+        chunks.clear();
+        int count = 0;
+        while (count < BatchSize) {
+            if (!reader.readNext(&value)) {
+                atEnd = true;
+                break;
+            }
+            if (!value.isObject()) {
+                qCWarning(CMAKE) << "JSON command file entry is not an object:" << value;
+                continue;
+            }
+            const QJsonObject entry = value.toObject();
+            if (!entry.contains(KEY_FILE) || !entry.contains(KEY_COMMAND) || !entry.contains(KEY_DIRECTORY)) {
+                qCWarning(CMAKE) << "JSON command file entry does not contain required keys:" << entry;
+                continue;
+            }
+            if (count % ChunkSize == 0) {
+                chunks.append(QVector<CommandEntry>());
+                chunks.last().reserve(ChunkSize);
+            }
+            chunks.last().append(CommandEntry{entry[KEY_FILE].toString(), entry[KEY_COMMAND].toString(),
+                                              entry[KEY_DIRECTORY].toString()});
+            ++count;
+        }
 
-        auto convert = [rt](const Path &path) { return rt->pathInHost(path); };
+        merge(pending);
+        pending = QtConcurrent::mapped(chunks, resolveCommands);
+    }
+    merge(pending);
 
-        CMakeFile ret;
-        ret.includes = kTransform<Path::List>(result.paths, convert);
-        ret.frameworkDirectories = kTransform<Path::List>(result.frameworkDirectories, convert);
-        ret.defines = result.defines;
-        const auto entryFile = entry[KEY_FILE].toString();
-        const auto entryInfo = QFileInfo(entryFile);
-        const auto entryPath = Path(entryInfo.exists() ? entryInfo.canonicalFilePath() : entryFile);
-        const Path path(rt->pathInHost(entryPath));
-        qCDebug(CMAKE) << "entering..." << path << entryFile;
-        data.files[path] = ret;
+    if (!reader.errorString().isEmpty()) {
+        qCWarning(CMAKE) << "Failed to parse JSON in commands file:" << reader.errorString() << commandsFile;
+        data.files.clear();
+        data.isValid = false;
+        return data;
     }
 
+    qCDebug(CMAKE) << "Imported" << data.files.size() << "entries with" << includes.size() << "distinct include sets and"
+                   << defines.size() << "distinct define sets";
     data.isValid = true;
     return data;
 }
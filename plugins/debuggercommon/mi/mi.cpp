@@ -21,6 +21,9 @@
  ***************************************************************************/
 #include "mi.h"
 
+#include <cstddef>
+#include <cstring>
+
 using namespace KDevMI::MI;
 
 
@@ -66,41 +69,105 @@ const Value& Value::operator[](int) const
 
 QString StringLiteralValue::literal() const
 {
-    return literal_;
+    return decode(raw_, size_);
 }
 
 int StringLiteralValue::toInt(int base) const
 {
     bool ok;
-    int result = literal_.toInt(&ok, base);
+    int result = literal().toInt(&ok, base);
     if (!ok)
         throw type_error();
     return result;
 }
 
-TupleValue::~TupleValue()
+QString StringLiteralValue::decode(const char* raw, int size)
+{
+    const char* end = raw + size;
+    const char* escape = static_cast<const char*>(memchr(raw, '\\', size));
+    if (!escape)
+        return QString::fromUtf8(raw, size);
+
+    QByteArray unescaped;
+    unescaped.reserve(size);
+    unescaped.append(raw, escape - raw);
+    for (const char* c = escape; c != end; ++c)
+    {
+        char translated = 0;
+        if (*c == '\\' && c + 1 != end) {
+            // TODO: implement all the other escapes, maybe
+            switch (c[1]) {
+            case 'n': translated = '\n'; break;
+            case '\\': translated = '\\'; break;
+            case '"': translated = '"'; break;
+            case 't': translated = '\t'; break;
+            case 'r': translated = '\r'; break;
+            default: break;
+            }
+        }
+
+        if (translated)
+        {
+            unescaped.append(translated);
+            ++c;
+        }
+        else
+        {
+            unescaped.append(*c);
+        }
+    }
+    return QString::fromUtf8(unescaped);
+}
+
+Arena::~Arena()
+{
+    for (char* block : m_blocks)
+        ::operator delete(block);
+}
+
+void* Arena::allocate(size_t size)
+{
+    const size_t alignment = alignof(std::max_align_t);
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (size > m_left) {
+        const size_t blockSize = qMax(size, m_nextBlockSize);
+        m_current = static_cast<char*>(::operator new(blockSize));
+        m_blocks.append(m_current);
+        m_left = blockSize;
+        // Large records get larger blocks, to keep the number of allocations low
+        m_nextBlockSize = qMin<size_t>(m_nextBlockSize * 2, 1024 * 1024);
+    }
+
+    void* memory = m_current;
+    m_current += size;
+    m_left -= size;
+    return memory;
+}
+
+const Result* TupleValue::find(const QString& variable) const
 {
-    qDeleteAll(results);
+    // Backwards, so that the last of several fields with the same name wins
+    for (int i = results.size() - 1; i >= 0; --i) {
+        if (results[i]->variable == variable)
+            return results[i];
+    }
+    return nullptr;
 }
 
 bool TupleValue::hasField(const QString& variable) const
 {
-    return results_by_name.contains(variable);
+    return find(variable);
 }
 
 const Value& TupleValue::operator[](const QString& variable) const
 {
-    Result* result = results_by_name.value(variable);
-    if (!result)
+    const Result* result = find(variable);
+    if (!result || !result->value)
         throw type_error();
     return *result->value;
 }
 
-ListValue::~ListValue()
-{
-    qDeleteAll(results);
-}
-
 bool ListValue::empty() const
 {
     return results.isEmpty();
@@ -113,14 +180,10 @@ int ListValue::size() const
 
 const Value& ListValue::operator[](int index) const
 {
-    if (index < results.size())
+    if (index < results.size() && results[index]->value)
     {
         return *results[index]->value;
     }
     else
         throw type_error();
 }
-
-
-
-
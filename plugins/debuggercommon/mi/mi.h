@@ -24,10 +24,13 @@
 #ifndef GDBMI_H
 #define GDBMI_H
 
+#include <QByteArray>
 #include <QString>
-#include <QMap>
+#include <QVector>
 
+#include <new>
 #include <stdexcept>
+#include <utility>
 
 /**
 @author Roberto Raggi
@@ -235,50 +238,104 @@ namespace KDevMI { namespace MI {
         virtual const Value& operator[](int index) const;
     };
 
+    /** @internal
+        Memory of the values of one record, which are freed together
+        with the record.
+
+        Values are only allocated while parsing and never destroyed
+        one by one, so they must not own any memory themselves. Instead,
+        they refer to the text of the record and to other values in
+        the same arena.
+    */
+    class Arena
+    {
+    public:
+        Arena() = default;
+        ~Arena();
+
+        void* allocate(size_t size);
+
+        template<typename T, typename... Args>
+        T* create(Args&&... args)
+        {
+            return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+        }
+
+    private:
+        Q_DISABLE_COPY(Arena)
+
+        QVector<char*> m_blocks;
+        char* m_current = nullptr;
+        size_t m_left = 0;
+        size_t m_nextBlockSize = 4096;
+    };
+
     /** @internal
         Internal class to represent name-value pair in tuples.
     */
     struct Result
     {
-        Result() {}
-        ~Result() { delete value; value = nullptr; }
-
-        QString variable;
+        /// Refers to the text of the record
+        QLatin1String variable = QLatin1String("");
         Value *value = nullptr;
     };
 
+    /** The results of a tuple or list, allocated in the arena of
+        the record.
+    */
+    struct ResultList
+    {
+        Result* const* begin() const { return items; }
+        Result* const* end() const { return items + count; }
+        int size() const { return count; }
+        bool isEmpty() const { return count == 0; }
+        Result* operator[](int index) const { return items[index]; }
+
+        Result** items = nullptr;
+        int count = 0;
+    };
+
+    /** A string literal, decoded only when it is accessed.
+        Large records mostly consist of literals that are never
+        looked at, e.g. the values of collapsed variables.
+    */
     struct StringLiteralValue : public Value
     {
-        explicit StringLiteralValue(const QString &lit)
-            : literal_(lit) { Value::kind = StringLiteral; }
+        /// @param raw The text between the quotes, which is still escaped
+        explicit StringLiteralValue(const char* raw, int size)
+            : raw_(raw), size_(size) { Value::kind = StringLiteral; }
 
     public: // Value overrides
 
         QString literal() const override;
         int toInt(int base) const override;
 
+        /// Replaces the C escape sequences in the @p size bytes at @p raw and decodes them as UTF-8
+        static QString decode(const char* raw, int size);
+
     private:
-        QString literal_;
+        const char* raw_;
+        int size_;
     };
 
     struct TupleValue : public Value
     {
         TupleValue() { Value::kind = Tuple; }
-        ~TupleValue() override;
 
         bool hasField(const QString&) const override;
 
         using Value::operator[];
         const Value& operator[](const QString& variable) const override;
 
-        QList<Result*> results;
-        QMap<QString, Result*> results_by_name;
+        /// Tuples have few fields, so the lookup by name is a linear search
+        const Result* find(const QString& variable) const;
+
+        ResultList results;
     };
 
     struct ListValue : public Value
     {
         ListValue() { Value::kind = List; }
-        ~ListValue() override;
 
         bool empty() const override;
 
@@ -287,7 +344,7 @@ namespace KDevMI { namespace MI {
         using Value::operator[];
         const Value& operator[](int index) const override;
 
-        QList<Result*> results;
+        ResultList results;
     };
 
     struct Record
@@ -296,6 +353,11 @@ namespace KDevMI { namespace MI {
         virtual QString toString() const { Q_ASSERT( 0 ); return QString(); }
 
         enum { Prompt, Stream, Result, Async } kind;
+
+        /// The text the record was parsed from, its values point into it
+        QByteArray contents;
+        /// Holds the values of the record
+        Arena arena;
     };
 
     struct TupleRecord : public Record, public TupleValue
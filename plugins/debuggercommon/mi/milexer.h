@@ -59,6 +59,13 @@ struct TokenStream
 
     QByteArray tokenText(int index = 0) const;
 
+    /// Points to the text of the current token within the contents, without copying it
+    inline const char* currentTokenData() const
+    { return m_contents.constData() + m_currentToken->position; }
+
+    inline int currentTokenLength() const
+    { return m_currentToken->length; }
+
     inline int lineOffset(int line) const
     { return m_lines.at(line); }
 
@@ -22,6 +22,8 @@
 #include "miparser.h"
 #include "tokens.h"
 
+#include <cstring>
+
 using namespace KDevMI::MI;
 
 #define MATCH(tok) \
@@ -93,6 +95,12 @@ std::unique_ptr<Record> MIParser::parse(FileSymbol *file)
             break;
     }
 
+    if (record) {
+        // The values point into the contents, which are implicitly shared
+        record->contents = file->contents;
+    }
+    m_arena = nullptr;
+
     if (record && record->kind == Record::Result) {
         ResultRecord * result = static_cast<ResultRecord *>(record.get());
         result->token = token;
@@ -143,7 +151,7 @@ std::unique_ptr<Record> MIParser::parseResultOrAsyncRecord()
     char c = m_lex->lookAhead();
     m_lex->nextToken();
     MATCH_PTR(Token_identifier);
-    QString reason = QString::fromUtf8(m_lex->currentTokenText());
+    QString reason = QString::fromUtf8(m_lex->currentTokenData(), m_lex->currentTokenLength());
     m_lex->nextToken();
 
     if (c == '^') {
@@ -164,6 +172,7 @@ std::unique_ptr<Record> MIParser::parseResultOrAsyncRecord()
     if (m_lex->lookAhead() == ',') {
         m_lex->nextToken();
 
+        m_arena = &result->arena;
         if (!parseCSV(*result))
             return {};
     }
@@ -177,14 +186,14 @@ bool MIParser::parseResult(Result *&result)
     // https://bugs.kde.org/show_bug.cgi?id=304730
     // http://sourceware.org/bugzilla/show_bug.cgi?id=9659
 
-    std::unique_ptr<Result> res(new Result);
+    Result *res = m_arena->create<Result>();
 
     if (m_lex->lookAhead() == Token_identifier) {
-        res->variable = QString::fromUtf8(m_lex->currentTokenText());
+        res->variable = QLatin1String(m_lex->currentTokenData(), m_lex->currentTokenLength());
         m_lex->nextToken();
 
         if (m_lex->lookAhead() != '=') {
-            result = res.release();
+            result = res;
             return true;
         }
 
@@ -196,7 +205,7 @@ bool MIParser::parseResult(Result *&result)
         return false;
 
     res->value = value;
-    result = res.release();
+    result = res;
 
     return true;
 }
@@ -207,7 +216,10 @@ bool MIParser::parseValue(Value *&value)
 
     switch (m_lex->lookAhead()) {
         case Token_string_literal: {
-            value = new StringLiteralValue(parseStringLiteral());
+            // Without the quotes, the escapes are replaced when the literal is accessed
+            const int length = m_lex->currentTokenLength();
+            value = m_arena->create<StringLiteralValue>(m_lex->currentTokenData() + 1, qMax(length - 2, 0));
+            m_lex->nextToken();
         }
         return true;
 
@@ -239,7 +251,8 @@ bool MIParser::parseList(Value *&value)
 {
     ADVANCE('[');
 
-    std::unique_ptr<ListValue> lst(new ListValue);
+    ListValue *lst = m_arena->create<ListValue>();
+    ResultBuffer results;
 
     // Note: can't use parseCSV here because of nested
     // "is this Value or Result" guessing. Too lazy to factor
@@ -260,10 +273,10 @@ bool MIParser::parseList(Value *&value)
         Q_ASSERT(result || val);
 
         if (!result) {
-            result = new Result;
+            result = m_arena->create<Result>();
             result->value = val;
         }
-        lst->results.append(result);
+        results.append(result);
 
         if (m_lex->lookAhead() == ',')
             m_lex->nextToken();
@@ -272,7 +285,8 @@ bool MIParser::parseList(Value *&value)
     }
     ADVANCE(']');
 
-    value = lst.release();
+    lst->results = allocateResults(results);
+    value = lst;
 
     return true;
 }
@@ -280,22 +294,22 @@ bool MIParser::parseList(Value *&value)
 bool MIParser::parseCSV(TupleValue** value,
                         char start, char end)
 {
-    std::unique_ptr<TupleValue> tuple(new TupleValue);
+    TupleValue *tuple = m_arena->create<TupleValue>();
 
     if (!parseCSV(*tuple, start, end))
         return false;
- 
-    *value = tuple.get();
-    tuple.release();
+
+    *value = tuple;
     return true;
 }
 
 bool MIParser::parseCSV(TupleValue& value,
                         char start, char end)
 {
-   if (start)
+    if (start)
         ADVANCE(start);
 
+    ResultBuffer results;
     int tok = m_lex->lookAhead();
     while (tok) {
         if (end && tok == end)
@@ -305,8 +319,7 @@ bool MIParser::parseCSV(TupleValue& value,
         if (!parseResult(result))
             return false;
 
-        value.results.append(result);
-        value.results_by_name.insert(result->variable, result);      
+        results.append(result);
 
         if (m_lex->lookAhead() == ',')
             m_lex->nextToken();
@@ -317,57 +330,28 @@ bool MIParser::parseCSV(TupleValue& value,
     if (end)
         ADVANCE(end);
 
+    value.results = allocateResults(results);
     return true;
 }
 
-QString MIParser::parseStringLiteral()
+ResultList MIParser::allocateResults(const ResultBuffer& results)
 {
-    QByteArray messageByteArray = m_lex->currentTokenText();
-    QString message = QString::fromUtf8(messageByteArray.constData());
+    ResultList list;
+    list.count = results.size();
+    if (list.count) {
+        list.items = static_cast<Result**>(m_arena->allocate(list.count * sizeof(Result*)));
+        memcpy(list.items, results.constData(), list.count * sizeof(Result*));
+    }
+    return list;
+}
 
-    int length = message.length();
-    QString message2;
-    message2.reserve(length);
+QString MIParser::parseStringLiteral()
+{
     // The [1,length-1] range removes quotes without extra
     // call to 'mid'
-    int target_index = 0;
-    for(int i = 1, e = length-1; i != e; ++i)
-    {
-        int translated = -1;
-        if (message[i] == QLatin1Char('\\')) {
-            if (i+1 < length)
-            {
-                // TODO: implement all the other escapes, maybe
-                if (message[i+1] == QLatin1Char('n')) {
-                    translated = '\n';
-                }
-                else if (message[i+1] == QLatin1Char('\\')) {
-                    translated = '\\';
-                }
-                else if (message[i+1] == QLatin1Char('"')) {
-                    translated = '"';
-                }
-                else if (message[i+1] == QLatin1Char('t')) {
-                    translated = '\t';
-                }
-                else if (message[i+1] == QLatin1Char('r')) {
-                    translated = '\r';
-                }
-            }
-        }
-
-        if (translated != -1)
-        {
-            message2[target_index++] = translated;
-            ++i;
-        }
-        else
-        {
-            message2[target_index++] = message[i];
-        }
-    }
+    const int length = m_lex->currentTokenLength();
+    QString message = StringLiteralValue::decode(m_lex->currentTokenData() + 1, qMax(length - 2, 0));
 
     m_lex->nextToken();
-    return message2;
+    return message;
 }
-
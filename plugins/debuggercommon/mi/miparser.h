@@ -20,6 +20,8 @@
 #ifndef MIPARSER_H
 #define MIPARSER_H
 
+#include <QVarLengthArray>
+
 #include <memory>
 
 #include "mi.h"
@@ -31,6 +33,9 @@ namespace KDevMI { namespace MI {
 
 /**
 @author Roberto Raggi
+
+The values of a record are allocated in its arena and refer to its
+contents, string literals are only decoded when they are accessed.
 */
 class MIParser
 {
@@ -75,8 +80,15 @@ protected: // rules
     QString parseStringLiteral();
 
 private:
+    typedef QVarLengthArray<Result*, 16> ResultBuffer;
+
+    /// Copies the results collected while parsing a tuple or list into the arena
+    ResultList allocateResults(const ResultBuffer& results);
+
     MILexer m_lexer;
     TokenStream *m_lex = nullptr;
+    /// Arena of the record being parsed
+    Arena *m_arena = nullptr;
 };
 
 } // end of namespace MI
@@ -23,12 +23,15 @@
 
 #include "debuglog.h"
 #include "midebugsession.h"
+#include "mivariablecontroller.h"
 #include "mi/micommand.h"
 #include "stringhelpers.h"
 
 #include <debugger/interfaces/ivariablecontroller.h>
 #include <interfaces/icore.h>
 
+#include <qtcompat_p.h>
+
 using namespace KDevelop;
 using namespace KDevMI;
 using namespace KDevMI::MI;
@@ -49,6 +52,9 @@ MIVariable::MIVariable(MIDebugSession *session, TreeModel* model, TreeItem* pare
     : Variable(model, parent, expression, display)
     , m_debugSession(session)
 {
+    // Hidden children do not need to be updated on every stop
+    connect(this, &TreeItem::collapsed, this, [this] { setChildrenFrozen(true); });
+    connect(this, &TreeItem::expanded, this, [this] { setChildrenFrozen(false); });
 }
 
 MIVariable *MIVariable::createChild(const Value& child)
@@ -66,9 +72,31 @@ MIVariable *MIVariable::createChild(const Value& child)
     var->setType(child[QStringLiteral("type")].literal());
     var->setValue(formatValue(child[QStringLiteral("value")].literal()));
     var->setChanged(true);
+
+    if (!isExpanded() && canFreezeChildren() && sessionIsAlive()) {
+        m_debugSession->addCommand(VarSetFrozen, QStringLiteral("\"%1\" 1").arg(var->varobj()));
+    }
     return var;
 }
 
+void MIVariable::setChildrenFrozen(bool frozen)
+{
+    if (!canFreezeChildren() || !sessionIsAlive())
+        return;
+
+    for (TreeItem* item : qAsConst(childItems)) {
+        auto* var = qobject_cast<MIVariable*>(item);
+        if (!var || var->varobj().isEmpty())
+            continue;
+
+        m_debugSession->addCommand(VarSetFrozen, QStringLiteral("\"%1\" %2").arg(var->varobj()).arg(frozen ? 1 : 0));
+        if (!frozen) {
+            // Unfreezing does not refresh the value, which may be outdated by several stops
+            static_cast<MIVariableController*>(m_debugSession->variableController())->updateVarobj(var->varobj());
+        }
+    }
+}
+
 MIVariable::~MIVariable()
 {
     if (!m_varobj.isEmpty())
@@ -265,7 +293,9 @@ void MIVariable::handleUpdate(const Value& var)
         deleteChildren();
         // FIXME: verify that this check is right.
         setHasMore(var[QStringLiteral("new_num_children")].toInt() != 0);
-        fetchMoreChildren();
+        // Collapsed variables fetch their children once they are expanded
+        if (isExpanded())
+            fetchMoreChildren();
     }
 
     if (var.hasField(QStringLiteral("in_scope")) && var[QStringLiteral("in_scope")].literal() == QLatin1String("false"))
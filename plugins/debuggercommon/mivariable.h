@@ -56,6 +56,11 @@ public:
 
     bool canSetFormat() const override { return true; }
 
+    using KDevelop::Variable::topLevel;
+
+    /** Returns true if @p item directly contains this variable. */
+    bool isChildOf(const KDevelop::TreeItem* item) const { return parentItem == item; }
+
 protected: // Variable overrides
     void attachMaybe(QObject *callback, const char *callbackMethod) override;
     void fetchMoreChildren() override;
@@ -76,6 +81,11 @@ protected: // Internal
 
     bool sessionIsAlive() const;
 
+    /** Whether the children can be frozen with -var-set-frozen while this variable is collapsed,
+        so that updates of this variable skip them. */
+    virtual bool canFreezeChildren() const { return true; }
+    void setChildrenFrozen(bool frozen);
+
     void setVarobj(const QString& v);
 
 protected:
@@ -38,6 +38,8 @@
 
 #include <KTextEditor/Document>
 
+#include <qtcompat_p.h>
+
 using namespace KDevelop;
 using namespace KDevMI;
 using namespace KDevMI::MI;
@@ -87,13 +89,49 @@ void MIVariableController::update()
    if ((autoUpdate() & UpdateLocals) ||
        ((autoUpdate() & UpdateWatches) && variableCollection()->watches()->childCount() > 0))
     {
-        debugSession()->addCommand(VarUpdate, QStringLiteral("--all-values *"), this,
-                                   &MIVariableController::handleVarUpdate);
+        // Instead of "-var-update *", which refreshes every varobj ever created, only update
+        // the variables in the sections the view shows. Children of collapsed variables are
+        // frozen, so they are skipped as well.
+        const Watches* watches = variableCollection()->watches();
+        const auto allLocals = variableCollection()->allLocals();
+        QStringList varobjs;
+        for (MIVariable* var : qAsConst(debugSession()->variableMapping())) {
+            if (!var->topLevel() || var->varobj().isEmpty())
+                continue;
+
+            bool shown = true; // tooltips
+            if (var->isChildOf(watches)) {
+                shown = autoUpdate() & UpdateWatches;
+            } else {
+                for (const Locals* locals : allLocals) {
+                    if (var->isChildOf(locals)) {
+                        shown = autoUpdate() & UpdateLocals;
+                        break;
+                    }
+                }
+            }
+            if (shown)
+                varobjs << var->varobj();
+        }
+
+        for (const QString& varobj : qAsConst(varobjs)) {
+            updateVarobj(varobj);
+        }
     }
 }
 
+void MIVariableController::updateVarobj(const QString& varobj)
+{
+    // The varobj may have been deleted by the time the command runs, which is not worth an error message
+    debugSession()->addCommand(VarUpdate, QStringLiteral("--all-values \"%1\"").arg(varobj), this,
+                               &MIVariableController::handleVarUpdate, CmdHandlesError);
+}
+
 void MIVariableController::handleVarUpdate(const ResultRecord& r)
 {
+    if (!r.hasField(QStringLiteral("changelist")))
+        return;
+
     const Value& changed = r[QStringLiteral("changelist")];
     for (int i = 0; i < changed.size(); ++i)
     {
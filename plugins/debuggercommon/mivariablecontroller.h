@@ -55,6 +55,9 @@ public:
     void addWatchpoint(KDevelop::Variable* variable) override;
     void update() override;
 
+    /** Updates the variable object @p varobj and those of its children that are not frozen. */
+    void updateVarobj(const QString& varobj);
+
 protected:
     void updateLocals();
 
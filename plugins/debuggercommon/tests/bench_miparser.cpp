@@ -0,0 +1,144 @@
+/* This file is part of KDevelop
+ *
+ * Copyright 2026 KDevelop developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bench_miparser.h"
+
+// SUT
+#include <mi/miparser.h>
+// Qt
+#include <QTest>
+
+using namespace KDevMI::MI;
+
+namespace {
+
+// The traces follow the records GDB sends for a deep backtrace, an expanded
+// std::vector and a stop in a template heavy function
+
+QByteArray stackListFrames(int depth)
+{
+    QByteArray line("^done,stack=[");
+    for (int level = 0; level < depth; ++level) {
+        if (level)
+            line += ',';
+        line += "frame={level=\"" + QByteArray::number(level) + "\",addr=\"0x00000000004005"
+              + QByteArray::number(level, 16) + "\",func=\"std::_Function_handler<void (int), "
+                "Recurse<std::vector<std::pair<std::string, int> > > >::_M_invoke(std::_Any_data const&, int&&)\","
+                "file=\"/usr/include/c++/8/bits/std_function.h\",fullname=\"/usr/include/c++/8/bits/std_function.h\","
+                "line=\"" + QByteArray::number(297 + level) + "\",arch=\"i386:x86-64\"}";
+    }
+    return line + ']';
+}
+
+QByteArray varListChildren(int count)
+{
+    QByteArray line("^done,numchild=\"" + QByteArray::number(count) + "\",children=[");
+    for (int i = 0; i < count; ++i) {
+        if (i)
+            line += ',';
+        line += "child={name=\"var1.[" + QByteArray::number(i) + "]\",exp=\"[" + QByteArray::number(i)
+              + "]\",numchild=\"2\",value=\"{first = \\\"key " + QByteArray::number(i)
+              + "\\\", second = " + QByteArray::number(i * 7) + "}\",type=\"std::pair<std::string, int>\","
+                "thread-id=\"1\",displayhint=\"map\",dynamic=\"1\"}";
+    }
+    return line + "],has_more=\"0\"";
+}
+
+QByteArray stopRecord()
+{
+    return QByteArray("*stopped,reason=\"end-stepping-range\",frame={addr=\"0x0000000000400b2e\","
+        "func=\"main\",args=[{name=\"argc\",value=\"1\"},{name=\"argv\",value=\"0x7fffffffe0b8\"}],"
+        "file=\"debugee.cpp\",fullname=\"/home/user/debugee.cpp\",line=\"31\",arch=\"i386:x86-64\"},"
+        "thread-id=\"1\",stopped-threads=\"all\",core=\"3\"");
+}
+
+QByteArray consoleStream(int size)
+{
+    QByteArray line("~\"");
+    while (line.size() < size)
+        line += "$1 = std::vector of length 1000, capacity 1024 = {\\\"element\\\", \\\"\\\\t\\\"}\\n";
+    return line + '"';
+}
+
+void traces()
+{
+    QTest::addColumn<QByteArray>("trace");
+
+    QTest::newRow("stop") << stopRecord();
+    QTest::newRow("stack-list-frames-100") << stackListFrames(100);
+    QTest::newRow("stack-list-frames-5000") << stackListFrames(5000);
+    QTest::newRow("var-list-children-1000") << varListChildren(1000);
+    QTest::newRow("var-list-children-20000") << varListChildren(20000);
+    QTest::newRow("console-1M") << consoleStream(1024 * 1024);
+}
+
+}
+
+void BenchMIParser::benchParse_data()
+{
+    traces();
+}
+
+void BenchMIParser::benchParse()
+{
+    QFETCH(QByteArray, trace);
+
+    MIParser parser;
+    QBENCHMARK {
+        FileSymbol file;
+        file.contents = trace;
+        std::unique_ptr<Record> record(parser.parse(&file));
+        QVERIFY(record);
+    }
+}
+
+void BenchMIParser::benchParseAndRead_data()
+{
+    traces();
+}
+
+void BenchMIParser::benchParseAndRead()
+{
+    QFETCH(QByteArray, trace);
+
+    // Like the frame stack and variable controllers, only look at a few fields
+    MIParser parser;
+    QBENCHMARK {
+        FileSymbol file;
+        file.contents = trace;
+        std::unique_ptr<Record> record(parser.parse(&file));
+        QVERIFY(record);
+
+        if (record->kind == Record::Result) {
+            const auto& result = static_cast<const ResultRecord&>(*record);
+            if (result.hasField(QStringLiteral("stack"))) {
+                const Value& frames = result[QStringLiteral("stack")];
+                for (int i = 0; i < frames.size(); ++i)
+                    QVERIFY(!frames[i][QStringLiteral("func")].literal().isEmpty());
+            } else if (result.hasField(QStringLiteral("children"))) {
+                const Value& children = result[QStringLiteral("children")];
+                for (int i = 0; i < children.size(); ++i)
+                    QVERIFY(!children[i][QStringLiteral("exp")].literal().isEmpty());
+            }
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchMIParser)
@@ -103,6 +103,11 @@ void TestMIParser::testParseLine_data()
         << AsyncRecordData{KDevMI::MI::AsyncRecord::Exec, "breakpoint",
                            {{"nr", "3"}, {"address", "0x123"}, {"source", "a.c:123"}}}.toVariant();
 
+    QTest::newRow("escapedvalue")
+        << QByteArray("^done,value=\"\\\"quoted\\\" back\\\\slash\\tend\"")
+        << (int)KDevMI::MI::Record::Result
+        << ResultRecordData{0, "done", {{"value", "\"quoted\" back\\slash\tend"}}}.toVariant();
+
     // breakpoint creation records
     QTest::newRow("breakreply")
         << QByteArray("&\"break /path/to/some/file.cpp:28\\n\"")
@@ -1171,6 +1171,51 @@ void GdbTest::testVariablesLocalsStruct()
     WAIT_FOR_STATE(session, DebugSession::EndedState);
 }
 
+void GdbTest::testVariablesLocalsStructCollapsed()
+{
+    TestDebugSession *session = new TestDebugSession;
+    session->variableController()->setAutoUpdate(KDevelop::IVariableController::UpdateLocals);
+
+    TestLaunchConfiguration cfg;
+
+    breakpoints()->addCodeBreakpoint(QUrl::fromLocalFile(debugeeFileName), 38);
+    QVERIFY(session->startDebugging(&cfg, m_iface));
+    WAIT_FOR_STATE(session, DebugSession::PausedState);
+    QTest::qWait(1000);
+
+    QModelIndex i = variableCollection()->index(1, 0);
+    QCOMPARE(variableCollection()->rowCount(i), 4);
+
+    int structIndex = 0;
+    for(int j=0; j<3; ++j) {
+        if (variableCollection()->index(j, 0, i).data().toString() == QLatin1String("ts")) {
+            structIndex = j;
+        }
+    }
+
+    QModelIndex ts = variableCollection()->index(structIndex, 0, i);
+    variableCollection()->expanded(ts);
+    QTest::qWait(100);
+    COMPARE_DATA(variableCollection()->index(0, 0, ts), "a");
+    COMPARE_DATA(variableCollection()->index(0, 1, ts), "0");
+
+    // the children of a collapsed variable are frozen, stepping does not update them
+    variableCollection()->collapsed(ts);
+    session->stepInto();
+    WAIT_FOR_STATE(session, DebugSession::PausedState);
+    QTest::qWait(1000);
+    COMPARE_DATA(variableCollection()->index(0, 1, ts), "0");
+
+    // they are updated once they are shown again
+    variableCollection()->expanded(ts);
+    QTest::qWait(300);
+    COMPARE_DATA(variableCollection()->index(0, 0, ts), "a");
+    COMPARE_DATA(variableCollection()->index(0, 1, ts), "1");
+
+    session->run();
+    WAIT_FOR_STATE(session, DebugSession::EndedState);
+}
+
 void GdbTest::testVariablesWatches()
 {
     TestDebugSession *session = new TestDebugSession;
@@ -67,6 +67,7 @@ private Q_SLOTS:
     void testCoreFile();
     void testVariablesLocals();
     void testVariablesLocalsStruct();
+    void testVariablesLocalsStructCollapsed();
     void testVariablesWatches();
     void testVariablesWatchesQuotes();
     void testVariablesWatchesTwoSessions();
@@ -21,7 +21,10 @@
 #include <QFile>
 #include <QList>
 #include <QRegExp>
-#include <QTextStream>
+#include <QTextCodec>
+#include <QtConcurrentMap>
+
+#include <limits>
 
 #include <KEncodingProber>
 #include <KLocalizedString>
@@ -33,36 +36,138 @@
 using namespace KDevelop;
 
 
-GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re)
+namespace {
+
+/// Whether @p codec encodes ASCII text as plain bytes, so encoded text can be searched for in the raw file
+bool isAsciiCompatible(const QTextCodec* codec)
+{
+    const QByteArray name = codec->name();
+    return !name.startsWith("UTF-16") && !name.startsWith("UTF-32") && !name.startsWith("ISO-10646-UCS");
+}
+
+inline char toAsciiLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+inline char toAsciiUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+bool isAscii(const QString& text)
+{
+    for (const QChar c : text) {
+        if (c.unicode() >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Searches the raw file contents for @p needle, comparing ASCII letters case-insensitively if requested
+bool containsBytes(const char* data, int size, const QByteArray& needle, Qt::CaseSensitivity cs)
+{
+    if (cs == Qt::CaseSensitive) {
+        return QByteArray::fromRawData(data, size).indexOf(needle) != -1;
+    }
+
+    const int length = needle.size();
+    const char lower = toAsciiLower(needle.at(0));
+    const char upper = toAsciiUpper(needle.at(0));
+    const char* const last = data + size - length;
+    const char* nextLower = nullptr;
+    const char* nextUpper = nullptr;
+    for (const char* pos = data; pos <= last; ) {
+        if (!nextLower || nextLower < pos) {
+            nextLower = static_cast<const char*>(memchr(pos, lower, last - pos + 1));
+        }
+        if (upper != lower && (!nextUpper || nextUpper < pos)) {
+            nextUpper = static_cast<const char*>(memchr(pos, upper, last - pos + 1));
+        }
+        const char* candidate = (!nextUpper || (nextLower && nextLower < nextUpper)) ? nextLower : nextUpper;
+        if (!candidate) {
+            return false;
+        }
+        if (qstrnicmp(candidate, needle.constData(), length) == 0) {
+            return true;
+        }
+        pos = candidate + 1;
+    }
+    return false;
+}
+
+}
+
+GrepOutputItem::List grepFile(const QString &filename, const QRegExp &regExp, const QString &requiredText)
 {
     GrepOutputItem::List res;
     QFile file(filename);
 
     if(!file.open(QIODevice::ReadOnly))
         return res;
-    int lineno = 0;
 
+    const qint64 fileSize = file.size();
+    if (fileSize > std::numeric_limits<int>::max())
+        return res;
+
+    // search on the mapped file where possible, so the contents are not copied before we know they match
+    QByteArray contents;
+    const char* rawData = reinterpret_cast<const char*>(fileSize ? file.map(0, fileSize) : nullptr);
+    int size = static_cast<int>(fileSize);
+    if (!rawData) {
+        contents = file.readAll();
+        rawData = contents.constData();
+        size = contents.size();
+    }
 
     // detect encoding (unicode files can be feed forever, stops when confidence reachs 99%
     KEncodingProber prober;
-    while(!file.atEnd() && prober.state() == KEncodingProber::Probing && prober.confidence() < 0.99) {
-        prober.feed(file.read(0xFF));
+    for (int pos = 0; pos < size && prober.state() == KEncodingProber::Probing && prober.confidence() < 0.99; pos += 0xFF) {
+        prober.feed(QByteArray::fromRawData(rawData + pos, qMin(0xFF, size - pos)));
     }
 
-    // reads file with detected encoding
-    file.seek(0);
-    QTextStream stream(&file);
-    if(prober.confidence()>0.7)
-        stream.setCodec(prober.encoding().constData());
-    while( !stream.atEnd() )
-    {
-        QString data = stream.readLine();
+    QTextCodec* codec = nullptr;
+    if (prober.confidence() > 0.7)
+        codec = QTextCodec::codecForName(prober.encoding());
+    if (!codec)
+        codec = QTextCodec::codecForLocale();
+    // like QTextStream, prefer a byte order mark over the detected encoding
+    codec = QTextCodec::codecForUtfText(QByteArray::fromRawData(rawData, qMin(size, 4)), codec);
+
+    const Qt::CaseSensitivity cs = regExp.caseSensitivity();
+    // case-insensitive prefiltering is limited to ASCII, where byte-wise case folding is sufficient
+    const bool usePrefilter = !requiredText.isEmpty() && (cs == Qt::CaseSensitive || isAscii(requiredText));
+    if (usePrefilter && isAsciiCompatible(codec)
+        && !containsBytes(rawData, size, codec->fromUnicode(requiredText), cs)) {
+        return res;
+    }
+
+    const QString text = codec->toUnicode(rawData, size);
+    file.close();
+
+    // QRegExp stores the captures of the last match, so every thread needs its own copy
+    QRegExp re(regExp);
+    const IndexedString indexedFilename(filename);
 
-        // remove line terminators (in order to not match them)
-        for (int pos = data.length()-1; pos >= 0 && (data[pos] == QLatin1Char('\r') || data[pos] == QLatin1Char('\n')); pos--) {
-            data.chop(1);
+    int lineno = 0;
+    for (int lineStart = 0; lineStart < text.size(); ++lineno) {
+        // like QTextStream::readLine(), lines end with "\n", "\r\n" or a lone "\r"
+        int lineEnd = lineStart;
+        while (lineEnd < text.size() && text[lineEnd] != QLatin1Char('\n') && text[lineEnd] != QLatin1Char('\r'))
+            ++lineEnd;
+        int nextLineStart = lineEnd + 1;
+        if (lineEnd + 1 < text.size() && text[lineEnd] == QLatin1Char('\r') && text[lineEnd + 1] == QLatin1Char('\n'))
+            ++nextLineStart;
+
+        if (usePrefilter && !text.midRef(lineStart, lineEnd - lineStart).contains(requiredText, cs)) {
+            lineStart = nextLineStart;
+            continue;
         }
 
+        const QString data = text.mid(lineStart, lineEnd - lineStart);
+        lineStart = nextLineStart;
+
         int offset = 0;
         // allow empty string matching result in an infinite loop !
         while( re.indexIn(data, offset)!=-1 && re.cap(0).length() > 0 )
@@ -71,23 +176,53 @@ GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re)
             int end = start + re.cap(0).length();
 
             DocumentChangePointer change = DocumentChangePointer(new DocumentChange(
-                IndexedString(filename),
+                indexedFilename,
                 KTextEditor::Range(lineno, start, lineno, end),
                 re.cap(0), QString()));
 
             res << GrepOutputItem(change, data, false);
             offset = end;
         }
-        lineno++;
     }
-    file.close();
     return res;
 }
 
+namespace {
+
+struct GrepFileFunctor
+{
+    typedef GrepFileMatches result_type;
+
+    GrepFileMatches operator()(const QUrl& url) const
+    {
+        const QString filename = url.toLocalFile();
+        return {filename, grepFile(filename, regExp, requiredText)};
+    }
+
+    QRegExp regExp;
+    QString requiredText;
+};
+
+/// Whether matches of @p searchTemplate with %s substituted are guaranteed to contain the substituted text
+bool templateRequiresPattern(const QString& searchTemplate)
+{
+    if (!searchTemplate.contains(QLatin1String("%s")))
+        return false;
+    for (const QChar c : searchTemplate) {
+        if (c == QLatin1Char('|') || c == QLatin1Char('?') || c == QLatin1Char('*')
+            || c == QLatin1Char('{') || c == QLatin1Char('['))
+            return false;
+    }
+    return true;
+}
+
+}
+
 GrepJob::GrepJob( QObject* parent )
     : KJob( parent )
     , m_workState(WorkIdle)
     , m_fileIndex(0)
+    , m_nextMatches(0)
     , m_findSomething(false)
 {
     qRegisterMetaType<GrepOutputItem::List>();
@@ -96,6 +231,12 @@ GrepJob::GrepJob( QObject* parent )
     KDevelop::ICore::self()->uiController()->registerStatus(this);
 
     connect(this, &GrepJob::result, this, &GrepJob::testFinishState);
+    connect(&m_grepWatcher, &QFutureWatcher<GrepFileMatches>::resultsReadyAt, this, &GrepJob::slotMatchesReady);
+    connect(&m_grepWatcher, &QFutureWatcher<GrepFileMatches>::progressValueChanged, this, [this](int value) {
+        m_fileIndex = value;
+        emit showProgress(this, 0, m_fileList.length(), m_fileIndex);
+    });
+    connect(&m_grepWatcher, &QFutureWatcher<GrepFileMatches>::finished, this, &GrepJob::slotGrepFinished);
 }
 
 QString GrepJob::statusName() const
@@ -130,6 +271,13 @@ void GrepJob::slotFindFinished()
         return;
     }
 
+    m_requiredText.clear();
+    if(templateRequiresPattern(m_settings.searchTemplate)
+        && (!m_settings.regexp || m_settings.pattern == QRegExp::escape(m_settings.pattern)))
+    {
+        m_requiredText = m_settings.pattern;
+    }
+
     if(!m_settings.regexp)
     {
         m_settings.pattern = QRegExp::escape(m_settings.pattern);
@@ -188,31 +336,10 @@ void GrepJob::slotWork()
             m_findThread->start();
             break;
         case WorkGrep:
-            if(m_fileIndex < m_fileList.length())
-            {
-                emit showProgress(this, 0, m_fileList.length(), m_fileIndex);
-                if(m_fileIndex < m_fileList.length()) {
-                    QString file = m_fileList[m_fileIndex].toLocalFile();
-                    GrepOutputItem::List items = grepFile(file, m_regExp);
-
-                    if(!items.isEmpty())
-                    {
-                        m_findSomething = true;
-                        emit foundMatches(file, items);
-                    }
-
-                    m_fileIndex++;
-                }
-                QMetaObject::invokeMethod(this, "slotWork", Qt::QueuedConnection);
-            }
-            else
-            {
-                emit hideProgress(this);
-                emit clearMessage(this);
-                m_workState = WorkIdle;
-                //model()->slotCompleted();
-                emitResult();
-            }
+            // the files are searched on the global thread pool, results arrive through m_grepWatcher
+            emit showProgress(this, 0, m_fileList.length(), m_fileIndex);
+            m_nextMatches = 0;
+            m_grepWatcher.setFuture(QtConcurrent::mapped(m_fileList, GrepFileFunctor{m_regExp, m_requiredText}));
             break;
         case WorkCancelled:
             emit hideProgress(this);
@@ -223,6 +350,30 @@ void GrepJob::slotWork()
     }
 }
 
+void GrepJob::slotMatchesReady(int /*begin*/, int /*end*/)
+{
+    // the searches finish in any order, forward the results in the order of the files
+    const QFuture<GrepFileMatches> future = m_grepWatcher.future();
+    for (; m_workState == WorkGrep && m_nextMatches < m_fileList.size() && future.isResultReadyAt(m_nextMatches); ++m_nextMatches) {
+        const GrepFileMatches matches = future.resultAt(m_nextMatches);
+        if (!matches.items.isEmpty()) {
+            m_findSomething = true;
+            emit foundMatches(matches.filename, matches.items);
+        }
+    }
+}
+
+void GrepJob::slotGrepFinished()
+{
+    slotMatchesReady(0, 0);
+
+    emit hideProgress(this);
+    emit clearMessage(this);
+    m_workState = WorkIdle;
+    //model()->slotCompleted();
+    emitResult();
+}
+
 void GrepJob::start()
 {
     if(m_workState!=WorkIdle)
@@ -252,6 +403,14 @@ bool GrepJob::doKill()
     else
     {
         m_workState = WorkCancelled;
+        if (m_grepWatcher.isRunning()) {
+            // the searches already running end on their own, but must not report to this job anymore
+            disconnect(&m_grepWatcher, nullptr, this, nullptr);
+            m_grepWatcher.cancel();
+            emit hideProgress(this);
+            emit clearMessage(this);
+            emit showErrorMessage(i18n("Search aborted"), 5000);
+        }
     }
     return true;
 }
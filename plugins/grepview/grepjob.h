@@ -16,6 +16,7 @@
 #ifndef KDEVPLATFORM_PLUGIN_GREPJOB_H
 #define KDEVPLATFORM_PLUGIN_GREPJOB_H
 
+#include <QFutureWatcher>
 #include <QPointer>
 #include <QUrl>
 
@@ -55,6 +56,12 @@ struct GrepJobSettings
 
 Q_DECLARE_TYPEINFO(GrepJobSettings, Q_MOVABLE_TYPE);
 
+struct GrepFileMatches
+{
+    QString filename;
+    GrepOutputItem::List items;
+};
+
 
 class GrepJob : public KJob, public KDevelop::IStatus
 {
@@ -85,6 +92,8 @@ protected:
 
 private Q_SLOTS:
     void slotFindFinished();
+    void slotMatchesReady(int begin, int end);
+    void slotGrepFinished();
     void testFinishState(KJob *job);
 
 Q_SIGNALS:
@@ -103,6 +112,8 @@ private:
 
     QRegExp m_regExp;
     QString m_regExpSimple;
+    /// Text every match must contain, used to skip files and lines before running m_regExp. May be empty
+    QString m_requiredText;
     GrepOutputModel *m_outputModel;
 
     enum {
@@ -114,7 +125,10 @@ private:
 
     QList<QUrl> m_fileList;
     int m_fileIndex;
+    /// Index of the next file whose matches are forwarded
+    int m_nextMatches;
     QPointer<GrepFindFilesThread> m_findThread;
+    QFutureWatcher<GrepFileMatches> m_grepWatcher;
 
     GrepJobSettings m_settings;
 
@@ -123,6 +137,8 @@ private:
 
 //FIXME: this function is used externally only for tests, find a way to keep it
 //       static for a regular compilation
-GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re);
+/// @param requiredText If not empty, a text that every match of @p re contains. Files and lines
+///                     without it are skipped without running the regular expression.
+GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re, const QString &requiredText = QString());
 
 #endif
@@ -14,6 +14,10 @@
 
 #include <QTest>
 #include <QRegExp>
+#include <QSemaphore>
+#include <QSignalSpy>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 #include <QTemporaryFile>
 #include <QTemporaryDir>
@@ -59,6 +63,8 @@ void FindReplaceTest::testFind_data()
                            << (MatchList() << Match(0, 0, 6) << Match(1, 0, 6));
     QTest::newRow("Matching EOL (Windows style)") << "foobar\r\nfoobar" << QRegExp("foo.*")
                            << (MatchList() << Match(0, 0, 6) << Match(1, 0, 6));
+    QTest::newRow("Matching EOL (Mac style)") << "foobar\rfoobar" << QRegExp("foo.*")
+                           << (MatchList() << Match(0, 0, 6) << Match(1, 0, 6));
     QTest::newRow("Empty lines handling") << "foo\n\n\n" << QRegExp("bar")
                            << (MatchList());
     QTest::newRow("Can match empty string (at EOL)") << "foobar\n" << QRegExp(".*")
@@ -89,6 +95,13 @@ void FindReplaceTest::testFind()
         QCOMPARE(actualMatches[i].change()->m_range.end().column(),   matches[i].end);
     }
 
+    // prefiltering by the literal pattern must not change the result
+    if (!search.pattern().isEmpty() && search.pattern() == QRegExp::escape(search.pattern())) {
+        GrepOutputItem::List prefilteredMatches = grepFile(file.fileName(), search, search.pattern());
+        QCOMPARE(prefilteredMatches.length(), matches.length());
+        QVERIFY(grepFile(file.fileName(), search, QStringLiteral("notInTheFile")).isEmpty());
+    }
+
     // check that file has not been altered by grepFile
     QVERIFY(file.open());
     QCOMPARE(QString(file.readAll()), subject);
@@ -197,5 +210,103 @@ void FindReplaceTest::testReplace()
     tempDir.remove();
 }
 
+static GrepJob* createFindJob(QObject* parent, const QString& path, const QString& pattern)
+{
+    GrepJob *job = new GrepJob(parent);
+    GrepOutputModel *model = new GrepOutputModel(job);
+    GrepJobSettings settings;
+
+    job->setOutputModel(model);
+    job->setDirectoryChoice(QList<QUrl>() << QUrl::fromLocalFile(path));
+
+    settings.projectFilesOnly = false;
+    settings.caseSensitive = true;
+    settings.regexp = false;
+    settings.depth = -1; // fully recursive
+    settings.pattern = pattern;
+    settings.searchTemplate = QStringLiteral("%s");
+    settings.files = QStringLiteral("*");
+
+    job->setSettings(settings);
+    return job;
+}
+
+void FindReplaceTest::testResultOrder()
+{
+    QTemporaryDir tempDir;
+    QDir dir(tempDir.path());
+
+    // files of very different sizes, so that their searches finish out of order
+    for (int i = 0; i < 64; ++i) {
+        QFile file(dir.filePath(QStringLiteral("file%1").arg(i)));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        const QByteArray line = "foo bar\n";
+        QVERIFY(file.write(line.repeated((i % 8) ? 1 : 20000)) != -1);
+        file.close();
+    }
+
+    GrepJob *job = createFindJob(this, dir.path(), QStringLiteral("foo"));
+    job->setAutoDelete(false);
+    QStringList reported;
+    connect(job, &GrepJob::foundMatches, this, [&reported](const QString& filename) {
+        reported << filename;
+    });
+
+    QVERIFY(job->exec());
+
+    QStringList searched;
+    const QList<QUrl> files = job->m_fileList;
+    for (const QUrl& url : files) {
+        searched << url.toLocalFile();
+    }
+    QCOMPARE(reported, searched);
+    delete job;
+}
+
+void FindReplaceTest::testKill()
+{
+    QTemporaryDir tempDir;
+    QDir dir(tempDir.path());
+
+    for (int i = 0; i < 20; ++i) {
+        QFile file(dir.filePath(QStringLiteral("file%1").arg(i)));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QVERIFY(file.write(QByteArray("foo bar\n").repeated(100)) != -1);
+        file.close();
+    }
+
+    // occupy the global thread pool, so the searches of the job cannot finish before it is killed
+    QThreadPool* pool = QThreadPool::globalInstance();
+    QSemaphore blocker;
+    QList<QFuture<void>> blockingTasks;
+    for (int i = 0; i < pool->maxThreadCount(); ++i) {
+        blockingTasks << QtConcurrent::run(pool, [&blocker] { blocker.acquire(); });
+    }
+
+    GrepJob *job = createFindJob(this, dir.path(), QStringLiteral("foo"));
+    job->setAutoDelete(false);
+    QSignalSpy resultSpy(job, &KJob::result);
+
+    job->start();
+    QTRY_VERIFY(job->m_grepWatcher.isRunning());
+    const QFuture<GrepFileMatches> searches = job->m_grepWatcher.future();
+
+    // killing must not wait for the searches that are still running
+    QVERIFY(job->kill(KJob::EmitResult));
+    QCOMPARE(resultSpy.count(), 1);
+    QVERIFY(job->error() == KJob::KilledJobError);
+
+    // nothing is reported after the job was killed
+    QSignalSpy matchesSpy(job, &GrepJob::foundMatches);
+    blocker.release(blockingTasks.size());
+    for (QFuture<void>& task : blockingTasks) {
+        task.waitForFinished();
+    }
+    searches.waitForFinished();
+    QTest::qWait(100);
+    QCOMPARE(matchesSpy.count(), 0);
+    QCOMPARE(resultSpy.count(), 1);
+    delete job;
+}
 
 QTEST_MAIN(FindReplaceTest)
@@ -53,6 +53,9 @@ private Q_SLOTS:
 
     void testReplace();
     void testReplace_data();
+
+    void testResultOrder();
+    void testKill();
 };
 
 Q_DECLARE_METATYPE(FindReplaceTest::MatchList)
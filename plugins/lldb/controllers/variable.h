@@ -53,6 +53,8 @@ public:
 protected:
     void formatChanged() override;
     QString formatValue(const QString &value) const override;
+    // lldb-mi does not implement -var-set-frozen
+    bool canFreezeChildren() const override { return false; }
 };
 
 } // end of namespace LLDB
@@ -24,15 +24,83 @@
 #include <interfaces/iproject.h>
 
 #include <QFile>
+#include <QVarLengthArray>
+
+#include <algorithm>
 
 using namespace KDevelop;
 
+namespace {
+
+bool isPlainGlob(const QString& pattern)
+{
+    for (const QChar c : pattern) {
+        if (c == QLatin1Char('?') || c == QLatin1Char('[') || c == QLatin1Char('\\')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Equivalent to QRegExp::exactMatch for a wildcard pattern that only contains '*',
+ * split at the wildcards into @p parts.
+ */
+bool matchesGlob(const QStringList& parts, const QString& text)
+{
+    if (parts.size() == 1) {
+        return text == parts.first();
+    }
+
+    const QString& head = parts.first();
+    const QString& tail = parts.last();
+    if (text.size() < head.size() + tail.size() || !text.startsWith(head) || !text.endsWith(tail)) {
+        return false;
+    }
+
+    int pos = head.size();
+    const int end = text.size() - tail.size();
+    for (int i = 1, c = parts.size() - 1; i < c; ++i) {
+        const QString& part = parts.at(i);
+        if (part.isEmpty()) {
+            continue;
+        }
+        pos = text.indexOf(part, pos);
+        if (pos == -1 || pos + part.size() > end) {
+            return false;
+        }
+        pos += part.size();
+    }
+    return true;
+}
+
+}
+
 ProjectFilter::ProjectFilter( const IProject* const project, const QVector<Filter>& filters )
     : m_filters( filters )
     , m_projectFile( project->projectFile() )
     , m_project( project->path() )
 {
-
+    m_patterns.reserve(m_filters.size());
+    for (int i = 0; i < m_filters.size(); ++i) {
+        const QString pattern = m_filters.at(i).pattern.pattern();
+        CompiledPattern compiled;
+        if (isPlainGlob(pattern)) {
+            compiled.parts = pattern.split(QLatin1Char('*'));
+            const QString& tail = compiled.parts.last();
+            if (!tail.isEmpty()) {
+                compiled.indexed = true;
+                m_suffixIndex.insert(qHash(tail), i);
+                if (!m_suffixLengths.contains(tail.size())) {
+                    m_suffixLengths.append(tail.size());
+                }
+            }
+        } else {
+            compiled.useRegExp = true;
+        }
+        m_patterns.append(compiled);
+    }
+    std::sort(m_suffixLengths.begin(), m_suffixLengths.end());
 }
 
 ProjectFilter::~ProjectFilter()
@@ -66,15 +134,35 @@ bool ProjectFilter::isValid( const Path &path, const bool isFolder ) const
         return false;
     }
 
+    // look up all patterns ending on a literal in one pass over the possible suffixes of the path,
+    // so that only the remaining patterns need to be matched one by one below
+    QVarLengthArray<bool, 64> suffixMatches(m_filters.size());
+    std::fill(suffixMatches.begin(), suffixMatches.end(), false);
+    for (const int length : m_suffixLengths) {
+        if (length > relativePath.size()) {
+            break;
+        }
+        const QStringRef suffix = relativePath.rightRef(length);
+        const uint hash = qHash(suffix);
+        for (auto it = m_suffixIndex.constFind(hash); it != m_suffixIndex.constEnd() && it.key() == hash; ++it) {
+            const int i = it.value();
+            const QStringList& parts = m_patterns.at(i).parts;
+            if (parts.last() == suffix && matchesGlob(parts, relativePath)) {
+                suffixMatches[i] = true;
+            }
+        }
+    }
+
     bool isValid = true;
-    foreach( const Filter& filter, m_filters ) {
+    for (int i = 0; i < m_filters.size(); ++i) {
+        const Filter& filter = m_filters.at(i);
         if (isFolder && !(filter.targets & Filter::Folders)) {
             continue;
         } else if (!isFolder && !(filter.targets & Filter::Files)) {
             continue;
         }
         if ((!isValid && filter.type == Filter::Inclusive) || (isValid && filter.type == Filter::Exclusive)) {
-            const bool match = filter.pattern.exactMatch( relativePath );
+            const bool match = m_patterns.at(i).indexed ? suffixMatches[i] : matches(i, relativePath);
             if (filter.type == Filter::Inclusive) {
                 isValid = match;
             } else {
@@ -93,3 +181,12 @@ QString ProjectFilter::makeRelative(const Path& path) const
 
     return QLatin1Char('/') + m_project.relativePath(path);
 }
+
+bool ProjectFilter::matches(int filter, const QString& relativePath) const
+{
+    const CompiledPattern& pattern = m_patterns.at(filter);
+    if (pattern.useRegExp) {
+        return m_filters.at(filter).pattern.exactMatch(relativePath);
+    }
+    return matchesGlob(pattern.parts, relativePath);
+}
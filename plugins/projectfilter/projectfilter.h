@@ -25,6 +25,9 @@
 #include <project/interfaces/iprojectfilter.h>
 #include <util/path.h>
 
+#include <QMultiHash>
+#include <QStringList>
+
 #include "filter.h"
 
 namespace KDevelop {
@@ -41,8 +44,28 @@ public:
 
 private:
     QString makeRelative(const Path& path) const;
+    bool matches(int filter, const QString& relativePath) const;
+
+    /**
+     * A filter pattern in a form that can be matched without QRegExp.
+     *
+     * Patterns which only use the '*' wildcard are split into their literal parts,
+     * everything else ('?', character sets, escapes) falls back to QRegExp.
+     */
+    struct CompiledPattern
+    {
+        QStringList parts;
+        /// whether the pattern ends on a literal and thus is matched through m_suffixIndex
+        bool indexed = false;
+        bool useRegExp = false;
+    };
 
     Filters m_filters;
+    QVector<CompiledPattern> m_patterns;
+    /// index of all literal patterns and '*' patterns ending on a literal, keyed by the hash of that trailing literal
+    QMultiHash<uint, int> m_suffixIndex;
+    /// the distinct lengths of the keys in m_suffixIndex
+    QVector<int> m_suffixLengths;
     Path m_projectFile;
     Path m_project;
 };
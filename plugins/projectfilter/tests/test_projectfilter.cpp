@@ -336,6 +336,44 @@ void TestProjectFilter::match_data()
         };
         ADD_TESTS("escaping", project, filter, tests);
     }
+    {
+        // globs with multiple wildcards, and patterns which need a regular expression
+        const TestProject project;
+        const Filters filters = Filters()
+            << Filter(SerializedFilter(QStringLiteral("*.o"), Filter::Files))
+            << Filter(SerializedFilter(QStringLiteral("moc_*.cpp"), Filter::Files))
+            << Filter(SerializedFilter(QStringLiteral("*/tmp*/*.log"), Filter::Files))
+            << Filter(SerializedFilter(QStringLiteral("core.[0-9]*"), Filter::Files))
+            << Filter(SerializedFilter(QStringLiteral("?.bak"), Filter::Files))
+            << Filter(SerializedFilter(QStringLiteral("keep.o"), Filter::Files, Filter::Inclusive));
+        TestFilter filter(new ProjectFilter(&project, filters));
+
+        QTest::newRow("projectRoot") << filter << project.path() << Folder << Valid;
+        QTest::newRow("project.kdev4") << filter << project.projectFile() << File << Invalid;
+
+        MatchTest tests[] = {
+            //{path, isFolder, isValid}
+            {QStringLiteral(".kdev4"), Folder, Invalid},
+
+            {QStringLiteral("file.o"), File, Invalid},
+            {QStringLiteral("file.o"), Folder, Valid},
+            {QStringLiteral("keep.o"), File, Valid},
+            {QStringLiteral("folder/keep.o"), File, Valid},
+            {QStringLiteral("file.od"), File, Valid},
+            {QStringLiteral("moc_file.cpp"), File, Invalid},
+            {QStringLiteral("folder/moc_file.cpp"), File, Invalid},
+            {QStringLiteral("folder/moc_.cpp"), File, Invalid},
+            {QStringLiteral("moc.cpp"), File, Valid},
+            {QStringLiteral("tmp/a.log"), File, Invalid},
+            {QStringLiteral("foo/tmp1/bar/a.log"), File, Invalid},
+            {QStringLiteral("foo/tm/a.log"), File, Valid},
+            {QStringLiteral("core.1234"), File, Invalid},
+            {QStringLiteral("core.dump"), File, Valid},
+            {QStringLiteral("a.bak"), File, Invalid},
+            {QStringLiteral("ab.bak"), File, Valid}
+        };
+        ADD_TESTS("globs", project, filter, tests);
+    }
 }
 
 static QVector<BenchData> createBenchData(const Path& base, int folderDepth, int foldersPerFolder, int filesPerFolder)
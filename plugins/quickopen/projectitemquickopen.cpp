@@ -38,6 +38,10 @@
 
 #include <KLocalizedString>
 
+#include <qtcompat_p.h>
+
+#include <algorithm>
+
 using namespace KDevelop;
 
 namespace {
@@ -119,6 +123,18 @@ Path findProjectForForPath(const IndexedString& path)
     const auto item = model->itemForPath(path);
     return item ? item->project()->path() : Path();
 }
+uint codeModelKinds(ProjectItemDataProvider::ItemTypes types)
+{
+    uint kinds = 0;
+    if (types & ProjectItemDataProvider::Classes) {
+        kinds |= CodeModelItem::Class;
+    }
+    if (types & ProjectItemDataProvider::Functions) {
+        kinds |= CodeModelItem::Function;
+    }
+    return kinds;
+}
+
 uint addedItems(const AddedItems& items)
 {
     uint add = 0;
@@ -133,6 +149,7 @@ uint addedItems(const AddedItems& items)
 ProjectItemDataProvider::ProjectItemDataProvider(KDevelop::IQuickOpen* quickopen)
     : m_itemTypes(NoItems)
     , m_quickopen(quickopen)
+    , m_itemOffsets([this]() { return itemOffsets(); })
     , m_addedItemsCountCache([this]() { return addedItems(m_addedItems); })
 {
 }
@@ -154,7 +171,8 @@ void ProjectItemDataProvider::setFilterText(const QString& text)
     }
 
     if (text.isEmpty() || search.isEmpty()) {
-        m_filteredItems = m_currentItems;
+        m_currentFilter.clear();
+        m_filteredItems.clear();
         return;
     }
 
@@ -163,22 +181,56 @@ void ProjectItemDataProvider::setFilterText(const QString& text)
         cache.append(SubstringCache(searchPart));
     }
 
-    if (!text.startsWith(m_currentFilter)) {
-        m_filteredItems = m_currentItems;
+    QVector<CodeModelViewItem> candidates;
+    QHash<int, int> qualities;
+    if (text.endsWith(QLatin1Char(':'))) {
+        //Listing the members of a scope: the typed names may match any part of the identifiers
+        if (!m_currentFilter.isEmpty() && text.startsWith(m_currentFilter)) {
+            candidates = m_filteredItems;
+        } else {
+            //Only the files declaring a class or namespace of the innermost typed name are searched for its members
+            QSet<IndexedString> scopeFiles;
+            const QVector<CodeModelMatch> scopes = CodeModel::self().search(search.back(), CodeModelItem::Class | CodeModelItem::Namespace);
+            for (const CodeModelMatch& scope : scopes) {
+                if (m_files.contains(scope.file)) {
+                    scopeFiles.insert(scope.file);
+                }
+            }
+            for (const IndexedString& file : qAsConst(scopeFiles)) {
+                candidates += fileItems(file);
+            }
+        }
+    } else {
+        //The name index delivers the items whose own name matches, best matches first
+        const QVector<CodeModelMatch> matches = CodeModel::self().search(search.back(), codeModelKinds(m_itemTypes));
+        for (const CodeModelMatch& match : matches) {
+            if (match.kind & CodeModelItem::ForwardDeclaration || !m_files.contains(match.file)) {
+                continue;
+            }
+            const QualifiedIdentifier id = match.id.identifier();
+            if (id.isEmpty() || id.at(0).identifier().isEmpty()) {
+                continue;
+            }
+            candidates << CodeModelViewItem(match.file, id);
+            if (!qualities.contains(id.index())) {
+                qualities[id.index()] = match.quality;
+            }
+        }
     }
 
     m_currentFilter = text;
 
-    const QVector<CodeModelViewItem> oldFiltered = m_filteredItems;
+    //Ranks the match quality above the distances computed below
+    const int qualityWeight = 1 << 24;
     QHash<int, int> heights;
 
     m_filteredItems.clear();
 
-    for (const CodeModelViewItem& item : oldFiltered) {
+    for (const CodeModelViewItem& item : qAsConst(candidates)) {
         const QualifiedIdentifier& currentId = item.m_id;
 
         int last_pos = currentId.count() - 1;
-        int current_height = 0;
+        int current_height = qualities.value(currentId.index()) * qualityWeight;
         int distance = 0;
 
         //iter over each search item from last to first
@@ -211,6 +263,23 @@ void ProjectItemDataProvider::setFilterText(const QString& text)
     std::sort(m_filteredItems.begin(), m_filteredItems.end(), ClosestMatchToText(heights));
 }
 
+CodeModelViewItem ProjectItemDataProvider::unfilteredItem(uint pos) const
+{
+    const QVector<uint> offsets = m_itemOffsets.cachedResult();
+    //The file after the last one starting at or before pos
+    const auto next = std::upper_bound(offsets.constBegin(), offsets.constEnd(), pos);
+    if (next == offsets.constBegin() || next == offsets.constEnd()) {
+        return CodeModelViewItem();
+    }
+
+    const int fileIndex = next - offsets.constBegin() - 1;
+    if (fileIndex != m_pageFile) {
+        m_page = fileItems(m_fileList[fileIndex]);
+        m_pageFile = fileIndex;
+    }
+    const uint offsetInFile = pos - offsets[fileIndex];
+    return offsetInFile < ( uint )m_page.size() ? m_page[offsetInFile] : CodeModelViewItem();
+}
 
 KDevelop::QuickOpenDataPointer ProjectItemDataProvider::data(uint pos) const
 {
@@ -228,12 +297,16 @@ KDevelop::QuickOpenDataPointer ProjectItemDataProvider::data(uint pos) const
     }
 
     const uint a = pos - filteredItemOffset;
-    if (a > ( uint )m_filteredItems.size()) {
+    CodeModelViewItem filteredItem;
+    if (m_currentFilter.isEmpty()) {
+        filteredItem = unfilteredItem(a);
+    } else if (a < ( uint )m_filteredItems.size()) {
+        filteredItem = m_filteredItems[a];
+    }
+    if (filteredItem.m_file.isEmpty()) {
         return KDevelop::QuickOpenDataPointer();
     }
 
-    const auto& filteredItem = m_filteredItems[a];
-
     QList<KDevelop::QuickOpenDataPointer> ret;
     KDevelop::DUChainReadLocker lock(DUChain::lock());
     TopDUContext* ctx = DUChainUtils::standardContextForUrl(filteredItem.m_file.toUrl());
@@ -304,50 +377,73 @@ KDevelop::QuickOpenDataPointer ProjectItemDataProvider::data(uint pos) const
 void ProjectItemDataProvider::reset()
 {
     m_files = m_quickopen->fileSet();
-    m_currentItems.clear();
+    m_fileList = m_files.toList().toVector();
+    m_itemOffsets.markDirty();
+    m_page.clear();
+    m_pageFile = -1;
     m_addedItems.clear();
     m_addedItemsCountCache.markDirty();
 
+    m_filteredItems.clear();
+    m_currentFilter.clear();
+}
+
+QVector<CodeModelViewItem> ProjectItemDataProvider::fileItems(const IndexedString& file) const
+{
+    QVector<CodeModelViewItem> ret;
+
     KDevelop::DUChainReadLocker lock(DUChain::lock());
-    foreach (const IndexedString& u, m_files) {
-        uint count;
-        const KDevelop::CodeModelItem* items;
-        CodeModel::self().items(u, count, items);
+    uint count;
+    const KDevelop::CodeModelItem* items;
+    CodeModel::self().items(file, count, items);
 
-        for (uint a = 0; a < count; ++a) {
-            if (!items[a].id.isValid() || items[a].kind & CodeModelItem::ForwardDeclaration) {
+    for (uint a = 0; a < count; ++a) {
+        if (!items[a].id.isValid() || items[a].kind & CodeModelItem::ForwardDeclaration) {
+            continue;
+        }
+        if (((m_itemTypes & Classes) && (items[a].kind & CodeModelItem::Class)) ||
+            ((m_itemTypes & Functions) && (items[a].kind & CodeModelItem::Function))) {
+            QualifiedIdentifier id = items[a].id.identifier();
+
+            if (id.isEmpty() || id.at(0).identifier().isEmpty()) {
+                // id.isEmpty() not always hit when .toString() is actually empty...
+                // anyhow, this makes sure that we don't show duchain items without
+                // any name that could be searched for. This happens e.g. in the c++
+                // plugin for anonymous structs or sometimes for declarations in macro
+                // expressions
                 continue;
             }
-            if (((m_itemTypes & Classes) && (items[a].kind & CodeModelItem::Class)) ||
-                ((m_itemTypes & Functions) && (items[a].kind & CodeModelItem::Function))) {
-                QualifiedIdentifier id = items[a].id.identifier();
-
-                if (id.isEmpty() || id.at(0).identifier().isEmpty()) {
-                    // id.isEmpty() not always hit when .toString() is actually empty...
-                    // anyhow, this makes sure that we don't show duchain items without
-                    // any name that could be searched for. This happens e.g. in the c++
-                    // plugin for anonymous structs or sometimes for declarations in macro
-                    // expressions
-                    continue;
-                }
-                m_currentItems << CodeModelViewItem(u, id);
-            }
+            ret << CodeModelViewItem(file, id);
         }
     }
-
-    m_filteredItems = m_currentItems;
-    m_currentFilter.clear();
+    return ret;
 }
 
+QVector<uint> ProjectItemDataProvider::itemOffsets() const
+{
+    //The code model counts the items the same way fileItems() filters them
+    const uint kinds = codeModelKinds(m_itemTypes);
+
+    QVector<uint> ret;
+    ret.reserve(m_fileList.size() + 1);
+    uint total = 0;
+    for (const IndexedString& file : m_fileList) {
+        ret << total;
+        total += CodeModel::self().itemCount(file, kinds);
+    }
+    ret << total;
+    return ret;
+}
 
 uint ProjectItemDataProvider::itemCount() const
 {
-    return m_filteredItems.count() + m_addedItemsCountCache.cachedResult();
+    const uint count = m_currentFilter.isEmpty() ? m_itemOffsets.cachedResult().last() : m_filteredItems.count();
+    return count + m_addedItemsCountCache.cachedResult();
 }
 
 uint ProjectItemDataProvider::unfilteredItemCount() const
 {
-    return m_currentItems.count() + m_addedItemsCountCache.cachedResult();
+    return m_itemOffsets.cachedResult().last() + m_addedItemsCountCache.cachedResult();
 }
 
 QStringList ProjectItemDataProvider::supportedItemTypes()
@@ -361,6 +457,10 @@ QStringList ProjectItemDataProvider::supportedItemTypes()
 
 void ProjectItemDataProvider::enableData(const QStringList& items, const QStringList& scopes)
 {
+    m_itemOffsets.markDirty();
+    m_page.clear();
+    m_pageFile = -1;
+
     //FIXME: property support different scopes
     if (scopes.contains(i18n("Project"))) {
         m_itemTypes = NoItems;
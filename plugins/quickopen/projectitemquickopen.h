@@ -106,10 +106,22 @@ public:
 private:
     KDevelop::QuickOpenDataPointer data(uint pos) const override;
 
+    /// The shown items of @p file
+    QVector<CodeModelViewItem> fileItems(const KDevelop::IndexedString& file) const;
+    /// For each file of m_fileList the position of its first item when listing everything, followed by the total
+    QVector<uint> itemOffsets() const;
+    /// The item at @p pos when listing everything, loading the items of one file at a time
+    CodeModelViewItem unfilteredItem(uint pos) const;
+
     ItemTypes m_itemTypes;
     KDevelop::IQuickOpen* m_quickopen;
     QSet<KDevelop::IndexedString> m_files;
-    QVector<CodeModelViewItem> m_currentItems;
+    /// m_files in the order they are listed when nothing is typed
+    QVector<KDevelop::IndexedString> m_fileList;
+    ResultCache<QVector<uint>> m_itemOffsets;
+    /// The items of the file at m_pageFile in m_fileList, the last one needed while listing everything
+    mutable QVector<CodeModelViewItem> m_page;
+    mutable int m_pageFile = -1;
     QString m_currentFilter;
     QVector<CodeModelViewItem> m_filteredItems;
 
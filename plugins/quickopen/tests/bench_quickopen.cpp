@@ -158,3 +158,38 @@ void BenchQuickOpen::benchProjectFileFilter_providerDataIcon_data()
 {
     getData();
 }
+
+void BenchQuickOpen::benchPathFilter_setFilter()
+{
+    QFETCH(int, files);
+    QFETCH(QString, filter);
+
+    QVector<QString> paths;
+    paths.reserve(files);
+    for (int i = 0; i < files; ++i) {
+        paths << QStringLiteral("/home/user/project/module%1/src/sub%2/file%3.cpp").arg(i % 97).arg(i % 13).arg(i);
+    }
+
+    PathTestFilter filterer;
+    filterer.setItems(paths);
+
+    // simulate typing the filter one keystroke at a time, so that the incremental
+    // path (refining the previous result) is measured as well as the initial one
+    QBENCHMARK {
+        for (int i = 1; i <= filter.size(); ++i) {
+            filterer.setFilter(filter.left(i).split(QLatin1Char('/'), QString::SkipEmptyParts));
+        }
+        filterer.clearFilter();
+    }
+}
+
+void BenchQuickOpen::benchPathFilter_setFilter_data()
+{
+    QTest::addColumn<int>("files");
+    QTest::addColumn<QString>("filter");
+
+    QTest::newRow("010000-file12") << 10000 << "file12";
+    QTest::newRow("300000-file12") << 300000 << "file12";
+    QTest::newRow("300000-mod5/f") << 300000 << "mod5/f";
+    QTest::newRow("300000-xyz") << 300000 << "xyz";
+}